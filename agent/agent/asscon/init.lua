@@ -35,6 +35,7 @@ local next = next
 local print = print
 local p = p
 local tostring = tostring
+local tonumber = tonumber
 local errnum = require 'status'.tonumber
 
 module (...)
@@ -47,6 +48,9 @@ assets = { }
 -- Commands table: holds the EMP commands that can be processed by the agent
 local commands = { }
 
+-- Whether local assets may switch to the shared memory transport
+local allowshm = false
+
 -- Allows other modules to register extra EMP commands.
 -- The hook must be a function that takes (assetid, payload) as parameters and
 -- returns a status number followed by an optional payload that will by sent back.
@@ -147,10 +151,26 @@ function sendcmd(assetid, cmd, payload)
 end
 
 
--- This function is called when a local asset makes a connection
--- Usually the connection is closed when the asset does not need to send or receive anymore data.
--- If the asset closes its connection it will not be able to receive any data anymore...
-function connectionhandler(skt)
+-- Switch the EMP stream of a UNIX socket connection to shared memory, when
+-- the asset asks for it (see agent.asscon.shm).
+local function shmtransport(instance, skt, rid, request)
+    local shm = require 'agent.asscon.shm'
+    if not allowshm then
+        assert(shm.refuse(skt, rid, errnum 'UNKNOWN_COMMAND'))
+        return skt
+    end
+    -- the request holds the size of the rings wished by the asset
+    local channel, err = shm.accept(skt, rid, tonumber(request))
+    if not channel then
+        log("ASSCON", "ERROR", "Asset [%s]: cannot set up a shared memory channel: '%s'", tostring(instance), err)
+        return skt
+    end
+    log("ASSCON", "DETAIL", "Asset [%s] switched to a shared memory channel", tostring(instance))
+    return channel
+end
+
+-- Serve a connection, `islocal` is set for the ones received on the UNIX domain socket.
+local function handleconnection(skt, islocal)
     local function cmdhdl(instance)
         return function(cmdname, payload)
             local cmd = commands[cmdname]
@@ -172,7 +192,20 @@ function connectionhandler(skt)
     local emp = require "racon.empparser"
     local instance = emp.new(skt)
     instance.cmdhook  = cmdhdl(instance)
-    log("ASSCON", "INFO", "Connection received from asset [%s] at '%s:%s'", tostring(instance), skt:getpeername())
+    local channel
+    if islocal then
+        instance.transporthook = function(skt, rid, request)
+            channel = shmtransport(instance, skt, rid, request)
+            return channel
+        end
+        log("ASSCON", "INFO", "Connection received from asset [%s] on the local socket", tostring(instance))
+    else
+        -- replies larger than the socket send step are written in several
+        -- chunks: don't let Nagle hold the last one until the asset acks.
+        -- The in-process racon.ipc pipe has no options.
+        if skt.setoption then skt:setoption('tcp-nodelay', true) end
+        log("ASSCON", "INFO", "Connection received from asset [%s] at '%s:%s'", tostring(instance), skt:getpeername())
+    end
     --save assetid in assets table (no registered name for now)
     assets[instance] = {}
     -- start emp
@@ -183,9 +216,17 @@ function connectionhandler(skt)
     end
     log("ASSCON", "INFO", "Asset (%s), connection closed.", getassetids(instance))
     unregisterasset(instance)
+    if channel and channel ~= skt then channel:close() end
     skt:close()
 end
 
+-- This function is called when a local asset makes a connection
+-- Usually the connection is closed when the asset does not need to send or receive anymore data.
+-- If the asset closes its connection it will not be able to receive any data anymore...
+function connectionhandler(skt)
+    return handleconnection(skt, false)
+end
+
 function init(cfg)
     -- register main EMP commands
     assert(registercmd("Register", EMPRegisterAsset))
@@ -196,5 +237,17 @@ function init(cfg)
         local socket = require "socket"
         assert(socket.bind(cfg.assetaddress or "localhost", cfg.assetport, connectionhandler))
     end
+    -- UNIX domain socket, for assets running on the same host
+    local socket = require "socket"
+    if cfg.assetunixpath and not socket.unix then
+        log("ASSCON", "WARNING", "UNIX domain sockets are not supported on this platform, assets must use TCP")
+    elseif cfg.assetunixpath then
+        local os = require "os"
+        local server = socket.unix()
+        os.remove(cfg.assetunixpath) -- left over by a previous run
+        assert(server:bind(cfg.assetunixpath))
+        allowshm = cfg.assetshm ~= false
+        assert(server:listen(function(skt) return handleconnection(skt, true) end))
+    end
     return "ok"
 end
@@ -0,0 +1,114 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Shared memory transport of EMP, for assets connected through the UNIX
+-- domain socket of the agent.
+--
+-- Once an asset asked for it, the EMP stream goes through a pair of shared
+-- memory rings instead of the socket; the object returned by `accept` offers
+-- the subset of the socket API used by the EMP parser (`receive` of a given
+-- number of bytes, `send`, `close`), so that the switch is invisible to it.
+-- The socket is kept open: the asset doesn't write on it anymore, so it
+-- becomes readable only when the asset goes away.
+
+local sched = require 'sched'
+local core  = require 'agent.asscon.shmcore'
+local table = require 'table'
+
+local setmetatable = setmetatable
+local assert = assert
+local type = type
+
+local M = { }
+
+local channel = { }; channel.__index = channel
+
+-- Answer the transport request #`rid` received over the UNIX socket `skt`,
+-- asking for rings of `size` bytes.
+-- Return the channel object, or nil followed by an error message.
+function M.accept(skt, rid, size)
+    local ring, err = core.accept(skt:getfd(), rid, size)
+    if not ring then return nil, err end
+    local self = setmetatable({ ring = ring, skt = skt }, channel)
+    -- the scheduler signals (self, 'read') after this handler, which wakes
+    -- up every thread waiting for the channel
+    sched.fd.when_readable(self, function() ring:drain(); return 'again' end)
+    sched.fd.when_readable(skt, function() self:close() end)
+    return self
+end
+
+-- Decline the transport request #`rid`: the asset keeps on using the socket.
+function M.refuse(skt, rid, status)
+    return core.refuse(skt:getfd(), rid, status)
+end
+
+function channel:getfd()
+    return self.ring and self.ring:getfd() or -1
+end
+
+function channel:dirty()
+    return false
+end
+
+function channel:getpeername()
+    return self.skt:getpeername()
+end
+
+-- Receive exactly `n` bytes. Same return values as the socket method.
+function channel:receive(n)
+    assert(type(n) == 'number', "only fixed size reads are supported")
+    local parts, len = { }, 0
+    while true do
+        local ring = self.ring
+        if not ring then return nil, 'closed', table.concat(parts) end
+        local data, err = ring:read(n - len)
+        if not data then
+            self:close()
+            return nil, err, table.concat(parts)
+        elseif #data > 0 then
+            len = len + #data
+            if len == n and not parts[1] then return data end
+            table.insert(parts, data)
+            if len == n then return table.concat(parts) end
+        else
+            -- the ring flagged itself empty: the asset rings as soon as it writes
+            sched.wait(self, {'read', 'closed'})
+        end
+    end
+end
+
+-- Send the whole `data` string. Same return values as the socket method.
+function channel:send(data)
+    local i, n = 1, #data
+    while i <= n do
+        local ring = self.ring
+        if not ring then return nil, 'closed', i - 1 end
+        local written, err = ring:write(data, i)
+        if not written then
+            self:close()
+            return nil, err, i - 1
+        elseif written > 0 then i = i + written
+        else sched.wait(self, {'read', 'closed'}) end
+    end
+    return n
+end
+
+function channel:close()
+    local ring = self.ring
+    if not ring then return end
+    self.ring = nil
+    sched.fd.close(self)
+    ring:close()
+    self.skt:close()
+    return 1
+end
+
+return M
@@ -0,0 +1,228 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Agent side of the shared memory EMP transport: answers the transport
+ * negotiation of a local asset connected through a UNIX domain socket, and
+ * gives non blocking access to the resulting channel. Blocking is left to
+ * the Lua side (agent.asscon.shm), which waits for the doorbell file
+ * descriptor with the scheduler.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "lauxlib.h"
+#include "shm_ring.h"
+
+#define CHANNEL_MT "agent.asscon.shm.channel"
+
+typedef struct
+{
+  ShmRing* ring;
+} channel_t;
+
+// Send the EMP reply of the transport negotiation, along with the channel
+// file descriptors when the request was accepted.
+static int send_reply(int sockfd, int rid, uint16_t status, int* fds)
+{
+  unsigned char frame[10] = { 0, 0, 1, (unsigned char) rid, 0, 0, 0, 2, status >> 8, status & 0xff };
+  char cbuf[CMSG_SPACE(3 * sizeof(int))];
+  struct msghdr msg;
+  struct iovec iov;
+  ssize_t r;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = frame;
+  iov.iov_len = sizeof(frame);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (fds)
+  {
+    struct cmsghdr* cmsg;
+    memset(cbuf, 0, sizeof(cbuf));
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+  }
+  do
+    r = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+  while (r < 0 && errno == EINTR);
+  return r == sizeof(frame) ? 0 : -1;
+}
+
+static channel_t* checkchannel(lua_State* L)
+{
+  channel_t* c = luaL_checkudata(L, 1, CHANNEL_MT);
+  if (!c->ring)
+    luaL_error(L, "channel is closed");
+  return c;
+}
+
+// accept(sockfd, rid, size): create a channel, hand it over to the peer.
+// Return the channel, or nil followed by an error message; the peer is
+// told about the failure in the latter case.
+static int l_accept(lua_State* L)
+{
+  int sockfd = luaL_checkint(L, 1);
+  int rid = luaL_checkint(L, 2);
+  uint32_t size = luaL_optint(L, 3, SHM_RING_DEFAULT_SIZE);
+  int fds[3];
+  channel_t* c = lua_newuserdata(L, sizeof(*c));
+
+  c->ring = NULL;
+  luaL_getmetatable(L, CHANNEL_MT);
+  lua_setmetatable(L, -2);
+  if (ShmRing_Create(&c->ring, size, fds) != SWI_STATUS_OK)
+  {
+    send_reply(sockfd, rid, (uint16_t) SWI_STATUS_RESOURCE_INITIALIZATION_FAILED, NULL);
+    lua_pushnil(L);
+    lua_pushstring(L, "cannot create the shared memory channel");
+    return 2;
+  }
+  if (send_reply(sockfd, rid, 0, fds))
+  {
+    int err = errno;
+    ShmRing_Destroy(c->ring);
+    c->ring = NULL;
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(err));
+    return 2;
+  }
+  return 1;
+}
+
+// refuse(sockfd, rid, status): decline a transport negotiation, the peer
+// then keeps on using the socket.
+static int l_refuse(lua_State* L)
+{
+  if (send_reply(luaL_checkint(L, 1), luaL_checkint(L, 2), (uint16_t) luaL_checkint(L, 3), NULL))
+  {
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(errno));
+    return 2;
+  }
+  lua_pushstring(L, "ok");
+  return 1;
+}
+
+// Error of the ring functions returning -1
+static int pushbroken(lua_State* L)
+{
+  lua_pushnil(L);
+  lua_pushstring(L, "broken channel");
+  return 2;
+}
+
+// channel:read(n): up to n bytes, the empty string when there is nothing to read,
+// nil and an error message when the asset corrupted the ring.
+static int l_read(lua_State* L)
+{
+  channel_t* c = checkchannel(L);
+  size_t n = luaL_checkint(L, 2);
+  luaL_Buffer b;
+
+  luaL_buffinit(L, &b);
+  while (n > 0)
+  {
+    size_t chunk = n < LUAL_BUFFERSIZE ? n : LUAL_BUFFERSIZE;
+    ssize_t r = ShmRing_Read(c->ring, luaL_prepbuffer(&b), chunk);
+    if (r < 0)
+      return pushbroken(L);
+    luaL_addsize(&b, r);
+    n -= r;
+    if ((size_t) r < chunk)
+      break;
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+// channel:write(data [, i]): write data from index i, return the number of bytes written,
+// nil and an error message when the asset corrupted the ring.
+static int l_write(lua_State* L)
+{
+  channel_t* c = checkchannel(L);
+  size_t len;
+  const char* data = luaL_checklstring(L, 2, &len);
+  size_t i = luaL_optint(L, 3, 1);
+  ssize_t w = 0;
+
+  if (i >= 1 && i <= len)
+    w = ShmRing_Write(c->ring, data + i - 1, len - i + 1);
+  if (w < 0)
+    return pushbroken(L);
+  lua_pushinteger(L, w);
+  return 1;
+}
+
+static int l_available(lua_State* L)
+{
+  lua_pushinteger(L, ShmRing_Available(checkchannel(L)->ring));
+  return 1;
+}
+
+static int l_getfd(lua_State* L)
+{
+  lua_pushinteger(L, ShmRing_GetFd(checkchannel(L)->ring));
+  return 1;
+}
+
+static int l_drain(lua_State* L)
+{
+  ShmRing_Drain(checkchannel(L)->ring);
+  return 0;
+}
+
+static int l_close(lua_State* L)
+{
+  channel_t* c = luaL_checkudata(L, 1, CHANNEL_MT);
+  ShmRing_Destroy(c->ring);
+  c->ring = NULL;
+  return 0;
+}
+
+static const luaL_Reg channel_methods[] =
+{
+  { "read", l_read },
+  { "write", l_write },
+  { "available", l_available },
+  { "getfd", l_getfd },
+  { "drain", l_drain },
+  { "close", l_close },
+  { NULL, NULL }
+};
+
+static const luaL_Reg R[] =
+{
+  { "accept", l_accept },
+  { "refuse", l_refuse },
+  { NULL, NULL }
+};
+
+int luaopen_agent_asscon_shmcore(lua_State* L)
+{
+  luaL_newmetatable(L, CHANNEL_MT);
+  lua_newtable(L);
+  luaL_register(L, NULL, channel_methods);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, l_close);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+  luaL_register(L, "agent.asscon.shmcore", R);
+  return 1;
+}
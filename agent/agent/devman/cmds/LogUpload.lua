@@ -9,7 +9,7 @@
 --     Laurent Barthelemy for Sierra Wireless - initial API and implementation
 -------------------------------------------------------------------------------
 
-local logstore = require "log.store"
+local logtools = require "log.tools"
 local config = require "agent.config"
 local os = require "os"
 local ftp = require "socket.ftp"
@@ -21,7 +21,7 @@ local function LogUpload(sys_asset, args)
     assert(url and (logtype == "ram" or logtype == "flash"), "COMMANDS.LogUpload Invalid params")
     assert(config.log.policy, "Log policies not activated")
     local type = string.match(url, "(%a*)://")
-    local src = logtype == "flash" and  logstore.logflashgetsource() or ltn12.source.string( logstore.logramget())
+    local src = logtools.source(config.log.policy, logtype)
     local res, err
     if type == "http" then
         return -1, "HTTP Post method is not supported yet to upload logs !"
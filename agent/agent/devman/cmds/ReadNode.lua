@@ -11,6 +11,7 @@
 -------------------------------------------------------------------------------
 
 local dev      = require 'agent.devman'
+local config   = require 'agent.config'
 local tm       = require 'agent.treemgr'
 local srvcon   = require 'agent.srvcon'
 local airvantage   = require 'racon'
@@ -50,15 +51,50 @@ local function recsend(path, error_messages)
     end
 end
 
+-- Send a whole subtree in a single data block, enabled by setting
+-- `device.readnodestream`: every leaf is read at once with `tm.getsubtree`,
+-- which lets handlers return their variables in bulk, and the values are
+-- nested by path so that the agent stores them in one stagedb table per
+-- node, all sent in the same message.
+-- The whole subtree must fit in RAM.
+local function streamsend(path, error_messages)
+    local lmap, err = tm.getsubtree(path)
+    if not lmap then
+        table.insert(error_messages, string.format("error for path [%s]:%s",
+            tostring(path), tostring(err)))
+        return
+    end
+    if lmap[path] ~= nil then -- leaf node
+        assert(dev.asset :pushdata (path, niltoken(lmap[path]), POLICY))
+        return
+    end
+    -- keys must remain strings, even numeric node names: don't use upath.set
+    local data, prefix = { }, path=='' and 0 or #path+1
+    for lpath, value in pairs(lmap) do
+        local node, leaf = lpath :sub (prefix+1) :match "^(.-)%.?([^%.]*)$"
+        local t = data
+        for k in node :gmatch "[^%.]+" do
+            local sub = t[k]
+            if not sub then sub = { }; t[k] = sub end
+            t = sub
+        end
+        t[leaf] = value
+    end
+    if next(data) then
+        assert(dev.asset :pushdata (path, data, POLICY))
+    end
+end
+
 local function ReadNode(sys_asset, args, fullpath, ticketid)
     checks('racon.asset', 'table', 'string', '?number')
     local error_messages = { }
     local err_msg=""
+    local send = config.get('device.readnodestream') and streamsend or recsend
     -- ReadNode parameters are put in a list, every parameter is a path to read
     -- No point in using parameter indexes/map keys
     for _, path in pairs(args) do
         if type(path)~='string' then return nil, 'ReadNode command expects string(s) parameter(s)' end
-        recsend(path, error_messages)
+        send(path, error_messages)
     end
     if next(error_messages) then
        -- Concatenate all error messages into a single one.
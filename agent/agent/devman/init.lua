@@ -89,8 +89,11 @@ end
 local dt_id_idx = 0
 local dt2tm = { } -- tm->id translation is kept in a closure passed to tm.register
 
+-- Changes are coalesced for `window` seconds (payload or `config.device.notifywindow`),
+-- so that fast changing variables produce one NotifyVariable message per window.
 local function EMPRegisterVariable(assetid, payload)
-    local regvars, passivevars = unpack(payload)
+    local regvars, passivevars, window = unpack(payload)
+    window = window or config.get('device.notifywindow')
     local dt_id, tm_id, err
     -- hook function need to be a closure to keep assetid and registerid
     -- needed in hook.
@@ -106,7 +109,7 @@ local function EMPRegisterVariable(assetid, payload)
        end
     end
     -- ensure we don't give niltoken to treemgr
-    tm_id, err = treemgr.register(regvars, function(...) sched.run(hook, ...) end, passivevars)
+    tm_id, err = treemgr.register(regvars, function(...) sched.run(hook, ...) end, passivevars, tonumber(window))
     if not tm_id then return nil, err end
     dt_id = "DT_ID_"..dt_id_idx
     dt_id_idx = dt_id_idx+1
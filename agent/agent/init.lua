@@ -89,6 +89,16 @@ if config.log then
     end
 end
 
+-- Group commit of the persisted tables; buffered writes are committed when the
+-- agent is stopped
+if config.persist and config.persist.commitdelay then
+    local persist = require "persist"
+    if persist.setcommit then
+        persist.setcommit(config.persist.commitdelay, config.persist.sync)
+        sched.sighook("system", "stop", persist.flush)
+    end
+end
+
 -- Necessary to receive signal from outside the Agent Process (on non OAT OS)
 if config.agent.signalport then
     sched.listen(config.agent.signalport)
@@ -0,0 +1,287 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* Trigger rules of the `agent.monitoring` module.
+ *
+ * A rule set keeps its threshold, deadband and hold rules in arrays indexed
+ * by rule: kind, parameter and state. Threshold and deadband rules watch a
+ * variable, given as a small integer by the caller; the rules watching the
+ * same variable are chained, so that a notified value is evaluated against
+ * all of them in one call. Hold rules only have a due date, which changes of
+ * their variables push back. Evaluations append the ids of the rules which
+ * fire to a list, the caller then runs their actions. Removed rules are
+ * chained in a free list and reused. */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#define RULES_CLASS "agent.monitoring.rules"
+
+enum { RULE_FREE, RULE_THRESHOLD, RULE_DEADBAND, RULE_HOLD };
+
+/* Threshold flags: edges which fire the rule, side of the last value. */
+#define EDGE_UP    1
+#define EDGE_DOWN  2
+#define SIDE_BELOW 4
+
+typedef struct {
+  int size;             /* number of rules allocated */
+  int free;             /* first free rule, -1 when none */
+  unsigned char *kind;
+  unsigned char *flags;
+  int *var;             /* watched variable, -1 for hold rules */
+  int *next;            /* next rule on the same variable, or next free rule */
+  double *param;        /* threshold, deadband, or hold timeout (< 0 when periodic) */
+  double *state;        /* deadband: last value; hold: due date, 0 when disarmed */
+  int nvars;
+  int *heads;           /* first rule watching each variable, -1 when none */
+} rules_t;
+
+static rules_t *checkrules( lua_State *L) {
+  return (rules_t *) luaL_checkudata( L, 1, RULES_CLASS);
+}
+
+/* Returns a rule id checked at argument i, as a rule index. */
+static int checkrule( lua_State *L, rules_t *r, int i) {
+  int id = luaL_checkint( L, i) - 1;
+  luaL_argcheck( L, id >= 0 && id < r->size && r->kind[id] != RULE_FREE, i, "invalid rule id");
+  return id;
+}
+
+#define GROW(a, n) do {                                   \
+    void *p = realloc( a, (n) * sizeof( *(a)));           \
+    if( NULL == p) return luaL_error( L, "not enough memory"); \
+    a = p;                                                \
+  } while( 0)
+
+/* Allocates a rule of the given kind, returns its index on top of the
+ * stack, as an id. */
+static int newrule( lua_State *L, rules_t *r, int kind) {
+  int i;
+  if( -1 == r->free) {
+    int size = r->size ? 2 * r->size : 16;
+    GROW( r->kind, size); GROW( r->flags, size); GROW( r->var, size);
+    GROW( r->next, size); GROW( r->param, size); GROW( r->state, size);
+    for( i = size - 1; i >= r->size; i--) {
+      r->kind[i] = RULE_FREE;
+      r->next[i] = r->free;
+      r->free = i;
+    }
+    r->size = size;
+  }
+  i = r->free;
+  r->free = r->next[i];
+  r->kind[i] = kind;
+  r->flags[i] = 0;
+  r->var[i] = -1;
+  r->next[i] = -1;
+  r->param[i] = r->state[i] = 0;
+  lua_pushinteger( L, i + 1);
+  return i;
+}
+
+/* Chains rule i to the rules watching variable var. */
+static int watch( lua_State *L, rules_t *r, int i, int var) {
+  if( var >= r->nvars) {
+    int n = r->nvars, nvars = var < 2 * n ? 2 * n : var + 16;
+    GROW( r->heads, nvars);
+    while( n < nvars) r->heads[n++] = -1;
+    r->nvars = nvars;
+  }
+  r->var[i] = var;
+  r->next[i] = r->heads[var];
+  r->heads[var] = i;
+  return 0;
+}
+
+/* rules:threshold(var, threshold, edge, value): adds a rule which fires when
+ * the value of var crosses threshold on the given edge, "up", "down" or
+ * "both", value being the current value. Returns the rule id. */
+static int l_threshold( lua_State *L) {
+  static const char *const edges[] = { "up", "down", "both", NULL };
+  static const unsigned char flags[] = { EDGE_UP, EDGE_DOWN, EDGE_UP | EDGE_DOWN };
+  rules_t *r = checkrules( L);
+  int var = luaL_checkint( L, 2);
+  lua_Number threshold = luaL_checknumber( L, 3);
+  int edge = luaL_checkoption( L, 4, "both", edges);
+  int i;
+  luaL_argcheck( L, var >= 0, 2, "invalid variable");
+  i = newrule( L, r, RULE_THRESHOLD);
+  r->param[i] = threshold;
+  r->flags[i] = flags[edge] | (lua_tonumber( L, 5) < threshold ? SIDE_BELOW : 0);
+  watch( L, r, i, var);
+  return 1;
+}
+
+/* rules:deadband(var, deadband, value): adds a rule which fires when the
+ * value of var moves by deadband or more from value, then from the value
+ * which fired it. Returns the rule id. */
+static int l_deadband( lua_State *L) {
+  rules_t *r = checkrules( L);
+  int var = luaL_checkint( L, 2);
+  lua_Number deadband = luaL_checknumber( L, 3);
+  int i;
+  luaL_argcheck( L, var >= 0, 2, "invalid variable");
+  i = newrule( L, r, RULE_DEADBAND);
+  r->param[i] = deadband;
+  r->state[i] = lua_tonumber( L, 4);
+  watch( L, r, i, var);
+  return 1;
+}
+
+/* rules:hold(timeout, now): adds a rule which fires when it is not touched
+ * for timeout seconds, then every -timeout seconds when timeout is negative.
+ * Returns the rule id and its due date. */
+static int l_hold( lua_State *L) {
+  rules_t *r = checkrules( L);
+  lua_Number timeout = luaL_checknumber( L, 2);
+  lua_Number now = luaL_checknumber( L, 3);
+  int i = newrule( L, r, RULE_HOLD);
+  r->param[i] = timeout;
+  r->state[i] = now + fabs( timeout);
+  lua_pushnumber( L, r->state[i]);
+  return 2;
+}
+
+/* rules:touch(id, now): pushes back the due date of a hold rule, returns it. */
+static int l_touch( lua_State *L) {
+  rules_t *r = checkrules( L);
+  int i = checkrule( L, r, 2);
+  lua_Number now = luaL_checknumber( L, 3);
+  luaL_argcheck( L, RULE_HOLD == r->kind[i], 2, "not a hold rule");
+  r->state[i] = now + fabs( r->param[i]);
+  lua_pushnumber( L, r->state[i]);
+  return 1;
+}
+
+/* rules:remove(id): removes a rule, its id may be reused. */
+static int l_remove( lua_State *L) {
+  rules_t *r = checkrules( L);
+  int i = checkrule( L, r, 2), *p;
+  if( r->var[i] >= 0) {
+    for( p = &r->heads[r->var[i]]; *p != i; p = &r->next[*p]);
+    *p = r->next[i];
+  }
+  r->kind[i] = RULE_FREE;
+  r->next[i] = r->free;
+  r->free = i;
+  return 0;
+}
+
+/* rules:eval(var, value, fired, n): evaluates the rules watching var against
+ * its new value, appends the ids of the rules which fire to the list fired,
+ * after its first n elements. Returns the new number of elements. */
+static int l_eval( lua_State *L) {
+  rules_t *r = checkrules( L);
+  int var = luaL_checkint( L, 2);
+  lua_Number v = lua_tonumber( L, 3);
+  int n = luaL_checkint( L, 5), i, fire, below;
+  luaL_checktype( L, 4, LUA_TTABLE);
+  for( i = var >= 0 && var < r->nvars ? r->heads[var] : -1; i >= 0; i = r->next[i]) {
+    if( RULE_THRESHOLD == r->kind[i]) {
+      below = v < r->param[i];
+      if( below == !!(r->flags[i] & SIDE_BELOW)) continue;
+      fire = r->flags[i] & (below ? EDGE_DOWN : EDGE_UP);
+      r->flags[i] ^= SIDE_BELOW;
+    } else {
+      fire = fabs( v - r->state[i]) >= r->param[i];
+      if( fire) r->state[i] = v;
+    }
+    if( fire) {
+      lua_pushinteger( L, i + 1);
+      lua_rawseti( L, 4, ++n);
+    }
+  }
+  lua_pushinteger( L, n);
+  return 1;
+}
+
+/* rules:expire(now, fired, n): appends the ids of the hold rules due at now
+ * to the list fired, as eval does, and rearms the periodic ones. */
+static int l_expire( lua_State *L) {
+  rules_t *r = checkrules( L);
+  lua_Number now = luaL_checknumber( L, 2);
+  int n = luaL_checkint( L, 4), i;
+  luaL_checktype( L, 3, LUA_TTABLE);
+  for( i = 0; i < r->size; i++) {
+    if( RULE_HOLD != r->kind[i] || 0 == r->state[i] || r->state[i] > now) continue;
+    if( r->param[i] < 0) {
+      r->state[i] -= r->param[i];
+      if( r->state[i] <= now) r->state[i] = now - r->param[i];
+    } else r->state[i] = 0;
+    lua_pushinteger( L, i + 1);
+    lua_rawseti( L, 3, ++n);
+  }
+  lua_pushinteger( L, n);
+  return 1;
+}
+
+/* rules:nextdue(): returns the earliest due date of the hold rules, nil if
+ * none is armed. */
+static int l_nextdue( lua_State *L) {
+  rules_t *r = checkrules( L);
+  double due = 0;
+  int i;
+  for( i = 0; i < r->size; i++)
+    if( RULE_HOLD == r->kind[i] && r->state[i] > 0 && (0 == due || r->state[i] < due))
+      due = r->state[i];
+  if( 0 == due) lua_pushnil( L); else lua_pushnumber( L, due);
+  return 1;
+}
+
+static int l_gc( lua_State *L) {
+  rules_t *r = checkrules( L);
+  free( r->kind); free( r->flags); free( r->var); free( r->next);
+  free( r->param); free( r->state); free( r->heads);
+  memset( r, 0, sizeof( *r));
+  return 0;
+}
+
+/* new(): returns a new empty rule set. */
+static int l_new( lua_State *L) {
+  rules_t *r = (rules_t *) lua_newuserdata( L, sizeof( *r));
+  memset( r, 0, sizeof( *r));
+  r->free = -1;
+  luaL_getmetatable( L, RULES_CLASS);
+  lua_setmetatable( L, -2);
+  return 1;
+}
+
+static const luaL_Reg rules_methods[] = {
+  { "deadband",  l_deadband },
+  { "eval",      l_eval },
+  { "expire",    l_expire },
+  { "hold",      l_hold },
+  { "nextdue",   l_nextdue },
+  { "remove",    l_remove },
+  { "threshold", l_threshold },
+  { "touch",     l_touch },
+  { NULL, NULL } };
+
+static const luaL_Reg R[] = {
+  { "new", l_new },
+  { NULL, NULL } };
+
+int luaopen_agent_monitoring_core( lua_State *L) {
+  luaL_newmetatable( L, RULES_CLASS);
+  lua_pushvalue( L, -1);
+  lua_setfield( L, -2, "__index");
+  lua_pushcfunction( L, l_gc);
+  lua_setfield( L, -2, "__gc");
+  luaL_register( L, NULL, rules_methods);
+  lua_pop( L, 1);
+  luaL_register( L, "agent.monitoring.core", R);
+  return 1;
+}
@@ -23,6 +23,10 @@ local os        = require 'os'
 local persist   = require 'persist'
 local utilst    = require 'utils.table'
 local table     = require 'table'
+local path      = require 'utils.path'
+local core      = require 'agent.monitoring.core'
+local sched_timer = require 'sched.timer'
+local monotonic_time = require 'sched.timer.core'.time
 
 local type = type
 local loadstring = loadstring
@@ -104,6 +108,85 @@ local function actioncaller(actions)
 end
 
 
+-- Threshold, deadband and hold rules, evaluated by the C core (see core.c).
+-- The threshold and deadband rules on a variable share a single treemgr
+-- registration, and evaluate the notified value; the actions of the rules
+-- fired by a notification are run in a single task.
+local rules = core.new()
+local ruleactions = {}   -- rule id -> actions of the trigger
+local holdmaps = {}      -- hold rule id -> variables which last pushed it back
+local subscriptions = {} -- variable -> { id=variable number, tm=treemgr registration, n=number of rules }
+local freevarids = {}    -- variable numbers to reuse
+local nvars = 0
+
+local function callbatch(batch, args)
+    for i, actions in ipairs(batch) do callhooks(actions, args[i]) end
+end
+
+-- Run the actions of the n rules of the list `fired` which pass their filters,
+-- with `map` as parameter, or the map of the rule in `maps`.
+local function dispatch(fired, n, map, maps)
+    local batch, args = {}, {}
+    for i = 1, n do
+        local id = fired[i]
+        local actions = ruleactions[id]
+        if actions and testfilters(actions) then
+            table.insert(batch, actions)
+            args[#batch] = maps and maps[id] or map
+        end
+    end
+    if batch[1] then sched.run(callbatch, batch, args) end
+end
+
+local function subscribe(var)
+    local sub = subscriptions[var]
+    if not sub then
+        local id = table.remove(freevarids)
+        if not id then nvars = nvars + 1; id = nvars end
+        sub = { id = id, n = 0 }
+        sub.tm = assert(treemgr.register(var, function(map)
+            local value = map[var]
+            if value == nil then value = treemgr.get(var) end -- var is not a leaf
+            local fired = {}
+            dispatch(fired, rules:eval(id, value, fired, 0), map)
+        end))
+        subscriptions[var] = sub
+    end
+    sub.n = sub.n + 1
+    return sub.id
+end
+
+local function unsubscribe(var)
+    local sub = subscriptions[var]
+    sub.n = sub.n - 1
+    if sub.n == 0 then
+        treemgr.unregister(sub.tm)
+        subscriptions[var] = nil
+        table.insert(freevarids, sub.id)
+    end
+end
+
+-- Single timer of the hold rules, due at their earliest due date
+local holdtimer = { nextevent = function() return rules:nextdue() end }
+function holdtimer.event()
+    local fired = {}
+    dispatch(fired, rules:expire(monotonic_time(), fired, 0), nil, holdmaps)
+end
+
+local function schedulehold(due)
+    if holdtimer.nd then
+        if holdtimer.nd <= due then return end
+        sched_timer.removetimer(holdtimer)
+    end
+    sched_timer.addtimer(holdtimer)
+end
+
+local function removerule(r)
+    rules:remove(r.rule)
+    ruleactions[r.rule], holdmaps[r.rule] = nil, nil
+    if r.var then unsubscribe(r.var) end
+end
+
 -- Return the environement of the monitoring rule/script
 -- This currently uses getfenv, but could be improved if performances were to be an issue
 local function scriptenv()
@@ -150,13 +233,16 @@ end
 --      Note: the action functions will be given a table containing the variables and the value that caused the last reaem of the holding timer, as first argument
 function setupenv.onhold(timeout, ...)
     checks('number')
-    local last
     local actions = {}
-    local function activate() actioncaller(actions)(last) end
-    local t = timer.new(tonumber(timeout), activate)
-    local tm = assert(treemgr.register({...}, function(v) t:rearm() last=v end))
+    local id, due = rules:hold(tonumber(timeout), monotonic_time())
+    ruleactions[id] = actions
+    local tm = assert(treemgr.register({...}, function(v)
+        holdmaps[id] = v
+        schedulehold(rules:touch(id, monotonic_time()))
+    end))
+    schedulehold(due)
     local unload = scriptenv().__unload
-    table.insert(unload, t)
+    table.insert(unload, {rule=id})
     table.insert(unload, tm)
     return actions
 end
@@ -207,19 +293,13 @@ function setupenv.onthreshold(threshold, var, edge)
     checks('number', 'string', '?string')
     edge = edge or "both"
     assert(edge=="up" or edge=="down" or edge=="both", "edge parameter is not valid")
-    
-    local side = (tonumber(treemgr.get(var)) or 0) < threshold
-    local up = edge=="up" or edge=="both"
-    local down = edge=="down" or edge=="both"
-    local function test()
-        local newval = tonumber(treemgr.get(var)) or 0
-        if (newval>=threshold and side) or (newval<threshold and not side) then
-            local r = (up and side) or (down and not side)
-            side = newval < threshold
-            return r
-        else return false end
-    end
-    return setupenv.filter(test, setupenv.onchange(var))
+
+    var = path.clean(var)
+    local actions = {}
+    local id = rules:threshold(subscribe(var), threshold, edge, treemgr.get(var))
+    ruleactions[id] = actions
+    table.insert(scriptenv().__unload, {rule=id, var=var})
+    return actions
 end
 
 
@@ -228,16 +308,12 @@ end
 function setupenv.ondeadband(deadband, var)
     checks('number', 'string')
 
-    local oldval = tonumber(treemgr.get(var)) or 0
-    local function test()
-        local newval  = tonumber(treemgr.get(var)) or 0
-        local d = math.abs(newval - oldval)
-        if d >= deadband then
-            oldval = newval
-            return true
-        else return false end
-    end
-    return setupenv.filter(test, setupenv.onchange(var))
+    var = path.clean(var)
+    local actions = {}
+    local id = rules:deadband(subscribe(var), deadband, treemgr.get(var))
+    ruleactions[id] = actions
+    table.insert(scriptenv().__unload, {rule=id, var=var})
+    return actions
 end
 
 
@@ -326,6 +402,8 @@ function _M.unload(name)
             timer.cancel(r)
         elseif r.otherhooks then
             r.otherhooks[r.idx] = nil
+        elseif r.rule then
+            removerule(r)
         else error("a ressource cannot be freed, please review monitoring module") end
 --         env.__unload[_] = nil
     end
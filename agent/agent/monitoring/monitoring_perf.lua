@@ -0,0 +1,79 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Evaluation throughput of the monitoring triggers: a monitoring script
+-- watches a few ram variables with threshold and deadband rules, and the
+-- variables are changed as fast as possible. Reports the number of
+-- notifications processed per second, and of actions run, against the
+-- number of rules.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/monitoring_perf.lua [changes per run]
+
+require 'strict'
+require 'sched'
+require 'print'
+rawset(_G, 'log', require 'log')
+local lfs = require 'lfs'
+local monotonic_time = require 'sched.timer.core'.time
+
+local VARS    = 8
+local CHANGES = tonumber(arg[1]) or 20000 -- variable changes per run
+
+-- Private treemgr databases and monitoring storage, with a ram store only
+local root = os.tmpname(); os.remove(root); root = root .. "/"
+assert(os.execute("mkdir -p "..root.."resources && ln -s "..lfs.currentdir().."/lua "..root.."lua") == 0)
+local f = assert(io.open(root.."resources/ram.map", "w"))
+f :write("treemgr agent.treemgr.handlers.ramstore\n\nram=\n")
+f :close()
+LUA_AF_RO_PATH, LUA_AF_RW_PATH = root, root
+
+local treemgr = require 'agent.treemgr'
+local mon     = require 'agent.monitoring'
+log.setlevel('WARNING')
+
+local function run(nrules)
+    local actions = 0
+    local function script()
+        local function action() actions = actions + 1 end
+        for i = 1, nrules do
+            local var = "ram.monperf.v"..(i % VARS + 1)
+            if i % 2 == 0 then connect(onthreshold(50 + i % 40, var, "up"), action)
+            else connect(ondeadband(25 + i % 40, var), action) end
+        end
+    end
+    assert(mon.load("monperf", script))
+    sched.wait()
+
+    local vars = require 'agent.treemgr.table'.ram.monperf
+    local t0 = monotonic_time()
+    for n = 1, CHANGES do
+        vars["v"..(n % VARS + 1)] = n % 100 -- a sawtooth crossing the thresholds
+        if n % 100 == 0 then sched.wait() end
+    end
+    sched.wait()
+    local elapsed = monotonic_time() - t0
+    assert(mon.unload("monperf"))
+
+    printf("%5d rules: %6d changes in %.3fs (%8.0f notifications/s), %8d actions",
+        nrules, CHANGES, elapsed, CHANGES / elapsed, actions)
+    return actions
+end
+
+sched.run(function()
+    assert(mon.init())
+    for i = 1, VARS do assert(treemgr.set("ram.monperf.v"..i, 0)) end
+    for _, nrules in ipairs{ 1, 10, 100, 1000 } do assert(run(nrules) > 0) end
+    os.execute("rm -rf "..root)
+    os.exit(0)
+end)
+sched.loop()
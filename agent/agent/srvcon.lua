@@ -30,7 +30,8 @@ local M = { }
 
 global 'agent'; agent.srvcon = M
 
-local m3da_deserialize = require "m3da.bysant".deserializer()
+-- messages may be split across payload fragments
+local m3da_deserialize = require "m3da.bysant".streamdeserializer()
 
 
 -- hook that is set to nil by default: if non nil this function is called prior to doing the connexion
@@ -43,17 +44,23 @@ M.preconnecthook = false
 M.session = nil
 
 -- Dispatch deserialized server messages to the appropriate assets through EMP.
-local function dispatch_message(envelope_payload)
-
-    if not envelope_payload or #envelope_payload <= 0 then return 'ok' end
+-- Envelope payloads can be passed in several fragments: `more` is true if
+-- other fragments of the same payload follow `envelope_payload`.
+local function dispatch_message(envelope_payload, more)
+
+    local messages, errmsg = m3da_deserialize :feed (envelope_payload or '')
+    if not messages then
+        -- don't take the next fragments for the continuation of this one
+        m3da_deserialize :reset()
+        log('SRVCON', 'ERROR', "Invalid message from server: %s", tostring(errmsg))
+        return nil, errmsg
+    end
+    if not more and m3da_deserialize :reset() then
+        log('SRVCON', 'ERROR', "Incomplete message from server")
+    end
 
-    --base.global 'last_payload'
-    --base.last_payload = payload
-    local offset = 1
-    while offset <= #envelope_payload do
-        local msg
-        msg, offset = m3da_deserialize(envelope_payload, offset)
-        if msg==nil and tonumber(offset) or msg=='' then
+    for _, msg in ipairs(messages) do
+        if msg=='' then
             log('SRVCON', 'DETAIL', 'Empty message from server')
         elseif msg.__class == 'Message' then
             if not msg.body or not next(msg.body) then
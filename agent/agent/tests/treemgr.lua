@@ -11,6 +11,7 @@
 -------------------------------------------------------------------------------
 
 local u          = require 'unittest'
+local sched      = require 'sched'
 local pathutils  = require 'utils.path'
 --local tableutils = require 'utils.table'
 local treemgr    = require 'agent.treemgr'
@@ -218,6 +219,50 @@ function t :test_notify1()
 
 end
 
+-- notify: changes coalesced within a window, last value wins
+function t :test_notify_window()
+    local calls = 0
+    local hook, last_values = save_into{ }
+    local function counted(r) calls = calls + 1; hook(r) end
+    u.assert(treemgr.set('tests.x.table1.junk.step', 'w'))
+    local r = u.assert(treemgr.register({'tests.z.ramstore.win'}, counted,
+        {'tests.x.table1.junk.step'}, 0.2))
+
+    u.assert(treemgr.set('tests.z.ramstore.win.a', 1))
+    u.assert(treemgr.set('tests.z.ramstore.win.a', 2))
+    u.assert(treemgr.set('tests.z.ramstore.win.b', 3))
+    u.assert_equal(calls, 0)
+    sched.wait(0.5)
+    u.assert_equal(calls, 1)
+    u.assert_clone_tables(last_values, {
+        ['tests.z.ramstore.win.a'] = 2,
+        ['tests.z.ramstore.win.b'] = 3,
+        ['tests.x.table1.junk.step'] = 'w' })
+
+    -- pending changes are dropped by unregister
+    u.assert(treemgr.set('tests.z.ramstore.win.a', 4))
+    u.assert(treemgr.unregister(r))
+    sched.wait(0.5)
+    u.assert_equal(calls, 1)
+end
+
+-- notify: a failing hook doesn't prevent the others of its batch from being called
+function t :test_notify_failing_hook()
+    local calls = 0
+    local function failing() error "failing hook" end
+    local function counted() calls = calls + 1 end
+    local ids = { }
+    for _, window in ipairs{ false, 0.2 } do
+        table.insert(ids, u.assert(treemgr.register({'tests.z.ramstore.fail'}, failing, nil, window or nil)))
+        table.insert(ids, u.assert(treemgr.register({'tests.z.ramstore.fail'}, counted, nil, window or nil)))
+    end
+    u.assert(treemgr.set('tests.z.ramstore.fail.a', 1))
+    u.assert_equal(calls, 1)
+    sched.wait(0.5)
+    u.assert_equal(calls, 2)
+    for _, id in ipairs(ids) do u.assert(treemgr.unregister(id)) end
+end
+
 function t :test_niltoken()
     u.assert(treemgr.set('tests.x.table1.junk.n1', niltoken))
     u.assert(treemgr.set('tests.x.table1.junk', {n2=niltoken, n3=niltoken}))
@@ -33,15 +33,48 @@
 -- init(file_prefix)`.  Each map file is then processed with
 -- `add(dbset, filename)`, and the writing operation is finalized by
 -- called `close(dbset)
+--
+-- Each map file is compiled into a list of mounts, which is cached in the
+-- `maps.cache` file together with the size and date of the map: when the
+-- databases are rebuilt, only the maps which changed are parsed again. The
+-- four databases are then written from all the mounts, as CDB files can't be
+-- updated, and finished in parallel by worker threads. `uptodate` tells
+-- whether a set of map files changed since the last compilation.
 
 local cdb_make = require 'cdb_make'
+local lfs      = require 'lfs'
+local l2b      = require 'luatobin'
 local path     = require 'utils.path' -- path.split, path.gsplit
+local worker   = require 'sched.worker'
 local log      = require 'log'
 
+local M  = { }
 local MT = { }; MT.__index=MT
 
 local DB_NAMES = { 'h2l', 'l2h', 'l2c', 'l2m' }
 
+-- Returns a string which changes when the file changes.
+local function stamp(filename)
+    local att = lfs.attributes(filename)
+    return att and att.modification..":"..att.size
+end
+
+-- Returns the table serialized in a file, an empty table if there is none.
+local function readtable(filename)
+    local file = io.open(filename, 'rb')
+    if not file then return { } end
+    local data = file :read '*a'
+    file :close()
+    local ok, _, t = pcall(l2b.deserialize, data)
+    return ok and type(t) == 'table' and t or { }
+end
+
+local function writetable(filename, t)
+    local file = assert(io.open(filename, 'wb'))
+    file :write(l2b.serialize(t))
+    file :close()
+end
+
 --------------------------------------------------------------------------------
 -- Create a new databases set. Any preexisting database will be destroyed.
 --
@@ -55,7 +88,8 @@ local DB_NAMES = { 'h2l', 'l2h', 'l2c', 'l2m' }
 local function newmapper (file_path)
     if file_path :sub(-1, -1) ~= '/' then file_path = file_path .. '/' end
     local db_prefix = 'treemgr'
-    local instance  = { cache = { l2c={ }; l2m={ }; lpaths={ } } }
+    local instance  = { cache = { l2c={ }; l2m={ }; lpaths={ } }, path = file_path,
+        compiled = readtable(file_path.."maps.cache"), maps = { } }
     for _, db_name in ipairs(DB_NAMES) do
            local stem = file_path..db_prefix..'.'..db_name
         local db = cdb_make.start(stem..'.cdb', stem..'.tmp.cdb')
@@ -77,10 +111,9 @@ local function newmapper (file_path)
     return setmetatable(instance, MT)
 end
 
---------------------------------------------------------------------------------
--- Add the mappings described in the file to the databases.
--- @param map_filename mappings to add to the databases.
-function MT :add (map_filename)
+-- Parses a map file into a list of mounts: `{ name=handler_name, lpath1,
+-- hpath1, lpath2, hpath2, ... }`.
+local function compile(map_filename)
     local input = assert(io.open(map_filename, 'r'), "map file "..
         map_filename.." not found")
     local first_line = input :read '*l'
@@ -88,7 +121,8 @@ function MT :add (map_filename)
 
     assert (name, "Bad map file format")
 
-    log('TREEMGR-BUILD', 'DETAIL', "Begin of mappings from %s to databases", map_filename)
+    log('TREEMGR-BUILD', 'DETAIL', "Compiling mappings of %s", map_filename)
+    local map = { name = name }
     local i=2
     for line in input :lines() do
         if not line :match "^%s*#" -- skip comment lines
@@ -99,35 +133,57 @@ function MT :add (map_filename)
                 input :close()
                 error("Bad line #"..i.." in file "..map_filename)
             end
-            log('TREEMGR-BUILD', 'DEBUG', "add line to l/h: L '%s' <-> H '%s:%s'.", lpath, name, hpath)
-            local name_hpath = name..":"..hpath
-            self.l2h :add (lpath, name_hpath)
-            self.h2l :add (name_hpath, lpath)
-            if self.cache.lpaths[lpath] then
-                error("Attempt to mount lpath "..lpath.." several times: as "..
-                    name_hpath.." and "..self.cache.lpaths[lpath])
+            table.insert(map, lpath)
+            table.insert(map, hpath)
+        end
+        i=i+1
+    end
+    input :close()
+    return map
+end
+
+--------------------------------------------------------------------------------
+-- Add the mappings described in the file to the databases.
+-- @param map_filename mappings to add to the databases.
+function MT :add (map_filename)
+    local map_stamp = stamp(map_filename)
+    local map = self.compiled[map_filename]
+    if not map or map.stamp ~= map_stamp then
+        map = compile(map_filename)
+        map.stamp = map_stamp
+    end
+    self.maps[map_filename] = map
+    local name = map.name
+
+    log('TREEMGR-BUILD', 'DETAIL', "Begin of mappings from %s to databases", map_filename)
+    for i = 1, #map, 2 do
+        local lpath, hpath = map[i], map[i+1]
+        log('TREEMGR-BUILD', 'DEBUG', "add line to l/h: L '%s' <-> H '%s:%s'.", lpath, name, hpath)
+        local name_hpath = name..":"..hpath
+        self.l2h :add (lpath, name_hpath)
+        self.h2l :add (name_hpath, lpath)
+        if self.cache.lpaths[lpath] then
+            error("Attempt to mount lpath "..lpath.." several times: as "..
+                name_hpath.." and "..self.cache.lpaths[lpath])
+        end
+        self.cache.lpaths[lpath] = name_hpath
+        for child, _ in path.gsplit(lpath) do
+            local parent, _ = path.split(child, -1)
+            local key_l2c = parent .. '->' .. child
+            local key_l2m = child  .. '->' .. name
+            if child ~= '' and not self.cache.l2c[key_l2c] then
+                log('TREEMGR-BUILD', 'DEBUG', "    add to l2c: Parent '%s' -> Child '%s'.", parent, child)
+                self.l2c :add (parent, child)
+                self.cache.l2c[key_l2c] = true
             end
-            self.cache.lpaths[lpath] = name_hpath
-            for child, _ in path.gsplit(lpath) do
-                local parent, _ = path.split(child, -1)
-                local key_l2c = parent .. '->' .. child
-                local key_l2m = child  .. '->' .. name
-                if child ~= '' and not self.cache.l2c[key_l2c] then
-                    log('TREEMGR-BUILD', 'DEBUG', "    add to l2c: Parent '%s' -> Child '%s'.", parent, child)
-                    self.l2c :add (parent, child)
-                    self.cache.l2c[key_l2c] = true
-                end
-                if not self.cache.l2c[key_l2m] then
-                    log('TREEMGR-BUILD', 'DEBUG', "    add to l2m: L '%s' -> Module '%s'.", child, name)
-                    self.l2m :add (child, name)
-                    self.cache.l2m[key_l2m] = true
-                end
+            if not self.cache.l2m[key_l2m] then
+                log('TREEMGR-BUILD', 'DEBUG', "    add to l2m: L '%s' -> Module '%s'.", child, name)
+                self.l2m :add (child, name)
+                self.cache.l2m[key_l2m] = true
             end
         end
-        i=i+1
     end
     log('TREEMGR-BUILD', 'DETAIL', "End of mappings from %s to databases", map_filename)
-    input :close()
     self.loader :write ("H['"..name.."'] = require '"..name.."'\n")
     self.builder :write("B :add '"..map_filename.."'\n")
    return self
@@ -140,8 +196,43 @@ function MT :close()
     self.builder :write 'B :close()\n'
     self.loader  :close()
     self.builder :close()
-    for _, db_name in ipairs(DB_NAMES) do self[db_name] :finish() end
+    -- Blocks until the jobs are done rather than waiting with `worker.run`:
+    -- databases are built on demand, possibly from a metamethod, which can't
+    -- yield.
+    local jobs = { }
+    for i, db_name in ipairs(DB_NAMES) do jobs[i] = assert(self[db_name] :finishjob()) end
+    for i, db_name in ipairs(DB_NAMES) do
+        worker.core.wait(jobs[i])
+        local ok, msg = jobs[i] :result()
+        assert(ok, "Cannot write tree manager database "..db_name..": "..tostring(msg))
+    end
+    local stamps = { }
+    for map_filename, map in pairs(self.maps) do stamps[map_filename] = map.stamp end
+    writetable(self.path.."maps.cache", self.maps)
+    writetable(self.path.."maps.stamps", stamps)
     log('TREEMGR-BUILD', 'DETAIL', "Database compilation finished.")
 end
 
-return newmapper
+--------------------------------------------------------------------------------
+-- Tell whether the databases in a directory were compiled from a set of map
+-- files, none of which changed since.
+--
+-- @param file_path the directory of the databases.
+-- @param map_filenames list of the map files.
+-- @return true if the databases are up to date, false and a reason otherwise.
+--
+function M.uptodate(file_path, map_filenames)
+    if file_path :sub(-1, -1) ~= '/' then file_path = file_path .. '/' end
+    local stamps, n = readtable(file_path.."maps.stamps"), 0
+    for _, map_filename in ipairs(map_filenames) do
+        local map_stamp = stamps[map_filename]
+        if not map_stamp then return false, map_filename.." is not compiled" end
+        if map_stamp ~= stamp(map_filename) then return false, map_filename.." has changed" end
+        n = n + 1
+    end
+    for _ in pairs(stamps) do n = n - 1 end
+    if n ~= 0 then return false, "some map files were removed" end
+    return true
+end
+
+return setmetatable(M, { __call = function(_, file_path) return newmapper(file_path) end })
@@ -44,8 +44,9 @@
 --
 -- @module treequery.db
 
-local cdb = require 'cdb'
-local lfs = require 'lfs'
+local cdb   = require 'cdb'
+local lfs   = require 'lfs'
+local build = require 'agent.treemgr.build'
 
 local treemgr_path = (LUA_AF_RW_PATH or "./").."persist/treemgr/"
 os.execute("mkdir -p "..treemgr_path)
@@ -77,38 +78,21 @@ local function get_all_map_names()
     return maps
 end
 
--- Returns true iff the maps are more recent than the compiled DB
-local function check_map_dates()
-    local att = lfs.attributes(treemgr_path.."load.lua")
-
-    if not att then
-        log('TREEMGR-DB', 'DEBUG', "Need to create the treemgr databases, no compiled file")
-        return true
-    end
-
-    local compilation_date = att.modification
-
-    for _, name in ipairs(get_all_map_names()) do
-        local map_date = lfs.attributes(name).modification
-        if not map_date or map_date > compilation_date then
-            log('TREEMGR-DB', 'INFO', "Need to rebuild the treemgr databases, %s (%d) has changed since last compilation (%d)",
-                name, map_date, compilation_date)
-            return true
-        end
-    end
-    log('TREEMGR-DB', 'DETAIL', "DB files already compiled from maps")
-    return false
-end
-
--- rebuild DB files if map files are more recent
+-- rebuild DB files if map files changed since the last compilation
 local function rebuild_db_if_needed()
-    if check_map_dates() then -- need to rebuild
-        local b = require 'agent.treemgr.build' (treemgr_path)
-        for _, filename in ipairs(get_all_map_names()) do
-            b :add (filename)
-        end
-        b :close()
+    local maps = get_all_map_names()
+    if not maps then return end
+    local uptodate, reason = build.uptodate(treemgr_path, maps)
+    if uptodate then
+        log('TREEMGR-DB', 'DETAIL', "DB files already compiled from maps")
+        return
+    end
+    log('TREEMGR-DB', 'INFO', "Need to rebuild the treemgr databases: %s", reason)
+    local b = build(treemgr_path)
+    for _, filename in ipairs(maps) do
+        b :add (filename)
     end
+    b :close()
 end
 
 local initialized = false
@@ -140,6 +124,19 @@ function M.h2l(handler_name, hpath)
     return h2l_db :values(handler_name..":"..hpath)
 end
 
+--------------------------------------------------------------------------------
+-- Translate several handler paths of a same handler into logical paths, in
+-- one query.
+-- @param handler_name
+-- @param hpaths list of handler paths
+-- @return a for-loop iterator listing `i, lpath` for every lpath associated
+-- to `hpaths[i]`, in the order of the list.
+--
+function M.h2lall(handler_name, hpaths)
+    if not initialized then M.init() end
+    return h2l_db :findall(hpaths, handler_name..":")
+end
+
 --------------------------------------------------------------------------------
 -- Translate a logical path into the handler path mounted on it;
 -- return nil if no handler is mounted there.
@@ -148,7 +145,7 @@ end
 --
 function M.l2h(lpath)
     if not initialized then M.init() end
-    local line = l2h_db :values (lpath) ()
+    local line = l2h_db :get (lpath)
     if line then return line :match "^([^:]+):(.*)$" end
 end
 
@@ -0,0 +1,117 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of the treemgr databases. Startup: time taken to compile the map
+-- files from scratch, then after one of them changed, then to check that
+-- they are up to date and open the databases, as db.init does when nothing
+-- changed. Lookups: translations per second of every mount point into its
+-- handler path, and of handler paths below every mount point into their
+-- logical paths, by querying each prefix in turn or all of them at once.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/db_perf.lua [rounds] [maps directory]
+
+rawset(_G, 'log', require 'log')
+local cdb   = require 'cdb'
+local lfs   = require 'lfs'
+local path  = require 'utils.path'
+local build = require 'agent.treemgr.build'
+local time  = require 'sched.timer.core'.time
+
+local ROUNDS = tonumber(arg[1]) or 200
+local MAPS   = arg[2] or "resources"
+local function printf(...) print(string.format(...)) end
+
+local dir = os.tmpname()
+os.remove(dir)
+assert(lfs.mkdir(dir))
+dir = dir.."/"
+
+-- Work on copies of the maps, as one of them is touched
+local maps = { }
+for name in lfs.dir(MAPS) do
+    if name :match "%.map$" then
+        local input = assert(io.open(MAPS.."/"..name))
+        local output = assert(io.open(dir..name, 'w'))
+        output :write(input :read '*a')
+        input :close(); output :close()
+        table.insert(maps, dir..name)
+    end
+end
+
+local function compile()
+    local start = time()
+    local b = build(dir)
+    for _, name in ipairs(maps) do b :add(name) end
+    b :close()
+    return (time() - start) * 1e3
+end
+
+local function open()
+    local start = time()
+    assert(build.uptodate(dir, maps))
+    local dbs = { }
+    for _, name in ipairs{ 'h2l', 'l2h', 'l2c', 'l2m' } do
+        dbs[name] = assert(cdb.init(dir.."treemgr."..name..".cdb"))
+    end
+    return (time() - start) * 1e3, dbs
+end
+
+printf("%d maps, compiled from scratch in %.2fms", #maps, compile())
+local date = lfs.attributes(maps[1], 'modification') - 10
+lfs.touch(maps[1], date, date)
+printf("%s changed, compiled in %.2fms", maps[1], compile())
+local elapsed, dbs = open()
+printf("up to date check and databases opening in %.2fms", elapsed)
+
+local lpaths, handlers, hpaths = { }, { }, { }
+for lpath, mount in dbs.l2h :pairs() do
+    local handler, hpath = mount :match "^([^:]+):(.*)$"
+    table.insert(lpaths, lpath)
+    table.insert(handlers, handler)
+    table.insert(hpaths, path.concat(hpath, "some.sub.node"))
+end
+
+local function rate(f)
+    local start, n = time(), 0
+    for _ = 1, ROUNDS do n = n + f() end
+    return n / (time() - start)
+end
+
+printf("%-24s %12s", "lookup", "lookups/s")
+printf("%-24s %12.0f", "l2h values()()", rate(function()
+    for _, lpath in ipairs(lpaths) do dbs.l2h :values (lpath) () end
+    return #lpaths
+end))
+printf("%-24s %12.0f", "l2h get", rate(function()
+    for _, lpath in ipairs(lpaths) do dbs.l2h :get (lpath) end
+    return #lpaths
+end))
+printf("%-24s %12.0f", "h2l values per prefix", rate(function()
+    for i, hpath in ipairs(hpaths) do
+        for hprefix in path.gsplit(hpath) do
+            for _ in dbs.h2l :values (handlers[i]..":"..hprefix) do end
+        end
+    end
+    return #hpaths
+end))
+printf("%-24s %12.0f", "h2l findall", rate(function()
+    for i, hpath in ipairs(hpaths) do
+        local hprefixes = { }
+        for hprefix in path.gsplit(hpath) do table.insert(hprefixes, hprefix) end
+        for _ in dbs.h2l :findall (hprefixes, handlers[i]..":") do end
+    end
+    return #hpaths
+end))
+
+for name in lfs.dir(dir) do os.remove(dir..name) end
+lfs.rmdir(dir)
@@ -15,14 +15,14 @@
 #include <errno.h>
 #include <dlfcn.h>
 #include <string.h>
+#include <limits.h>
 #include <pthread.h>
-#include <semaphore.h>
 
 #include "lua.h"
 #include "lauxlib.h"
-#include "luasignal.h"
 #include "lstate.h"
 #include "extvars.h"
+#include "notify_queue.h"
 
 typedef struct
 {
@@ -34,6 +34,8 @@ typedef struct
   swi_status_t (*list)(int *nvars, ExtVars_id_t **vars);
   swi_status_t (*get_release)(ExtVars_id_t var, void *value, ExtVars_type_t type);
   swi_status_t (*list_release)(int nvars, ExtVars_id_t *vars);
+  swi_status_t (*get_many)(int nvars, ExtVars_id_t *vars, void **values, ExtVars_type_t *types);
+  void (*get_many_release)(int nvars, ExtVars_id_t *vars, void **values, ExtVars_type_t *types);
 } ExtVars_Mod_t;
 
 static inline ExtVars_Mod_t *checkmod(lua_State *L)
@@ -41,27 +43,21 @@ static inline ExtVars_Mod_t *checkmod(lua_State *L)
     return (ExtVars_Mod_t *)luaL_checkudata(L, 1, "extvars_handler");
 }
 
-/* Static variables needed to handle and synchronize variable change notifications.
-/ * This structure is a signleton. */
-#define NOTIFY_SIGEMITTER "ExtVars"
-#define NOTIFY_SIGEVENT   "CNotify"
+/* Variable change notifications. This structure is a singleton.
+ * Notifications sent from other threads go through a queue, drained in batches
+ * by the Lua thread when the scheduler finds its file descriptor readable. */
+#define NOTIFY_QUEUE_MT "extvars_queue"
+#define NOTIFY_BATCH    64 // max records handled per scheduler round
 
 static struct notify_buffer_t
 {
     pthread_t            lua_thread;   // thread in which the Lua VM runs
-    pthread_mutex_t      inprogress;   // ensure there's only one notification in progress
-    sem_t                handled;      // released by Lua thread to signal handling completion
     lua_State           *L;            // lua state, in which notifications can be handled
-    LuaSignalCtx        *luasigctx;    // context for luasignal emissions
-
-    /* This content changes at each notification. */
-    const char          *handler_name; // name of the handler whose notification is pending
-    int                  nvars;        // # of variables whose notification is pending
-    ExtVars_id_t        *vars;         // variable identifiers
-    void               **values;       // variable values
-    ExtVars_type_t      *types;        // variable types
-
-} notify_buffer;
+    notify_queue_t      *queue;        // notifications sent from other threads
+    unsigned             size;         // queue settings, see `api_setqueue`
+    notify_policy_t      policy;
+    int                  configured;   // whether `api_setqueue` was called
+} notify_buffer = { .size = 256, .policy = NOTIFY_POLICY_BLOCK };
 
 #define RETURN_ERROR_NUMBER( name, i) do { \
     lua_pushnil( L); \
@@ -123,6 +119,19 @@ static int get_all_var_names( lua_State *L) {
     return 2;              // return nil, children_set
 }
 
+/* Push the Lua-converted value on stack. Return 0 if the type is unknown. */
+static int push_value( lua_State *L, void *value, ExtVars_type_t type) {
+    switch( type) {
+        case EXTVARS_TYPE_STR:    lua_pushstring(  L, value ? (const char *) value : ""); break;
+        case EXTVARS_TYPE_INT:    lua_pushinteger( L, *(int*)        value); break;
+        case EXTVARS_TYPE_DOUBLE: lua_pushnumber(  L, *(double*)     value); break;
+        case EXTVARS_TYPE_BOOL:   lua_pushboolean( L, *(int*)        value); break;
+        case EXTVARS_TYPE_NIL:    lua_pushnil(L); break;
+        default:                  return 0;
+    }
+    return 1;
+}
+
 /* Called from `api_get`: push the appropriate value, retrieved from callback, on the Lua stack. */
 static int get_leaf_value( lua_State *L) {
     ExtVars_Mod_t *mod = checkmod(L);
@@ -143,14 +152,8 @@ static int get_leaf_value( lua_State *L) {
             RETURN_ERROR_NUMBER( "get", r);
 	}
     }
-    switch( type) {
-        case EXTVARS_TYPE_STR:    lua_pushstring(  L, value ? (const char *) value : ""); break;
-        case EXTVARS_TYPE_INT:    lua_pushinteger( L, *(int*)        value); break;
-        case EXTVARS_TYPE_DOUBLE: lua_pushnumber(  L, *(double*)     value); break;
-        case EXTVARS_TYPE_BOOL:   lua_pushboolean( L, *(int*)        value); break;
-        case EXTVARS_TYPE_NIL:    lua_pushnil(L); break;
-        default:                  RETURN_ERROR_STRING( "Unknown ExtVars type"); // TODO get_release leak
-    }
+    if( ! push_value( L, value, type))
+        RETURN_ERROR_STRING( "Unknown ExtVars type"); // TODO get_release leak
     if (mod->get_release)
         mod->get_release(var, value, type);
     return 1;
@@ -172,6 +175,82 @@ static int api_get(lua_State *L)
 }
 
 
+/* Called from `api_getall` on the root node: add every variable to the hmap on top of the stack. */
+static int get_all_values( lua_State *L) {
+    ExtVars_Mod_t *mod = checkmod(L);
+    int nvars, *vars, i;
+    void **values;
+    ExtVars_type_t *types;
+    swi_status_t r;
+
+    if( ! mod->list) return 1; /* Var listing not implemented */
+    r = mod->list(&nvars, &vars);
+    if( r) RETURN_ERROR_NUMBER( "getall", r);
+
+    /* Scratch arrays for the values, collected with the stack. */
+    values = lua_newuserdata( L, nvars * (sizeof( void*) + sizeof( ExtVars_type_t)) + 1); // ctx, "", hmap, scratch
+    types  = (ExtVars_type_t *) (values + nvars);
+    lua_insert( L, -2); // ctx, "", scratch, hmap
+
+    if( mod->get_many) {
+        r = mod->get_many( nvars, vars, values, types);
+        if( r) {
+            if( mod->list_release) mod->list_release( nvars, vars);
+            RETURN_ERROR_NUMBER( "getall", r);
+        }
+        for( i = 0; i < nvars; i++) {
+            lua_pushnumber( L, vars[i]);                     // ctx, "", scratch, hmap, var_number
+            lua_tostring(   L, -1);                          // ctx, "", scratch, hmap, var_string
+            if( ! push_value( L, values[i], types[i])) lua_pushnil( L); // ctx, "", scratch, hmap, var_string, value
+            lua_rawset(     L, -3);                          // ctx, "", scratch, hmap
+        }
+        if( mod->get_many_release) mod->get_many_release( nvars, vars, values, types);
+    } else {
+        for( i = 0; i < nvars; i++) {
+            r = mod->get( vars[i], values, types);
+            if( r == SWI_STATUS_DA_NOT_FOUND) continue;
+            if( r) {
+                if( mod->list_release) mod->list_release( nvars, vars);
+                RETURN_ERROR_NUMBER( "getall", r);
+            }
+            lua_pushnumber( L, vars[i]);
+            lua_tostring(   L, -1);
+            if( ! push_value( L, values[0], types[0])) lua_pushnil( L);
+            lua_rawset(     L, -3);
+            if( mod->get_release) mod->get_release( vars[i], values[0], types[0]);
+        }
+    }
+    if( mod->list_release) mod->list_release( nvars, vars);
+    return 1;
+}
+
+/* Takes an hpath; returns an hmap of every leaf value under it, with paths
+ * relative to `hpath`, i.e. `{ [""] = value }` for a leaf. The same design
+ * constraints as `api_get` apply; on the root node, the values are retrieved
+ * with a single call to `get_variables` when the handler provides it. */
+static int api_getall(lua_State *L)
+{
+    // Initial stack state: ctx, hpath
+    size_t len;
+    int n;
+    luaL_checklstring( L, 2, & len);
+    lua_settop( L, 2);
+    if( len == 0) {
+        lua_newtable( L);      // ctx, "", hmap
+        return get_all_values( L);
+    }
+    n = get_leaf_value( L);    // ctx, hpath, value | nil, nil | nil, msg
+    if( n == 2) {
+        if( lua_isnil( L, -1)) { lua_newtable( L); return 1; } /* Not found: empty hmap */
+        return 2;
+    }
+    lua_newtable(   L);        // ctx, hpath, value, hmap
+    lua_pushstring( L, "");    // ctx, hpath, value, hmap, ""
+    lua_pushvalue(  L, -3);    // ctx, hpath, value, hmap, "", value
+    lua_rawset(     L, -3);    // ctx, hpath, value, hmap
+    return 1;
+}
+
 /* Takes an hmap,
  * converts it into nvars / vars / values / types,
  * calls the corresponding `set` C callback. */
@@ -293,98 +372,229 @@ static int api_register( lua_State *L)   { return register_unregister( L, 1); }
 static int api_unregister( lua_State *L) { return register_unregister( L, 0); }
 
 
-/* Calls `require 'agent.treemgr' .notify (handler_name, hmap)`.
- * Can be either called directly by `trigger_notification`, if the later is called
- * in the Lua VM thread, or through a Lua signal.
- * Releases `notify_buffer->handled` to indicate that a notification handling
- * has been completed. */
-static int handle_notification( lua_State *L) {
-    int i, r;
-
-    // TODO: register notify in a faster-to-reach place
-    lua_getglobal(  L, "require");                   // require
-    lua_pushvalue(  L, -1);                          // require, require
-    lua_pushstring( L, "sched");                     // require, require, "sched"
-    lua_call(       L, 1, 1);                        // require, sched
-    lua_getfield(   L, -1, "run");                   // require, sched, run
-    lua_pushvalue(  L, -3);                          // require, sched, run, require
-    lua_pushstring( L, "agent.treemgr");             // require, sched, run, require, "agent.treemgr"
-    lua_call(       L, 1, 1);                        // require, sched, run, treemgr
-    lua_getfield(   L, -1, "notify");                // require, sched, run, treemgr, notify
-    lua_remove(     L, -2);                          // require, sched, run, notify
-    lua_pushstring( L, notify_buffer.handler_name);  // require, sched, run, notify, hname
-
-    /* Create and fill the hmap of notified variables. */
-    lua_newtable(   L);                              // require, sched, run, notify, hname, hmap
-    for( i=0; i<notify_buffer.nvars; i++) {          // require, sched, run, notify, hname, hmap
-        lua_pushnumber( L, notify_buffer.vars[i]);   // require, sched, run, notify, hname, hmap, id_num
-        lua_tostring(    L, -1);                     // require, sched, run, notify, hname, hmap, id_string
-        void *v = notify_buffer.values[i];
-        switch( notify_buffer.types[i]) { /* Push the Lua-converted value on stack. */
+/* Notifications are delivered by calling `sched.run(treemgr.notify, handler_name, hmap)`.
+ * Consecutive records of a handler are merged into a single hmap, as long as
+ * they don't notify the same variable twice: every value is delivered. */
+typedef struct {
+    lua_State     *L;
+    int            base;  // stack index of sched.run; treemgr.notify follows
+    ExtVars_Mod_t *mod;   // handler of the hmap being built, on top of the stack
+} batch_t;
+
+static void batch_begin( batch_t *b, lua_State *L) {
+    b->L   = L;
+    b->mod = NULL;
+    lua_getglobal(  L, "require");            // require
+    lua_pushstring( L, "sched");              // require, "sched"
+    lua_call(       L, 1, 1);                 // sched
+    lua_getfield(   L, -1, "run");            // sched, run
+    lua_remove(     L, -2);                   // run
+    lua_getglobal(  L, "require");            // run, require
+    lua_pushstring( L, "agent.treemgr");      // run, require, "agent.treemgr"
+    lua_call(       L, 1, 1);                 // run, treemgr
+    lua_getfield(   L, -1, "notify");         // run, treemgr, notify
+    lua_remove(     L, -2);                   // run, notify
+    b->base = lua_gettop( L) - 1;
+}
+
+/* Send the hmap being built, if any. */
+static void batch_flush( batch_t *b) {
+    lua_State *L = b->L;
+    if( ! b->mod) return;                          // run, notify, hmap
+    lua_pushvalue(  L, b->base);                   // run, notify, hmap, run
+    lua_pushvalue(  L, b->base + 1);               // run, notify, hmap, run, notify
+    lua_pushstring( L, b->mod->name);              // run, notify, hmap, run, notify, hname
+    lua_pushvalue(  L, -4);                        // run, notify, hmap, run, notify, hname, hmap
+    if( lua_pcall( L, 3, 0, 0)) {                  // run, notify, hmap, [error_msg]
+        printf("Error during notification: %s\n", lua_tostring( L, -1));
+        lua_pop( L, 1);
+    }
+    lua_pop( L, 1);                                // run, notify
+    b->mod = NULL;
+}
+
+static void batch_add( batch_t *b, notify_record_t *rec) {
+    lua_State *L = b->L;
+    int i;
+    if( b->mod != rec->ctx) {
+        batch_flush( b);
+        b->mod = rec->ctx;
+        lua_newtable( L);                          // run, notify, hmap
+    }
+    for( i = 0; i < rec->nvars; i++) {
+        void *v = rec->values[i];
+        lua_pushnumber( L, rec->vars[i]);          // run, notify, hmap, id_num
+        lua_tostring(   L, -1);                    // run, notify, hmap, id_string
+        lua_pushvalue(  L, -1);                    // run, notify, hmap, id_string, id_string
+        lua_rawget(     L, -3);                    // run, notify, hmap, id_string, previous
+        if( ! lua_isnil( L, -1)) {                 /* Already notified in this hmap: send it first. */
+            ExtVars_Mod_t *mod = b->mod;
+            lua_pop(        L, 1);                 // run, notify, hmap, id_string
+            lua_insert(     L, -2);                // run, notify, id_string, hmap
+            batch_flush( b);                       // run, notify, id_string
+            b->mod = mod;
+            lua_newtable(   L);                    // run, notify, id_string, hmap
+            lua_insert(     L, -2);                // run, notify, hmap, id_string
+        } else {
+            lua_pop(        L, 1);                 // run, notify, hmap, id_string
+        }
+        if( ! v) lua_pushnil( L);
+        else switch( rec->types[i]) { /* Push the Lua-converted value on stack. */
         case EXTVARS_TYPE_INT:    lua_pushinteger( L, * (int*) v); break;
         case EXTVARS_TYPE_BOOL:   lua_pushboolean( L, * (int*) v); break;
         case EXTVARS_TYPE_DOUBLE: lua_pushnumber(  L, * (lua_Number*) v); break;
         case EXTVARS_TYPE_STR:    lua_pushstring(  L, (char*) v); break;
         default: lua_pushnil( L);  break; /* This is an error: just avoid a catastrophic failure */
-        }                      // require, sched, run, notify, hname, hmap, id_string, value
-        lua_settable( L, -3);  // require, sched, run, notify, hname, hmap[id_string=value]
-    }                          // require, sched, run, notify, hname, hmap
-    r = lua_pcall( L, 3, 0, 0);
-    sem_post(&notify_buffer.handled); /* Allow next notification. */
+        }                                          // run, notify, hmap, id_string, value
+        lua_rawset( L, -3);                        // run, notify, hmap[id_string=value]
+    }
+}
 
-    if( r) { // require, sched, error_msg
-        printf("Error during notification: %s\n", lua_tostring( L, -1));
-        lua_pop( L, 3); // -
-    } else { // require, sched
-        lua_pop( L, 2); // -
+static void batch_end( batch_t *b) {
+    batch_flush( b);
+    lua_settop( b->L, b->base - 1);
+}
+
+/* Deliver up to `max` queued notifications.
+ * Return whether some remain in the queue. */
+static int drain_queue( lua_State *L, int max) {
+    notify_record_t *rec = NULL;
+    batch_t b;
+    int n;
+    batch_begin( & b, L);
+    for( n = 0; n < max && (rec = notify_queue_pop( notify_buffer.queue)); n++) {
+        batch_add( & b, rec);
+        notify_record_free( rec);
     }
-    return 0;
+    batch_end( & b);
+    return n == max;
+}
+
+/* Called by the scheduler when the queue's file descriptor is readable. */
+static int queue_readable( lua_State *L) {
+    notify_queue_ack( notify_buffer.queue);
+    /* Let other threads run before the next batch. */
+    if( drain_queue( L, NOTIFY_BATCH)) notify_queue_wake( notify_buffer.queue);
+    lua_pushstring( L, "again");
+    return 1;
+}
+
+static int queue_getfd( lua_State *L) {
+    lua_pushinteger( L, notify_queue_getfd( notify_buffer.queue));
+    return 1;
 }
 
 /* This is the C function which allows to cause a variable change notification in the Lua VM.
  * Its works differently, depending on whether it's called from the thread in which the Lua
  * VM runs:
  *
- * * in all cases, it stores the notification description in `notify_buffer`.
- * * if it runs in the Lua VM thread, it calls the Lua handler directly;
- * * if called from another thread, it sends a Lua signal, which will trigger
- *   the notification handler, and waits until the handling is completed; completion
- *   is signaled by the release of a dedicated `notify_buffer->handled` mutex.
+ * * if it runs in the Lua VM thread, it calls the Lua handler directly, after the
+ *   notifications still queued, to preserve their order;
+ * * if called from another thread, it copies the notification into the queue and returns;
+ *   it only waits, with the default policy, when the queue is full.
  */
 static swi_status_t trigger_notification(void *ctx, int nvars, ExtVars_id_t* vars, void** values, ExtVars_type_t* types) {
 
-    ExtVars_Mod_t *mod = (ExtVars_Mod_t *)ctx;
-    /* make sure that only one notification is in progress. */
-    pthread_mutex_lock(&notify_buffer.inprogress);
-
-    notify_buffer.handler_name = mod->name;
-    notify_buffer.nvars        = nvars;
-    notify_buffer.vars         = vars;
-    notify_buffer.values       = values;
-    notify_buffer.types        = types;
+    notify_record_t *rec = notify_record_new(ctx, nvars, vars, values, types);
+    if( ! rec) return SWI_STATUS_ALLOC_FAILED;
 
     if(pthread_self() == notify_buffer.lua_thread) { /* Direct nested call */
-        handle_notification(notify_buffer.L);
-    } else { /* Triggered through a pre-subscribed Lua signal */
-        LUASIGNAL_SignalT( notify_buffer.luasigctx, NOTIFY_SIGEMITTER, NOTIFY_SIGEVENT, NULL);
+        lua_State *L = notify_buffer.L;
+        batch_t b;
+        while( drain_queue( L, INT_MAX));
+        batch_begin( & b, L);
+        batch_add( & b, rec);
+        batch_end( & b);
+        notify_record_free( rec);
+    } else {
+        notify_queue_push( notify_buffer.queue, rec);
     }
+    return SWI_STATUS_OK;
+}
 
-    /* If this function runs in the lua thread, the `handled` semaphore has already been released by the
-     * Lua notification handler.
-     *
-     * If this thread is not the lua thread, the lua signal sent above will eventually cause the lua
-     * handler to run, which will eventually release the `handled` sem.
-     * Until this happens, the current thread pauses, and the notification ctx won't be altered. */
-    sem_wait(&notify_buffer.handled);
+static int api_setqueue( lua_State *L);
+
+/* Apply the `device.extvarsqueue` config entry, unless `setqueue` was called.
+ * Handlers may be loaded before any module had a chance to call `setqueue`,
+ * so the setting is read when the queue is created. */
+static void config_queue( lua_State *L) {
+    int top = lua_gettop( L), err;
+    if( notify_buffer.configured) return;
+    lua_getglobal(      L, "require");                  // require
+    lua_pushstring(     L, "agent.config");             // require, "agent.config"
+    if( lua_pcall(      L, 1, 1, 0)) goto quit;         // no agent config
+    lua_getfield(       L, -1, "get");                  // config, get
+    lua_pushstring(     L, "device.extvarsqueue");      // config, get, path
+    if( lua_pcall(      L, 1, 1, 0) || ! lua_istable( L, -1)) goto quit;
+    lua_pushcfunction(  L, api_setqueue);               // config, q, setqueue
+    lua_getfield(       L, -2, "size");                 // config, q, setqueue, size
+    lua_getfield(       L, -3, "policy");               // config, q, setqueue, size, policy
+    if( ! lua_pcall(    L, 2, 2, 0) && ! lua_isnil( L, -2)) goto quit;
+    err = lua_gettop(   L);                             // config, q, [nil,] error
+    lua_getglobal(      L, "log");                      // ..., log
+    lua_pushstring(     L, "EXTVARS");
+    lua_pushstring(     L, "WARNING");
+    lua_pushstring(     L, "Invalid device.extvarsqueue setting: %s");
+    lua_pushvalue(      L, err);                        // ..., log, module, level, fmt, error
+    lua_pcall(          L, 4, 0, 0);
+quit:
+    lua_settop(         L, top);
+}
 
-    pthread_mutex_unlock(&notify_buffer.inprogress);
+/* Create the notification queue, and have the scheduler watch it. */
+static int init_queue( lua_State *L) {
+    swi_status_t r;
+    config_queue( L);
+    r = notify_queue_new( & notify_buffer.queue, notify_buffer.size, notify_buffer.policy);
+    if( r) RETURN_ERROR_NUMBER( "newhandler/queue", r);
+    notify_buffer.L = G( L)->mainthread;
+    notify_buffer.lua_thread = pthread_self();
+
+    lua_getglobal(      L, "require");                  // require
+    lua_pushstring(     L, "sched.fd");                 // require, "sched.fd"
+    lua_call(           L, 1, 1);                       // sched.fd
+    lua_getfield(       L, -1, "when_readable");        // sched.fd, when_readable
+    lua_newuserdata(    L, 1);                          // sched.fd, when_readable, queue
+    luaL_getmetatable(  L, NOTIFY_QUEUE_MT);
+    lua_setmetatable(   L, -2);
+    lua_pushcfunction(  L, queue_readable);             // sched.fd, when_readable, queue, handler
+    lua_call(           L, 2, 0);                       // sched.fd
+    lua_pop(            L, 1);                          // -
+    return 0;
+}
 
-    return SWI_STATUS_OK;
+/* setqueue(size, policy): settings of the notification queue, to be called
+ * before the first handler is loaded, instead of the `device.extvarsqueue`
+ * config entry. `policy` tells what threads notifying while the queue is
+ * full do: "block" (default) until there's room,
+ * "dropoldest" drop the oldest notification, "coalesce" only keep the last
+ * value of each variable until there's room. */
+static int api_setqueue( lua_State *L) {
+    static const char *const policies[] = { "block", "dropoldest", "coalesce", NULL };
+    int size = luaL_optint( L, 1, notify_buffer.size);
+    int policy = luaL_checkoption( L, 2, "block", policies);
+    if( notify_buffer.queue) RETURN_ERROR_STRING( "notification queue already created");
+    if( size < 2) RETURN_ERROR_STRING( "invalid notification queue size");
+    notify_buffer.size       = size;
+    notify_buffer.policy     = (notify_policy_t) policy;
+    notify_buffer.configured = 1;
+    RETURN_OK;
+}
+
+/* queuestats(): number of notifications dropped, and of values overwritten
+ * while coalescing, so far. */
+static int api_queuestats( lua_State *L) {
+    unsigned dropped = 0, coalesced = 0;
+    if( notify_buffer.queue) notify_queue_stats( notify_buffer.queue, & dropped, & coalesced);
+    lua_pushinteger( L, dropped);
+    lua_pushinteger( L, coalesced);
+    return 2;
 }
 
 
 static luaL_Reg hdlr[] = {
   {"get", api_get},
+  {"getall", api_getall},
   {"set", api_set},
   {"register", api_register},
   {"unregister", api_unregister},
@@ -426,6 +636,8 @@ static int l_load(lua_State *L)
   mod->list = dlsym(handler, "ExtVars_list");
   mod->get_release = dlsym(handler, "ExtVars_get_variable_release");
   mod->list_release = dlsym(handler, "ExtVars_list_release");
+  mod->get_many = dlsym(handler, "ExtVars_get_variables");
+  mod->get_many_release = dlsym(handler, "ExtVars_get_variables_release");
 
   if (mod->get == NULL) {
     lua_pushnil(L);
@@ -433,32 +645,16 @@ static int l_load(lua_State *L)
     return 2;
   }
 
+  /* The queue must exist before the handler is given the notifier. */
+  if (!notify_buffer.queue) {
+    int n = init_queue(L);
+    if (n) return n;
+  }
+
   void (*set_notifier)(void *, ExtVars_notify_t *) = dlsym(handler, "ExtVars_set_notifier");
   if (set_notifier)
     set_notifier(mod, trigger_notification);
 
-  notify_buffer.L = G( L)->mainthread;
-  notify_buffer.lua_thread = pthread_self();
-  pthread_mutex_init(&notify_buffer.inprogress, NULL);
-  sem_init(&notify_buffer.handled, 0, 0);
-
-  
-  int r = LUASIGNAL_Init(&notify_buffer.luasigctx, 18888, NULL, NULL);
-  if(r) 
-    RETURN_ERROR_NUMBER( "newhandler/luasignal", r);
-
-  /* Subscribe the notification handler to the signal, for notifications
-   * triggered from outside the Lua thread. */
-  lua_getglobal(L, "require");
-  lua_pushstring(L, "sched");
-  lua_call(L, 1, 1);
-  lua_getfield(L, -1, "sighook");
-  lua_pushstring(L, NOTIFY_SIGEMITTER);
-  lua_pushstring(L, NOTIFY_SIGEVENT);
-  lua_pushcfunction(L, handle_notification);
-  lua_call(L, 3, 0);
-  lua_pop(L, 1);
-
   luaL_getmetatable(L, "extvars_handler");
   lua_setmetatable(L, -2);
   return 1;
@@ -467,6 +663,8 @@ static int l_load(lua_State *L)
 static const luaL_Reg R[] =
 {
     { "load", l_load },
+    { "setqueue", api_setqueue },
+    { "queuestats", api_queuestats },
     { NULL, NULL }
 };
 
@@ -479,6 +677,14 @@ int luaopen_agent_treemgr_handlers_extvars(lua_State* L)
     lua_setfield(L, -2, "__index");
 
     luaL_register(L, NULL, hdlr);
+
+    luaL_newmetatable(L, NOTIFY_QUEUE_MT);
+    lua_newtable(L);
+    lua_pushcfunction(L, queue_getfd);
+    lua_setfield(L, -2, "getfd");
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
     luaL_register(L, "extvars", R);
     return 1;
 }
@@ -105,6 +105,23 @@ swi_status_t ExtVars_get_variable(ExtVars_id_t var, void **value, ExtVars_type_t
  *  Allows to clean up resources needed to maintain those results valid. */
 swi_status_t ExtVars_get_variable_release(ExtVars_id_t var, void *value, ExtVars_type_t type);
 
+/* Optional: retrieve the content of several variables in a single call.
+ * `values` and `types` are arrays of `nvars` elements, provided by the caller, to be filled
+ * as `get_variable` does for a single variable; variables which can't be found must be
+ * given the EXTVARS_TYPE_NIL type.
+ * The resources necessary to store the values must remain available at least until the
+ * `get_variables_release` callback, or the next `get_variables` call.
+ * When this callback isn't provided, `get_variable` is called for each variable.
+ * @param nvars  number of retrieved variables
+ * @param vars   array of the retrieved variables ids
+ * @param values (output) array of `nvars` values
+ * @param types  (output) array of `nvars` types
+ * @return SWI_STATUS_OK, SWI_STATUS_WRONG_PARAMS */
+swi_status_t ExtVars_get_variables(int nvars, ExtVars_id_t *vars, void **values, ExtVars_type_t *types);
+
+/* If provided, called by ExtVars after it has stopped needing the results of a `get_variables` callback. */
+void ExtVars_get_variables_release(int nvars, ExtVars_id_t *vars, void **values, ExtVars_type_t *types);
+
 /* List all the variables identifiers handled by the handler.
  *
  * The resources necessary to store the `vars` table must be allocated by the callback,
@@ -0,0 +1,75 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* ExtVars handler for extvars_perf.lua: a flat tree of EXTVARS_PERF_LEAVES
+ * read-only leaves (5000 by default), alternately integers, doubles and
+ * strings. Built with NO_GET_VARIABLES, it doesn't provide the bulk
+ * `ExtVars_get_variables` entry point. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "extvars.h"
+
+static int nvars;
+static ExtVars_id_t *ids;
+static int *ints;
+static double *doubles;
+static char (*strings)[16];
+
+swi_status_t ExtVars_initialize(void)
+{
+    const char *n = getenv("EXTVARS_PERF_LEAVES");
+    int i;
+
+    nvars   = n ? atoi(n) : 5000;
+    ids     = malloc(nvars * sizeof(*ids));
+    ints    = malloc(nvars * sizeof(*ints));
+    doubles = malloc(nvars * sizeof(*doubles));
+    strings = malloc(nvars * sizeof(*strings));
+    if (!ids || !ints || !doubles || !strings) return SWI_STATUS_RESOURCE_INITIALIZATION_FAILED;
+    for (i = 0; i < nvars; i++) {
+        ids[i]     = i + 1;
+        ints[i]    = i;
+        doubles[i] = i / 8.0;
+        snprintf(strings[i], sizeof(*strings), "value%d", i);
+    }
+    return SWI_STATUS_OK;
+}
+
+swi_status_t ExtVars_get_variable(ExtVars_id_t id, void **value, ExtVars_type_t *type)
+{
+    int i = id - 1;
+    if (i < 0 || i >= nvars) return SWI_STATUS_DA_NOT_FOUND;
+    switch (i % 3) {
+        case 0:  *value = ints + i;    *type = EXTVARS_TYPE_INT;    break;
+        case 1:  *value = doubles + i; *type = EXTVARS_TYPE_DOUBLE; break;
+        default: *value = strings[i];  *type = EXTVARS_TYPE_STR;    break;
+    }
+    return SWI_STATUS_OK;
+}
+
+#ifndef NO_GET_VARIABLES
+swi_status_t ExtVars_get_variables(int n, ExtVars_id_t *vars, void **values, ExtVars_type_t *types)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        if (ExtVars_get_variable(vars[i], values + i, types + i))
+            types[i] = EXTVARS_TYPE_NIL;
+    return SWI_STATUS_OK;
+}
+#endif
+
+swi_status_t ExtVars_list(int *n, ExtVars_id_t **vars)
+{
+    *n    = nvars;
+    *vars = ids;
+    return SWI_STATUS_OK;
+}
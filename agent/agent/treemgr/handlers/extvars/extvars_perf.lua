@@ -0,0 +1,69 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of subtree reads: the 5000 leaves of the extvars_perf handler
+-- are read through the tree manager as ReadNode used to, one `get` per
+-- node, then with `treemgr.getsubtree`, with and without the bulk
+-- `ExtVars_get_variables` entry point of the handler.
+--
+-- Build the extvars_perf and extvars_perf_single targets, then from the
+-- runtime directory:
+--
+--   bin/lua <this directory>/extvars_perf.lua [runs]
+
+require 'log'
+require 'checks'
+local lfs = require 'lfs'
+
+local runs = tonumber(arg[1]) or 20
+
+-- Private treemgr databases, built from the maps below only
+local root = os.tmpname(); os.remove(root); root = root .. "/"
+assert(os.execute("mkdir -p "..root.."resources && ln -s "..lfs.currentdir().."/lua "..root.."lua") == 0)
+local function writemap(name, handler)
+    local f = assert(io.open(root.."resources/"..name..".map", "w"))
+    f :write("treemgr agent.devman.extvars."..handler.."\n\n"..name.."=\n")
+    f :close()
+end
+writemap("perf", "extvars_perf")
+writemap("perfsingle", "extvars_perf_single")
+LUA_AF_RO_PATH, LUA_AF_RW_PATH = root, root
+
+local tm = require 'agent.treemgr'
+log.setlevel('WARNING')
+
+-- ReadNode's former traversal
+local function walk(path, out)
+    local value, children = tm.get(path)
+    if not children then out[path] = value
+    else for _, child in ipairs(children) do walk(child, out) end end
+    return out
+end
+
+local function bench(name, f, path)
+    local best, n = math.huge, 0
+    for _ = 1, runs do
+        local t = os.clock()
+        local r = f(path)
+        best = math.min(best, os.clock() - t)
+        n = 0; for _ in pairs(r) do n = n + 1 end
+    end
+    printf("%-32s %5d leaves: %8.2f ms", name, n, best * 1e3)
+end
+
+local function subtree(path) return assert(tm.getsubtree(path)) end
+local function pernode(path) return walk(path, { }) end
+
+bench("get per node (former ReadNode)", pernode, "perf")
+bench("getsubtree, get per leaf",       subtree, "perfsingle")
+bench("getsubtree, get_variables",      subtree, "perf")
+
+os.execute("rm -rf "..root)
@@ -0,0 +1,309 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "notify_queue.h"
+
+/* The ring is a bounded multi-producer queue where each cell carries a
+ * sequence number telling whether it's free for the producer of a given
+ * position, or filled for the consumer of that position. Popping is also
+ * done with a compare-and-swap, as producers pop the oldest record
+ * themselves with NOTIFY_POLICY_DROP_OLDEST. */
+typedef struct {
+    unsigned         seq;
+    notify_record_t *rec;
+} cell_t;
+
+struct notify_queue_t {
+    cell_t          *cells;
+    unsigned         mask;
+    notify_policy_t  policy;
+    int              efd;
+    char             pad0[64];
+    unsigned         enqueue_pos;
+    char             pad1[64];
+    unsigned         dequeue_pos;
+    char             pad2[64];
+    int              signaled;       // the eventfd has been written and not acknowledged yet
+
+    pthread_mutex_t  lock;           // protects the fields below
+    pthread_cond_t   room;           // NOTIFY_POLICY_BLOCK: broadcast when records are popped
+    int              waiters;        // producers waiting for room
+    int              overflowing;    // NOTIFY_POLICY_COALESCE: the overflow list is in use
+    notify_record_t *overflow;
+    notify_record_t *pending;        // overflow list taken by the consumer
+
+    unsigned         dropped;
+    unsigned         coalesced;
+};
+
+typedef union { int i; double d; } slot_t;
+
+notify_record_t *notify_record_new( void *ctx, int nvars, ExtVars_id_t *vars, void **values, ExtVars_type_t *types) {
+    size_t size = sizeof( notify_record_t) +
+        nvars * (sizeof( slot_t) + sizeof( void *) + sizeof( ExtVars_id_t) + sizeof( ExtVars_type_t));
+    notify_record_t *rec;
+    slot_t *slots;
+    char *str;
+    int i;
+
+    for( i = 0; i < nvars; i++)
+        if( EXTVARS_TYPE_STR == types[i] && values[i]) size += strlen( values[i]) + 1;
+    rec = malloc( size);
+    if( ! rec) return NULL;
+
+    slots       = (slot_t *) (rec + 1);
+    rec->ctx    = ctx;
+    rec->nvars  = nvars;
+    rec->values = (void **) (slots + nvars);
+    rec->vars   = (ExtVars_id_t *) (rec->values + nvars);
+    rec->types  = (ExtVars_type_t *) (rec->vars + nvars);
+    rec->next   = NULL;
+    str         = (char *) (rec->types + nvars);
+
+    for( i = 0; i < nvars; i++) {
+        void *v = values[i];
+        rec->vars[i]   = vars[i];
+        rec->types[i]  = types[i];
+        rec->values[i] = v ? slots + i : NULL;
+        if( ! v) continue;
+        switch( types[i]) {
+        case EXTVARS_TYPE_INT:
+        case EXTVARS_TYPE_BOOL:   slots[i].i = * (int *) v; break;
+        case EXTVARS_TYPE_DOUBLE: slots[i].d = * (double *) v; break;
+        case EXTVARS_TYPE_STR:
+            rec->values[i] = str;
+            strcpy( str, v);
+            str += strlen( str) + 1;
+            break;
+        default: rec->values[i] = NULL; break;
+        }
+    }
+    return rec;
+}
+
+void notify_record_free( notify_record_t *rec) {
+    free( rec);
+}
+
+swi_status_t notify_queue_new( notify_queue_t **pq, unsigned size, notify_policy_t policy) {
+    notify_queue_t *q;
+    unsigned i, n = 2;
+
+    while( n < size) n <<= 1;
+    *pq = NULL;
+    q = calloc( 1, sizeof( *q));
+    if( ! q) return SWI_STATUS_ALLOC_FAILED;
+    q->cells = malloc( n * sizeof( cell_t));
+    if( ! q->cells) {
+        free( q);
+        return SWI_STATUS_ALLOC_FAILED;
+    }
+    for( i = 0; i < n; i++) q->cells[i].seq = i;
+    q->mask   = n - 1;
+    q->policy = policy;
+    q->efd    = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if( q->efd < 0) {
+        free( q->cells);
+        free( q);
+        return SWI_STATUS_RESOURCE_INITIALIZATION_FAILED;
+    }
+    pthread_mutex_init( & q->lock, NULL);
+    pthread_cond_init( & q->room, NULL);
+    *pq = q;
+    return SWI_STATUS_OK;
+}
+
+void notify_queue_destroy( notify_queue_t *q) {
+    notify_record_t *rec;
+    if( ! q) return;
+    while( (rec = notify_queue_pop( q))) notify_record_free( rec);
+    close( q->efd);
+    pthread_cond_destroy( & q->room);
+    pthread_mutex_destroy( & q->lock);
+    free( q->cells);
+    free( q);
+}
+
+static int try_push( notify_queue_t *q, notify_record_t *rec) {
+    unsigned pos = __atomic_load_n( & q->enqueue_pos, __ATOMIC_RELAXED);
+    for( ;;) {
+        cell_t *c = q->cells + (pos & q->mask);
+        int dif = (int) (__atomic_load_n( & c->seq, __ATOMIC_ACQUIRE) - pos);
+        if( 0 == dif) {
+            if( __atomic_compare_exchange_n( & q->enqueue_pos, & pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                c->rec = rec;
+                __atomic_store_n( & c->seq, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if( dif < 0) {
+            return 0; /* full */
+        } else {
+            pos = __atomic_load_n( & q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static notify_record_t *try_pop( notify_queue_t *q) {
+    unsigned pos = __atomic_load_n( & q->dequeue_pos, __ATOMIC_RELAXED);
+    for( ;;) {
+        cell_t *c = q->cells + (pos & q->mask);
+        int dif = (int) (__atomic_load_n( & c->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+        if( 0 == dif) {
+            if( __atomic_compare_exchange_n( & q->dequeue_pos, & pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                notify_record_t *rec = c->rec;
+                __atomic_store_n( & c->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+                return rec;
+            }
+        } else if( dif < 0) {
+            return NULL; /* empty */
+        } else {
+            pos = __atomic_load_n( & q->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void notify_queue_wake( notify_queue_t *q) {
+    if( ! __atomic_exchange_n( & q->signaled, 1, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        ssize_t r = write( q->efd, & one, sizeof( one));
+        (void) r;
+    }
+}
+
+/* Remove from `old` the variables notified again in `rec`. Return the number of values removed. */
+static int remove_vars( notify_record_t *old, notify_record_t *rec) {
+    int i, j, n = 0;
+    for( i = 0; i < old->nvars; i++) {
+        for( j = 0; j < rec->nvars && rec->vars[j] != old->vars[i]; j++);
+        if( j < rec->nvars) continue;
+        old->vars[n]   = old->vars[i];
+        old->values[n] = old->values[i];
+        old->types[n]  = old->types[i];
+        n++;
+    }
+    i = old->nvars - n;
+    old->nvars = n;
+    return i;
+}
+
+/* NOTIFY_POLICY_COALESCE: append to the overflow list, removing the values
+ * this record makes obsolete. */
+static void coalesce( notify_queue_t *q, notify_record_t *rec) {
+    notify_record_t **p;
+    pthread_mutex_lock( & q->lock);
+    for( p = & q->overflow; *p; ) {
+        notify_record_t *old = *p;
+        if( old->ctx == rec->ctx) q->coalesced += remove_vars( old, rec);
+        if( old->nvars) {
+            p = & old->next;
+        } else {
+            *p = old->next;
+            notify_record_free( old);
+        }
+    }
+    *p = rec;
+    __atomic_store_n( & q->overflowing, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock( & q->lock);
+}
+
+void notify_queue_push( notify_queue_t *q, notify_record_t *rec) {
+    if( NOTIFY_POLICY_COALESCE == q->policy && __atomic_load_n( & q->overflowing, __ATOMIC_ACQUIRE)) {
+        coalesce( q, rec);
+        notify_queue_wake( q);
+        return;
+    }
+    while( ! try_push( q, rec)) {
+        notify_record_t *old;
+        switch( q->policy) {
+        case NOTIFY_POLICY_DROP_OLDEST:
+            old = try_pop( q);
+            if( old) {
+                notify_record_free( old);
+                __atomic_add_fetch( & q->dropped, 1, __ATOMIC_RELAXED);
+            }
+            break;
+        case NOTIFY_POLICY_COALESCE:
+            coalesce( q, rec);
+            notify_queue_wake( q);
+            return;
+        default:
+            /* Announce ourselves before checking again: either the consumer
+             * sees us waiting, or we see the room it made. */
+            pthread_mutex_lock( & q->lock);
+            __atomic_add_fetch( & q->waiters, 1, __ATOMIC_SEQ_CST);
+            if( try_push( q, rec)) {
+                __atomic_sub_fetch( & q->waiters, 1, __ATOMIC_SEQ_CST);
+                pthread_mutex_unlock( & q->lock);
+                notify_queue_wake( q);
+                return;
+            }
+            notify_queue_wake( q);
+            pthread_cond_wait( & q->room, & q->lock);
+            __atomic_sub_fetch( & q->waiters, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock( & q->lock);
+            break;
+        }
+    }
+    notify_queue_wake( q);
+}
+
+int notify_queue_getfd( notify_queue_t *q) {
+    return q->efd;
+}
+
+void notify_queue_ack( notify_queue_t *q) {
+    uint64_t n;
+    ssize_t r = read( q->efd, & n, sizeof( n));
+    (void) r;
+    __atomic_store_n( & q->signaled, 0, __ATOMIC_SEQ_CST);
+}
+
+notify_record_t *notify_queue_pop( notify_queue_t *q) {
+    notify_record_t *rec;
+
+    /* The overflow list taken over holds values more recent than anything in the ring. */
+    if( (rec = q->pending)) {
+        q->pending = rec->next;
+        return rec;
+    }
+    if( (rec = try_pop( q))) {
+        __atomic_thread_fence( __ATOMIC_SEQ_CST);
+        if( __atomic_load_n( & q->waiters, __ATOMIC_RELAXED)) {
+            pthread_mutex_lock( & q->lock);
+            pthread_cond_broadcast( & q->room);
+            pthread_mutex_unlock( & q->lock);
+        }
+        return rec;
+    }
+    if( __atomic_load_n( & q->overflowing, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock( & q->lock);
+        q->pending  = q->overflow;
+        q->overflow = NULL;
+        __atomic_store_n( & q->overflowing, 0, __ATOMIC_RELEASE);
+        pthread_mutex_unlock( & q->lock);
+        if( (rec = q->pending)) q->pending = rec->next;
+    }
+    return rec;
+}
+
+void notify_queue_stats( notify_queue_t *q, unsigned *dropped, unsigned *coalesced) {
+    *dropped = __atomic_load_n( & q->dropped, __ATOMIC_RELAXED);
+    pthread_mutex_lock( & q->lock);
+    *coalesced = q->coalesced;
+    pthread_mutex_unlock( & q->lock);
+}
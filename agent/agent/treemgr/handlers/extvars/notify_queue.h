@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* Queue of the variable change notifications sent by ExtVars handlers,
+ * from any thread, to the Lua VM.
+ *
+ * Producers copy their notification into a record and push it into a bounded
+ * lock-free ring; they never wait for the Lua VM unless the ring is full and
+ * the queue policy is NOTIFY_POLICY_BLOCK. The consumer is woken up through
+ * an eventfd, to be watched by the scheduler, and pops records in batches.
+ *
+ * When the ring is full, depending on the policy, producers:
+ * - NOTIFY_POLICY_BLOCK:       wait until the consumer makes room;
+ * - NOTIFY_POLICY_DROP_OLDEST: drop the oldest queued record;
+ * - NOTIFY_POLICY_COALESCE:    store the notification in an overflow list, in
+ *   which only the last value of each variable is kept; the overflow list is
+ *   delivered after the ring, and takes every notification until then so
+ *   that the order of the values is preserved. */
+
+#ifndef NOTIFY_QUEUE_H_
+#define NOTIFY_QUEUE_H_
+
+#include "extvars.h"
+
+typedef enum notify_policy_t {
+    NOTIFY_POLICY_BLOCK,
+    NOTIFY_POLICY_DROP_OLDEST,
+    NOTIFY_POLICY_COALESCE
+} notify_policy_t;
+
+/* A notification, copied from the arguments of ExtVars_notify_t in a single
+ * memory chunk (strings included). */
+typedef struct notify_record_t {
+    void                   *ctx;    // opaque handler context
+    int                     nvars;
+    ExtVars_id_t           *vars;
+    void                  **values;
+    ExtVars_type_t         *types;
+    struct notify_record_t *next;   // used in the overflow list
+} notify_record_t;
+
+typedef struct notify_queue_t notify_queue_t;
+
+/* Copy a notification into a new record; NULL when out of memory. */
+notify_record_t *notify_record_new( void *ctx, int nvars, ExtVars_id_t *vars, void **values, ExtVars_type_t *types);
+void notify_record_free( notify_record_t *rec);
+
+/* Create a queue of `size` records, rounded up to a power of 2.
+ * @return SWI_STATUS_OK, SWI_STATUS_ALLOC_FAILED, SWI_STATUS_RESOURCE_INITIALIZATION_FAILED */
+swi_status_t notify_queue_new( notify_queue_t **q, unsigned size, notify_policy_t policy);
+void notify_queue_destroy( notify_queue_t *q);
+
+/* Push a record, the queue takes its ownership. Only blocks with NOTIFY_POLICY_BLOCK
+ * when the ring is full. */
+void notify_queue_push( notify_queue_t *q, notify_record_t *rec);
+
+/* Consumer side: acknowledge the wake up, to be called before popping the
+ * records once the file descriptor is found readable. */
+int notify_queue_getfd( notify_queue_t *q);
+void notify_queue_ack( notify_queue_t *q);
+
+/* Make the file descriptor readable, unless it already is. Producers call it
+ * for each record pushed; the consumer calls it to handle the rest of the
+ * records later. */
+void notify_queue_wake( notify_queue_t *q);
+
+/* Consumer side: next record, NULL when the queue is empty. The caller
+ * frees the record. */
+notify_record_t *notify_queue_pop( notify_queue_t *q);
+
+/* Number of records dropped (NOTIFY_POLICY_DROP_OLDEST) and of values
+ * overwritten (NOTIFY_POLICY_COALESCE) so far. */
+void notify_queue_stats( notify_queue_t *q, unsigned *dropped, unsigned *coalesced);
+
+#endif /* NOTIFY_QUEUE_H_ */
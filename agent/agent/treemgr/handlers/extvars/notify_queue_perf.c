@@ -0,0 +1,197 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Benchmark of the ExtVars notification queue.
+ *
+ * Producer threads send notifications of one integer variable to a consumer
+ * thread which stands for the Lua VM: it waits for the queue's eventfd, then
+ * spends `wakeup` microseconds for the scheduler round and `cost` microseconds
+ * per notification. Reports the time spent by the producers in each
+ * notification, and the overall throughput, for every queue policy and for
+ * the former hand-off, where each producer waits until the Lua VM handled its
+ * notification (mutex + socket signal + semaphore).
+ *
+ * Usage: notify_queue_perf [producers] [notifications per producer] [queue size] [cost us] [wakeup us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "notify_queue.h"
+
+#define MODE_HANDOFF 3
+
+static const char *const mode_names[] = { "block", "dropoldest", "coalesce", "handoff" };
+
+static int nproducers = 8, count = 20000, qsize = 256;
+static double cost = 2e-6, wakeup = 20e-6;
+
+static notify_queue_t *queue;
+static volatile int done;
+static unsigned long handled;
+
+/* Hand-off: one notification in flight at a time. */
+static pthread_mutex_t inprogress = PTHREAD_MUTEX_INITIALIZER;
+static sem_t ready, handoff_done;
+static int signalfds[2];
+
+static double now( void) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, & ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void spin( double t) {
+    double end = now() + t;
+    while( now() < end);
+}
+
+static int cmpdouble( const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+typedef struct {
+    int     id;
+    int     mode;
+    double *lat;
+} producer_t;
+
+static void *producer( void *arg) {
+    producer_t *p = arg;
+    int i;
+    for( i = 0; i < count; i++) {
+        ExtVars_id_t var = p->id * 16 + i % 16;
+        ExtVars_type_t type = EXTVARS_TYPE_INT;
+        void *value = & i;
+        double t = now();
+        if( MODE_HANDOFF == p->mode) {
+            char c = 0;
+            pthread_mutex_lock( & inprogress);
+            if( write( signalfds[1], & c, 1) != 1) abort();
+            sem_wait( & handoff_done);
+            pthread_mutex_unlock( & inprogress);
+        } else {
+            notify_queue_push( queue, notify_record_new( p, 1, & var, & value, & type));
+        }
+        p->lat[i] = now() - t;
+    }
+    return NULL;
+}
+
+static void *consumer( void *arg) {
+    int mode = *(int *) arg;
+    struct pollfd pfd;
+    pfd.fd     = MODE_HANDOFF == mode ? signalfds[0] : notify_queue_getfd( queue);
+    pfd.events = POLLIN;
+    sem_post( & ready);
+    for( ;;) {
+        if( poll( & pfd, 1, 10) <= 0) {
+            if( done) break;
+            continue;
+        }
+        spin( wakeup);
+        if( MODE_HANDOFF == mode) {
+            char c;
+            if( read( signalfds[0], & c, 1) == 1) {
+                spin( cost);
+                handled++;
+                sem_post( & handoff_done);
+            }
+        } else {
+            notify_record_t *rec;
+            int n = 0;
+            notify_queue_ack( queue);
+            /* Same batches as the Lua side */
+            while( n < 64 && (rec = notify_queue_pop( queue))) {
+                spin( cost * rec->nvars);
+                handled += rec->nvars;
+                notify_record_free( rec);
+                n++;
+            }
+            if( 64 == n) notify_queue_wake( queue);
+        }
+    }
+    return NULL;
+}
+
+static void run( int mode) {
+    pthread_t cons, *prods = malloc( nproducers * sizeof( *prods));
+    producer_t *p = malloc( nproducers * sizeof( *p));
+    double *lat = malloc( (size_t) nproducers * count * sizeof( *lat));
+    unsigned dropped = 0, coalesced = 0;
+    double t0, t;
+    int i, n = nproducers * count;
+
+    done = 0;
+    handled = 0;
+    if( MODE_HANDOFF == mode) {
+        if( pipe( signalfds)) abort();
+    } else if( notify_queue_new( & queue, qsize, (notify_policy_t) mode)) {
+        abort();
+    }
+    pthread_create( & cons, NULL, consumer, & mode);
+    sem_wait( & ready);
+
+    t0 = now();
+    for( i = 0; i < nproducers; i++) {
+        p[i].id   = i;
+        p[i].mode = mode;
+        p[i].lat  = lat + (size_t) i * count;
+        pthread_create( prods + i, NULL, producer, p + i);
+    }
+    for( i = 0; i < nproducers; i++) pthread_join( prods[i], NULL);
+    t = now() - t0;
+    done = 1;
+    pthread_join( cons, NULL);
+
+    if( MODE_HANDOFF == mode) {
+        close( signalfds[0]);
+        close( signalfds[1]);
+    } else {
+        notify_queue_stats( queue, & dropped, & coalesced);
+        notify_queue_destroy( queue);
+    }
+
+    qsort( lat, n, sizeof( *lat), cmpdouble);
+    printf( "%-10s: %9.0f notifs/s, producer p50 %7.2fus p99 %8.2fus max %9.1fus, handled %lu dropped %u coalesced %u\n",
+        mode_names[mode], n / t, lat[n / 2] * 1e6, lat[(size_t) n * 99 / 100] * 1e6, lat[n - 1] * 1e6,
+        handled, dropped, coalesced);
+    free( lat);
+    free( p);
+    free( prods);
+}
+
+int main( int argc, char **argv) {
+    int mode;
+    if( argc > 1) nproducers = atoi( argv[1]);
+    if( argc > 2) count      = atoi( argv[2]);
+    if( argc > 3) qsize      = atoi( argv[3]);
+    if( argc > 4) cost       = atof( argv[4]) * 1e-6;
+    if( argc > 5) wakeup     = atof( argv[5]) * 1e-6;
+    if( nproducers < 1 || count < 1 || qsize < 2) {
+        printf( "usage: notify_queue_perf [producers] [notifications per producer] [queue size] [cost us] [wakeup us]\n");
+        return 1;
+    }
+    sem_init( & ready, 0, 0);
+    sem_init( & handoff_done, 0, 0);
+    printf( "%d producers x %d notifications, queue size %d, %.1fus per notification, %.1fus per wakeup\n",
+        nproducers, count, qsize, cost * 1e6, wakeup * 1e6);
+    for( mode = NOTIFY_POLICY_BLOCK; mode <= MODE_HANDOFF; mode++) run( mode);
+    return 0;
+}
@@ -233,6 +233,19 @@ swi_status_t ExtVars_set_variables(int nvars, ExtVars_id_t *vars, void **values,
     return SWI_STATUS_OK;
 }
 
+/* This function is called when treemgr gets several leaves at once, e.g. when
+ * reading the whole tree; it is optional, ExtVars_get_variable is called for each
+ * leaf otherwise */
+swi_status_t ExtVars_get_variables (int nvars, ExtVars_id_t *vars, void **values, ExtVars_type_t *types)
+{
+    int i;
+    SWI_LOG("TREEHDL", DEBUG, "%s(%d vars)\n", __FUNCTION__, nvars);
+    for(i = 0; i < nvars; i++)
+        if(ExtVars_get_variable(vars[i], values + i, types + i) != SWI_STATUS_OK)
+            types[i] = EXTVARS_TYPE_NIL;
+    return SWI_STATUS_OK;
+}
+
 /* These functions are called when treemgr requires notifications for a specific node
    or for all existing nodes attached to the root node (treehdlsample) */
 swi_status_t ExtVars_register_variable(ExtVars_id_t id, int enable)
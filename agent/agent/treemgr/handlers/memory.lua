@@ -0,0 +1,49 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+--- Read-only handler exposing the statistics of the Lua VM allocator
+--  (see module `memory`): `total`, `peak`, `limit`, `large`, `failures`,
+--  `classes.<size>.{pages,used}` and `owners.<name>.{bytes,peak,allocs}`.
+--  `limit` is writable.
+--  When the VM does not run on the pooled allocator, only `total`, as given
+--  by the garbage collector, is available.
+
+local memory   = require 'memory'
+local pathutils = require 'utils.path'
+
+local M = { }
+
+local function stats()
+    return memory.stats() or { total = math.floor(collectgarbage 'count' * 1024) }
+end
+
+function M :get(hpath)
+    local data = stats()
+    if hpath ~= '' then data = pathutils.get(data, hpath) end
+    if data == nil then return nil, "invalid path"
+    elseif type(data) ~= 'table' then return data end
+    local children = { }
+    for k, _ in pairs(data) do children[tostring(k)] = true end
+    return nil, children
+end
+
+function M :set(hmap)
+    for hpath, value in pairs(hmap) do
+        if hpath ~= 'limit' or not tonumber(value) then return nil, "non-writable path" end
+        if not memory.setlimit(tonumber(value)) then return nil, "pooled allocator not in use" end
+    end
+    return true
+end
+
+function M :register() end
+function M :unregister() end
+
+return M
@@ -0,0 +1,58 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+--- Handler exposing the scheduler profiler (see module `sched.profiler`):
+--  `running` and `sampling` control it, and are writable; writing `reset`
+--  drops the statistics. Statistics are read-only lists, sorted as in
+--  `sched.profiler.stats()`: `tasks.<i>.{name,time,runs,maxrun}`,
+--  `hooks.<i>.{name,time,runs,maxrun}` and `signals.<i>.{emitter,event,count}`.
+--  `folded` holds the stack samples in the folded format.
+
+local profiler  = require 'sched.profiler'
+local pathutils = require 'utils.path'
+
+local M = { }
+
+local function data()
+    local d = profiler.stats()
+    d.running, d.sampling = profiler.running()
+    d.folded = profiler.folded()
+    return d
+end
+
+function M :get(hpath)
+    local d = data()
+    if hpath ~= '' then d = pathutils.get(d, hpath) end
+    if d == nil then return nil, "invalid path"
+    elseif type(d) ~= 'table' then return d end
+    local children = { }
+    for k, _ in pairs(d) do children[tostring(k)] = true end
+    return nil, children
+end
+
+function M :set(hmap)
+    for hpath, value in pairs(hmap) do
+        if hpath == 'running' then
+            if value and value ~= 0 then profiler.start(select(2, profiler.running()))
+            else profiler.stop() end
+        elseif hpath == 'sampling' and tonumber(value) then
+            profiler.start(tonumber(value))
+        elseif hpath == 'reset' then
+            profiler.reset()
+        else return nil, "non-writable path" end
+    end
+    return true
+end
+
+function M :register() end
+function M :unregister() end
+
+return M
@@ -160,6 +160,11 @@
 --    `{ 'x', 'y' }` is not. The path toward the children must be relative
 --    to the `hpath` argument.
 --
+-- * `handler:getall(hpath)` is optional. It returns a map of every leaf value
+--   under `hpath`, indexed by paths relative to `hpath` (`{[""]=value}` for
+--   a leaf node), or nil followed by an error message. It allows to read a
+--   whole subtree with a single handler call, see `treemgr.getsubtree()`.
+--
 -- * `handler:set(hmap)` allows to write a map of `hlpath->value` pairs in the
 --   handler. It is not expected to return anything meaningful.
 --
@@ -196,6 +201,9 @@
 -- * `treemgr.get(lpath_list)` performs a batch reading, returns an lmap of
 --   values and/or a list of children node lpaths.
 --
+-- * `treemgr.getsubtree(lpath)` returns an lmap of the values of every leaf
+--   node under `lpath`, recursively.
+--
 -- * `treemgr.set(llpath, value)` sets the value of a leaf node.
 --
 -- * `treemgr.set(lpath, map)` where map keys `k_n` are strings such that
@@ -214,6 +222,12 @@
 --   hook even if it didn't change, then it needs to be listed both
 --   in `monitored_lpath_list` and in `associated_lpath_list`.
 --
+-- * `treemgr.register(lpath_list, hook, associated_lpath_list, window)`
+--   does the same, but coalesces the changes happening within `window`
+--   seconds into a single hook call, keeping the last value of each
+--   variable. Variables changed by different handlers are merged as well,
+--   and associated variables are read once for every hook due together.
+--
 -- Mapping and handler loading
 -- ===========================
 --
@@ -365,6 +379,10 @@ local db          = require 'agent.treemgr.db'; M.db = db
 local utils_table = require 'utils.table'
 local niltoken    = require 'niltoken'
 local lfs         = require 'lfs'
+local timer       = require 'timer'
+local monotonic_time = require 'sched.timer.core'.time
+require 'coxpcall'
+local copcall     = copcall
 
 require 'print'
 
@@ -401,15 +419,16 @@ end
 --  @return a list lpaths
 --local
 function hpath2lpath(handler_name, hpath)
-    local results = { }
+    local results, hprefixes, relpaths = { }, { }, { }
     -- printf("h2l: translate  %s:%s", handler_name, hpath)
     for hprefix, relpath in path.gsplit(hpath) do
-        -- printf("h2l: trying to retrieve lprefix %q from DB", hprefix)
-        for lprefix in db.h2l (handler_name, hprefix) do
-            local lpath = path.concat(lprefix, relpath)
-            -- printf("h2l: hit: lprefix = %s, relpath = %s , lpath = %s", lprefix, relpath, lpath)
-            table.insert(results, lpath)
-        end
+        table.insert(hprefixes, hprefix)
+        table.insert(relpaths, relpath)
+    end
+    for i, lprefix in db.h2lall (handler_name, hprefixes) do
+        local lpath = path.concat(lprefix, relpaths[i])
+        -- printf("h2l: hit: lprefix = %s, relpath = %s , lpath = %s", lprefix, relpaths[i], lpath)
+        table.insert(results, lpath)
     end
     return results
 end
@@ -563,6 +582,59 @@ function M.get(lpath_list, result_lmap)
     end
 end
 
+--------------------------------------------------------------------------------
+-- Retrieves the values of every leaf node under a logical path, recursively.
+--
+-- Handlers which provide a `:getall()` method return their part of the
+-- subtree in a single call; the other ones are walked node by node with
+-- `:get()`. Leaf nodes whose value is nil are not listed.
+--
+-- @param lpath the logical path of the subtree; can be a leaf node.
+-- @param result_lmap an optional table; if provided, the values are written
+--        in it rather than in a purpose-created table.
+-- @return an lmap of every leaf node value under `lpath`.
+-- @return nil, error_msg
+--
+function M.getsubtree(lpath, result_lmap)
+    checks ('string', '?table')
+    local result = result_lmap or { }
+
+    local function walk(lpath)
+        local l2h = lpath2hpath (lpath)
+        if l2h and l2h.handler.getall then
+            local hpath = path.concat(l2h.hpath, l2h.relpath)
+            local hmap, err_msg = l2h.handler :getall (hpath)
+            if not hmap then return nil, lpath..": "..tostring(err_msg) end
+            local prefix = lpath=='' and '' or lpath..'.'
+            for relpath, value in pairs(hmap) do
+                result[relpath=='' and lpath or prefix..relpath] = value
+            end
+            -- other mapping points may lie below; list them before walking
+            -- them, as db iterators can't be nested.
+            local children = { }
+            for child_lpath in db.l2c (lpath) do table.insert(children, child_lpath) end
+            for _, child_lpath in ipairs(children) do
+                local ok, err_msg = walk(child_lpath)
+                if not ok then return nil, err_msg end
+            end
+            return true
+        end
+        local value, children = M.get(lpath)
+        if value ~= nil then result[lpath] = value
+        elseif type(children)=='table' then
+            for _, child_lpath in ipairs(children) do
+                local ok, err_msg = walk(child_lpath)
+                if not ok then return nil, err_msg end
+            end
+        elseif children then return nil, lpath..": "..children end
+        return true
+    end
+
+    local ok, err_msg = walk(lpath)
+    if not ok then return nil, err_msg end
+    return result
+end
+
 --------------------------------------------------------------------------------
 -- Set values in logical tree leaf nodes.
 --
@@ -653,8 +725,13 @@ end
 --        `hook` everytime it's called, whether they changed or not,
 --        even if they're not monitored.
 --
-function M.register(monitored_lpath_list, hook, associated_lpath_list)
-    checks('string|table', 'function', '?string|table')
+-- @param window optional coalescing window, in seconds. When given, changes
+--        are accumulated for that long after the first one, and `hook` is
+--        then called once with the merged map: for a variable which changed
+--        several times, only the last value is reported.
+--
+function M.register(monitored_lpath_list, hook, associated_lpath_list, window)
+    checks('string|table', 'function', '?string|table', '?number')
 
     if type(monitored_lpath_list)=='string'
     then monitored_lpath_list = {monitored_lpath_list} end
@@ -676,7 +753,8 @@ function M.register(monitored_lpath_list, hook, associated_lpath_list)
     local hook = {
         monitored_lpath_set = list2set(monitored_lpath_list),
         f = hook,
-        associated_lpath_set = list2set(associated_lpath_list or { }) }
+        associated_lpath_set = list2set(associated_lpath_list or { }),
+        window = window and window>0 and window or nil }
 
     -- Register the hook, so that we know when it must be triggered
     for _, lpath in ipairs (monitored_lpath_list) do
@@ -723,6 +801,9 @@ function M.unregister(hook)
 
     checks('table') -- TODO: declare agent.treemgr.hook type?
 
+    -- 0/ drop the changes it may still have to be notified of
+    M.pending[hook] = nil
+
     -- 1/ remove the hook's lpaths from `M.hooks`
     for lpath, _ in pairs(hook.monitored_lpath_set) do
         local hooks_set = M.hooks[lpath]
@@ -765,16 +846,110 @@ end
 --
 --  * `monitored_lpath_set`:  set of lpaths which trigger this hook;
 --  * `associated_lpath_set`: set of lpaths mandatory in the hook's argument;
---  * `f`: function to run at each triggering.
+--  * `f`: function to run at each triggering;
+--  * `window`: coalescing window in seconds, `nil` for immediate notifications.
 --
 -- Hooks monitoring more than one lpath will be referenced more than once.
 --
 M.hooks = { }
 
+--------------------------------------------------------------------------------
+-- hook -> { lmap=changed llpath->value map, due=flush date }.
+-- Changes waiting for the coalescing window of their hook to expire.
+--
+M.pending = { }
+
+--------------------------------------------------------------------------------
+-- Select the subset of `lmap` a hook must be notified of, and add it to
+-- `hook_lmap`: later values overwrite earlier ones.
+--
+local function hook_subset(hook, lmap, hook_lmap)
+    for llpath, val in pairs(lmap) do
+        for lprefix, _ in path.gsplit(llpath) do -- listed as registered?
+            if hook.monitored_lpath_set[lprefix] or hook.associated_lpath_set[lprefix] then
+                log('TREEMGR', 'DEBUG', "Notify: llpath %q needed because of lprefix %q", llpath, lprefix)
+                hook_lmap[llpath] = val
+                break -- to the next llpath/value pair
+            end
+        end
+    end
+    return hook_lmap
+end
+
+--------------------------------------------------------------------------------
+-- Call a batch of hooks, given as a hook -> hook_lmap map.
+-- Associated lpaths missing from the maps are retrieved with a single `M.get`
+-- for the whole batch, then every hook is called once. A failing hook is
+-- logged, and doesn't prevent the other hooks of the batch from being called.
+--
+local function trigger(batch)
+
+    -- Gather the associated lpaths missing from at least one map
+    local missing, missing_set = { }, { }
+    for hook, hook_lmap in pairs(batch) do
+        for lpath, _ in pairs (hook.associated_lpath_set) do
+            if hook_lmap[lpath]==nil and not missing_set[lpath] then
+                log('TREEMGR', 'DEBUG', "Need to retrieve associated lpath %q", lpath)
+                missing_set[lpath] = true
+                table.insert(missing, lpath)
+            end
+        end
+    end
+
+    -- Beware that `M.get` will ignore non-leaf associated paths.
+    local associated_lmap = { }
+    if missing[1] then
+        local _, children = M.get(missing, associated_lmap)
+
+        -- Check for erroneous non-leaf associated paths
+        if children and next(children) then
+            -- Some associated vars were non-leaf, log an error
+            local non_llpaths = { }
+            for _, lpath in ipairs(children) do
+                local non_llpath, _ = path.split(lpath, -1)
+                non_llpaths [non_llpath] = true
+            end
+            local list = table.concat(utils_table.keys(non_llpaths), ", ")
+            log("TREEMGR", "ERROR", "Non-leaf associated path %s", list)
+        end
+    end
+
+    for hook, hook_lmap in pairs(batch) do
+        for lpath, _ in pairs (hook.associated_lpath_set) do
+            if hook_lmap[lpath]==nil then hook_lmap[lpath] = associated_lmap[lpath] end
+        end
+
+        if log.musttrace('TREEMGR', 'DEBUG') then
+            log('TREEMGR', 'DEBUG', "Notify hook with lmap %s", sprint(hook_lmap))
+        end
+
+        -- perform the hook call
+        local ok, err = copcall(hook.f, hook_lmap)
+        if not ok then log('TREEMGR', 'ERROR', "Error in notification hook: %s", tostring(err)) end
+    end
+end
+
+--------------------------------------------------------------------------------
+-- Notify the coalescing hooks whose window expired.
+-- Run by a timer, armed when a hook gets its first pending change.
+--
+function M.flush()
+    local now = monotonic_time()
+    local batch = { }
+    for hook, p in pairs(M.pending) do
+        if p.due <= now then batch[hook] = p.lmap; M.pending[hook] = nil end
+    end
+    if next(batch) then trigger(batch) end
+end
+
 --------------------------------------------------------------------------------
 -- Take a variable change notification from a handler, trigger the
 -- proper logical notifications on user-provided hooks.
 --
+-- Hooks registered without a coalescing window are called before `notify`
+-- returns; the others get the changes merged into their pending map, which
+-- is flushed by `M.flush` when their window expires.
+--
 -- @param handler the handler which triggers the notification
 -- @param hmap the hpath->value map of changed variables.
 --
@@ -811,51 +986,22 @@ function M.notify (handler_name, hmap)
             end
         end
 
-    else -- For each hook to be notified, build the argument map and call the hook
+    else -- For each hook to be notified, build the argument map
+        local batch = { } -- hook -> hook_lmap, for immediate notifications
         for hook, _ in pairs(notified_hooks) do
-
-            -- build the map #1: sort `lmap` subset relevant to this hook
-            local hook_lmap = { }
-            for llpath, val in pairs(lmap) do
-                for lprefix, _ in path.gsplit(llpath) do -- listed as registered?
-                    if hook.monitored_lpath_set[lprefix] or hook.associated_lpath_set[lprefix] then
-                        log('TREEMGR', 'DEBUG', "Notify: llpath %q needed because of lprefix %q", llpath, lprefix)
-                        hook_lmap[llpath] = val
-                        break -- to the next llpath/value pair
-                    end
+            if hook.window then
+                local p = M.pending[hook]
+                if not p then
+                    p = { lmap = { }, due = monotonic_time() + hook.window }
+                    M.pending[hook] = p
+                    timer.once(hook.window, M.flush)
                 end
+                hook_subset(hook, lmap, p.lmap)
+            else
+                batch[hook] = hook_subset(hook, lmap, { })
             end
-
-            -- build the map #2: add missing lpaths for this hook
-            -- Beware that `M.get` will ignore non-leaf associated paths.
-            local associated_lmap = { }
-            for lpath, _ in pairs (hook.associated_lpath_set) do
-                if hook_lmap[lpath]==nil then
-                    log('TREEMGR', 'DEBUG', "Need to retrieve associated lpath %q", lpath)
-                    table.insert(associated_lmap, lpath)
-                end
-            end
-            local _, children = M.get(associated_lmap, hook_lmap)
-
-            -- Check for erroneous non-leaf associated paths
-            if children and next(children) then
-                -- Some associated vars were non-leaf, log an error
-                local non_llpaths = { }
-                for _, lpath in ipairs(children) do
-                    local non_llpath, _ = path.split(lpath, -1)
-                    non_llpaths [non_llpath] = true
-                end
-                local list = table.concat(utils_table.keys(non_llpaths), ", ")
-                log("TREEMGR", "ERROR", "Non-leaf associated path %s", list)
-            end
-
-            if log.musttrace('TREEMGR', 'DEBUG') then
-                log('TREEMGR', 'DEBUG', "Notify hook with lmap %s", sprint(hook_lmap))
-            end
-
-            -- perform the hook call
-            hook.f(hook_lmap)
         end
+        if next(batch) then trigger(batch) end
     end
     return "ok"
 end
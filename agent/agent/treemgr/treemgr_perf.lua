@@ -0,0 +1,97 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Notification throughput of the tree manager: a handler reports changes of
+-- a few sensors at 1kHz overall, as extvars handlers do, and several hooks
+-- monitor them with associated variables, either notified immediately or
+-- through a coalescing window. Reports the number of hook invocations per
+-- second and the CPU time spent.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/treemgr_perf.lua [seconds of input per run]
+
+require 'strict'
+require 'sched'
+require 'print'
+rawset(_G, 'log', require 'log')
+local lfs = require 'lfs'
+local monotonic_time = require 'sched.timer.core'.time
+
+local RATE     = 1000 -- input changes per second
+local DURATION = tonumber(arg[1]) or 3
+local SENSORS  = 8
+local HOOKS    = 4
+local HANDLER  = 'agent.treemgr.handlers.ramstore'
+local HPATH    = 'sensors.s' -- mounted as perf.sensors.s
+
+-- Private treemgr databases, built from the map below only
+local root = os.tmpname(); os.remove(root); root = root .. "/"
+assert(os.execute("mkdir -p "..root.."resources && ln -s "..lfs.currentdir().."/lua "..root.."lua") == 0)
+local f = assert(io.open(root.."resources/perf.map", "w"))
+f :write("treemgr "..HANDLER.."\n\nperf=\n")
+f :close()
+LUA_AF_RO_PATH, LUA_AF_RW_PATH = root, root
+
+local treemgr = require 'agent.treemgr'
+log.setlevel('WARNING')
+
+local function run(window)
+    local calls, values = 0, 0
+    local function hook(lmap)
+        calls = calls + 1
+        for _ in pairs(lmap) do values = values + 1 end
+    end
+    local ids = { }
+    for i = 1, HOOKS do
+        ids[i] = assert(treemgr.register({'perf.sensors'}, hook,
+            {'perf.info.label', 'perf.info.unit'}, window))
+    end
+
+    -- CPU is only accounted inside the tree manager: the scheduler loop
+    -- would otherwise dominate the figures.
+    local cpu, flush = 0, treemgr.flush
+    treemgr.flush = function()
+        local c = os.clock(); flush(); cpu = cpu + os.clock() - c
+    end
+
+    -- Feed the changes by bursts of 10, every 10ms
+    local t0 = monotonic_time()
+    local n = 0
+    for tick = 1, DURATION * RATE / 10 do
+        local c = os.clock()
+        for _ = 1, 10 do
+            n = n + 1
+            treemgr.notify(HANDLER, { [HPATH..(n % SENSORS)] = n })
+        end
+        cpu = cpu + os.clock() - c
+        sched.wait(0.01)
+    end
+    local elapsed = monotonic_time() - t0
+    if window then sched.wait(2 * window) end -- let the last windows expire
+    treemgr.flush = flush
+
+    for _, id in ipairs(ids) do assert(treemgr.unregister(id)) end
+    printf("window %-6s: %6d changes, %6d hook calls (%7.1f/s), %6d values, treemgr cpu %.3fs (%.1f%%)",
+        tostring(window or "none"), n, calls, calls / elapsed, values, cpu, 100 * cpu / elapsed)
+    return calls
+end
+
+sched.run(function()
+    assert(treemgr.set('perf.info', { label = 'perf', unit = 'mV' }))
+    local immediate = run(nil)
+    local coalesced = run(0.1)
+    local slow      = run(1)
+    assert(coalesced < immediate and slow < coalesced)
+    os.execute("rm -rf "..root)
+    os.exit(0)
+end)
+sched.loop()
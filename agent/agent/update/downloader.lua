@@ -21,6 +21,7 @@ local config = require"agent.config"
 local log = require"log"
 local sched = require"sched"
 local timer = require"timer"
+local worker = require"sched.worker"
 --this time function is not affected by date adjustment, perfect for periodic action
 local monotonic_time = require 'sched.timer.core'.time
 local data = common.data
@@ -77,18 +78,10 @@ local function existingfile(filename)
     end
 end
 
---compute md5 from an existing file
+--compute md5 from an existing file, in a worker thread
 --use empty md5 context created outside
 local function compute_md5 (md5, file)
-    local size = 2048
-    local f = io.open(file, "r")
-    local read = f:read(size)
-    while read do
-        md5:update(read)
-        read = f:read(size)
-    end
-    f:close(file)
-    return md5
+    return assert(worker.run(md5:filejob(file)))
 end
 
 --internal function used in start_m3da_download
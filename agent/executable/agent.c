@@ -12,12 +12,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
 
 #include "version.h"
+#include "lmempool.h"
 
 // LUA_AF_RO_PATH: This is the location used for read only components like binaries, libraries, resources
 // LUA_AF_RF_PATH: This is the location used for persisted data or components which need to be saved for future usage like:
@@ -46,9 +48,73 @@ static void envsetup(lua_State *L)
   lua_setglobal(L, "LUA_AF_RW_PATH");
 }
 
+// Path of the precompiled bytecode bundle (built by the agent_bundle target),
+// relative to the agent runtime directory. Can be overridden with LUA_AF_BUNDLE.
+#define AGENT_BUNDLE_PATH "lua/agent.bundle"
+
+// When a bytecode bundle is available, register it as a module searcher so that
+// the boot sequence does not search package.path for every module.
+// Any failure falls back silently to the regular searchers.
+static void bundlesetup(lua_State *L)
+{
+  const char *path = getenv("LUA_AF_BUNDLE");
+  if (!path)
+    path = AGENT_BUNDLE_PATH;
+  if (access(path, R_OK))
+    return;
+
+  lua_getglobal(L, "require");
+  lua_pushstring(L, "loader");
+  if (lua_pcall(L, 1, 1, 0))
+  {
+    printf("Bundle %s not used: %s\n", path, lua_tostring(L, -1));
+    lua_pop(L, 1);
+    return;
+  }
+  lua_getfield(L, -1, "bundle");
+  lua_pushstring(L, path);
+  if (lua_pcall(L, 1, 2, 0))
+  {
+    printf("Bundle %s not used: %s\n", path, lua_tostring(L, -1));
+    lua_pop(L, 2);
+    return;
+  }
+  if (lua_isnil(L, -2))
+    printf("Bundle %s not used: %s\n", path, lua_tostring(L, -1));
+  lua_pop(L, 3);
+}
+
+static int panic(lua_State *L)
+{
+  printf("PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+  return 0;
+}
+
+// The VM runs on the pooled allocator (see luafwk/memory), bounded by
+// LUA_AF_MEMLIMIT bytes when this variable is set.
+static lua_State *newstate(lmp_pool_t **pool)
+{
+  const char *limit = getenv("LUA_AF_MEMLIMIT");
+  lua_State *L;
+
+  *pool = lmp_new(limit ? strtoul(limit, NULL, 0) : 0);
+  if (!*pool)
+    return NULL;
+  L = lua_newstate(lmp_alloc, *pool);
+  if (L)
+    lua_atpanic(L, panic);
+  return L;
+}
+
 int main(void)
 {
-  lua_State *L = luaL_newstate();
+  lmp_pool_t *pool;
+  lua_State *L = newstate(&pool);
+  if (!L)
+  {
+    printf("Cannot create Lua state\n");
+    return 1;
+  }
   luaL_openlibs(L);
 
 #ifdef AWT_USE_PRELOADED_LIBS
@@ -57,6 +123,7 @@ int main(void)
 #endif
 
   envsetup(L);
+  bundlesetup(L);
 
   lua_getglobal(L, "debug");
   lua_getfield(L, -1, "traceback");
@@ -75,5 +142,6 @@ int main(void)
     printf("Application finished normally.\n");
 
   lua_close(L);
+  lmp_delete(pool);
   return s;
 }
@@ -0,0 +1,100 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Pack all the Lua modules found under a Lua library directory into a single
+-- bytecode bundle, to be registered at startup with loader.bundle().
+--
+-- The bundle is a cdb file: keys are module names (as given to require),
+-- values are the path of the module source relative to luadir, its
+-- modification time and the string.dump() of the module main chunk, separated
+-- by '\0'. At load time, modules whose source was modified since are loaded
+-- from package.path instead. Chunks are named after their path relative to
+-- luadir, so that the bundle does not depend on where it was built, and error
+-- messages and debug info look the same with or without it.
+--
+-- Usage:
+--     lua mkbundle.lua luadir bundlefile [excludedprefix...]
+--
+-- luadir is typically the runtime/lua directory of a build; the 'tests'
+-- subtree is always excluded.
+
+local luadir, output = arg[1], arg[2]
+if not luadir or not output then
+    io.stderr:write("Usage:\n\tlua mkbundle.lua luadir bundlefile [excludedprefix...]\n")
+    os.exit(1)
+end
+
+-- lfs and cdb_make are taken from the library directory being bundled
+package.cpath = luadir.."/?.so;"..package.cpath
+local lfs = require 'lfs'
+local cdb_make = require 'cdb_make'
+
+local excluded = { 'tests' }
+for i = 3, #arg do excluded[#excluded+1] = arg[i] end
+
+local function isexcluded(rel)
+    for _, prefix in ipairs(excluded) do
+        if rel == prefix or rel:sub(1, #prefix+1) == prefix..'/' then return true end
+    end
+    return false
+end
+
+-- module name -> { file, relpath, prio }; 'x.lua' wins over 'x/init.lua', as in package.path
+local modules = {}
+
+local function walk(dir, rel)
+    for entry in lfs.dir(dir) do
+        if entry ~= '.' and entry ~= '..' then
+            local path = dir..'/'..entry
+            local relpath = rel and rel..'/'..entry or entry
+            local mode = lfs.attributes(path, 'mode')
+            if mode == 'directory' then
+                if not isexcluded(relpath) then walk(path, relpath) end
+            elseif mode == 'file' and relpath:match('%.lua$') and not isexcluded(relpath) then
+                local name, prio = relpath:match('^(.*)/init%.lua$'), 1
+                if not name then name, prio = relpath:sub(1, -5), 2 end
+                name = name:gsub('/', '.')
+                local m = modules[name]
+                if not m or m.prio < prio then modules[name] = { file = path, relpath = relpath, prio = prio } end
+            end
+        end
+    end
+end
+
+walk(luadir)
+
+local names = {}
+for name in pairs(modules) do names[#names+1] = name end
+table.sort(names)
+
+local db = assert(cdb_make.start(output, output..'.tmp'))
+local count, size = 0, 0
+for _, name in ipairs(names) do
+    local m = modules[name]
+    local file, f, err = io.open(m.file, 'rb')
+    if file then
+        f, err = loadstring(file:read('*a'), '@'..m.relpath)
+        file:close()
+    end
+    if f then
+        local bc = string.dump(f)
+        local mtime = string.format("%.0f", lfs.attributes(m.file, 'modification'))
+        local errno, err = db:add(name, m.relpath.."\0"..mtime.."\0"..bc)
+        if errno then error("cannot add module "..name..": "..err) end
+        count, size = count + 1, size + #bc
+    else
+        io.stderr:write("skipping module "..name..": "..tostring(err).."\n")
+    end
+end
+local errno, err = db:finish()
+if errno then error("cannot write "..output..": "..err) end
+
+print(string.format("Bundled %d modules (%d bytes of bytecode) into %s", count, size, output))
@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Benchmark of device tree reads, with and without the local cache.
+ *
+ * Sets variables config.dt_perf.var<i>, then reads all of them in a loop, as
+ * a control loop does, one swi_dt_Get per variable, and reports the reads per
+ * second without the cache, then with it. The agent must be running.
+ *
+ * Usage: dt_perf [variables] [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "swi_devicetree.h"
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double bench(int vars, int rounds, char (*names)[32])
+{
+  swi_dset_Iterator_t *set;
+  double t = now();
+  int i, r;
+
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < vars; i++)
+    {
+      if (swi_dt_Get(names[i], &set) != SWI_STATUS_OK)
+        return 0;
+      swi_dset_Destroy(set);
+    }
+  return vars * rounds / (now() - t);
+}
+
+int main(int argc, char **argv)
+{
+  int vars = argc > 1 ? atoi(argv[1]) : 50;
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+  char (*names)[32];
+  double uncached, cached;
+  int i;
+
+  if (vars < 1 || rounds < 1)
+  {
+    printf("usage: dt_perf [variables] [rounds]\n");
+    return 1;
+  }
+  if (swi_dt_Init() != SWI_STATUS_OK)
+    return 1;
+  names = malloc(vars * sizeof(*names));
+  for (i = 0; i < vars; i++)
+  {
+    sprintf(names[i], "config.dt_perf.var%d", i);
+    if (swi_dt_SetInteger(names[i], i) != SWI_STATUS_OK)
+      return 1;
+  }
+
+  uncached = bench(vars, rounds, names);
+  swi_dt_SetCache(SWI_DT_CACHE_NO_EXPIRY);
+  bench(vars, 1, names); // registers the variables
+  cached = bench(vars, rounds * 100, names);
+  printf("%d variables: uncached %10.0f reads/s, cached %10.0f reads/s\n", vars, uncached, cached);
+
+  swi_dt_SetNull("config.dt_perf");
+  swi_dt_Destroy();
+  free(names);
+  return uncached && cached ? 0 : 1;
+}
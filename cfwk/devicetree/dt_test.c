@@ -182,6 +182,53 @@ static swi_status_t test_dt_MultipleGet()
   return 0;
 }
 
+static swi_status_t test_dt_Cache()
+{
+  swi_status_t res;
+  swi_dset_Iterator_t *set;
+  int i;
+
+  if (swi_dt_SetCache(-2) != SWI_STATUS_WRONG_PARAMS)
+    return 1;
+  res = swi_dt_SetCache(SWI_DT_CACHE_NO_EXPIRY);
+  if (res != SWI_STATUS_OK)
+    return res;
+  res = swi_dt_SetCacheTTL("config.tata", 0);
+  if (res != SWI_STATUS_OK)
+    return res;
+
+  // Read from the agent, then from the cache
+  for (i = 0; i < 2; i++)
+  {
+    res = test_dt_Get();
+    if (res != SWI_STATUS_OK)
+      return res;
+    res = test_dt_MultipleGet();
+    if (res != SWI_STATUS_OK)
+      return res;
+  }
+
+  // Variables set are read again
+  res = swi_dt_SetInteger("config.toto", 42);
+  if (res != SWI_STATUS_OK)
+    return res;
+  res = swi_dt_Get("config.toto", &set);
+  if (res != SWI_STATUS_OK)
+    return res;
+  swi_dset_Next(set);
+  if (swi_dset_GetType(set) != SWI_DSET_INTEGER || swi_dset_ToInteger(set) != 42)
+    return 2;
+  swi_dset_Destroy(set);
+  res = swi_dt_SetString("config.toto", "toto");
+  if (res != SWI_STATUS_OK)
+    return res;
+
+  res = swi_dt_SetCache(0);
+  if (res != SWI_STATUS_OK)
+    return res;
+  return test_dt_Get();
+}
+
 static swi_status_t test_dt_SetTypes()
 {
   swi_status_t res;
@@ -261,6 +308,7 @@ int main(void)
   CHECK_TEST(test_dt_Get());
   CHECK_TEST(test_dt_MultipleGet());
   CHECK_TEST(test_dt_Unregister(regId));
+  CHECK_TEST(test_dt_Cache());
   CHECK_TEST(test_dt_SetTypes());
 
   CHECK_TEST(test_dt_Destroy());
@@ -11,6 +11,7 @@
 
 #define _GNU_SOURCE // this is required for strndup, which might cause warnings depending on the used toolchains
 #include <string.h>
+#include <time.h>
 #include <arpa/inet.h>
 #include "swi_devicetree.h"
 #include "swi_log.h"
@@ -36,6 +37,8 @@ typedef struct cb_list
 } cb_list_t;
 
 static swi_status_t empNotifyVariables(uint32_t payloadsize, char *payload);
+static void cache_notify(const char *regId, yajl_val vars);
+static void cache_invalidate(const char *path);
 
 static cb_list_t *cb_list;
 static EmpCommand empCmds[] = { EMP_NOTIFYVARIABLES };
@@ -75,6 +78,7 @@ static swi_status_t empNotifyVariables(uint32_t payloadsize, char *payload)
   SWI_LOG("DT", DEBUG, "%s: payload=%.*s, payloadsize=%u\n", __FUNCTION__, payloadsize, payload, payloadsize);
 
   regId = yval->u.array.values[0]->u.string;
+  cache_notify(regId, yval->u.array.values[1]);
 
   for (i = 0; i < yval->u.array.values[1]->u.object.len; i++)
   {
@@ -196,6 +200,7 @@ static swi_status_t setVariable(const char *pathPtr, void *valuePtr, int type)
     return res;
   }
   free(respPayload);
+  cache_invalidate(pathPtr);
   return SWI_STATUS_OK;
 }
 
@@ -228,11 +233,471 @@ quit:
   return res;
 }
 
+static swi_status_t send_unregister(const char *regId)
+{
+  swi_status_t res;
+  char* payload, *respPayload = NULL;
+  size_t payloadLen;
+  uint32_t respPayloadLen = 0;
+  yajl_gen gen;
+
+  YAJL_GEN_ALLOC(gen);
+  YAJL_GEN_STRING(regId, "regId");
+  YAJL_GEN_GET_BUF(payload, payloadLen);
+
+  res = emp_send_and_wait_response(EMP_DEREGISTERVARIABLE, 0, payload, payloadLen, &respPayload, &respPayloadLen);
+  yajl_gen_clear(gen);
+  yajl_gen_free(gen);
+
+  if (SWI_STATUS_OK != res)
+  {
+    SWI_LOG("DT", ERROR, "%s: failed to send EMP cmd, res = %d\n", __FUNCTION__, res);
+    if (respPayload)
+      SWI_LOG("DT", ERROR, "%s: respPayload = %.*s\n", __FUNCTION__, respPayloadLen, respPayload);
+  }
+  free(respPayload);
+  return res;
+}
+
+/*
+ * Local cache of the variables read, see swi_dt_SetCache.
+ *
+ * The first read of a variable registers for its changes, before reading it
+ * so that no change is missed; the notified changes then update the cached
+ * value. Entries are kept in a hash table of CACHE_BUCKETS lists, protected
+ * by cache_lock, which is never held during EMP exchanges: the epoch, bumped
+ * when the cache is flushed, tells whether the entries are still the ones
+ * the exchange was about.
+ */
+#define CACHE_BUCKETS 64
+
+typedef struct cache_entry
+{
+  char *path;
+  char *regId;             // change registration, NULL when not registered
+  int ttl;                 // seconds, SWI_DT_CACHE_NO_EXPIRY, or 0 when not cached
+  swi_dset_Type_t type;    // SWI_DSET_NIL when the value must be read from the agent
+  union { int64_t i; double d; char *s; bool b; } value;
+  time_t expiry;
+  unsigned int seq;        // bumped when a notification or a set changes the value
+  struct cache_entry *next;
+} cache_entry_t;
+
+typedef struct cache_ttl
+{
+  char *path;
+  int ttl;
+  struct cache_ttl *next;
+} cache_ttl_t;
+
+static struct
+{
+  int ttl;                 // default time to live, 0 when the cache is disabled
+  cache_ttl_t *ttls;       // time to live of the variables below some paths
+  cache_entry_t *buckets[CACHE_BUCKETS];
+  unsigned int epoch;
+} cache;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static time_t cache_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+static cache_entry_t **cache_bucket(const char *path)
+{
+  uint32_t h = 2166136261u; // FNV-1a
+  while (*path)
+    h = (h ^ (unsigned char) *path++) * 16777619u;
+  return &cache.buckets[h % CACHE_BUCKETS];
+}
+
+static cache_entry_t *cache_find(const char *path)
+{
+  cache_entry_t *e;
+  for (e = *cache_bucket(path); e; e = e->next)
+    if (!strcmp(e->path, path))
+      return e;
+  return NULL;
+}
+
+// Whether path is prefix or a variable below it
+static int cache_below(const char *path, const char *prefix)
+{
+  size_t len = strlen(prefix);
+  return !strncmp(path, prefix, len) && (path[len] == '\0' || path[len] == '.');
+}
+
+// Time to live of a variable: the one of its longest configured prefix
+static int cache_ttl(const char *path)
+{
+  cache_ttl_t *t;
+  int ttl = cache.ttl;
+  size_t len = 0;
+  for (t = cache.ttls; t; t = t->next)
+    if (cache_below(path, t->path) && strlen(t->path) >= len)
+    {
+      ttl = t->ttl;
+      len = strlen(t->path);
+    }
+  return ttl;
+}
+
+static void cache_clear(cache_entry_t *e)
+{
+  if (e->type == SWI_DSET_STRING)
+    free(e->value.s);
+  e->type = SWI_DSET_NIL;
+}
+
+// Caches a value received from the agent, null values are read again
+static void cache_set(cache_entry_t *e, yajl_val v)
+{
+  cache_clear(e);
+  if (e->ttl == 0)
+    return;
+  switch (v->type)
+  {
+    case yajl_t_string:
+      if ((e->value.s = strdup(v->u.string)) != NULL)
+        e->type = SWI_DSET_STRING;
+      break;
+    case yajl_t_number:
+      if (v->u.number.flags & YAJL_NUMBER_INT_VALID)
+      {
+        e->value.i = v->u.number.i;
+        e->type = SWI_DSET_INTEGER;
+      }
+      else
+      {
+        e->value.d = v->u.number.d;
+        e->type = SWI_DSET_FLOAT;
+      }
+      break;
+    case yajl_t_true:
+    case yajl_t_false:
+      e->value.b = v->type == yajl_t_true;
+      e->type = SWI_DSET_BOOL;
+      break;
+    default:
+      break;
+  }
+  e->expiry = cache_now() + e->ttl;
+}
+
+static swi_status_t cache_push(swi_dset_Iterator_t *set, cache_entry_t *e)
+{
+  size_t len = strlen(e->path);
+  switch (e->type)
+  {
+    case SWI_DSET_STRING:
+      return swi_dset_PushString(set, e->path, len, e->value.s, strlen(e->value.s));
+    case SWI_DSET_INTEGER:
+      return swi_dset_PushInteger(set, e->path, len, e->value.i);
+    case SWI_DSET_FLOAT:
+      return swi_dset_PushFloat(set, e->path, len, e->value.d);
+    default:
+      return swi_dset_PushBool(set, e->path, len, e->value.b);
+  }
+}
+
+// Whether the cached value of the variable can be used
+static cache_entry_t *cache_fresh(const char *path, time_t now)
+{
+  cache_entry_t *e = cache_find(path);
+  if (e == NULL || e->type == SWI_DSET_NIL || (e->ttl != SWI_DT_CACHE_NO_EXPIRY && e->expiry <= now))
+    return NULL;
+  return e;
+}
+
+// Builds the dset of the values of the variables when they are all cached,
+// returns SWI_STATUS_DA_NOT_FOUND otherwise.
+static swi_status_t cache_get(size_t numVars, const char **pathPtr, swi_dset_Iterator_t **data)
+{
+  swi_status_t res = SWI_STATUS_DA_NOT_FOUND;
+  swi_dset_Iterator_t *set;
+  time_t now = cache_now();
+  size_t i;
+
+  pthread_mutex_lock(&cache_lock);
+  if (cache.ttl == 0)
+    goto quit;
+  for (i = 0; i < numVars; i++)
+    if (!cache_fresh(pathPtr[i], now))
+      goto quit;
+  if ((res = swi_dset_Create(&set)) != SWI_STATUS_OK)
+    goto quit;
+  for (i = 0; i < numVars && res == SWI_STATUS_OK; i++)
+    res = cache_push(set, cache_fresh(pathPtr[i], now));
+  if (res == SWI_STATUS_OK)
+    *data = set;
+  else
+    swi_dset_Destroy(set);
+quit:
+  pthread_mutex_unlock(&cache_lock);
+  return res;
+}
+
+// Registers for the changes of a variable read for the first time, returns
+// the epoch of the cache and sets the sequence of the entry, both to give to
+// cache_store.
+static unsigned int cache_register(const char *path, unsigned int *seq)
+{
+  cache_entry_t *e, **bucket;
+  unsigned int epoch;
+  int ttl;
+  char *payload, *regId = NULL;
+  size_t payloadLen;
+  swi_status_t res = SWI_STATUS_ALLOC_FAILED;
+  yajl_gen gen;
+
+  pthread_mutex_lock(&cache_lock);
+  epoch = cache.epoch;
+  e = cache.ttl ? cache_find(path) : NULL;
+  *seq = e ? e->seq : 0;
+  if (cache.ttl == 0 || e || (e = calloc(1, sizeof(*e))) == NULL)
+  {
+    pthread_mutex_unlock(&cache_lock);
+    return epoch;
+  }
+  e->path = strdup(path);
+  if (e->path == NULL)
+  {
+    free(e);
+    pthread_mutex_unlock(&cache_lock);
+    return epoch;
+  }
+  bucket = cache_bucket(path);
+  e->ttl = ttl = cache_ttl(path);
+  e->type = SWI_DSET_NIL;
+  e->next = *bucket;
+  *bucket = e;
+  // once unlocked, a TTL change may free the entry: only path is used below
+  pthread_mutex_unlock(&cache_lock);
+  if (ttl == 0)
+    return epoch;
+
+  // [[path], [], 0]: notified without coalescing window
+  gen = yajl_gen_alloc(NULL);
+  if (gen != NULL)
+  {
+    yajl_gen_array_open(gen);
+    yajl_gen_array_open(gen);
+    yajl_gen_string(gen, (const unsigned char *) path, strlen(path));
+    yajl_gen_array_close(gen);
+    yajl_gen_array_open(gen);
+    yajl_gen_array_close(gen);
+    yajl_gen_integer(gen, 0);
+    yajl_gen_array_close(gen);
+    if (yajl_gen_get_buf(gen, (const unsigned char **) &payload, &payloadLen) == yajl_gen_status_ok)
+      res = send_register_payload(payload, payloadLen, &regId);
+    yajl_gen_free(gen);
+  }
+  if (res != SWI_STATUS_OK)
+    SWI_LOG("DT", DEBUG, "%s: cannot register %s for caching, res = %d\n", __FUNCTION__, path, res);
+
+  // The entry may have been dropped meanwhile, the registration is then
+  // cancelled
+  pthread_mutex_lock(&cache_lock);
+  e = cache_find(path);
+  if (e)
+    *seq = e->seq;
+  if (epoch == cache.epoch && e && e->regId == NULL && e->ttl != 0)
+  {
+    if (res == SWI_STATUS_OK)
+      e->regId = regId;
+    else
+      e->ttl = 0;
+    regId = NULL;
+  }
+  pthread_mutex_unlock(&cache_lock);
+  if (regId)
+    send_unregister(regId);
+  free(regId);
+  return epoch;
+}
+
+// Caches the value of a variable read from the agent. The value is dropped
+// when the variable was notified or set since seq was taken: it may be older
+// than the cached one. The variable is not cached anymore when it is a node:
+// its registration is cancelled.
+static void cache_store(const char *path, yajl_val v, unsigned int epoch, unsigned int seq)
+{
+  cache_entry_t *e;
+  char *regId = NULL;
+
+  pthread_mutex_lock(&cache_lock);
+  if (epoch == cache.epoch && (e = cache_find(path)) != NULL)
+  {
+    if (v)
+    {
+      if (e->seq == seq)
+        cache_set(e, v);
+    }
+    else
+    {
+      e->ttl = 0;
+      regId = e->regId;
+      e->regId = NULL;
+    }
+  }
+  pthread_mutex_unlock(&cache_lock);
+  if (regId)
+    send_unregister(regId);
+  free(regId);
+}
+
+static void cache_notify(const char *regId, yajl_val vars)
+{
+  cache_entry_t *e;
+  size_t i;
+
+  if (!YAJL_IS_OBJECT(vars))
+    return;
+  pthread_mutex_lock(&cache_lock);
+  for (i = 0; i < vars->u.object.len; i++)
+  {
+    e = cache_find(vars->u.object.keys[i]);
+    if (e && e->regId && !strcmp(e->regId, regId))
+    {
+      cache_set(e, vars->u.object.values[i]);
+      e->seq++;
+    }
+  }
+  pthread_mutex_unlock(&cache_lock);
+}
+
+// Drops the cached values of a path and of the variables below it
+static void cache_invalidate(const char *path)
+{
+  cache_entry_t *e;
+  int i;
+
+  pthread_mutex_lock(&cache_lock);
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    for (e = cache.buckets[i]; e; e = e->next)
+      if (cache_below(e->path, path))
+      {
+        cache_clear(e);
+        e->seq++;
+      }
+  pthread_mutex_unlock(&cache_lock);
+}
+
+// Drops every entry. When unregister is set, the registrations are cancelled,
+// otherwise they are lost with the connection to the agent.
+static void cache_flush(int unregister)
+{
+  cache_entry_t *e, *next, *entries = NULL;
+  int i;
+
+  pthread_mutex_lock(&cache_lock);
+  for (i = 0; i < CACHE_BUCKETS; i++)
+  {
+    for (e = cache.buckets[i]; e; e = next)
+    {
+      next = e->next;
+      e->next = entries;
+      entries = e;
+    }
+    cache.buckets[i] = NULL;
+  }
+  cache.epoch++;
+  pthread_mutex_unlock(&cache_lock);
+
+  for (e = entries; e; e = next)
+  {
+    next = e->next;
+    if (unregister && e->regId)
+      send_unregister(e->regId);
+    cache_clear(e);
+    free(e->regId);
+    free(e->path);
+    free(e);
+  }
+}
+
+// Applies the time to live settings to the variables already read. The
+// ones which are not registered are dropped, to be registered if needed
+// when read again.
+static void cache_update_ttls()
+{
+  cache_entry_t *e, **p;
+  time_t now = cache_now();
+  int i;
+
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    for (p = &cache.buckets[i]; (e = *p) != NULL; )
+    {
+      if (e->regId == NULL)
+      {
+        *p = e->next;
+        free(e->path);
+        free(e);
+        continue;
+      }
+      e->ttl = cache_ttl(e->path);
+      if (e->ttl == 0)
+        cache_clear(e);
+      else if (e->ttl != SWI_DT_CACHE_NO_EXPIRY && e->expiry > now + e->ttl)
+        e->expiry = now + e->ttl;
+      p = &e->next;
+    }
+}
+
+swi_status_t swi_dt_SetCache(int ttl)
+{
+  if (ttl < 0 && ttl != SWI_DT_CACHE_NO_EXPIRY)
+    return SWI_STATUS_WRONG_PARAMS;
+  pthread_mutex_lock(&cache_lock);
+  cache.ttl = ttl;
+  cache_update_ttls();
+  pthread_mutex_unlock(&cache_lock);
+  if (ttl == 0)
+    cache_flush(1);
+  return SWI_STATUS_OK;
+}
+
+swi_status_t swi_dt_SetCacheTTL(const char* pathPtr, int ttl)
+{
+  swi_status_t res = SWI_STATUS_OK;
+  cache_ttl_t *t;
+
+  if (pathPtr == NULL || (ttl < 0 && ttl != SWI_DT_CACHE_NO_EXPIRY))
+    return SWI_STATUS_WRONG_PARAMS;
+  pthread_mutex_lock(&cache_lock);
+  for (t = cache.ttls; t; t = t->next)
+    if (!strcmp(t->path, pathPtr))
+      break;
+  if (t == NULL)
+  {
+    t = malloc(sizeof(*t));
+    if (t == NULL || (t->path = strdup(pathPtr)) == NULL)
+    {
+      free(t);
+      res = SWI_STATUS_ALLOC_FAILED;
+      goto quit;
+    }
+    t->next = cache.ttls;
+    cache.ttls = t;
+  }
+  t->ttl = ttl;
+  cache_update_ttls();
+quit:
+  pthread_mutex_unlock(&cache_lock);
+  return res;
+}
+
 static void empReregisterServices()
 {
   cb_list_t *entry;
   swi_status_t res;
 
+  // The cache registrations are lost: read everything again
+  cache_flush(0);
+
   pthread_mutex_lock(&cb_lock);
   for (entry = cb_list; entry; entry = entry->next)
   {
@@ -269,6 +734,15 @@ swi_status_t swi_dt_Destroy()
   if (!initialized)
     return SWI_STATUS_OK;
 
+  swi_dt_SetCache(0);
+  while (cache.ttls)
+  {
+    cache_ttl_t *t = cache.ttls;
+    cache.ttls = t->next;
+    free(t->path);
+    free(t);
+  }
+
   res = emp_parser_destroy(1, empCmds, empReregisterServices);
   if (res != SWI_STATUS_OK)
   {
@@ -287,6 +761,7 @@ swi_status_t swi_dt_Get(const char* pathPtr, swi_dset_Iterator_t** data)
   size_t payloadLen, len;
   uint32_t respPayloadLen = 0;
   uint8_t is_leaf = 1, null_value = 0;
+  unsigned int epoch, seq;
   yajl_gen gen;
   yajl_val yval, yarray;
   int i;
@@ -302,6 +777,10 @@ swi_status_t swi_dt_Get(const char* pathPtr, swi_dset_Iterator_t** data)
     return SWI_STATUS_DA_NOT_FOUND;
   }
 
+  if (cache_get(1, &pathPtr, data) == SWI_STATUS_OK)
+    return SWI_STATUS_OK;
+  epoch = cache_register(pathPtr, &seq);
+
   YAJL_GEN_ALLOC(gen);
 
   YAJL_GEN_STRING(pathPtr, "pathPtr");
@@ -351,12 +830,12 @@ swi_status_t swi_dt_Get(const char* pathPtr, swi_dset_Iterator_t** data)
   switch(yval->u.array.values[0]->type)
   {
   case yajl_t_number:
-    if (yval->u.number.flags & YAJL_NUMBER_INT_VALID)
+    if (yval->u.array.values[0]->u.number.flags & YAJL_NUMBER_INT_VALID)
     {
       res = swi_dset_PushInteger(*data, pathPtr,  strlen(pathPtr), yval->u.array.values[0]->u.number.i);
       SWI_LOG("DT", DEBUG, "%s: pushing int value %s -> %lld\n", __FUNCTION__, pathPtr, yval->u.array.values[0]->u.number.i);
     }
-    else if (yval->u.number.flags & YAJL_NUMBER_DOUBLE_VALID)
+    else if (yval->u.array.values[0]->u.number.flags & YAJL_NUMBER_DOUBLE_VALID)
     {
       res = swi_dset_PushFloat(*data, pathPtr,  strlen(pathPtr), yval->u.array.values[0]->u.number.d);
       SWI_LOG("DT", DEBUG, "%s: pushing float value %s -> %lf\n", __FUNCTION__, pathPtr, yval->u.array.values[0]->u.number.d);
@@ -390,7 +869,11 @@ swi_status_t swi_dt_Get(const char* pathPtr, swi_dset_Iterator_t** data)
   }
 
   if (yval->u.array.len < 2)
+  {
+    if (!null_value)
+      cache_store(pathPtr, yval->u.array.values[0], epoch, seq);
     goto status;
+  }
 
   yarray = yval->u.array.values[1];
   SWI_LOG("DT", DEBUG, "%s: {\n", __FUNCTION__);
@@ -409,6 +892,8 @@ swi_status_t swi_dt_Get(const char* pathPtr, swi_dset_Iterator_t** data)
 
   if (null_value && is_leaf)
     res = SWI_STATUS_DA_NOT_FOUND;
+  else
+    cache_store(pathPtr, is_leaf ? yval->u.array.values[0] : NULL, epoch, seq);
 
 status:
   SWI_LOG("DT", DEBUG, "%s: end\n", __FUNCTION__);
@@ -418,13 +903,69 @@ status:
   return (res != SWI_STATUS_OK) ? res : (is_leaf ? SWI_STATUS_OK : SWI_STATUS_DA_NODE);
 }
 
+typedef struct
+{
+  const char* path;
+  yajl_val value;
+} mget_entry_t;
+
+static int mget_entry_cmp(const void* a, const void* b)
+{
+  return strcmp(((const mget_entry_t*) a)->path, ((const mget_entry_t*) b)->path);
+}
+
+static int mget_str_cmp(const void* a, const void* b)
+{
+  return strcmp(*(const char**) a, *(const char**) b);
+}
+
+// Whether a sorted list of paths holds a child of `path`.
+static int mget_has_child(const char** children, size_t nchildren, const char* path)
+{
+  size_t lo = 0, hi = nchildren, len = strlen(path);
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (strcmp(children[mid], path) <= 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < nchildren && !strncmp(children[lo], path, len) && children[lo][len] == '.';
+}
+
+static swi_status_t mget_push(swi_dset_Iterator_t* set, const char* path, yajl_val v)
+{
+  size_t len = strlen(path);
+  switch (v->type)
+  {
+    case yajl_t_string:
+      return swi_dset_PushString(set, path, len, v->u.string, strlen(v->u.string));
+    case yajl_t_number:
+      if (v->u.number.flags & YAJL_NUMBER_INT_VALID)
+        return swi_dset_PushInteger(set, path, len, v->u.number.i);
+      return swi_dset_PushFloat(set, path, len, v->u.number.d);
+    case yajl_t_true:
+      return swi_dset_PushBool(set, path, len, true);
+    case yajl_t_false:
+      return swi_dset_PushBool(set, path, len, false);
+    default:
+      return SWI_STATUS_OK;
+  }
+}
+
 swi_status_t swi_dt_MultipleGet(size_t numVars, const char** pathPtr, swi_dset_Iterator_t** data)
 {
-  int i;
   swi_status_t res;
-  swi_dset_Iterator_t *set, *tmp;
-  swi_dset_Type_t type;
-  const char *name = NULL, *value = NULL;
+  swi_dset_Iterator_t *set = NULL;
+  char *payload, *respPayload = NULL;
+  size_t payloadLen, nvalues = 0, nchildren = 0, i;
+  uint32_t respPayloadLen = 0;
+  mget_entry_t *values = NULL, key, *found;
+  const char **children = NULL;
+  unsigned int epoch = 0, *seqs;
+  yajl_gen gen;
+  yajl_val yval = NULL, yvalues, ychildren;
 
   if (data == NULL)
     return SWI_STATUS_WRONG_PARAMS;
@@ -432,54 +973,122 @@ swi_status_t swi_dt_MultipleGet(size_t numVars, const char** pathPtr, swi_dset_I
   if (pathPtr == NULL || numVars == 0)
     return SWI_STATUS_DA_NOT_FOUND;
 
+  if (cache_get(numVars, pathPtr, data) == SWI_STATUS_OK)
+    return SWI_STATUS_OK;
+
+  // All the paths are read in a single request: the agent answers with a map
+  // of the leaf values, and the list of the children of the non-leaf nodes.
+  YAJL_GEN_ALLOC(gen);
+  yajl_gen_array_open(gen);
+  for (i = 0; i < numVars; i++)
+    YAJL_GEN_STRING(pathPtr[i], "pathPtr");
+  yajl_gen_array_close(gen);
+  YAJL_GEN_GET_BUF(payload, payloadLen);
+
+  seqs = malloc(numVars * sizeof(*seqs));
+  if (seqs == NULL)
+  {
+    yajl_gen_free(gen);
+    return SWI_STATUS_ALLOC_FAILED;
+  }
+  for (i = 0; i < numVars; i++)
+    epoch = cache_register(pathPtr[i], &seqs[i]);
+
+  res = emp_send_and_wait_response(EMP_GETVARIABLE, 0, payload, payloadLen, &respPayload, &respPayloadLen);
+  yajl_gen_clear(gen);
+  yajl_gen_free(gen);
+  if (SWI_STATUS_OK != res)
+  {
+    SWI_LOG("DT", ERROR, "%s: failed to send EMP cmd, res = %d\n", __FUNCTION__, res);
+    free(respPayload);
+    goto quit;
+  }
+
+  payload = strndup(respPayload, respPayloadLen);
+  free(respPayload);
+  if (payload == NULL)
+  {
+    res = SWI_STATUS_ALLOC_FAILED;
+    goto quit;
+  }
+  yval = yajl_tree_parse(payload, NULL, 0);
+  free(payload);
+  if (!YAJL_IS_ARRAY(yval) || yval->u.array.len < 1)
+  {
+    SWI_LOG("DT", ERROR, "%s: Invalid object returned by RA, expected array\n", __FUNCTION__);
+    res = SWI_STATUS_INVALID_OBJECT_TYPE;
+    goto quit;
+  }
+  yvalues = yval->u.array.values[0];
+  ychildren = yval->u.array.len > 1 ? yval->u.array.values[1] : NULL;
+  if (YAJL_IS_OBJECT(yvalues))
+    nvalues = yvalues->u.object.len;
+  else if (!YAJL_IS_ARRAY(yvalues) || yvalues->u.array.len > 0) // empty maps may come as empty lists
+  {
+    // nil followed by an error message: one of the paths doesn't exist
+    SWI_LOG("DT", DEBUG, "%s: %s\n", __FUNCTION__, YAJL_IS_STRING(ychildren) ? ychildren->u.string : "no value");
+    res = SWI_STATUS_DA_NOT_FOUND;
+    goto quit;
+  }
+
+  // Sort the results to look them up
+  values = malloc((nvalues + 1) * sizeof(*values));
+  nchildren = YAJL_IS_ARRAY(ychildren) ? ychildren->u.array.len : 0;
+  children = malloc((nchildren + 1) * sizeof(*children));
+  if (values == NULL || children == NULL)
+  {
+    res = SWI_STATUS_ALLOC_FAILED;
+    goto quit;
+  }
+  for (i = 0; i < nvalues; i++)
+  {
+    values[i].path = yvalues->u.object.keys[i];
+    values[i].value = yvalues->u.object.values[i];
+  }
+  qsort(values, nvalues, sizeof(*values), mget_entry_cmp);
+  for (i = 0; i < nchildren; i++)
+    children[i] = YAJL_IS_STRING(ychildren->u.array.values[i]) ? ychildren->u.array.values[i]->u.string : "";
+  qsort(children, nchildren, sizeof(*children), mget_str_cmp);
 
   res = swi_dset_Create(&set);
   if (res != SWI_STATUS_OK)
   {
     SWI_LOG("DT", ERROR, "%s: dset allocation failed, res %d\n", __FUNCTION__, res);
-    return SWI_STATUS_ALLOC_FAILED;
+    res = SWI_STATUS_ALLOC_FAILED;
+    goto quit;
   }
 
+  // Push the leaf values in the order of the request, skip the nodes
   for (i = 0; i < numVars; i++)
   {
-    res = swi_dt_Get(pathPtr[i], &tmp);
-    if (res == SWI_STATUS_DA_NODE)
+    key.path = pathPtr[i];
+    found = bsearch(&key, values, nvalues, sizeof(*values), mget_entry_cmp);
+    if (found)
     {
-      swi_dset_Destroy(tmp);
-      continue;
-    }
-    else if (res == SWI_STATUS_DA_NOT_FOUND)
-    {
-      return res;
+      res = mget_push(set, pathPtr[i], found->value);
+      cache_store(pathPtr[i], found->value, epoch, seqs[i]);
     }
-
-    while (swi_dset_Next(tmp) != SWI_STATUS_DA_NOT_FOUND)
+    else if (mget_has_child(children, nchildren, pathPtr[i]))
     {
-      type = swi_dset_GetType(tmp);
-      name = swi_dset_GetName(tmp);
-      switch(type)
-      {
-        case SWI_DSET_INTEGER:
-          swi_dset_PushInteger(set, name, strlen(name), swi_dset_ToInteger(tmp));
-      SWI_LOG("DT", DEBUG, "%s: concat %s=%ld\n", __FUNCTION__, name, swi_dset_ToInteger(tmp));
-      break;
-        case SWI_DSET_FLOAT:
-      swi_dset_PushFloat(set, name, strlen(name), swi_dset_ToFloat(tmp));
-      SWI_LOG("DT", DEBUG, "%s: concat %s=%f\n", __FUNCTION__, name, swi_dset_ToFloat(tmp));
-      break;
-        case SWI_DSET_STRING:
-      value = swi_dset_ToString(tmp);
-      swi_dset_PushString(set, name, strlen(name), value, strlen(value));
-      SWI_LOG("DT", DEBUG, "%s: concat %s=%s\n", __FUNCTION__, name, value);
-      break;
-        default:
-      break;
-      }
+      cache_store(pathPtr[i], NULL, epoch, seqs[i]);
+      continue;
     }
-    swi_dset_Destroy(tmp);
+    else
+      res = SWI_STATUS_DA_NOT_FOUND;
+    if (res != SWI_STATUS_OK)
+      goto quit;
   }
   *data = set;
-  return SWI_STATUS_OK;
+  set = NULL;
+
+quit:
+  if (set)
+    swi_dset_Destroy(set);
+  free(values);
+  free(children);
+  free(seqs);
+  yajl_tree_free(yval);
+  return res;
 }
 
 swi_status_t swi_dt_SetInteger(const char* pathPtr, int value)
@@ -577,13 +1186,8 @@ quit:
 swi_status_t swi_dt_Unregister(swi_dt_regId_t regId)
 {
   swi_status_t res;
-  char* payload, *respPayload = NULL;
-  size_t payloadLen;
-  uint32_t respPayloadLen = 0;
   cb_list_t *entry = NULL, *tmp = NULL;
-  yajl_gen gen;
 
-  YAJL_GEN_ALLOC(gen);
   for (entry = cb_list; entry; entry = entry->next)
   {
     if (entry == regId)
@@ -593,23 +1197,9 @@ swi_status_t swi_dt_Unregister(swi_dt_regId_t regId)
   if (entry == NULL)
     return SWI_STATUS_OK;
 
-  YAJL_GEN_STRING(entry->regId, "regId");
-  YAJL_GEN_GET_BUF(payload, payloadLen);
-
-  res = emp_send_and_wait_response(EMP_DEREGISTERVARIABLE, 0, payload, payloadLen, &respPayload, &respPayloadLen);
-  yajl_gen_clear(gen);
-  yajl_gen_free(gen);
-
+  res = send_unregister(entry->regId);
   if (SWI_STATUS_OK != res)
-  {
-    SWI_LOG("DT", ERROR, "%s: failed to send EMP cmd, res = %d\n", __FUNCTION__, res);
-    if (respPayload)
-    {
-      SWI_LOG("DT", ERROR, "%s: respPayload = %.*s\n", __FUNCTION__, respPayloadLen, respPayload);
-      free(respPayload);
-    }
     return res;
-  }
 
   pthread_mutex_lock(&cb_lock);
   if (cb_list == regId)
@@ -637,6 +1227,5 @@ swi_status_t swi_dt_Unregister(swi_dt_regId_t regId)
   }
   pthread_mutex_unlock(&cb_lock);
 
-  free(respPayload);
   return SWI_STATUS_OK;
 }
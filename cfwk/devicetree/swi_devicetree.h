@@ -118,6 +118,7 @@ swi_status_t swi_dt_Get
 * Only leaf paths will be retrieved, any node path will be silently discarded.
 * Each leaf value will be put as an element in the #swi_dset_Iterator_t object.
 * Each element's name will be the full path of the variable.
+* All the variables are read in a single request to the agent.
 *
 * @return SWI_STATUS_OK on success
 * @return SWI_STATUS_DA_NOT_FOUND when one of the requested path was not found,
@@ -133,6 +134,49 @@ swi_status_t swi_dt_MultipleGet
                                 ///<       The user is responsible to release the data iterator resources using #swi_dset_Destroy function.
 );
 
+/**
+* Time to live of the cached variables which are kept until they change, see #swi_dt_SetCache.
+*/
+#define SWI_DT_CACHE_NO_EXPIRY (-1)
+
+/**
+* Enables, configures or disables the local cache of the variables read with #swi_dt_Get and #swi_dt_MultipleGet.
+*
+* When the cache is enabled, the first read of a variable registers for its changes, and the following reads
+* are served from memory: the changes notified by the agent update the cached values, and a variable set with
+* the swi_dt_Set functions is read from the agent again. The cache is flushed when the connection to the agent
+* is lost.
+*
+* Some variables are not notified when they change, e.g. values computed by their handler when read:
+* they must be given a time to live with #swi_dt_SetCacheTTL, after which they are read again from the agent,
+* or a time to live of 0 which disables their caching. Non-leaf paths are never cached.
+*
+* The cache is disabled by default, and by #swi_dt_Destroy.
+*
+* @return SWI_STATUS_OK on success
+* @return SWI_STATUS_WRONG_PARAMS when ttl is invalid
+*/
+swi_status_t swi_dt_SetCache
+(
+    int ttl ///< [IN] the time to live of the cached values in seconds, #SWI_DT_CACHE_NO_EXPIRY to keep them until they change,
+            ///<      0 to disable the cache.
+);
+
+/**
+* Sets the time to live of the cached variables below a path, overriding the one given to #swi_dt_SetCache.
+*
+* The time to live of a variable is the one of the longest path it is below.
+*
+* @return SWI_STATUS_OK on success
+* @return SWI_STATUS_WRONG_PARAMS when a parameter is invalid
+*/
+swi_status_t swi_dt_SetCacheTTL
+(
+    const char* pathPtr, ///< [IN] the path of the variables.
+    int ttl              ///< [IN] the time to live of their cached values in seconds, #SWI_DT_CACHE_NO_EXPIRY to keep them
+                         ///<      until they change, 0 not to cache them.
+);
+
 /**
 * Sets an integer variable value into the variable tree.
 *
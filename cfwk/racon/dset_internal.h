@@ -41,7 +41,7 @@ swi_status_t swi_dset_Create(swi_dset_Iterator_t** set);
 swi_status_t swi_dset_Rewind(swi_dset_Iterator_t *set);
 /*
  * Push fct: to be used to populate dset with a new
- * swi_dset_Element_t malloc'ed in each fct.
+ * swi_dset_Element_t allocated in the dset arena.
  * those fcts don't change current element.
  */
 swi_status_t swi_dset_PushInteger(swi_dset_Iterator_t* set, const char* name,  size_t nameLength, uint64_t val);
@@ -53,6 +53,9 @@ swi_status_t swi_dset_PushUnsupported(swi_dset_Iterator_t *set, const char *name
 /*
  * To remove an element
  * The current element is discarded, dset iteration will restart from scratch.
+ * If elt is not NULL, it is set to a copy of the removed element, to be freed by the caller.
+ * Removing may move the other elements: names and string values previously
+ * returned for this dset are invalidated.
  */
 swi_status_t swi_dset_RemoveByName(swi_dset_Iterator_t* set, const char* name, swi_dset_Element_t ** elt);
 
@@ -0,0 +1,91 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Benchmark of dset building and by name lookups.
+ *
+ * Builds dsets of integer, float and string fields, as received by a data
+ * writing callback or returned by swi_dt_MultipleGet, then gets every field
+ * by name, and reports the time of both steps for each dset.
+ *
+ * Usage: dset_perf [fields] [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "swi_dset.h"
+#include "dset_internal.h"
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  int fields = argc > 1 ? atoi(argv[1]) : 1000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 100;
+  double build = 0, lookup = 0, t, d;
+  swi_dset_Iterator_t *set;
+  char (*names)[32];
+  const char *s;
+  int64_t v;
+  int i, r;
+
+  if (fields < 1 || rounds < 1)
+  {
+    printf("usage: dset_perf [fields] [rounds]\n");
+    return 1;
+  }
+  names = malloc(fields * sizeof(*names));
+  for (i = 0; i < fields; i++)
+    sprintf(names[i], "system.sensors.sensor%d.value", i);
+
+  for (r = 0; r < rounds; r++)
+  {
+    t = now();
+    if (swi_dset_Create(&set) != SWI_STATUS_OK)
+      return 1;
+    for (i = 0; i < fields; i++)
+    {
+      switch (i % 3)
+      {
+        case 0: swi_dset_PushInteger(set, names[i], strlen(names[i]), i); break;
+        case 1: swi_dset_PushFloat(set, names[i], strlen(names[i]), i / 3.0); break;
+        case 2: swi_dset_PushString(set, names[i], strlen(names[i]), "running", strlen("running")); break;
+      }
+    }
+    build += now() - t;
+
+    t = now();
+    for (i = 0; i < fields; i++)
+    {
+      switch (i % 3)
+      {
+        case 0: if (swi_dset_GetIntegerByName(set, names[i], &v) != SWI_STATUS_OK) return 1; break;
+        case 1: if (swi_dset_GetFloatByName(set, names[i], &d) != SWI_STATUS_OK) return 1; break;
+        case 2: if (swi_dset_GetStringByName(set, names[i], &s) != SWI_STATUS_OK) return 1; break;
+      }
+    }
+    lookup += now() - t;
+    swi_dset_Destroy(set);
+  }
+
+  printf("%d fields: build %8.1fus, lookup of every field %9.1fus\n",
+      fields, build * 1e6 / rounds, lookup * 1e6 / rounds);
+  free(names);
+  return 0;
+}
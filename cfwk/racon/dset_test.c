@@ -12,6 +12,7 @@
 #include "swi_dset.h"
 #include "dset_internal.h"
 #include "testutils.h"
+#include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
 
@@ -225,6 +226,98 @@ int test_4_Iterate_Elements()
   return 0;
 }
 
+int test_5_Large_Sets()
+{
+  swi_status_t res = SWI_STATUS_OK;
+  swi_dset_Iterator_t* set = NULL;
+  swi_dset_Element_t* elt = NULL;
+  char name[32], value[32];
+  const char* s = NULL;
+  int64_t v = 0;
+  int i;
+
+  res = swi_dset_Create(&set);
+  if (res != SWI_STATUS_OK)
+    return 1;
+
+  for (i = 0; i < 1000; i++)
+  {
+    sprintf(name, "var%d", i);
+    sprintf(value, "value%d", i);
+    if (i % 2)
+      res = swi_dset_PushInteger(set, name, strlen(name), i);
+    else
+      res = swi_dset_PushString(set, name, strlen(name), value, strlen(value));
+    if (res != SWI_STATUS_OK)
+      return 1;
+  }
+
+  //first lookup builds the index
+  res = swi_dset_GetIntegerByName(set, "var999", &v);
+  if (res != SWI_STATUS_OK || 999 != v)
+    return 1;
+  res = swi_dset_GetStringByName(set, "var500", &s);
+  if (res != SWI_STATUS_OK || strcmp(s, "value500"))
+    return 1;
+  res = swi_dset_GetIntegerByName(set, "var1000", &v);
+  if (res != SWI_STATUS_DA_NOT_FOUND)
+    return 1;
+  res = swi_dset_GetIntegerByName(set, "var2", &v);
+  if (res != SWI_STATUS_DA_BAD_TYPE)
+    return 1;
+
+  //pushed after the index was built, duplicates are not found
+  res = swi_dset_PushInteger(set, "var1000", strlen("var1000"), 1000);
+  if (res != SWI_STATUS_OK)
+    return 1;
+  res = swi_dset_PushInteger(set, "var1", strlen("var1"), -1);
+  if (res != SWI_STATUS_OK)
+    return 1;
+  res = swi_dset_GetIntegerByName(set, "var1000", &v);
+  if (res != SWI_STATUS_OK || 1000 != v)
+    return 1;
+  res = swi_dset_GetIntegerByName(set, "var1", &v);
+  if (res != SWI_STATUS_OK || 1 != v)
+    return 1;
+
+  //remove most elements, which compacts the set
+  for (i = 0; i < 900; i++)
+  {
+    sprintf(name, "var%d", i);
+    res = swi_dset_RemoveByName(set, name, i == 898 ? &elt : NULL);
+    if (res != SWI_STATUS_OK)
+      return 1;
+  }
+  if (NULL == elt || strcmp(elt->name, "var898") || SWI_DSET_STRING != elt->type || strcmp(elt->val.sval, "value898"))
+    return 1;
+  free(elt);
+  res = swi_dset_GetStringByName(set, "var0", &s);
+  if (res != SWI_STATUS_DA_NOT_FOUND)
+    return 1;
+  res = swi_dset_GetIntegerByName(set, "var1", &v);
+  if (res != SWI_STATUS_OK || -1 != v)
+    return 1;
+  res = swi_dset_GetStringByName(set, "var990", &s);
+  if (res != SWI_STATUS_OK || strcmp(s, "value990"))
+    return 1;
+
+  //iteration order is kept
+  for (i = 900; SWI_STATUS_OK == swi_dset_Next(set); i++)
+  {
+    sprintf(name, "var%d", i == 1001 ? 1 : i);
+    if (strcmp(swi_dset_GetName(set), name))
+      return 1;
+  }
+  if (i != 1002)
+    return 1;
+
+  res = swi_dset_Destroy(set);
+  if (res != SWI_STATUS_OK)
+    return 1;
+
+  return 0;
+}
+
 int main(int argc, char ** argv)
 {
   INIT_TEST("DSET_TEST");
@@ -233,6 +326,7 @@ int main(int argc, char ** argv)
   CHECK_TEST(test_2_Adding_Elements());
   CHECK_TEST(test_3_Find_Elements());
   CHECK_TEST(test_4_Iterate_Elements());
+  CHECK_TEST(test_5_Large_Sets());
 
   return 0;
 }
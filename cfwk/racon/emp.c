@@ -14,20 +14,31 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
+#include <poll.h>
 #include <unistd.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <strings.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "emp.h"
 #include "swi_log.h"
 
 /*
  * EMP is the Embedded Micro Protocol, it is used to communicate to the agent
- * through a TCP socket.
+ * through a TCP socket, a UNIX domain socket, or a pair of shared memory rings.
+ *
+ * Transport:
+ *
+ * By default, EMP connects to the UNIX domain socket of the agent, and falls back to TCP when the agent doesn't
+ * listen on it. With the shared memory transport, right after connecting to the UNIX domain socket, a
+ * EMP_SETTRANSPORT command asks the agent for a channel (see shm_ring.h), whose file descriptors come back with
+ * the response. Messages then go through the rings, and the socket is only watched to detect the agent going away.
+ * When the agent refuses, EMP keeps on using the socket.
  *
  * This module is responsible to communicate to agent by exchanging commands with optional payloads.
  * To do so when the module is initialized, it creates a "reader thread", this one runs in background and waits
@@ -82,6 +93,8 @@ static swi_status_t emp_sendmessage(EmpCommand command, uint8_t type, uint8_t* r
 static swi_status_t emp_addCmdHandler(EmpCommand cmd, emp_command_hdl_t h);
 static swi_status_t emp_removeCmdHandler(EmpCommand cmd);
 static struct sockaddr_in agent_addr;
+static struct sockaddr_un agent_unix_addr;
+static uint32_t shm_size;
 
 #ifdef __ARMEL__
 
@@ -285,6 +298,230 @@ static void throw_and_broadcast_err(swi_status_t status)
   }
 }
 
+/*
+ * Ask the agent for a shared memory channel over the freshly connected UNIX domain socket fd.
+ * On success, parser->shm is set; otherwise the socket is to be used as is.
+ */
+static void shm_negotiate(int fd)
+{
+  unsigned char request[8 + 16];
+  unsigned char header[8];
+  char cbuf[CMSG_SPACE(3 * sizeof(int))];
+  struct timeval tv = { 5, 0 };
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  int fds[3] = { -1, -1, -1 }, nfds = 0, i;
+  uint32_t got = 0, dlen;
+  uint16_t status = SWI_STATUS_UNKNOWN_ERROR;
+  ssize_t r;
+
+  // the payload is the ring size, JSON encoded like any EMP payload, so that older agents can decode it
+  dlen = snprintf((char *) request + 8, sizeof(request) - 8, "%u", shm_size);
+  request[0] = (EMP_SETTRANSPORT >> 8) & 0xff;
+  request[1] = EMP_SETTRANSPORT & 0xff;
+  request[2] = 0;
+  request[3] = 0;
+  request[4] = (dlen >> 24) & 0xff;
+  request[5] = (dlen >> 16) & 0xff;
+  request[6] = (dlen >> 8) & 0xff;
+  request[7] = dlen & 0xff;
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  if (send(fd, request, 8 + dlen, MSG_NOSIGNAL) != 8 + dlen)
+    goto quit;
+
+  // the file descriptors come along with the header of the response
+  while (got < 8)
+  {
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = header + got;
+    iov.iov_len = 8 - got;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    r = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (r <= 0)
+      goto quit;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      {
+        int *p = (int *) CMSG_DATA(cmsg);
+        int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < n; i++)
+        {
+          if (nfds < 3)
+            fds[nfds++] = p[i];
+          else
+            close(p[i]);
+        }
+      }
+    }
+    got += r;
+  }
+  dlen = (((uint32_t) header[4]) << 24) + (((uint32_t) header[5]) << 16)
+    + (((uint32_t) header[6]) << 8) + (uint32_t) header[7];
+
+  // status, then whatever an agent not knowing the command may have added
+  for (got = 0; got < dlen; got++)
+  {
+    unsigned char c;
+    if (recv(fd, &c, 1, MSG_WAITALL) != 1)
+      goto quit;
+    if (got < 2)
+      status = got ? (status & 0xff00) | c : c << 8;
+  }
+
+quit:
+  tv.tv_sec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  if (status == SWI_STATUS_OK && nfds == 3)
+  {
+    parser->shmBroken = 0;
+    if (ShmRing_Attach(&parser->shm, fds) == SWI_STATUS_OK)
+    {
+      SWI_LOG("EMP", DEBUG, "%s: using a shared memory channel\n", __FUNCTION__);
+      return;
+    }
+  }
+  else
+  {
+    for (i = 0; i < nfds; i++)
+      close(fds[i]);
+  }
+  SWI_LOG("EMP", WARNING, "Shared memory transport not available (status %d), using the UNIX domain socket\n", status);
+}
+
+/*
+ * Connect to the agent with the configured transport.
+ * Return the socket, or -1 on failure.
+ */
+static int ipc_connect()
+{
+  int fd;
+
+  if (parser->transport != EMP_TRANSPORT_TCP)
+  {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*) &agent_unix_addr, sizeof(agent_unix_addr)) == 0)
+    {
+      if (parser->transport == EMP_TRANSPORT_SHM)
+        shm_negotiate(fd);
+      return fd;
+    }
+    if (fd >= 0)
+      close(fd);
+    if (parser->transport != EMP_TRANSPORT_AUTO)
+      return -1;
+    SWI_LOG("EMP", DEBUG, "%s: cannot connect to %s, trying TCP\n", __FUNCTION__, agent_unix_addr.sun_path);
+  }
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (connect(fd, (struct sockaddr*) &agent_addr, sizeof(agent_addr)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * Wake up the senders waiting for room in the shared memory ring.
+ */
+static void shm_wakeup(int broken)
+{
+  pthread_mutex_lock(&parser->shmLock);
+  parser->shmWakeups++;
+  if (broken)
+    parser->shmBroken = 1;
+  pthread_cond_broadcast(&parser->shmCond);
+  pthread_mutex_unlock(&parser->shmLock);
+}
+
+/*
+ * Called with sockLock held.
+ */
+static swi_status_t shm_send(const char* payload, uint32_t payloadsize)
+{
+  uint32_t sent = 0, wakeups;
+  ssize_t w;
+
+  while (sent < payloadsize)
+  {
+    wakeups = __atomic_load_n(&parser->shmWakeups, __ATOMIC_ACQUIRE);
+    w = ShmRing_Write(parser->shm, payload + sent, payloadsize - sent);
+    if (w < 0)
+    {
+      shm_wakeup(1);
+      return SWI_STATUS_IPC_BROKEN;
+    }
+    sent += w;
+    if (w)
+      continue;
+
+    // ring full: the agent rings as soon as it has read some bytes, then the reader thread wakes us up
+    pthread_mutex_lock(&parser->shmLock);
+    while (wakeups == parser->shmWakeups && !parser->shmBroken)
+    {
+      struct timeval tv;
+      struct timespec deadline;
+      gettimeofday(&tv, NULL);
+      deadline.tv_sec = tv.tv_sec + 1;
+      deadline.tv_nsec = tv.tv_usec * 1000;
+      if (pthread_cond_timedwait(&parser->shmCond, &parser->shmLock, &deadline) == ETIMEDOUT)
+        break;
+    }
+    if (parser->shmBroken)
+    {
+      pthread_mutex_unlock(&parser->shmLock);
+      return SWI_STATUS_IPC_BROKEN;
+    }
+    pthread_mutex_unlock(&parser->shmLock);
+  }
+  return SWI_STATUS_OK;
+}
+
+/*
+ * Used in reader thread.
+ * Return 0 when the socket tells the agent went away, or the parser is being destroyed.
+ */
+static uint32_t shm_read(char* buffer, uint32_t size)
+{
+  struct pollfd pfd[2];
+  ssize_t r;
+
+  while (parser->sockfd >= 0)
+  {
+    r = ShmRing_Read(parser->shm, buffer, size);
+    if (r < 0)
+      break;
+    if (r)
+      return r;
+
+    pfd[0].fd = ShmRing_GetFd(parser->shm);
+    pfd[0].events = POLLIN;
+    pfd[1].fd = parser->sockfd;
+    pfd[1].events = POLLIN;
+    // bounded wait: emp_parser_destroy may close the socket before we poll it
+    if (poll(pfd, 2, 1000) < 0 && errno != EINTR)
+      break;
+    if (pfd[0].revents & POLLIN)
+    {
+      ShmRing_Drain(parser->shm);
+      shm_wakeup(0);
+    }
+    // nothing is written on the socket after the negotiation: it's readable on disconnection only
+    if (pfd[1].revents && !ShmRing_Available(parser->shm))
+      break;
+  }
+  shm_wakeup(1);
+  return 0;
+}
+
 static int ipc_reconnect()
 {
   int ret = 0, limit = 0, retry = 0, timeout = 0;
@@ -303,11 +540,13 @@ static int ipc_reconnect()
     SWI_LOG("EMP", DEBUG, "%s: sockLock locked\n", __FUNCTION__, parser->sockfd);
 
     close(parser->sockfd);
+    ShmRing_Destroy(parser->shm);
+    parser->shm = NULL;
 
-    parser->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    parser->sockfd = ipc_connect();
     SWI_LOG("EMP", DEBUG, "%s: got new fd %d\n", __FUNCTION__, parser->sockfd);
 
-    ret = connect(parser->sockfd, (struct sockaddr*) &agent_addr, sizeof(agent_addr));
+    ret = parser->sockfd >= 0 ? 0 : -1;
     if (ret == 0)
     {
       pthread_mutex_unlock(&parser->sockLock);
@@ -403,32 +642,44 @@ swi_status_t emp_parser_init(size_t nbCmds, EmpCommand* cmds, emp_command_hdl_t*
   {
     SWI_LOG("EMP", DEBUG, "%s: No existing parser found, allocating a new one\n", __FUNCTION__);
     parser = calloc(1, sizeof(*parser));
-    parser->sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (parser->sockfd < 0)
-    {
-      SWI_LOG("EMP", ERROR, "socket creation failed\n");
-      emp_parser_destroy(nbCmds, cmds, ipcHdlr);
-      return SWI_STATUS_RESOURCE_INITIALIZATION_FAILED;
-    }
+    pthread_mutex_init(&parser->sockLock, 0);
+    pthread_mutex_init(&parser->shmLock, 0);
+    pthread_cond_init(&parser->shmCond, 0);
 
     agent_addr.sin_family = AF_INET;
+    agent_unix_addr.sun_family = AF_UNIX;
 
     char *port = getenv("SWI_EMP_SERVER_PORT");
     char *addr = getenv("SWI_EMP_SERVER_ADDR");
+    char *path = getenv("SWI_EMP_SERVER_PATH");
+    char *transport = getenv("SWI_EMP_TRANSPORT");
+    char *size = getenv("SWI_EMP_SHM_SIZE");
     char *timeout = getenv("SWI_EMP_CMD_TIMEOUT");
 
     agent_addr.sin_port = port ? htons( atoi(port) ) : htons(SWI_IPC_SERVER_PORT);
     agent_addr.sin_addr.s_addr = addr ? inet_addr(addr) : inet_addr(SWI_IPC_SERVER_ADDR);
+    strncpy(agent_unix_addr.sun_path, path ? path : SWI_IPC_SERVER_PATH, sizeof(agent_unix_addr.sun_path) - 1);
+    shm_size = size ? atoi(size) : SHM_RING_DEFAULT_SIZE;
+
+    // an explicit TCP address keeps applications written for the TCP only versions working unchanged
+    if (transport && !strcmp(transport, "tcp"))
+      parser->transport = EMP_TRANSPORT_TCP;
+    else if (transport && !strcmp(transport, "unix"))
+      parser->transport = EMP_TRANSPORT_UNIX;
+    else if (transport && !strcmp(transport, "shm"))
+      parser->transport = EMP_TRANSPORT_SHM;
+    else
+      parser->transport = port || addr ? EMP_TRANSPORT_TCP : EMP_TRANSPORT_AUTO;
 
     SWI_LOG("EMP", DEBUG, "%s: Connecting to agent\n", __FUNCTION__);
-    if (connect(parser->sockfd, (struct sockaddr*) &agent_addr, sizeof(agent_addr)) < 0)
+    parser->sockfd = ipc_connect();
+    if (parser->sockfd < 0)
     {
       SWI_LOG("EMP", ERROR, "socket connection failed\n");
       emp_parser_destroy(nbCmds, cmds, ipcHdlr);
       return SWI_STATUS_RESOURCE_INITIALIZATION_FAILED;
     }
 
-    pthread_mutex_init(&parser->sockLock, 0);
     parser->cmdTimeout = timeout ? atoi(timeout) : 60;
 
     SWI_LOG("EMP", DEBUG, "%s: Creating reader thread\n", __FUNCTION__);
@@ -485,6 +736,10 @@ swi_status_t emp_parser_destroy(size_t nbCmds, EmpCommand* cmds, emp_ipc_broken_
   if (parser->readerThread)
     pthread_join(parser->readerThread, NULL);
 
+  ShmRing_Destroy(parser->shm);
+  pthread_cond_destroy(&parser->shmCond);
+  pthread_mutex_destroy(&parser->shmLock);
+  pthread_mutex_destroy(&parser->sockLock);
   free(parser);
   parser = NULL;
   return SWI_STATUS_OK;
@@ -647,6 +902,11 @@ static swi_status_t ipc_send(const char* payload, uint32_t payloadsize)
   swi_status_t status;
 
   pthread_mutex_lock(&parser->sockLock);
+  if (parser->shm)
+  {
+    status = shm_send(payload, payloadsize);
+    goto quit;
+  }
   s = send(parser->sockfd, payload, payloadsize, MSG_NOSIGNAL);
   if (s < 0)
   {
@@ -675,6 +935,14 @@ static uint32_t ipc_read(char* buffer, uint32_t size)
 {
   int r;
 
+  if (parser->shm)
+  {
+    r = shm_read(buffer, size);
+    if (r > 0)
+      return r;
+    // the agent went away (or the parser is being destroyed): handled as for the socket below
+    errno = 0;
+  }
   r = recv(parser->sockfd, buffer, size, MSG_WAITALL);
 
   if (r <= 0)
@@ -25,18 +25,33 @@
 #include <semaphore.h>
 #include "swi_status.h"
 #include "swi_dset.h"
+#include "shm_ring.h"
 
 /**
  * Agent connection parameters
  */
 #define SWI_IPC_SERVER_ADDR "127.0.0.1"
 #define SWI_IPC_SERVER_PORT 9999
+#define SWI_IPC_SERVER_PATH "/tmp/mihini_emp"
+
+/**
+ * Transports to the agent, selected with the SWI_EMP_TRANSPORT environment
+ * variable ("tcp", "unix" or "shm").
+ */
+typedef enum
+{
+  EMP_TRANSPORT_AUTO, ///< UNIX domain socket, TCP when the agent doesn't listen on it
+  EMP_TRANSPORT_TCP,
+  EMP_TRANSPORT_UNIX,
+  EMP_TRANSPORT_SHM   ///< shared memory rings, negotiated over the UNIX domain socket
+} EmpTransport;
 
 
 struct EmpParser_s;
 
 typedef enum
 {
+  EMP_SETTRANSPORT          = 0, // reserved for the transport negotiation, at connection time
   EMP_SENDDATA              = 1,
   EMP_REGISTER              = 2,
   EMP_UNREGISTER            = 3,
@@ -114,6 +129,13 @@ typedef struct EmpParser_s
   uint16_t cmdTimeout;
   int sockfd;
   int32_t ridBitfields[2];
+
+  EmpTransport transport;
+  ShmRing *shm; // shared memory channel, when negotiated; sockfd then only tells the agent is alive
+  pthread_mutex_t shmLock;
+  pthread_cond_t shmCond; // broadcast by the reader thread each time the agent rings
+  uint32_t shmWakeups;
+  int shmBroken;
 } EmpParser;
 
 #define SWI_EMP_INIT_NO_CMDS 0,NULL,NULL,NULL
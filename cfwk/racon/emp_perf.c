@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Benchmark of the EMP transports.
+ *
+ * Sends SendData commands to an echo server (emp_perf_server.lua, or an agent
+ * with an echo SendData command) one after the other, and reports the number
+ * of round trips per second and the latency percentiles. The transport is
+ * selected as usual by the SWI_EMP_TRANSPORT environment variable, e.g.:
+ *
+ *   for t in tcp unix shm; do SWI_EMP_TRANSPORT=$t emp_perf 20000 64; done
+ *
+ * Usage: emp_perf [count] [payload size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "emp.h"
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmpdouble(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+  int count = argc > 1 ? atoi(argv[1]) : 10000;
+  int size = argc > 2 ? atoi(argv[2]) : 64;
+  char *payload, *resp;
+  uint32_t resplen;
+  double *lat, t0, t;
+  const char *transport = getenv("SWI_EMP_TRANSPORT");
+  int i;
+
+  if (count < 1 || size < 2)
+  {
+    printf("usage: emp_perf [count] [payload size >= 2]\n");
+    return 1;
+  }
+  // payloads are JSON: send a string
+  payload = malloc(size);
+  lat = malloc(count * sizeof(*lat));
+  memset(payload, 'x', size);
+  payload[0] = payload[size - 1] = '"';
+
+  if (emp_parser_init(SWI_EMP_INIT_NO_CMDS) != SWI_STATUS_OK)
+  {
+    printf("cannot connect to the server\n");
+    return 1;
+  }
+
+  t0 = now();
+  for (i = 0; i < count; i++)
+  {
+    swi_status_t res;
+    t = now();
+    res = emp_send_and_wait_response(EMP_SENDDATA, 0, payload, size, &resp, &resplen);
+    lat[i] = now() - t;
+    if (res != SWI_STATUS_OK || resplen != size)
+    {
+      printf("round trip #%d failed: status %d, %u bytes\n", i, res, resplen);
+      return 1;
+    }
+    free(resp);
+  }
+  t = now() - t0;
+
+  qsort(lat, count, sizeof(*lat), cmpdouble);
+  printf("%-5s %6d bytes: %9.0f msgs/s, latency p50 %6.1fus p99 %6.1fus max %7.1fus\n",
+      transport ? transport : "auto", size, count / t,
+      lat[count / 2] * 1e6, lat[count * 99 / 100] * 1e6, lat[count - 1] * 1e6);
+
+  emp_parser_destroy(SWI_EMP_DESTROY_NO_CMDS);
+  free(lat);
+  free(payload);
+  return 0;
+}
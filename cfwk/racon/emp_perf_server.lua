@@ -0,0 +1,26 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Echo server for emp_perf: the asset connector of the agent, alone, with a
+-- SendData command sending its payload back. Listens on the default TCP
+-- port and UNIX domain socket of the agent.
+--
+-- Usage: lua emp_perf_server.lua [unix socket path]
+
+local sched  = require 'sched'
+local asscon = require 'agent.asscon'
+
+sched.run(function()
+    assert(asscon.registercmd("SendData", function(asset, payload) return 0, payload end))
+    assert(asscon.init{ assetport = 9999, assetunixpath = arg[1] or "/tmp/mihini_emp" })
+    print("EMP echo server ready")
+end)
+sched.loop()
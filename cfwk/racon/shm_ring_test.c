@@ -0,0 +1,136 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+#include "shm_ring.h"
+#include "testutils.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Offsets of the shared counters, as laid out by shm_ring.c
+#define DIR_OFFSET(dir) (64 + (dir) * 192)
+#define HEAD 0
+#define TAIL 64
+
+static ShmRing *creator, *peer;
+static char* hdr;
+static int shmfd;
+
+static swi_status_t open_channel()
+{
+  int fds[3], peerfds[3], i;
+
+  if (ShmRing_Create(&creator, SHM_RING_MIN_SIZE, fds) != SWI_STATUS_OK)
+    return SWI_STATUS_UNKNOWN_ERROR;
+  for (i = 0; i < 3; i++)
+    peerfds[i] = dup(fds[i]);
+  if (ShmRing_Attach(&peer, peerfds) != SWI_STATUS_OK)
+    return SWI_STATUS_UNKNOWN_ERROR;
+  // the view of a hostile peer
+  shmfd = fds[0];
+  hdr = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+  return hdr == MAP_FAILED ? SWI_STATUS_UNKNOWN_ERROR : SWI_STATUS_OK;
+}
+
+static void close_channel()
+{
+  munmap(hdr, 4096);
+  ShmRing_Destroy(peer);
+  ShmRing_Destroy(creator);
+}
+
+static uint32_t* counter(int dir, int which)
+{
+  return (uint32_t*) (hdr + DIR_OFFSET(dir) + which);
+}
+
+static swi_status_t test_1_ReadWrite()
+{
+  char buffer[8192];
+  swi_status_t res = SWI_STATUS_UNKNOWN_ERROR;
+
+  if (open_channel() != SWI_STATUS_OK)
+    return SWI_STATUS_UNKNOWN_ERROR;
+  memset(buffer, 'x', sizeof(buffer));
+  if (ShmRing_Write(peer, buffer, sizeof(buffer)) == SHM_RING_MIN_SIZE // the ring is full
+      && ShmRing_Write(peer, buffer, 1) == 0
+      && ShmRing_Available(creator) == SHM_RING_MIN_SIZE
+      && ShmRing_Read(creator, buffer, 10) == 10
+      && ShmRing_Read(creator, buffer, sizeof(buffer)) == SHM_RING_MIN_SIZE - 10
+      && ShmRing_Read(creator, buffer, sizeof(buffer)) == 0)
+    res = SWI_STATUS_OK;
+  close_channel();
+  return res;
+}
+
+// A head too far ahead of the tail would make the reader copy past the ring
+static swi_status_t test_2_CorruptedHead()
+{
+  char buffer[8192];
+  swi_status_t res = SWI_STATUS_UNKNOWN_ERROR;
+
+  if (open_channel() != SWI_STATUS_OK)
+    return SWI_STATUS_UNKNOWN_ERROR;
+  if (ShmRing_Write(peer, "abc", 3) == 3)
+  {
+    *counter(1, HEAD) = *counter(1, TAIL) + 2 * SHM_RING_MIN_SIZE;
+    if (ShmRing_Read(creator, buffer, sizeof(buffer)) == -1
+        && ShmRing_Available(creator) == 0
+        && ShmRing_Write(creator, "abc", 3) == -1) // the whole channel is broken
+      res = SWI_STATUS_OK;
+  }
+  close_channel();
+  return res;
+}
+
+// A tail ahead of the head would make the writer see a huge room
+static swi_status_t test_3_CorruptedTail()
+{
+  swi_status_t res = SWI_STATUS_UNKNOWN_ERROR;
+
+  if (open_channel() != SWI_STATUS_OK)
+    return SWI_STATUS_UNKNOWN_ERROR;
+  if (ShmRing_Write(creator, "abc", 3) == 3)
+  {
+    *counter(0, TAIL) = *counter(0, HEAD) + 1;
+    if (ShmRing_Write(creator, "abc", 3) == -1)
+      res = SWI_STATUS_OK;
+  }
+  close_channel();
+  return res;
+}
+
+// The peer cannot resize the shared file under our mapping
+static swi_status_t test_4_Sealed()
+{
+  swi_status_t res = SWI_STATUS_UNKNOWN_ERROR;
+
+  if (open_channel() != SWI_STATUS_OK)
+    return SWI_STATUS_UNKNOWN_ERROR;
+  if (ftruncate(shmfd, 0) < 0 && ftruncate(shmfd, 1 << 20) < 0
+      && ShmRing_Write(creator, "abc", 3) == 3)
+    res = SWI_STATUS_OK;
+  close_channel();
+  return res;
+}
+
+int main(int argc, char** argv)
+{
+  INIT_TEST("SHM_RING_TEST");
+
+  CHECK_TEST(test_1_ReadWrite());
+  CHECK_TEST(test_2_CorruptedHead());
+  CHECK_TEST(test_3_CorruptedTail());
+  CHECK_TEST(test_4_Sealed());
+
+  return 0;
+}
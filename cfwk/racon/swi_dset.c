@@ -22,23 +22,184 @@
 
 #define DSET_INIT_INDEX (UINT32_MAX)
 
+/*
+ * Elements, with their name and string value, are allocated in an arena: a
+ * list of blocks, each one twice as large as the previous one. The space of
+ * removed elements is reclaimed by compacting the arena once it exceeds the
+ * space of the elements left.
+ *
+ * By name lookups in sets of more than DSET_INDEX_THRESHOLD elements go
+ * through an open addressing hash table of the elements, built on the first
+ * lookup, updated by pushes and dropped by removals.
+ */
+#define DSET_BLOCK_SIZE 256
+#define DSET_INDEX_THRESHOLD 16
+#define DSET_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+typedef struct dset_Block
+{
+  struct dset_Block *next;
+  size_t size;
+  size_t used;
+  char data[];
+} dset_Block_t;
+
 struct swi_dset_Iterator
 {
   unsigned int magic;
   unsigned int currentIndex;
   swi_dset_Element_t* currentElt;
   PointerList* list;
+  dset_Block_t* arena; //current block, older blocks follow
+  size_t live; //space used by the elements of the list
+  size_t dead; //space used by removed elements
+  swi_dset_Element_t** index; //hash table of the elements by name, NULL if not built
+  unsigned int indexSize; //power of 2
+  unsigned int indexCount;
 };
 
+static void* arenaAlloc(swi_dset_Iterator_t* set, size_t size)
+{
+  dset_Block_t *b = set->arena;
+  size_t bsize;
+  void *p;
+
+  size = DSET_ALIGN(size);
+  if (NULL == b || b->used + size > b->size)
+  {
+    for (bsize = b ? 2 * b->size : DSET_BLOCK_SIZE; bsize < size; bsize *= 2)
+      ;
+    b = malloc(sizeof(*b) + bsize);
+    if (NULL == b)
+      return NULL;
+    b->next = set->arena;
+    b->size = bsize;
+    b->used = 0;
+    set->arena = b;
+  }
+  p = b->data + b->used;
+  b->used += size;
+  return p;
+}
+
+static void arenaFree(dset_Block_t* b)
+{
+  dset_Block_t *next;
+  for (; b; b = next)
+  {
+    next = b->next;
+    free(b);
+  }
+}
+
+static size_t elementSize(swi_dset_Element_t* e)
+{
+  size_t size = sizeof(*e) + strlen(e->name) + 1;
+  if (SWI_DSET_STRING == e->type)
+    size += strlen(e->val.sval) + 1;
+  return DSET_ALIGN(size);
+}
+
+/* Copies an element, with its name and value, to dst, which must hold elementSize(e) bytes. */
+static swi_dset_Element_t* copyElement(swi_dset_Element_t* e, void* dst)
+{
+  swi_dset_Element_t *t = dst;
+  size_t len = strlen(e->name) + 1;
+
+  *t = *e;
+  t->name = (char*) (t + 1);
+  memcpy(t->name, e->name, len);
+  if (SWI_DSET_STRING == e->type)
+  {
+    t->val.sval = t->name + len;
+    memcpy(t->val.sval, e->val.sval, strlen(e->val.sval) + 1);
+  }
+  return t;
+}
+
+/* Moves the elements to a single block, the size of the elements left. */
+static void arenaCompact(swi_dset_Iterator_t* set)
+{
+  dset_Block_t *b;
+  swi_dset_Element_t *e = NULL;
+  unsigned int i, size = 0;
+
+  PointerList_GetSize(set->list, &size, NULL);
+  b = malloc(sizeof(*b) + (set->live > DSET_BLOCK_SIZE ? set->live : DSET_BLOCK_SIZE));
+  if (NULL == b)
+    return; //keep the removed elements around
+  b->next = NULL;
+  b->size = set->live > DSET_BLOCK_SIZE ? set->live : DSET_BLOCK_SIZE;
+  b->used = 0;
+  for (i = 0; i < size; i++)
+  {
+    PointerList_Peek(set->list, i, (void**) &e);
+    PointerList_Poke(set->list, i, copyElement(e, b->data + b->used));
+    b->used += elementSize(e);
+  }
+  arenaFree(set->arena);
+  set->arena = b;
+  set->dead = 0;
+}
+
+static unsigned int hashName(const char* name)
+{
+  unsigned int h = 2166136261u; //FNV-1a
+  while (*name)
+    h = (h ^ (unsigned char) *name++) * 16777619u;
+  return h;
+}
+
+/* Adds an element to the index, unless an element with the same name is already there. */
+static void indexInsert(swi_dset_Iterator_t* set, swi_dset_Element_t* e)
+{
+  unsigned int mask = set->indexSize - 1, i;
+
+  for (i = hashName(e->name) & mask; set->index[i]; i = (i + 1) & mask)
+    if (!strcmp(set->index[i]->name, e->name))
+      return; //first match by name is used
+  set->index[i] = e;
+  set->indexCount++;
+}
+
+static void indexDrop(swi_dset_Iterator_t* set)
+{
+  free(set->index);
+  set->index = NULL;
+  set->indexSize = set->indexCount = 0;
+}
+
+/* Builds the index, with a load factor of at most 1/2. */
+static swi_status_t indexBuild(swi_dset_Iterator_t* set, unsigned int nbElts)
+{
+  swi_dset_Element_t *e = NULL;
+  unsigned int i, size;
+
+  for (size = 2 * DSET_INDEX_THRESHOLD; size < 2 * nbElts; size *= 2)
+    ;
+  indexDrop(set);
+  set->index = calloc(size, sizeof(*set->index));
+  if (NULL == set->index)
+    return SWI_STATUS_ALLOC_FAILED;
+  set->indexSize = size;
+  for (i = 0; i < nbElts; i++)
+  {
+    PointerList_Peek(set->list, i, (void**) &e);
+    indexInsert(set, e);
+  }
+  return SWI_STATUS_OK;
+}
+
 swi_status_t dset_PushData(swi_dset_Iterator_t* set, const char* name, size_t nameLength, void *data, size_t dataLength, swi_dset_Type_t type)
 {
   swi_dset_Element_t *t = NULL;
+  swi_status_t res;
 
   CHECK_CONTEXT(set);
   if (NULL == name ||0 == nameLength)
     return SWI_STATUS_WRONG_PARAMS;
 
-  t = malloc(sizeof(*t) + nameLength + 1 + dataLength);
+  t = arenaAlloc(set, sizeof(*t) + nameLength + 1 + dataLength);
   if (t == NULL)
     return SWI_STATUS_ALLOC_FAILED;
 
@@ -67,7 +228,18 @@ swi_status_t dset_PushData(swi_dset_Iterator_t* set, const char* name, size_t na
       break;
   }
 
-  return PointerList_PushLast(set->list, (void*) t);
+  res = PointerList_PushLast(set->list, (void*) t);
+  if (SWI_STATUS_OK != res)
+    return res;
+  set->live += elementSize(t);
+  if (set->index)
+  {
+    if (2 * (set->indexCount + 1) > set->indexSize)
+      indexDrop(set); //rebuilt larger on next lookup
+    else
+      indexInsert(set, t);
+  }
+  return SWI_STATUS_OK;
 }
 
 /* Internal functions*/
@@ -78,7 +250,7 @@ swi_status_t dset_PushData(swi_dset_Iterator_t* set, const char* name, size_t na
  * */
 swi_status_t swi_dset_Create(swi_dset_Iterator_t** set)
 {
-  swi_dset_Iterator_t* s = malloc(sizeof(*s));
+  swi_dset_Iterator_t* s = calloc(1, sizeof(*s));
   if (NULL == s)
   {
     return SWI_STATUS_ALLOC_FAILED;
@@ -143,6 +315,25 @@ swi_status_t findByName(swi_dset_Iterator_t* data, const char* namePtr, swi_dset
   if (SWI_STATUS_OK != res)
     return res;
   swi_dset_Element_t * e = NULL;
+  if (NULL == eltIndex && size > DSET_INDEX_THRESHOLD)
+  {
+    if (NULL == data->index && SWI_STATUS_OK != indexBuild(data, size))
+      indexDrop(data); //not enough memory for the index, scan the list
+    else
+    {
+      unsigned int mask = data->indexSize - 1;
+      for (i = hashName(namePtr) & mask; data->index[i]; i = (i + 1) & mask)
+      {
+        if (!strcmp(data->index[i]->name, namePtr))
+        {
+          if (elt)
+            *elt = data->index[i];
+          return SWI_STATUS_OK;
+        }
+      }
+      return SWI_STATUS_DA_NOT_FOUND;
+    }
+  }
   for (i = 0; i < size; i++)
   {
     PointerList_Peek(data->list, i, (void**) &e);
@@ -182,10 +373,22 @@ swi_status_t swi_dset_RemoveByName(swi_dset_Iterator_t* data, const char* namePt
 
   swi_dset_Element_t * tmp = NULL;
   res = PointerList_Remove(data->list, index, (void**)&tmp);
+  if (SWI_STATUS_OK != res)
+    return res;
+  indexDrop(data);
   if (elt)
-    *elt = tmp;
-  else
-    free(tmp);
+  {
+    //the element lives in the arena, give a copy to the caller
+    *elt = malloc(elementSize(tmp));
+    if (NULL == *elt)
+      res = SWI_STATUS_ALLOC_FAILED;
+    else
+      copyElement(tmp, *elt);
+  }
+  data->live -= elementSize(tmp);
+  data->dead += elementSize(tmp);
+  if (data->dead > data->live && data->dead > DSET_BLOCK_SIZE)
+    arenaCompact(data);
   return res;
 }
 
@@ -197,22 +400,9 @@ swi_status_t swi_dset_Destroy(swi_dset_Iterator_t* data)
   data->magic = ~data->magic;
   swi_status_t res = SWI_STATUS_OK;
 
-  //free each swi_dset_Element_t!
-  unsigned int i = 0;
-  unsigned int size = 0;
-  res = PointerList_GetSize(data->list, &size, NULL );
-  if (res != SWI_STATUS_OK)
-    return res;
-  swi_dset_Element_t * elt = NULL;
-  for (i = 0; i < size; i++)
-  {
-    PointerList_Peek(data->list, i, (void**) &elt);
-    if (elt)
-    {
-      free(elt); //only one alloc per swi_dset_Element_t, to be sync with functions creating swi_dset_Element_t.
-      elt = NULL;
-    }
-  }
+  //elements are all in the arena
+  arenaFree(data->arena);
+  indexDrop(data);
 
   res = PointerList_Destroy(data->list);
   free(data);
@@ -136,10 +136,13 @@ static bsd_status_t bsd_object( bsd_ctx_t *ctx, bsd_data_t *x, bs_classid_t clas
     if( BSD_ERROR == x->type) return 0; \
   } while( 0)
 
-/* TODO: explain how this works. */
+/* Decode a value embedded after the `nread` bytes already read: add its
+ * length to nread. If data is missing, return the number of bytes needed
+ * counted from the beginning of the enclosing value; on errors, return 0. */
 #define CHECK_SUBDECODE( expr, expectedtype) do { \
     int _subread = (expr); \
-    if( _subread <= 0) return -nread - _subread; \
+    if( _subread < 0) return _subread - nread; \
+    if( 0 == _subread) return BSD_ERROR == x->type ? 0 : bsd_error( x, BSD_EINVALID); \
     if( (expectedtype) != x->type) return bsd_error( x, BSD_EINVALID); \
     nread += _subread; \
   } while( 0)
@@ -233,7 +236,7 @@ static int decodeCollection( bsd_ctx_t *ctx, bsd_data_t *x, const uint8_t *buffe
     CHECK_ERROR( openContainer( ctx, enc->fixed_kind, BS_CTXID_GLOBAL, x->content.length, f));
   } else if( enc->long_untyped_opcode == opcode) {
     /* Long untyped container */
-    CHECK_SUBDECODE( bsd_uis( ctx, x, buffer + 1, length + 1), BSD_INT);
+    CHECK_SUBDECODE( bsd_uis( ctx, x, buffer + 1, length - 1), BSD_INT);
     x->type = bsd_typeFromFrameKind( enc->fixed_kind);
     x->content.length = x->content.i + enc->small_limit + 1;
     CHECK_ERROR( openContainer( ctx, enc->fixed_kind, BS_CTXID_GLOBAL, x->content.length, f));
@@ -249,7 +252,7 @@ static int decodeCollection( bsd_ctx_t *ctx, bsd_data_t *x, const uint8_t *buffe
     CHECK_ERROR( openContainer( ctx, enc->fixed_kind, buffer[1], x->content.length, f));
   } else if( enc->long_typed_opcode == opcode) {
     /* Long typed container */
-    CHECK_SUBDECODE( bsd_uis( ctx, x, buffer + 1, length + 1), BSD_INT);
+    CHECK_SUBDECODE( bsd_uis( ctx, x, buffer + 1, length - 1), BSD_INT);
     CHECK_LENGTH( nread + 1);
     x->type = bsd_typeFromFrameKind( enc->fixed_kind);
     x->content.length = x->content.i + enc->small_limit + 1;
@@ -58,8 +58,11 @@ static bs_ctxid_t getctxid( struct bss_stackframe_t *f) {
   } while( 0)
 
 static bss_status_t startTransaction( bss_ctx_t *ctx) {
-  struct bss_stackframe_t *f = topframe( ctx);
+  struct bss_stackframe_t *f;
+  /* Drop the frames opened by an interrupted transaction before checking
+   * the enclosing container. */
   ctx->stacksize = ctx->acknowledged_stacksize;
+  f = topframe( ctx);
   if( ctx->broken) {
     return BSS_EBROKEN;
   } else if( (BS_FLIST == f->kind || BS_FMAP == f->kind || BS_FOBJECT == f->kind) && 0 == f->missing) {
@@ -148,45 +151,74 @@ static bss_status_t writeByte( bss_ctx_t *ctx, uint8_t k) {
  */
 #define COMPUTE_OFFSET(x, ifneg, ifpos) (( x<0) ? ((-x) - (-ifneg+1)) : (x - (ifpos+1)))
 
-static bss_status_t writeIntegerBigEndian( bss_ctx_t *ctx, int64_t x, size_t nbytes) {
+/* Encode the 'nbytes' lowest bytes of 'x' into 'p', most significant first. */
+static void encodeIntegerBigEndian( uint8_t *p, int64_t x, size_t nbytes) {
   int i;
   for( i = (nbytes - 1) * 8; i >= 0; i -= 8)
-    TRY( writeByte( ctx, (x>>i) & 0xff));
-  return BSS_EOK;
+    *p++ = (x>>i) & 0xff;
 }
 
-static bss_status_t writeInteger( bss_ctx_t *ctx, int64_t x, const bs_integer_encoding_t *enc) {
+static bss_status_t writeIntegerBigEndian( bss_ctx_t *ctx, int64_t x, size_t nbytes) {
+  uint8_t buffer[8];
+  encodeIntegerBigEndian( buffer, x, nbytes);
+  return writeData( ctx, buffer, nbytes);
+}
+
+/* Encode an integer into 'p', which must have room for 9 bytes.
+ * Returns the number of bytes encoded. */
+static size_t encodeInteger( uint8_t *p, int64_t x, const bs_integer_encoding_t *enc) {
   if( enc->tiny_min <= x && x <= enc->tiny_max) {
-    return writeByte( ctx, enc->tiny_zero_opcode + x);
+    p[0] = enc->tiny_zero_opcode + x;
+    return 1;
 
   } else if( enc->small_min <= x && x <= enc->small_max) {
     int offset = COMPUTE_OFFSET(x, enc->tiny_min, enc->tiny_max);
     uint8_t opbase = (x < 0) ? enc->small_neg_opcode : enc->small_pos_opcode;
-    return writeBytes( ctx, 2, opbase + (offset >> 8), offset & 0xff);
+    p[0] = opbase + (offset >> 8);
+    p[1] = offset & 0xff;
+    return 2;
 
   } else if( enc->medium_min <= x && x <= enc->medium_max) {
     int offset = COMPUTE_OFFSET(x, enc->small_min, enc->small_max);
     uint8_t opbase = (x < 0) ? enc->medium_neg_opcode : enc->medium_pos_opcode;
-    return writeBytes( ctx, 3, opbase + (offset >> 16), (offset >> 8) & 0xff, offset & 0xff);
+    p[0] = opbase + (offset >> 16);
+    encodeIntegerBigEndian( p + 1, offset, 2);
+    return 3;
 
   } else if( enc->large_min <= x && x <= enc->large_max) {
     int offset = COMPUTE_OFFSET(x, enc->medium_min, enc->medium_max);
     uint8_t opbase = (x < 0) ? enc->large_neg_opcode : enc->large_pos_opcode;
-    return writeBytes( ctx, 4, opbase + (offset >> 24), (offset >> 16) & 0xff, (offset >> 8) & 0xff,
-        offset & 0xff);
+    p[0] = opbase + (offset >> 24);
+    encodeIntegerBigEndian( p + 1, offset, 3);
+    return 4;
 
   } else if( (int64_t) ((int32_t) x) == x) {
-    TRY( writeByte( ctx, enc->int32_opcode));
-    TRY( writeIntegerBigEndian( ctx, x, 4));
-    return BSS_EOK;
+    p[0] = enc->int32_opcode;
+    encodeIntegerBigEndian( p + 1, x, 4);
+    return 5;
 
   } else {
-    TRY( writeByte( ctx, enc->int64_opcode));
-    TRY( writeIntegerBigEndian( ctx, x, 8));
-    return BSS_EOK;
+    p[0] = enc->int64_opcode;
+    encodeIntegerBigEndian( p + 1, x, 8);
+    return 9;
   }
 }
 
+/* Number of bytes encodeInteger() would produce. */
+static size_t integerLength( int64_t x, const bs_integer_encoding_t *enc) {
+  if( enc->tiny_min <= x && x <= enc->tiny_max) return 1;
+  else if( enc->small_min <= x && x <= enc->small_max) return 2;
+  else if( enc->medium_min <= x && x <= enc->medium_max) return 3;
+  else if( enc->large_min <= x && x <= enc->large_max) return 4;
+  else if( (int64_t) ((int32_t) x) == x) return 5;
+  else return 9;
+}
+
+static bss_status_t writeInteger( bss_ctx_t *ctx, int64_t x, const bs_integer_encoding_t *enc) {
+  uint8_t buffer[9];
+  return writeData( ctx, buffer, encodeInteger( buffer, x, enc));
+}
+
 static bss_status_t writeUnsignedInteger( bss_ctx_t *ctx, uint32_t x) {
   if( x <= BS_UTI_MAX) {
     return writeByte( ctx, x + 0x3b);
@@ -226,7 +258,8 @@ typedef struct bss_float_encoding_t {
 static const bss_float_encoding_t GLOBAL_FLOAT_OPCODES = { BS_G_FLOAT32, BS_G_FLOAT64 };
 static const bss_float_encoding_t NUMBER_FLOAT_OPCODES = { BS_N_FLOAT32, BS_N_FLOAT64 };
 
-static bss_status_t writeFloat32( bss_ctx_t *ctx, float x) {
+/* Encode a float into 4 bytes at 'p'. */
+static void encodeFloat32( uint8_t *p, float x) {
   int i;
   // WARNING! check endianness!
   union float_as_byte_char {
@@ -235,11 +268,11 @@ static bss_status_t writeFloat32( bss_ctx_t *ctx, float x) {
   } u;
   u.f = x;
   for( i = 0; i < sizeof(FLOAT_BYTES) / sizeof(FLOAT_BYTES[0]); i++)
-    TRY( writeByte( ctx, u.k[FLOAT_BYTES[i]]));
-  return BSS_EOK;
+    p[i] = u.k[FLOAT_BYTES[i]];
 }
 
-static bss_status_t writeFloat64( bss_ctx_t *ctx, double x) {
+/* Encode a double into 8 bytes at 'p'. */
+static void encodeFloat64( uint8_t *p, double x) {
   int i;
   // WARNING! check endianness!
   union float_as_byte_char {
@@ -248,8 +281,19 @@ static bss_status_t writeFloat64( bss_ctx_t *ctx, double x) {
   } u;
   u.f = x;
   for( i = 0; i < sizeof(DOUBLE_BYTES) / sizeof(DOUBLE_BYTES[0]); i++)
-    TRY( writeByte( ctx, u.k[DOUBLE_BYTES[i]]));
-  return BSS_EOK;
+    p[i] = u.k[DOUBLE_BYTES[i]];
+}
+
+static bss_status_t writeFloat32( bss_ctx_t *ctx, float x) {
+  uint8_t buffer[4];
+  encodeFloat32( buffer, x);
+  return writeData( ctx, buffer, 4);
+}
+
+static bss_status_t writeFloat64( bss_ctx_t *ctx, double x) {
+  uint8_t buffer[8];
+  encodeFloat64( buffer, x);
+  return writeData( ctx, buffer, 8);
 }
 
 static bss_status_t writeFloat( bss_ctx_t *ctx, double x, const bss_float_encoding_t *enc) {
@@ -376,6 +420,146 @@ static void getNullToken( bs_ctxid_t ctxid, const uint8_t** buffer, size_t *len)
   }
 }
 
+/*
+ * Numeric arrays.
+ * Array elements are encoded in a local scratch buffer, which is written
+ * whenever it is full, rather than through one writer call per byte or
+ * per value. An array is either a list of integers 'ints', or a list of
+ * doubles 'doubles'; the other pointer is NULL.
+ */
+#define ARRAY_SCRATCH_SIZE 1024
+#define ARRAY_ELEMENT_MAX 9
+
+/* Whether 'x' is encoded as an integer by bss_double(). */
+static int isInteger( double x) {
+  return -9.2e18 < x && x < 9.2e18 && (double) (int64_t) x == x;
+}
+
+/* Choose the list context which gives the shortest encoding to an array:
+ * global and number contexts encode small integers on a single byte, the
+ * int32, float and double contexts encode every value on a fixed size,
+ * but only accept some values and cost a context byte. */
+static bs_ctxid_t chooseArrayContext( const int64_t *ints, const double *doubles, int n) {
+  size_t global = 0, number = 1, int32 = 1, float32 = 1, float64 = 1;
+  int i, isint32 = 1, isfloat = NULL != doubles;
+
+  for( i = 0; i < n; i++) {
+    if( ints || isInteger( doubles[i])) {
+      int64_t x = ints ? ints[i] : (int64_t) doubles[i];
+      global += integerLength( x, &BS_GLOBAL_INTEGER);
+      number += integerLength( x, &BS_NUMBER_INTEGER);
+      if( (int64_t) ((int32_t) x) != x) isint32 = 0;
+      else int32 += INT32_MIN == x ? 5 : 4;
+    } else {
+      size_t len = (double) (float) doubles[i] == doubles[i] ? 5 : 9;
+      global += len;
+      number += len;
+      isint32 = 0;
+    }
+    if( doubles) {
+      union { double d; uint64_t i; } ux;
+      ux.d = doubles[i];
+      if( (double) (float) doubles[i] != doubles[i]) isfloat = 0;
+      float32 += 4; /* the escaped 0xFFFFFFFF pattern is a NaN, never exact */
+      float64 += 0xFFFFFFFFFFFFFFFFLL == ux.i ? 9 : 8;
+    }
+  }
+
+  if( 0 == n) return BS_CTXID_GLOBAL;
+  if( !isint32) int32 = SIZE_MAX;
+  if( !isfloat) float32 = SIZE_MAX;
+  if( !doubles) float64 = SIZE_MAX;
+  if( global <= number && global <= int32 && global <= float32 && global <= float64)
+    return BS_CTXID_GLOBAL;
+  if( number <= int32 && number <= float32 && number <= float64) return BS_CTXID_NUMBER;
+  if( int32 <= float32 && int32 <= float64) return BS_CTXID_INT32;
+  if( float32 <= float64) return BS_CTXID_FLOAT;
+  return BS_CTXID_DOUBLE;
+}
+
+/* Encode the i-th element of an array into 'p', in a context chosen by
+ * chooseArrayContext(). Returns the number of bytes encoded, at most
+ * ARRAY_ELEMENT_MAX. */
+static size_t encodeArrayElement( uint8_t *p, const int64_t *ints, const double *doubles, int i,
+    bs_ctxid_t ctxid) {
+  switch( ctxid) {
+  case BS_CTXID_INT32: {
+    int64_t x = ints ? ints[i] : (int64_t) doubles[i];
+    encodeIntegerBigEndian( p, x, 4);
+    if( INT32_MIN != x) return 4;
+    p[4] = 0x01;
+    return 5;
+  }
+  case BS_CTXID_FLOAT: {
+    union { float f; uint32_t i; } ux;
+    ux.f = (float) doubles[i];
+    encodeFloat32( p, ux.f);
+    if( 0xFFFFFFFF != ux.i) return 4;
+    p[4] = 0x01;
+    return 5;
+  }
+  case BS_CTXID_DOUBLE: {
+    union { double d; uint64_t i; } ux;
+    ux.d = doubles[i];
+    encodeFloat64( p, ux.d);
+    if( 0xFFFFFFFFFFFFFFFFLL != ux.i) return 8;
+    p[8] = 0x01;
+    return 9;
+  }
+  default: {
+    int global = BS_CTXID_GLOBAL == ctxid;
+    const bss_float_encoding_t *opcodes = global ? &GLOBAL_FLOAT_OPCODES : &NUMBER_FLOAT_OPCODES;
+    double x;
+    if( ints) return encodeInteger( p, ints[i], global ? &BS_GLOBAL_INTEGER : &BS_NUMBER_INTEGER);
+    x = doubles[i];
+    if( isInteger( x)) return encodeInteger( p, (int64_t) x, global ? &BS_GLOBAL_INTEGER : &BS_NUMBER_INTEGER);
+    if( (double) (float) x == x) {
+      p[0] = opcodes->float32_opcode;
+      encodeFloat32( p + 1, (float) x);
+      return 5;
+    }
+    p[0] = opcodes->float64_opcode;
+    encodeFloat64( p + 1, x);
+    return 9;
+  }
+  }
+}
+
+/* Write a whole fixed size list of numbers, see bss_int_array(). */
+static bss_status_t writeArray( bss_ctx_t *ctx, const int64_t *ints, const double *doubles, int n) {
+  const bs_coll_encoding_t *enc;
+  bs_ctxid_t ctxid;
+  uint8_t scratch[ARRAY_SCRATCH_SIZE];
+  size_t used = 0;
+  int i;
+
+  switch( getctxid( topframe( ctx))) {
+  case BS_CTXID_GLOBAL:
+    enc = &BS_GLOBAL_LIST;
+    break;
+  case BS_CTXID_LIST_OR_MAP:
+    enc = &BS_LISTMAP_LIST;
+    break;
+  default:
+    return BSS_EBADCONTEXT;
+  }
+  if( n < 0) return BSS_EINVALID;
+  ctxid = chooseArrayContext( ints, doubles, n);
+
+  START_TRANSACTION;
+  TRY( openCollection( ctx, n, ctxid, NULL, enc));
+  for( i = 0; i < n; i++) {
+    if( used > ARRAY_SCRATCH_SIZE - ARRAY_ELEMENT_MAX) {
+      TRY( writeData( ctx, scratch, used));
+      used = 0;
+    }
+    used += encodeArrayElement( scratch + used, ints, doubles, i, ctxid);
+  }
+  if( used > 0) TRY( writeData( ctx, scratch, used));
+  ctx->stacksize--; /* the list is already complete */
+  COMMIT_AND_RETURN;
+}
+
 /*
  * Public API
  */
@@ -738,3 +922,10 @@ bss_status_t bss_raw( bss_ctx_t *ctx, const unsigned char *data, size_t len) {
   COMMIT_AND_RETURN;
 }
 
+bss_status_t bss_int_array( bss_ctx_t *ctx, const int64_t *values, int n) {
+  return writeArray( ctx, values, NULL, n);
+}
+
+bss_status_t bss_double_array( bss_ctx_t *ctx, const double *values, int n) {
+  return writeArray( ctx, NULL, values, n);
+}
@@ -185,6 +185,23 @@ bss_status_t bss_bool( bss_ctx_t *ctx, int x);
  * another BSS_EXXX error, or a writer-returned negative error code. */
 bss_status_t bss_double( bss_ctx_t *ctx, double x);
 
+/* Serialize a fixed size list of 'n' integers, in a single transaction.
+ * This is equivalent to bss_list() followed by one bss_int() per value,
+ * except that the list context which gives the shortest encoding is chosen,
+ * and that the values are passed to the writer in blocks rather than one
+ * by one.
+ * returns: 0 on success, BSS_EAGAIN in case of writer overflow,
+ * another BSS_EXXX error, or a writer-returned negative error code. */
+bss_status_t bss_int_array( bss_ctx_t *ctx, const int64_t *values, int n);
+
+/* Serialize a fixed size list of 'n' floating point numbers, as
+ * bss_int_array() does for integers. Integral values are serialized as
+ * integers, as with bss_double(), unless a float or double list context is
+ * shorter.
+ * returns: 0 on success, BSS_EAGAIN in case of writer overflow,
+ * another BSS_EXXX error, or a writer-returned negative error code. */
+bss_status_t bss_double_array( bss_ctx_t *ctx, const double *values, int n);
+
 /* Serialize a string of length 'len'.
  * returns: 0 on success, BSS_EAGAIN in case of writer overflow,
  * another BSS_EXXX error, or a writer-returned negative error code. */
@@ -11,6 +11,7 @@
  *******************************************************************************/
 #include "sdb_internal.h"
 #include <stdlib.h> // qsort
+#include <string.h> // memcpy
 
 
 
@@ -44,56 +45,69 @@ static int cons_init( struct sdb_cons_ctx_t *ctx,
     return SDB_EOK;
 }
 
-/* Parse a value to consolidate. If this function returns a non-zero
- * value, then there is no need to parse the remaining elements. */
+/* Numeric methods are computed by reduction kernels, over batches of
+ * decoded values; the others only need the position of a cell. */
+static int cons_numeric( enum sdb_consolidation_method_t method) {
+    switch( method) {
+    case SDB_CM_MAX: case SDB_CM_MIN: case SDB_CM_MEAN:
+    case SDB_CM_SUM: case SDB_CM_MEDIAN:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Number of rows decoded at once for numeric consolidations. */
+#define SDB_CONS_BATCH 128
+
+/* Reduce a batch of n values of a numeric column. As in the kernels, max and
+ * min skip NaN: they are only NaN as long as every value is. */
+static void cons_reduce_batch( struct sdb_cons_ctx_t *cons_ctx,
+        const double *v,
+        int n) {
+    double d;
+    int first = (0 == cons_ctx->iteration);
+    union sdb_cons_ctx_content_t *u = & cons_ctx->content;
+
+    if( SDB_CCS_RUNNING != cons_ctx->state || n <= 0) return;
+
+    switch( cons_ctx->method) {
+    case SDB_CM_MAX: d = sdb_reduce_max( v, n); if( first || d>u->max || u->max!=u->max) u->max=d; break;
+    case SDB_CM_MIN: d = sdb_reduce_min( v, n); if( first || d<u->min || u->min!=u->min) u->min=d; break;
+    case SDB_CM_MEAN:
+    case SDB_CM_SUM: u->sum += sdb_reduce_sum( v, n); break;
+    case SDB_CM_MEDIAN: memcpy( u->median + cons_ctx->iteration, v, n * sizeof( *v)); break;
+    default: return;
+    }
+    cons_ctx->iteration += n;
+}
+
+/* Take note of the position of a cell, for the methods which copy one of
+ * the cells as it is. */
 static void cons_reduce( struct sdb_cons_ctx_t *cons_ctx,
-        struct bsd_data_t *data,
         int offset,
-        int length) {
-    double d;
+        int length,
+        const struct bsd_data_t *bsd_data) {
     int i;
-    enum  sdb_consolidation_method_t method = cons_ctx->method;
-    union sdb_cons_ctx_content_t    *u      = & cons_ctx->content;
+    union sdb_cons_ctx_content_t *u = & cons_ctx->content;
 
     if( SDB_CCS_RUNNING != cons_ctx->state) return;
 
     i = (cons_ctx->iteration) ++;
 
-    switch( method) {
-    case SDB_CM_MAX:
-    case SDB_CM_MIN:
-    case SDB_CM_MEAN:
-    case SDB_CM_SUM:
-    case SDB_CM_MEDIAN:
-      /* Retrieve the double value from data. */
-      switch( data->type) {
-      case BSD_INT:    d = (double) data->content.i; break;
-      case BSD_DOUBLE: d = data->content.d; break;
-      default: cons_ctx->state = SDB_CCS_BROKEN; return;
-      }
-
-      /* Perform reduction operation on double d. */
-      switch( method) {
-      case SDB_CM_MAX:  if( 0==i || d>u->max) u->max=d; return;
-      case SDB_CM_MIN:  if( 0==i || d<u->min) u->min=d; return;
-      case SDB_CM_MEAN:
-      case SDB_CM_SUM: u->sum += d; return;
-      case SDB_CM_MEDIAN: u->median[i] = d; return;
-      default: return; /* for warning suppression: this case cannot happen. */
-      }
-
-    case SDB_CM_FIRST:
-    case SDB_CM_LAST:
-    case SDB_CM_MIDDLE:
-      switch( method) {
-      case SDB_CM_FIRST:  if( i != 0) return; else break;
-      case SDB_CM_LAST:   if( i != cons_ctx->nrows-1) return; else break;
-      case SDB_CM_MIDDLE: if( i != cons_ctx->nrows/2) return; else break;
-      default: return; /* for warning suppression: this case cannot happen. */
-      }
-      u->streampos.offset = offset;
-      u->streampos.length = length;
-      return;
+    switch( cons_ctx->method) {
+    case SDB_CM_FIRST:  if( i != 0) return; else break;
+    case SDB_CM_LAST:   if( i != cons_ctx->nrows-1) return; else break;
+    case SDB_CM_MIDDLE: if( i != cons_ctx->nrows/2) return; else break;
+    default: return; /* numeric methods are handled by cons_reduce_batch(). */
+    }
+    u->streampos.offset = offset;
+    u->streampos.length = length;
+    u->streampos.type   = bsd_data->type;
+    switch( bsd_data->type) {
+    case BSD_INT:    u->streampos.d = (double) bsd_data->content.i; break;
+    case BSD_DOUBLE: u->streampos.d = bsd_data->content.d; break;
+    default: break;
     }
 }
 
@@ -185,6 +199,11 @@ static void cons_finalize( struct sdb_cons_ctx_t *ctx,
     case SDB_CM_FIRST:
     case SDB_CM_LAST:
     case SDB_CM_MIDDLE:
+        switch( u->streampos.type) {
+        case BSD_INT:    sdb_analyze_integer( dst, (int) u->streampos.d); break;
+        case BSD_DOUBLE: sdb_analyze_double( dst, u->streampos.d); break;
+        default:         sdb_analyze_noninteger( dst, 0); break;
+        }
         r = copy_data( src, dst, u->streampos.offset, u->streampos.length);
         if( r != SDB_EOK) sdb_null( dst);
         return;
@@ -210,7 +229,12 @@ static void cons_close( struct sdb_cons_ctx_t *ctx) {
 }
 
 /* If the table is configured to consolidate itself into another,
- * consolidate each destination column from the source table. */
+ * consolidate each destination column from the source table.
+ *
+ * The source table is read once, row by row. Cells of the columns which are
+ * consolidated by a numeric method are decoded into per-column scratch
+ * arrays, SDB_CONS_BATCH rows at a time, and every numeric destination
+ * column then reduces the batch of its source column with a vector kernel. */
 int sdb_consolidate( sdb_table_t *src) {
     struct sdb_consolidation_t *cons = src->consolidation;
     struct sdb_cons_ctx_t      *cctx;
@@ -219,6 +243,11 @@ int sdb_consolidate( sdb_table_t *src) {
     sdb_ncolumn_t              *matrix;
     sdb_ncolumn_t               i_src_col, i_dst_col, n_src_col, n_dst_col;
     sdb_nrow_t                  i_src_row, n_src_row;
+    double                     *scratch;
+    /* per source column: batch of decoded values, NULL if not needed. */
+    struct sdb_cons_src_t { double *values; int broken; } *srccols;
+    int                         n_num_col, i_batch, n_batch;
+    unsigned char               numeric[1 << (8 * sizeof( sdb_ncolumn_t))];
 
     if( ! cons) return SDB_ENOCONS;
     dst       = cons->dst;
@@ -243,7 +272,8 @@ int sdb_consolidate( sdb_table_t *src) {
     /* Create the consolidation matrix:
      * conceptually a 2D matrix with n_src_col rows of at most n_dst_col
      * columns: to each src column, it associates the list of dst columns
-     * which consolidate it.
+     * which consolidate it by copying one of its cells (numeric methods
+     * are handled by batches, and don't appear in it).
      *
      * A first extra column is reserved to hold the number of significant cells
      * in this row.
@@ -261,17 +291,35 @@ int sdb_consolidate( sdb_table_t *src) {
     for( i_src_col = 0;  i_src_col < n_src_col; i_src_col++)
         MATRIX_N_DST_COL( i_src_col) = 0;
 
-    /* Fill the matrix. */
+    /* Fill the matrix, and mark the source columns to decode in batches. */
+    memset( numeric, 0, sizeof( numeric));
+    n_num_col = 0;
     for( i_dst_col = 0; i_dst_col < n_dst_col; i_dst_col++) {
         i_src_col = cons->dst_columns[i_dst_col].src_column;
-        MATRIX_DST_COL( i_src_col, MATRIX_N_DST_COL( i_src_col)++) = i_dst_col;
+        if( ! cons_numeric( cons->dst_columns[i_dst_col].method)) {
+            MATRIX_DST_COL( i_src_col, MATRIX_N_DST_COL( i_src_col)++) = i_dst_col;
+        } else if( ! numeric[i_src_col]) {
+            numeric[i_src_col] = 1;
+            n_num_col++;
+        }
+    }
+
+    /* Scratch arrays, followed by the source columns descriptions. */
+    scratch = malloc( n_num_col * SDB_CONS_BATCH * sizeof( double) + n_src_col * sizeof( *srccols));
+    if( ! scratch) goto scratch_malloc_fail;
+    srccols = (void *) (scratch + n_num_col * SDB_CONS_BATCH);
+    n_num_col = 0;
+    for( i_src_col = 0;  i_src_col < n_src_col; i_src_col++) {
+        srccols[i_src_col].values = numeric[i_src_col] ? scratch + SDB_CONS_BATCH * n_num_col++ : NULL;
+        srccols[i_src_col].broken = 0;
     }
 
 #ifdef SDB_VERBOSE_PRINT /* Check the matrix' content: */
     printf( "Consolidation matrix:\n");
     for( i_src_col = 0;  i_src_col < n_src_col; i_src_col++) {
         sdb_ncolumn_t n_cons = MATRIX_N_DST_COL( i_src_col), i_cons;
-        printf( "SRC column %i used by %i DST columns:",i_src_col, n_cons);
+        printf( "SRC column %i used by %i DST columns%s:",i_src_col, n_cons,
+                srccols[i_src_col].values ? " and numeric ones" : "");
         for( i_cons = 0;  i_cons < n_cons; i_cons++) {
             i_dst_col = MATRIX_DST_COL( i_src_col, i_cons);
             printf(" %i", i_dst_col);
@@ -280,21 +328,42 @@ int sdb_consolidate( sdb_table_t *src) {
     }
 #endif
 
-    /* For each source cell: */
-    for( i_src_row = 0;  i_src_row < n_src_row;  i_src_row++) {
-        for( i_src_col = 0;  i_src_col < n_src_col;  i_src_col++) {
-            /* # of dst columns which consolidate this cell. */
-            sdb_ncolumn_t n_cons = MATRIX_N_DST_COL( i_src_col), i_cons;
-            struct bsd_data_t bsd_data;
-            int offset = rctx.nreadbytes;
-            int length = sdb_read_data( & rctx, & bsd_data, n_cons>0);
-            if( length<0) goto reading_fail;
-            /* For each dst cell consolidating this src cell: */
-            for( i_cons = 0;  i_cons < n_cons; i_cons++) {
-                i_dst_col = MATRIX_DST_COL( i_src_col, i_cons);
-                cons_reduce( cctx + i_dst_col, & bsd_data, offset, length);
+    /* For each batch of rows: */
+    for( i_src_row = 0;  i_src_row < n_src_row;  i_src_row += n_batch) {
+        n_batch = n_src_row - i_src_row;
+        if( n_batch > SDB_CONS_BATCH) n_batch = SDB_CONS_BATCH;
+
+        /* For each source cell: */
+        for( i_batch = 0;  i_batch < n_batch;  i_batch++) {
+            for( i_src_col = 0;  i_src_col < n_src_col;  i_src_col++) {
+                /* # of dst columns which copy a cell of this column. */
+                sdb_ncolumn_t n_cons = MATRIX_N_DST_COL( i_src_col), i_cons;
+                struct sdb_cons_src_t *srccol = srccols + i_src_col;
+                struct bsd_data_t bsd_data;
+                int offset = rctx.nreadbytes;
+                int length = sdb_read_data( & rctx, & bsd_data, ! srccol->values && ! n_cons);
+                if( length<0) goto reading_fail;
+                /* Decode numbers into the batch. */
+                if( srccol->values) switch( bsd_data.type) {
+                    case BSD_INT:    srccol->values[i_batch] = (double) bsd_data.content.i; break;
+                    case BSD_DOUBLE: srccol->values[i_batch] = bsd_data.content.d; break;
+                    default: srccol->broken = 1; break;
+                }
+                /* For each dst cell copying this src cell: */
+                for( i_cons = 0;  i_cons < n_cons; i_cons++) {
+                    i_dst_col = MATRIX_DST_COL( i_src_col, i_cons);
+                    cons_reduce( cctx + i_dst_col, offset, length, & bsd_data);
+                }
             }
         }
+
+        /* Reduce the batch into every numeric dst column. */
+        for( i_dst_col = 0;  i_dst_col < n_dst_col;  i_dst_col++) {
+            struct sdb_cons_src_t *srccol = srccols + cons->dst_columns[i_dst_col].src_column;
+            if( ! cons_numeric( cctx[i_dst_col].method)) continue;
+            if( srccol->broken) cctx[i_dst_col].state = SDB_CCS_BROKEN;
+            else cons_reduce_batch( cctx + i_dst_col, srccol->values, n_batch);
+        }
     }
 
     /* Finalize the consolidation contexts. */
@@ -302,13 +371,18 @@ int sdb_consolidate( sdb_table_t *src) {
         cons_finalize( cctx + i_dst_col, src, dst);
         cons_close(  cctx + i_dst_col);
     }
+    sdb_read_close( & rctx);
     free( cctx);
     free( matrix);
+    free( scratch);
     return SDB_EOK;
 
     if( 0) {
         reading_fail:
         sdb_read_close( & rctx);
+        free( scratch);
+        scratch_malloc_fail:
+        free( matrix);
         matrix_malloc_fail:
         i_dst_col = n_dst_col;
         cons_init_fail:
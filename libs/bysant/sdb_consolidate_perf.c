@@ -0,0 +1,123 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Benchmark of the consolidation of numeric columns.
+ *
+ * For a sweep of row counts, fills a 4 columns table (2 integer, 2 double
+ * columns), and consolidates it into a table computing max, min, mean, sum
+ * and median over its columns in a single pass, with every reduction kernel
+ * implementation available. The kernels alone are also timed over the same
+ * number of values, to tell them apart from the bysant decoding cost.
+ *
+ * Usage: sdb_consolidate_perf [maxrows]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sdb_internal.h"
+
+#define NCOLS 4
+
+static const char *impl_names[] = { "auto", "scalar", "sse2", "avx2", "neon" };
+static const int sweep[] = { 16, 64, 256, 1024, 4096, 16384, 65535, 0 };
+
+static double now( void) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, & ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int fill( sdb_table_t *src, int nrows) {
+    int i, r = SDB_EOK;
+    for( i = 0; i < nrows && SDB_EOK == r; i++) {
+        r = sdb_int( src, i % 1000);
+        if( SDB_EOK == r) r = sdb_int( src, (i * 7919) % 100003);
+        if( SDB_EOK == r) r = sdb_double( src, i * 0.25);
+        if( SDB_EOK == r) r = sdb_double( src, 1.0 / (i + 1));
+    }
+    return r;
+}
+
+/* Average duration of a consolidation, in microseconds. */
+static double bench_consolidate( sdb_table_t *src, sdb_table_t *dst, int nrows) {
+    int iter, niter = nrows < 4096 ? 200 : 20;
+    double t0 = now();
+    for( iter = 0; iter < niter; iter++) {
+        if( SDB_EOK != sdb_consolidate( src)) return -1;
+        sdb_reset( dst);
+    }
+    return (now() - t0) * 1e6 / niter;
+}
+
+/* Average duration of a sum + min + max over n values, in nanoseconds per value. */
+static double bench_kernels( const double *v, int n) {
+    int iter, niter = 1 + 20000000 / n;
+    volatile double sink = 0;
+    double t0 = now();
+    for( iter = 0; iter < niter; iter++)
+        sink += sdb_reduce_sum( v, n) + sdb_reduce_min( v, n) + sdb_reduce_max( v, n);
+    (void) sink;
+    return (now() - t0) * 1e9 / niter / n;
+}
+
+int main( int argc, char **argv) {
+    int maxrows = argc > 1 ? atoi( argv[1]) : 65535;
+    int nrows, i, impl, isweep;
+    double *values;
+
+    if( maxrows > 65535) maxrows = 65535;
+    values = malloc( maxrows * sizeof( *values));
+    for( i = 0; i < maxrows; i++) values[i] = (i * 7919) % 100003;
+
+    printf( "%8s %8s %16s %16s\n", "rows", "kernels", "consolidate (us)", "kernels (ns/val)");
+    for( isweep = 0; (nrows = sweep[isweep]) && nrows <= maxrows; isweep++) {
+        sdb_table_t src, dst;
+        int c;
+        if( SDB_EOK != sdb_init( & src, "src", SDB_SK_RAM,
+                    "a", SDB_SM_FASTEST, "b", SDB_SM_FASTEST,
+                    "c", SDB_SM_FASTEST, "d", SDB_SM_FASTEST, NULL)
+            || SDB_EOK != sdb_initwithoutcolumns( & dst, "dst", 5 * NCOLS, SDB_SK_RAM)) {
+            printf( "cannot create tables\n");
+            return 1;
+        }
+        for( c = 0; c < 5 * NCOLS; c++) {
+            char name[8];
+            sprintf( name, "c%d", c);
+            sdb_setcolumn( & dst, name, SDB_SM_FASTEST, 0);
+        }
+        sdb_setconstable( & src, & dst);
+        for( c = 0; c < NCOLS; c++) {
+            sdb_setconscolumn( & src, c, SDB_CM_MAX);
+            sdb_setconscolumn( & src, c, SDB_CM_MIN);
+            sdb_setconscolumn( & src, c, SDB_CM_MEAN);
+            sdb_setconscolumn( & src, c, SDB_CM_SUM);
+            sdb_setconscolumn( & src, c, SDB_CM_MEDIAN);
+        }
+        if( SDB_EOK != fill( & src, nrows)) {
+            printf( "cannot fill the table\n");
+            return 1;
+        }
+
+        for( impl = SDB_RI_SCALAR; impl <= SDB_RI_NEON; impl++) {
+            if( sdb_reduce_select( impl) != impl) continue;
+            printf( "%8d %8s %16.1f %16.3f\n", nrows, impl_names[impl],
+                    bench_consolidate( & src, & dst, nrows), bench_kernels( values, nrows));
+        }
+        sdb_close( & dst);
+        sdb_close( & src);
+    }
+    sdb_reduce_select( SDB_RI_AUTO);
+    free( values);
+    return 0;
+}
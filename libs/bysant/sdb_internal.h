@@ -53,11 +53,17 @@ typedef struct sdb_cons_ctx_t {
   union sdb_cons_ctx_content_t {              // method-specific temporary data.
     double max, min, sum;               // sum also serves for mean computation.
     double *median;      // array of nrow doubles, to be sorted at finalization.
-    /* data to recopy, just keep a pointer on their serialized form: */
-    struct { int offset; int length; } first, middle, last, streampos;
+    /* data to recopy, just keep a pointer on their serialized form,
+     * and their value if numeric, for the destination's data analysis: */
+    struct { int offset; int length; int type; double d; } first, middle, last, streampos;
   } content;
 } sdb_cons_ctx_t;
 
+/* Number of differences between consecutive values kept per "smallest"
+ * column to estimate the size of the vector containers. Smaller columns
+ * are estimated exactly. */
+#define SDB_ANALYSIS_SAMPLES 16
+
 /* Column description, one per column in a table. Holds serialization info,
  * but not consolidation ones, which are only kept in consolidated tables,
  * and if so, in a separate table. */
@@ -66,7 +72,8 @@ typedef struct sdb_column_t {
   enum sdb_serialization_method_t serialization_method;
   double arg;           // Extra argument, meaning depend on serialization method.
   /* Statistics collected during data writing. Only used with "shortest"
-   * serialization. */
+   * serialization. They are maintained incrementally, so that the container
+   * can be chosen at serialization time without reading the data back. */
   struct sdb_data_analysis_t {
       double original_arg;        // original arg value as it will be overwritten.
       int gcd;                          // Greatest Common Divisor of all entries.
@@ -75,6 +82,12 @@ typedef struct sdb_column_t {
       enum sdb_serialization_method_t method;      // Chosen serialization method.
       int all_integer:1;  // Flag set to true when any non integer data is stored.
       int all_numeric:1;  // Flag set to true when any non numeric data is stored.
+      int list_size;             // # of bytes the cells take in a plain list.
+      int nvalues;                           // # of numeric values analyzed.
+      double first, previous;           // first and previous numeric values.
+      double min_delta, max_delta;       // range of the differences between items.
+      unsigned rng;                   // state of the sampling random generator.
+      double deltas[SDB_ANALYSIS_SAMPLES];  // uniform sample of the differences.
   } data_analysis;
 } sdb_column_t;
 
@@ -151,6 +164,23 @@ int sdb_ram_trim( sdb_table_t *tbl);
  * functions must be called before nwrittenobjects is incremented as use it
  * to get column. */
 void sdb_analyze_integer( sdb_table_t *tbl, int i);
+void sdb_analyze_double( sdb_table_t *tbl, double d);
 void sdb_analyze_noninteger( sdb_table_t *tbl, unsigned char numeric);
+/* Reset the statistics of a column, before any data is written. */
+void sdb_analyze_reset( sdb_column_t *column);
+
+/* Reduction kernels used by the consolidation of numeric columns (see
+ * sdb_reduce.c). They operate on n > 0 doubles. */
+enum sdb_reduce_impl_t {
+    SDB_RI_AUTO,                      // best implementation supported by the CPU.
+    SDB_RI_SCALAR,
+    SDB_RI_SSE2,
+    SDB_RI_AVX2,
+    SDB_RI_NEON
+};
+enum sdb_reduce_impl_t sdb_reduce_select( enum sdb_reduce_impl_t impl);
+double sdb_reduce_sum( const double *v, int n);
+double sdb_reduce_min( const double *v, int n);
+double sdb_reduce_max( const double *v, int n);
 
 #endif
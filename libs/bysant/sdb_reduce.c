@@ -0,0 +1,268 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* sdb_reduce_*: reduction kernels over arrays of doubles, used to consolidate
+ * numeric columns once they have been decoded in batches.
+ *
+ * Every kernel exists in a portable scalar version and, depending on the
+ * target, in SSE2, AVX2 (selected at runtime according to the CPU) and NEON
+ * versions. Vector sums are computed in several interleaved accumulators,
+ * so their last bits may differ from a sequential sum.
+ *
+ * NaN values are propagated by the sums, and skipped by every min and max
+ * version alike: they only return NaN when all the values are NaN. */
+
+#include "sdb_internal.h"
+
+#if defined( __SSE2__)
+#  include <emmintrin.h>
+#  define SDB_REDUCE_HAVE_SSE2
+#  if defined( __GNUC__) && (__GNUC__ >= 5) && (defined( __x86_64__) || defined( __i386__))
+#    include <immintrin.h>
+#    define SDB_REDUCE_HAVE_AVX2
+#  endif
+#endif
+#if defined( __aarch64__) && defined( __ARM_NEON)
+#  include <arm_neon.h>
+#  define SDB_REDUCE_HAVE_NEON
+#endif
+
+typedef double (*sdb_reduce_fn_t)( const double *v, int n);
+
+/* Scalar versions: four accumulators, so that the compiler doesn't
+ * serialize the loop on a single dependency chain. */
+static double reduce_sum_scalar( const double *v, int n) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i;
+    for( i = 0; i + 4 <= n; i += 4) {
+        s0 += v[i]; s1 += v[i+1]; s2 += v[i+2]; s3 += v[i+3];
+    }
+    for( ; i < n; i++) s0 += v[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+/* Index of the first value which isn't NaN, n if there is none. Comparisons
+ * with NaN being false, min and max start from that value to skip NaN. */
+static int first_number( const double *v, int n) {
+    int i;
+    for( i = 0; i < n && v[i] != v[i]; i++);
+    return i;
+}
+
+static double reduce_min_scalar( const double *v, int n) {
+    int i = first_number( v, n);
+    double m;
+    if( i == n) return v[0];
+    for( m = v[i++]; i < n; i++) if( v[i] < m) m = v[i];
+    return m;
+}
+
+static double reduce_max_scalar( const double *v, int n) {
+    int i = first_number( v, n);
+    double m;
+    if( i == n) return v[0];
+    for( m = v[i++]; i < n; i++) if( v[i] > m) m = v[i];
+    return m;
+}
+
+#ifdef SDB_REDUCE_HAVE_SSE2
+static double reduce_sum_sse2( const double *v, int n) {
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    double r[2], s;
+    int i;
+    for( i = 0; i + 4 <= n; i += 4) {
+        a0 = _mm_add_pd( a0, _mm_loadu_pd( v + i));
+        a1 = _mm_add_pd( a1, _mm_loadu_pd( v + i + 2));
+    }
+    _mm_storeu_pd( r, _mm_add_pd( a0, a1));
+    s = r[0] + r[1];
+    for( ; i < n; i++) s += v[i];
+    return s;
+}
+
+/* MINPD and MAXPD return their second operand when one of them is NaN: the
+ * accumulator, which starts from a number, is passed second so that NaN
+ * values are skipped. */
+static double reduce_min_sse2( const double *v, int n) {
+    __m128d m;
+    double r[2], x;
+    int i = first_number( v, n);
+    if( i == n) return v[0];
+    m = _mm_set1_pd( v[i]);
+    for( i = 0; i + 2 <= n; i += 2) m = _mm_min_pd( _mm_loadu_pd( v + i), m);
+    _mm_storeu_pd( r, m);
+    x = r[0] < r[1] ? r[0] : r[1];
+    for( ; i < n; i++) if( v[i] < x) x = v[i];
+    return x;
+}
+
+static double reduce_max_sse2( const double *v, int n) {
+    __m128d m;
+    double r[2], x;
+    int i = first_number( v, n);
+    if( i == n) return v[0];
+    m = _mm_set1_pd( v[i]);
+    for( i = 0; i + 2 <= n; i += 2) m = _mm_max_pd( _mm_loadu_pd( v + i), m);
+    _mm_storeu_pd( r, m);
+    x = r[0] > r[1] ? r[0] : r[1];
+    for( ; i < n; i++) if( v[i] > x) x = v[i];
+    return x;
+}
+#endif
+
+#ifdef SDB_REDUCE_HAVE_AVX2
+#define AVX2 __attribute__(( target( "avx2")))
+
+AVX2 static double reduce_sum_avx2( const double *v, int n) {
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    double r[4], s;
+    int i;
+    for( i = 0; i + 8 <= n; i += 8) {
+        a0 = _mm256_add_pd( a0, _mm256_loadu_pd( v + i));
+        a1 = _mm256_add_pd( a1, _mm256_loadu_pd( v + i + 4));
+    }
+    _mm256_storeu_pd( r, _mm256_add_pd( a0, a1));
+    s = (r[0] + r[1]) + (r[2] + r[3]);
+    for( ; i < n; i++) s += v[i];
+    return s;
+}
+
+AVX2 static double reduce_min_avx2( const double *v, int n) {
+    __m256d m;
+    double r[4], x;
+    int i = first_number( v, n);
+    if( i == n) return v[0];
+    m = _mm256_set1_pd( v[i]);
+    for( i = 0; i + 4 <= n; i += 4) m = _mm256_min_pd( _mm256_loadu_pd( v + i), m);
+    _mm256_storeu_pd( r, m);
+    x = r[0];
+    for( ; i < n; i++) if( v[i] < x) x = v[i];
+    for( i = 1; i < 4; i++) if( r[i] < x) x = r[i];
+    return x;
+}
+
+AVX2 static double reduce_max_avx2( const double *v, int n) {
+    __m256d m;
+    double r[4], x;
+    int i = first_number( v, n);
+    if( i == n) return v[0];
+    m = _mm256_set1_pd( v[i]);
+    for( i = 0; i + 4 <= n; i += 4) m = _mm256_max_pd( _mm256_loadu_pd( v + i), m);
+    _mm256_storeu_pd( r, m);
+    x = r[0];
+    for( ; i < n; i++) if( v[i] > x) x = v[i];
+    for( i = 1; i < 4; i++) if( r[i] > x) x = r[i];
+    return x;
+}
+#endif
+
+#ifdef SDB_REDUCE_HAVE_NEON
+static double reduce_sum_neon( const double *v, int n) {
+    float64x2_t a0 = vdupq_n_f64( 0), a1 = vdupq_n_f64( 0);
+    double s;
+    int i;
+    for( i = 0; i + 4 <= n; i += 4) {
+        a0 = vaddq_f64( a0, vld1q_f64( v + i));
+        a1 = vaddq_f64( a1, vld1q_f64( v + i + 2));
+    }
+    s = vaddvq_f64( vaddq_f64( a0, a1));
+    for( ; i < n; i++) s += v[i];
+    return s;
+}
+
+/* FMINNM and FMAXNM return the number when one of their operands is NaN. */
+static double reduce_min_neon( const double *v, int n) {
+    float64x2_t m;
+    double x;
+    int i = first_number( v, n);
+    if( i == n) return v[0];
+    m = vdupq_n_f64( v[i]);
+    for( i = 0; i + 2 <= n; i += 2) m = vminnmq_f64( vld1q_f64( v + i), m);
+    x = vminnmvq_f64( m);
+    for( ; i < n; i++) if( v[i] < x) x = v[i];
+    return x;
+}
+
+static double reduce_max_neon( const double *v, int n) {
+    float64x2_t m;
+    double x;
+    int i = first_number( v, n);
+    if( i == n) return v[0];
+    m = vdupq_n_f64( v[i]);
+    for( i = 0; i + 2 <= n; i += 2) m = vmaxnmq_f64( vld1q_f64( v + i), m);
+    x = vmaxnmvq_f64( m);
+    for( ; i < n; i++) if( v[i] > x) x = v[i];
+    return x;
+}
+#endif
+
+static struct {
+    sdb_reduce_fn_t sum, min, max;
+} kernels = { NULL, NULL, NULL };
+
+/* Select the kernels to use, SDB_RI_AUTO picks the best one supported by the
+ * CPU. Return the implementation actually selected, which is the scalar one
+ * when the requested implementation isn't available. */
+enum sdb_reduce_impl_t sdb_reduce_select( enum sdb_reduce_impl_t impl) {
+    if( SDB_RI_AUTO == impl) {
+        impl = SDB_RI_SCALAR;
+#if defined( SDB_REDUCE_HAVE_NEON)
+        impl = SDB_RI_NEON;
+#elif defined( SDB_REDUCE_HAVE_SSE2)
+        impl = SDB_RI_SSE2;
+#  ifdef SDB_REDUCE_HAVE_AVX2
+        if( __builtin_cpu_supports( "avx2")) impl = SDB_RI_AVX2;
+#  endif
+#endif
+    }
+    switch( impl) {
+#ifdef SDB_REDUCE_HAVE_SSE2
+    case SDB_RI_SSE2:
+        kernels.sum = reduce_sum_sse2; kernels.min = reduce_min_sse2; kernels.max = reduce_max_sse2;
+        break;
+#endif
+#ifdef SDB_REDUCE_HAVE_AVX2
+    case SDB_RI_AVX2:
+        if( ! __builtin_cpu_supports( "avx2")) goto scalar;
+        kernels.sum = reduce_sum_avx2; kernels.min = reduce_min_avx2; kernels.max = reduce_max_avx2;
+        break;
+#endif
+#ifdef SDB_REDUCE_HAVE_NEON
+    case SDB_RI_NEON:
+        kernels.sum = reduce_sum_neon; kernels.min = reduce_min_neon; kernels.max = reduce_max_neon;
+        break;
+#endif
+    default:
+#ifdef SDB_REDUCE_HAVE_AVX2
+        scalar:
+#endif
+        impl = SDB_RI_SCALAR;
+        kernels.sum = reduce_sum_scalar; kernels.min = reduce_min_scalar; kernels.max = reduce_max_scalar;
+        break;
+    }
+    return impl;
+}
+
+/* The kernels below expect n > 0. */
+double sdb_reduce_sum( const double *v, int n) {
+    if( ! kernels.sum) sdb_reduce_select( SDB_RI_AUTO);
+    return kernels.sum( v, n);
+}
+
+double sdb_reduce_min( const double *v, int n) {
+    if( ! kernels.min) sdb_reduce_select( SDB_RI_AUTO);
+    return kernels.min( v, n);
+}
+
+double sdb_reduce_max( const double *v, int n) {
+    if( ! kernels.max) sdb_reduce_select( SDB_RI_AUTO);
+    return kernels.max( v, n);
+}
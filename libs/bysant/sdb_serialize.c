@@ -295,148 +295,89 @@ static int bss_double_size(double x) {
     else                                 return 9;
 }
 
-/* Compute the smallest serialization container using  data analysis and stored data.
- * The method is to estimate as precisely as possible final size and take the smallest one.
- * Store the result in serialization_data struct.
+/* Compute the smallest serialization container using the data analysis
+ * maintained as cells are written, and store the result in the columns.
+ * The method is to estimate as precisely as possible final size and take
+ * the smallest one: list size is known exactly, vector sizes are
+ * extrapolated from a sample of the differences between consecutive
+ * values, which holds all of them for small tables. The stored data
+ * doesn't have to be read, so the cost doesn't depend on the table size.
  */
 static int compute_serialization_methods( struct sdb_table_t *tbl) {
-    // Data used for 2nd pass computations.
-    struct data_analysis_t {
-        int vsize,dvsize, qpvsize;                            // Computed sizes.
-        double dvfactor;                            // Data for DV computations.
-        int qpvperiod, qpvcurrentn;                // Data for QPV computations.
-        double dprevious;                            // Previous data as double.
-        int iprevious;                                  // Previous data as int.
-    };
-
-    sdb_ncolumn_t nsmallest = 0;
-    sdb_ncolumn_t current_smallest;
-    int i;
-    struct data_analysis_t *analysis_data = NULL;
-    int return_code = SDB_EOK;
-    struct sdb_read_ctx_t read_ctx;
-
-    // count columns that needs serialization computation
+    int i, j;
+    int nrows = tbl->nwrittenobjects / tbl->ncolumns;
+
     for( i=0; i<tbl->ncolumns; i++) {
         struct sdb_column_t *column = tbl->columns + i;
-        if( SDB_SM_SMALLEST == SDB_SM_CONTAINER(column->serialization_method)) {
-            // if any data is not numeric, DV and QPV are not able to serialize them
-            if( !column->data_analysis.all_numeric) {
-                column->data_analysis.method = SDB_SM_LIST;
-            }
-            // QPV period guessing is integer only, DV support floats only when factor is forced.
-            else if( !column->data_analysis.all_integer &&
-                    !(column->serialization_method & SDB_SM_FIXED_PRECISION)) {
-                column->data_analysis.method = SDB_SM_LIST;
-            }
-            // otherwise the serialization method must be computed
-            else {
-                column->data_analysis.method = SDB_SM_SMALLEST;
-                nsmallest++;
-            }
+        struct sdb_data_analysis_t *a = & column->data_analysis;
+        int vsize, dvsize, qpvsize, qpvperiod;
+        int ndeltas, nsamples;
+        double dvfactor, scale;
+
+        if( SDB_SM_SMALLEST != SDB_SM_CONTAINER(column->serialization_method)) continue;
+        // if any data is not numeric, DV and QPV are not able to serialize them
+        // QPV period guessing is integer only, DV support floats only when factor is forced.
+        // Without any delta, there is nothing to gain with vectors.
+        if( !a->all_numeric ||
+                (!a->all_integer && !(column->serialization_method & SDB_SM_FIXED_PRECISION)) ||
+                nrows < 2 || a->nvalues != nrows) {
+            a->method = SDB_SM_LIST;
+            continue;
         }
-    }
-
-    if( 0 == nsmallest) return SDB_EOK; // no column to analyze.
 
-    analysis_data = malloc( sizeof(struct data_analysis_t) * nsmallest);
-    if( !analysis_data) return SDB_EMEM;
+        ndeltas  = nrows - 1;
+        nsamples = ndeltas < SDB_ANALYSIS_SAMPLES ? ndeltas : SDB_ANALYSIS_SAMPLES;
+        scale    = (double) ndeltas / nsamples;
 
-    // Initialize analysis data
-    for( i=0, current_smallest=0; i<tbl->ncolumns; i++) {
-        struct sdb_column_t *column = tbl->columns + i;
-        if( SDB_SM_SMALLEST == SDB_SM_CONTAINER(column->serialization_method) &&
-                SDB_SM_SMALLEST == SDB_SM_CONTAINER(column->data_analysis.method)) {
+        vsize = a->list_size;
 
-            struct data_analysis_t *data = analysis_data + (current_smallest++);
-            data->vsize = 0;
-            data->dvfactor = (column->serialization_method & SDB_SM_FIXED_PRECISION) ?
-                    column->data_analysis.original_arg : column->data_analysis.gcd;
-            data->dvsize = bss_double_size(data->dvfactor);
-
-            data->qpvperiod = round((double)column->data_analysis.delta_sum / (double)((tbl->nwrittenobjects / tbl->ncolumns) - 1));
-            data->qpvsize = bss_int_size(data->qpvperiod);
-        }
-    }
+        dvfactor = (column->serialization_method & SDB_SM_FIXED_PRECISION) ?
+                a->original_arg : a->gcd;
+        dvsize = bss_double_size(dvfactor) + bss_double_size(a->first);
 
-    // read table and analyze data
-    sdb_read_init( & read_ctx, tbl);
-    for( i=0, current_smallest=0; i<tbl->nwrittenobjects; i++) {
-        int column_index = read_ctx.nreadobjects%tbl->ncolumns;
-        struct sdb_column_t *column = tbl->columns + column_index;
-        bsd_data_t read_data;
-        int is_smallest = SDB_SM_SMALLEST == SDB_SM_CONTAINER(column->serialization_method) &&
-                SDB_SM_SMALLEST == SDB_SM_CONTAINER(column->data_analysis.method);
-
-        int r = sdb_read_data( & read_ctx, & read_data, ! is_smallest);
-        if( r<0) {
-            return_code = r;
-            goto compute_serialization_methods_exit;
-        }
+        qpvperiod = round((double)a->delta_sum / (double)ndeltas);
+        qpvsize = bss_int_size(qpvperiod) + bss_int_size((int) a->first);
 
-        if( is_smallest) {
-            struct data_analysis_t *data = analysis_data + (current_smallest++ % nsmallest);
-            double dvalue = (BSD_INT == read_data.type) ? ((double)read_data.content.i) : read_data.content.d;
-            // This will cause errors, QPV size will be marked as wrong later.
-            int ivalue = (BSD_INT == read_data.type) ? read_data.content.i : 0;
-
-            data->vsize += read_ctx.nbytes;
-            if( i<tbl->ncolumns) { // first cell
-                data->dvsize += bss_double_size(dvalue);
-                data->qpvsize += bss_int_size(ivalue);
-                data->qpvcurrentn = 0;
-            } else {
-                int qpvshift = ivalue - (data->iprevious + data->qpvperiod);
-                if( 0 == qpvshift) {
-                    data->qpvcurrentn++;
-                } else {
-                    data->qpvsize += bss_int_size(qpvshift) + bss_int_size(data->qpvcurrentn);
-                    data->qpvcurrentn = 0;
+        {
+            // this is not useful to care about corner cases here, impact on computed size, if any, is negligible
+            double dvsampled = 0, qpvsampled = 0;
+            for( j=0; j<nsamples; j++) {
+                double delta = a->deltas[j];
+                dvsampled += bss_int_size(floor(delta/dvfactor));
+                if( delta != qpvperiod) {
+                    // shift, and length of the periodic run before it (usually short)
+                    qpvsampled += bss_int_size(delta - qpvperiod) + 1;
                 }
-                // this is not useful to care about corner cases here, impact on computed size, if any, is negligible
-                data->dvsize += bss_int_size(floor((dvalue - data->dprevious)/data->dvfactor));
             }
-            data->dprevious = dvalue;
-            data->iprevious = ivalue;
+            dvsize += (int) (dvsampled * scale + 0.5);
+            if( a->min_delta != a->max_delta) qpvsize += (int) (qpvsampled * scale + 0.5);
         }
-    }
 
-    // Finalize computation
-    for( i=0, current_smallest=0; i<tbl->ncolumns; i++) {
-        struct sdb_column_t *column = tbl->columns + i;
-        if( SDB_SM_SMALLEST == SDB_SM_CONTAINER(column->serialization_method) &&
-                SDB_SM_SMALLEST == SDB_SM_CONTAINER(column->data_analysis.method)) {
-            struct data_analysis_t *data = analysis_data + (current_smallest++);
-            if( !column->data_analysis.all_integer) {
-                data->qpvsize = INT_MAX;
-            }
+        if( !a->all_integer) {
+            qpvsize = INT_MAX;
+        }
 //#define SDB_VERBOSE_PRINT
 #ifdef SDB_VERBOSE_PRINT
-            printf("Data analysis results:\n"
-                   " - List: size %d bytes\n"
-                   " - Deltas Vector: size %d bytes; factor %f\n"
-                   " - Quasi Periodic Vector: size %d bytes; period %d\n\n",
-                   data->vsize, data->dvsize, data->dvfactor, data->qpvsize, data->qpvperiod);
+        printf("Data analysis results:\n"
+               " - List: size %d bytes\n"
+               " - Deltas Vector: size %d bytes; factor %f\n"
+               " - Quasi Periodic Vector: size %d bytes; period %d\n\n",
+               vsize, dvsize, dvfactor, qpvsize, qpvperiod);
 #endif
 
-            // See also the "--FIXME M3DA QPV" tags in stagedb.lua tests
-            // (some tests has been disabled/chaged)
-            if( data->qpvsize < data->dvsize && data->qpvsize < data->vsize) {
-                column->arg = data->qpvperiod;
-                column->data_analysis.method = SDB_SM_QUASIPERIODIC_VECTOR;
-            } else if( data->dvsize < data->vsize) {
-                column->arg = data->dvfactor;
-                column->data_analysis.method = SDB_SM_DELTAS_VECTOR;
-            } else {
-                column->data_analysis.method = SDB_SM_LIST;
-            }
+        // See also the "--FIXME M3DA QPV" tags in stagedb.lua tests
+        // (some tests has been disabled/chaged)
+        if( qpvsize < dvsize && qpvsize < vsize) {
+            column->arg = qpvperiod;
+            a->method = SDB_SM_QUASIPERIODIC_VECTOR;
+        } else if( dvsize < vsize) {
+            column->arg = dvfactor;
+            a->method = SDB_SM_DELTAS_VECTOR;
+        } else {
+            a->method = SDB_SM_LIST;
         }
     }
-
-compute_serialization_methods_exit:
-    sdb_read_close( & read_ctx);
-    free( analysis_data);
-    return return_code;
+    return SDB_EOK;
 }
 
 static bss_status_t serialize_table( struct sdb_table_t *tbl) {
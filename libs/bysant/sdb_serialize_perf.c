@@ -0,0 +1,128 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Benchmark of the serialization of "smallest" tables.
+ *
+ * For a sweep of row counts, fills a table with a telemetry-like corpus:
+ * jittered timestamps, a slowly varying temperature with a fixed precision,
+ * an irregular counter and a constant, all of them serialized with
+ * SDB_SM_SMALLEST. Reports the time spent writing the cells, the time spent
+ * serializing them, the payload size, and the container chosen per column
+ * (List, Deltas vector or Quasi-periodic vector).
+ *
+ * Usage: sdb_serialize_perf [maxrows]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sdb_internal.h"
+
+#define NCOLS 4
+
+static const int sweep[] = { 16, 64, 256, 1024, 4096, 16384, 65535, 0 };
+
+static double now( void) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, & ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* M3DA vector classes, as declared by the agent's M3DA serializer. */
+static struct bs_field_t dv_fields[] = {
+    { "factor", BS_CTXID_NUMBER }, { "start", BS_CTXID_NUMBER }, { "deltas", BS_CTXID_LIST_OR_MAP } };
+static struct bs_field_t qpv_fields[] = {
+    { "period", BS_CTXID_NUMBER }, { "start", BS_CTXID_NUMBER }, { "shifts", BS_CTXID_LIST_OR_MAP } };
+static const bs_class_t dv_class = {
+    SDB_CLSID_DELTAS_VECTOR, "DeltasVector", 3, BS_CLASS_EXTERNAL, dv_fields };
+static const bs_class_t qpv_class = {
+    SDB_CLSID_QUASI_PERIODIC_VECTOR, "QuasiPeriodicVector", 3, BS_CLASS_EXTERNAL, qpv_fields };
+
+/* Writer which only counts the serialized bytes. */
+static int count_writer( unsigned const char *data, int length, void *ctx) {
+    * (int *) ctx += length;
+    return length;
+}
+
+static int fill( sdb_table_t *tbl, int nrows) {
+    int i, r = SDB_EOK, timestamp = 1340000000, counter = 0;
+    double temperature = 21.5;
+    srand( 42);
+    for( i = 0; i < nrows && SDB_EOK == r; i++) {
+        timestamp += 10 + (rand() % 16 ? 0 : rand() % 3 - 1);
+        if( rand() % 8 == 0) temperature += (rand() % 3 - 1) * 0.1;
+        counter += rand() % 5;
+        r = sdb_int( tbl, timestamp);
+        if( SDB_EOK == r) r = sdb_double( tbl, temperature);
+        if( SDB_EOK == r) r = sdb_int( tbl, counter);
+        if( SDB_EOK == r) r = sdb_int( tbl, 230);
+    }
+    return r;
+}
+
+int main( int argc, char **argv) {
+    int maxrows = argc > 1 ? atoi( argv[1]) : 65535;
+    int nrows, isweep;
+
+    if( maxrows > 65535) maxrows = 65535;
+    printf( "%8s %16s %16s %12s %8s\n", "rows", "write (ns/row)", "serialize (us)", "payload (B)", "methods");
+    for( isweep = 0; (nrows = sweep[isweep]) && nrows <= maxrows; isweep++) {
+        int iter, niter = nrows < 4096 ? 200 : 20, size = 0, c, r;
+        double twrite = 0, tserialize = 0, t0;
+        char methods[NCOLS + 1];
+        sdb_table_t tbl;
+        bss_ctx_t bss;
+
+        if( SDB_EOK != sdb_initwithoutcolumns( & tbl, "telemetry", NCOLS, SDB_SK_RAM)) {
+            printf( "cannot create the table\n");
+            return 1;
+        }
+        sdb_setcolumn( & tbl, "timestamp", SDB_SM_SMALLEST, 0);
+        sdb_setcolumn( & tbl, "temperature", SDB_SM_SMALLEST | SDB_SM_FIXED_PRECISION, 0.1);
+        sdb_setcolumn( & tbl, "counter", SDB_SM_SMALLEST, 0);
+        sdb_setcolumn( & tbl, "voltage", SDB_SM_SMALLEST, 0);
+
+        for( iter = 0; iter < niter; iter++) {
+            sdb_reset( & tbl);
+            t0 = now();
+            if( SDB_EOK != fill( & tbl, nrows)) {
+                printf( "cannot fill the table\n");
+                return 1;
+            }
+            twrite += now() - t0;
+
+            size = 0;
+            bss_init( & bss, count_writer, & size);
+            bss_class( & bss, & dv_class, 1);
+            bss_class( & bss, & qpv_class, 1);
+            t0 = now();
+            if( BSS_EOK != (r = sdb_serialize( & tbl, & bss))) {
+                printf( "cannot serialize the table: %d\n", r);
+                return 1;
+            }
+            tserialize += now() - t0;
+        }
+        for( c = 0; c < NCOLS; c++) {
+            switch( tbl.columns[c].data_analysis.method) {
+            case SDB_SM_DELTAS_VECTOR:        methods[c] = 'D'; break;
+            case SDB_SM_QUASIPERIODIC_VECTOR: methods[c] = 'Q'; break;
+            default:                          methods[c] = 'L'; break;
+            }
+        }
+        methods[NCOLS] = '\0';
+        printf( "%8d %16.1f %16.1f %12d %8s\n", nrows, twrite * 1e9 / niter / nrows,
+                tserialize * 1e6 / niter, size, methods);
+        sdb_close( & tbl);
+    }
+    return 0;
+}
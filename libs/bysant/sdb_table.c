@@ -48,9 +48,10 @@ static void sdb_restore_file_cells( sdb_table_t *tbl) {
         // restore data analysis
         switch( bsd.kind) {
         case BSD_INT:    sdb_analyze_integer(tbl, bsd.content.i); break;
-        case BSD_DOUBLE: sdb_analyze_noninteger(tbl, 1); break;
+        case BSD_DOUBLE: sdb_analyze_double(tbl, bsd.content.d); break;
         default:         sdb_analyze_noninteger(tbl, 0); break;
         }
+        tbl->columns[tbl->nwrittenobjects % tbl->ncolumns].data_analysis.list_size += nread;
 
         tbl->nwrittenbytes += nread;
         tbl->nwrittenobjects ++;
@@ -285,9 +286,7 @@ int sdb_reset( sdb_table_t *tbl) {
     for( i=0; i<tbl->ncolumns; i++) {
         sdb_column_t *c = tbl->columns + i;
         if( SDB_SM_SMALLEST == SDB_SM_CONTAINER(c->serialization_method)) {
-            c->data_analysis.delta_sum = 0;
-            c->data_analysis.all_integer = 1;
-            c->data_analysis.all_numeric = 1;
+            sdb_analyze_reset( c);
         }
     }
 
@@ -306,9 +305,7 @@ int sdb_setcolumn(  sdb_table_t *tbl, const char *label,
 
     if( SDB_SM_SMALLEST == SDB_SM_CONTAINER(sm)) {
         c->data_analysis.original_arg = precision;
-        c->data_analysis.delta_sum = 0;
-        c->data_analysis.all_integer = 1;
-        c->data_analysis.all_numeric = 1;
+        sdb_analyze_reset( c);
     }
 
     c->label_offset = new_conf_string( tbl, label);
@@ -162,6 +162,7 @@ static int sdb_bss_file_writer( unsigned const char *data,  int length, sdb_tabl
 int sdb_bss_writer( unsigned const char *data,  int length, void *ctx) {
     sdb_table_t *tbl = (sdb_table_t *) ctx;
     if( tbl->state != SDB_ST_READING) return SDB_EBADSTATE;
+    tbl->columns[tbl->nwrittenobjects % tbl->ncolumns].data_analysis.list_size += length;
     switch( tbl->storage_kind) {
     case SDB_SK_RAM: return sdb_bss_ram_writer( data, length, tbl);
 #ifdef SDB_FLASH_SUPPORT
@@ -185,6 +186,42 @@ static int gcd( int a, int b) {
     return a;
 }
 
+/* Reset the statistics of a column. */
+void sdb_analyze_reset( sdb_column_t *column) {
+    struct sdb_data_analysis_t *a = & column->data_analysis;
+    a->delta_sum   = 0;
+    a->all_integer = 1;
+    a->all_numeric = 1;
+    a->list_size   = 0;
+    a->nvalues     = 0;
+    a->min_delta   = 0;
+    a->max_delta   = 0;
+    a->rng         = 1;
+}
+
+/* Account a numeric value: keep track of the range of the differences
+ * between consecutive values, and of a uniform sample of them
+ * (reservoir sampling), from which the sizes of the vector containers
+ * are estimated at serialization time. */
+static void analyze_number( sdb_column_t *column, double d) {
+    struct sdb_data_analysis_t *a = & column->data_analysis;
+    if( 0 == a->nvalues) {
+        a->first = d;
+    } else {
+        double delta = d - a->previous;
+        int i = a->nvalues - 1; /* # of the delta */
+        if( 0 == i || delta < a->min_delta) a->min_delta = delta;
+        if( 0 == i || delta > a->max_delta) a->max_delta = delta;
+        if( i >= SDB_ANALYSIS_SAMPLES) {
+            a->rng = a->rng * 1103515245 + 12345;
+            i = ((unsigned long long) a->rng * (unsigned) (i + 1)) >> 32;
+        }
+        if( i < SDB_ANALYSIS_SAMPLES) a->deltas[i] = delta;
+    }
+    a->previous = d;
+    a->nvalues++;
+}
+
 /* Cancels data analysis whenever a non-numeric value is stored. */
 void sdb_analyze_noninteger( sdb_table_t *tbl, unsigned char numeric) {
     sdb_column_t *column = tbl->columns + (tbl->nwrittenobjects % tbl->ncolumns);
@@ -194,10 +231,19 @@ void sdb_analyze_noninteger( sdb_table_t *tbl, unsigned char numeric) {
     }
 }
 
+void sdb_analyze_double( sdb_table_t *tbl, double d) {
+    sdb_column_t *column = tbl->columns + (tbl->nwrittenobjects % tbl->ncolumns);
+    if( SDB_SM_CONTAINER(column->serialization_method) == SDB_SM_SMALLEST) {
+        column->data_analysis.all_integer = 0;
+        if( column->data_analysis.all_numeric) analyze_number( column, d);
+    }
+}
+
 void sdb_analyze_integer( sdb_table_t *tbl, int i) {
     sdb_column_t *column = tbl->columns + (tbl->nwrittenobjects % tbl->ncolumns);
-    if( SDB_SM_CONTAINER(column->serialization_method) == SDB_SM_SMALLEST
-            && column->data_analysis.all_integer) {
+    if( SDB_SM_CONTAINER(column->serialization_method) != SDB_SM_SMALLEST) return;
+    if( column->data_analysis.all_numeric) analyze_number( column, i);
+    if( column->data_analysis.all_integer) {
         if( tbl->nwrittenobjects < tbl->ncolumns) {
             column->data_analysis.gcd = i; // used to initialize GCD calculation correctly (if any)
         } else {
@@ -241,7 +287,7 @@ int sdb_double( sdb_table_t *tbl, double d) {
         d = (double) (float) d;
     }
 
-    sdb_analyze_noninteger(tbl, 1);
+    sdb_analyze_double(tbl, d);
     r = bss_double(tbl->bss_ctx, d);
     if( r) {
         return r;
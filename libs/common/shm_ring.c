@@ -0,0 +1,306 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+#include "shm_ring.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+#define SHM_RING_MAGIC 0x454d5053 // "EMPS"
+#define SHM_RING_HDR_SIZE 4096
+
+// Control block of one direction. Counters are free running, the producer
+// only writes head, the consumer only writes tail; they lie on distinct
+// cache lines so that both sides don't fight for them.
+struct shm_ring_ctrl
+{
+  uint32_t head;           // bytes written so far
+  char pad0[60];
+  uint32_t tail;           // bytes read so far
+  char pad1[60];
+  uint32_t rwait;          // set by the consumer before sleeping on an empty ring
+  uint32_t wwait;          // set by the producer before sleeping on a full ring
+  char pad2[56];
+};
+
+struct shm_ring_header
+{
+  uint32_t magic;
+  uint32_t size;
+  char pad[56];
+  struct shm_ring_ctrl dir[2]; // creator to peer, peer to creator
+};
+
+struct ShmRing_s
+{
+  struct shm_ring_header* hdr;
+  size_t mapsize;
+  uint32_t size;
+  struct shm_ring_ctrl* tx;
+  struct shm_ring_ctrl* rx;
+  char* txdata;
+  char* rxdata;
+  int fds[3];
+  int wakefd;              // our doorbell
+  int peerfd;              // the peer's doorbell
+  int broken;              // set once the peer corrupted the counters
+};
+
+// The file is shared with the peer: its size is sealed, otherwise the peer
+// could truncate it and make our next access to the ring fault. Without
+// memfd_create, the size of the /dev/shm file cannot be sealed.
+static int shm_file(size_t size)
+{
+  int fd = -1, sealed = 0;
+#ifdef SYS_memfd_create
+  fd = syscall(SYS_memfd_create, "emp_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  sealed = fd >= 0;
+#endif
+  if (fd < 0)
+  {
+    char path[] = "/dev/shm/emp_shm.XXXXXX";
+    fd = mkstemp(path);
+    if (fd < 0)
+      return -1;
+    unlink(path);
+  }
+  if (ftruncate(fd, size) < 0
+      || (sealed && fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static swi_status_t map(ShmRing* ring, int creator)
+{
+  ring->mapsize = SHM_RING_HDR_SIZE + 2 * (size_t) ring->size;
+  ring->hdr = mmap(NULL, ring->mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fds[0], 0);
+  if (ring->hdr == MAP_FAILED)
+  {
+    ring->hdr = NULL;
+    return SWI_STATUS_ALLOC_FAILED;
+  }
+  ring->tx = &ring->hdr->dir[creator ? 0 : 1];
+  ring->rx = &ring->hdr->dir[creator ? 1 : 0];
+  ring->txdata = (char*) ring->hdr + SHM_RING_HDR_SIZE + (creator ? 0 : ring->size);
+  ring->rxdata = (char*) ring->hdr + SHM_RING_HDR_SIZE + (creator ? ring->size : 0);
+  ring->wakefd = ring->fds[creator ? 1 : 2];
+  ring->peerfd = ring->fds[creator ? 2 : 1];
+  return SWI_STATUS_OK;
+}
+
+swi_status_t ShmRing_Create(ShmRing** ring_, uint32_t size, int fds[3])
+{
+  ShmRing* ring;
+  uint32_t s = SHM_RING_MIN_SIZE;
+
+  while (s < size && s < SHM_RING_MAX_SIZE)
+    s <<= 1;
+
+  *ring_ = NULL;
+  ring = calloc(1, sizeof(*ring));
+  if (!ring)
+    return SWI_STATUS_ALLOC_FAILED;
+  ring->size = s;
+  ring->fds[0] = shm_file(SHM_RING_HDR_SIZE + 2 * (size_t) s);
+  ring->fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ring->fds[2] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ring->fds[0] < 0 || ring->fds[1] < 0 || ring->fds[2] < 0 || map(ring, 1) != SWI_STATUS_OK)
+  {
+    ShmRing_Destroy(ring);
+    return SWI_STATUS_RESOURCE_INITIALIZATION_FAILED;
+  }
+  ring->hdr->size = s;
+  ring->hdr->magic = SHM_RING_MAGIC;
+  memcpy(fds, ring->fds, sizeof(ring->fds));
+  *ring_ = ring;
+  return SWI_STATUS_OK;
+}
+
+swi_status_t ShmRing_Attach(ShmRing** ring_, int fds[3])
+{
+  ShmRing* ring;
+  struct shm_ring_header* hdr;
+
+  *ring_ = NULL;
+  ring = calloc(1, sizeof(*ring));
+  if (!ring)
+  {
+    close(fds[0]); close(fds[1]); close(fds[2]);
+    return SWI_STATUS_ALLOC_FAILED;
+  }
+  memcpy(ring->fds, fds, sizeof(ring->fds));
+
+  // read the size from the header before mapping the whole channel
+  hdr = mmap(NULL, SHM_RING_HDR_SIZE, PROT_READ, MAP_SHARED, fds[0], 0);
+  if (hdr == MAP_FAILED)
+  {
+    ShmRing_Destroy(ring);
+    return SWI_STATUS_RESOURCE_INITIALIZATION_FAILED;
+  }
+  ring->size = hdr->size;
+  if (hdr->magic != SHM_RING_MAGIC || ring->size < SHM_RING_MIN_SIZE || ring->size > SHM_RING_MAX_SIZE
+      || (ring->size & (ring->size - 1)))
+    ring->size = 0;
+  munmap(hdr, SHM_RING_HDR_SIZE);
+
+  if (!ring->size || map(ring, 0) != SWI_STATUS_OK)
+  {
+    ShmRing_Destroy(ring);
+    return SWI_STATUS_RESOURCE_INITIALIZATION_FAILED;
+  }
+  *ring_ = ring;
+  return SWI_STATUS_OK;
+}
+
+void ShmRing_Destroy(ShmRing* ring)
+{
+  int i;
+  if (!ring)
+    return;
+  if (ring->hdr)
+    munmap(ring->hdr, ring->mapsize);
+  for (i = 0; i < 3; i++)
+    if (ring->fds[i] >= 0)
+      close(ring->fds[i]);
+  free(ring);
+}
+
+static void ring_doorbell(int fd)
+{
+  uint64_t one = 1;
+  ssize_t r = write(fd, &one, sizeof(one));
+  (void) r; // only fails when the counter is already huge: the peer is notified anyway
+}
+
+// The peer can write anything in the shared counters: more than ring->size
+// bytes in use means it is broken or hostile, stop using the channel.
+static int check_used(ShmRing* ring, uint32_t used)
+{
+  if (used > ring->size)
+    ring->broken = 1;
+  return !ring->broken;
+}
+
+ssize_t ShmRing_Write(ShmRing* ring, const char* data, size_t size)
+{
+  struct shm_ring_ctrl* c = ring->tx;
+  uint32_t head = c->head;
+  uint32_t used = head - __atomic_load_n(&c->tail, __ATOMIC_ACQUIRE);
+  uint32_t room, offset, first;
+
+  if (!check_used(ring, used))
+    return -1;
+  room = ring->size - used;
+  if (!room)
+  {
+    // flag, then check again: either the consumer sees the flag, or we see its progress
+    __atomic_store_n(&c->wwait, 1, __ATOMIC_SEQ_CST);
+    used = head - __atomic_load_n(&c->tail, __ATOMIC_SEQ_CST);
+    if (!check_used(ring, used))
+      return -1;
+    room = ring->size - used;
+    if (!room)
+      return 0;
+    __atomic_store_n(&c->wwait, 0, __ATOMIC_RELAXED);
+  }
+  if (size > room)
+    size = room;
+
+  offset = head & (ring->size - 1);
+  first = ring->size - offset;
+  if (first >= size)
+    memcpy(ring->txdata + offset, data, size);
+  else
+  {
+    memcpy(ring->txdata + offset, data, first);
+    memcpy(ring->txdata, data + first, size - first);
+  }
+  __atomic_store_n(&c->head, head + (uint32_t) size, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&c->rwait, __ATOMIC_RELAXED) && __atomic_exchange_n(&c->rwait, 0, __ATOMIC_SEQ_CST))
+    ring_doorbell(ring->peerfd);
+  return size;
+}
+
+ssize_t ShmRing_Read(ShmRing* ring, char* data, size_t size)
+{
+  struct shm_ring_ctrl* c = ring->rx;
+  uint32_t tail = c->tail;
+  uint32_t avail = __atomic_load_n(&c->head, __ATOMIC_ACQUIRE) - tail;
+  uint32_t offset, first;
+
+  if (!check_used(ring, avail))
+    return -1;
+  if (!avail)
+  {
+    __atomic_store_n(&c->rwait, 1, __ATOMIC_SEQ_CST);
+    avail = __atomic_load_n(&c->head, __ATOMIC_SEQ_CST) - tail;
+    if (!check_used(ring, avail))
+      return -1;
+    if (!avail)
+      return 0;
+    __atomic_store_n(&c->rwait, 0, __ATOMIC_RELAXED);
+  }
+  if (size > avail)
+    size = avail;
+
+  offset = tail & (ring->size - 1);
+  first = ring->size - offset;
+  if (first >= size)
+    memcpy(data, ring->rxdata + offset, size);
+  else
+  {
+    memcpy(data, ring->rxdata + offset, first);
+    memcpy(data + first, ring->rxdata, size - first);
+  }
+  __atomic_store_n(&c->tail, tail + (uint32_t) size, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&c->wwait, __ATOMIC_RELAXED) && __atomic_exchange_n(&c->wwait, 0, __ATOMIC_SEQ_CST))
+    ring_doorbell(ring->peerfd);
+  return size;
+}
+
+size_t ShmRing_Available(ShmRing* ring)
+{
+  uint32_t avail = __atomic_load_n(&ring->rx->head, __ATOMIC_ACQUIRE) - ring->rx->tail;
+  return check_used(ring, avail) ? avail : 0;
+}
+
+int ShmRing_GetFd(ShmRing* ring)
+{
+  return ring->wakefd;
+}
+
+void ShmRing_Drain(ShmRing* ring)
+{
+  uint64_t count;
+  ssize_t r = read(ring->wakefd, &count, sizeof(count));
+  (void) r; // EAGAIN: already drained
+}
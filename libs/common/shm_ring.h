@@ -0,0 +1,108 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+/**
+ * @file shm_ring.h
+ * @brief Bidirectional byte stream between two processes over shared memory.
+ *
+ * A channel is made of two single producer / single consumer rings, one per
+ * direction, living in a shared memory file, and of two eventfd doorbells,
+ * one per side. A side which finds its receiving ring empty (or its sending
+ * ring full) flags it and sleeps on its own doorbell; the peer rings it once
+ * it has written (or read) some bytes. As long as both sides keep up, no
+ * system call at all is made.
+ *
+ * The creator of a channel gets three file descriptors (shared memory,
+ * creator doorbell, peer doorbell) to hand over to the peer, which attaches
+ * the channel with them.
+ *
+ * Reading and writing never block: blocking is up to the caller, by waiting
+ * for the doorbell file descriptor (ShmRing_GetFd) to be readable, then
+ * calling ShmRing_Drain.
+ *
+ * @ingroup common
+ */
+
+#ifndef SHM_RING_H_
+#define SHM_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "swi_status.h"
+
+#define SHM_RING_MIN_SIZE     4096
+#define SHM_RING_MAX_SIZE     (1 << 20)
+#define SHM_RING_DEFAULT_SIZE (1 << 16)
+
+typedef struct ShmRing_s ShmRing;
+
+/**
+ * Create a channel, and the file descriptors to hand over to the peer.
+ *
+ * @param ring will point to the newly created channel.
+ * @param size capacity of each ring, rounded up to a power of 2 within
+ *        [SHM_RING_MIN_SIZE, SHM_RING_MAX_SIZE].
+ * @param fds filled with the shared memory, creator doorbell and peer
+ *        doorbell file descriptors; they stay owned by the channel.
+ * @return status code.
+ */
+swi_status_t ShmRing_Create(ShmRing** ring, uint32_t size, int fds[3]);
+
+/**
+ * Attach the channel created by the peer.
+ *
+ * @param ring will point to the attached channel.
+ * @param fds the file descriptors given by ShmRing_Create, in the same order.
+ *        The channel takes their ownership, even on failure.
+ * @return status code.
+ */
+swi_status_t ShmRing_Attach(ShmRing** ring, int fds[3]);
+
+/**
+ * Release a channel, unmapping the shared memory and closing its file descriptors.
+ */
+void ShmRing_Destroy(ShmRing* ring);
+
+/**
+ * Copy up to size bytes to the sending ring, ring the peer if it waits for them.
+ *
+ * @return number of bytes written, 0 when the ring is full (the peer will then
+ * ring our doorbell as soon as it has read some bytes), -1 when the channel is
+ * broken: the peer left the ring counters inconsistent. Nothing is copied then,
+ * and the channel must be destroyed.
+ */
+ssize_t ShmRing_Write(ShmRing* ring, const char* data, size_t size);
+
+/**
+ * Copy up to size bytes from the receiving ring, ring the peer if it waits for room.
+ *
+ * @return number of bytes read, 0 when the ring is empty (the peer will then
+ * ring our doorbell as soon as it has written some bytes), -1 when the channel
+ * is broken, as for ShmRing_Write.
+ */
+ssize_t ShmRing_Read(ShmRing* ring, char* data, size_t size);
+
+/**
+ * Number of bytes available for reading, 0 when the channel is broken.
+ */
+size_t ShmRing_Available(ShmRing* ring);
+
+/**
+ * File descriptor of our doorbell, readable when the peer rang it.
+ */
+int ShmRing_GetFd(ShmRing* ring);
+
+/**
+ * Acknowledge the rings of our doorbell, to be called after it was found readable.
+ */
+void ShmRing_Drain(ShmRing* ring);
+
+#endif /* SHM_RING_H_ */
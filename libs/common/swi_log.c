@@ -14,7 +14,6 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdint.h>
 #include <stdarg.h>
 #include <string.h>
 #include <time.h>
@@ -34,14 +33,19 @@ typedef struct md_list
 } md_list_t;
 
 
+// Messages are formatted in a stack buffer, longer ones are allocated.
+#define MESSAGE_SIZE 512
+
 static void default_displaylogger(const char *module, swi_log_level_t severity, const char *message);
 
 swi_log_displaylogger_t swi_log_displaylogger = default_displaylogger;
 swi_log_storelogger_t swi_log_storelogger;
+volatile unsigned int swi_log_generation = 1;
 static const char *swi_log_format = "%t %m-%s: %l";
 static swi_log_level_t default_level = WARNING;
 static md_list_t *md_list;
-static char format_cached[64];
+static md_list_t *env_list; // levels from SWI_LOG_VERBOSITY, which take precedence
+static int color = 1;
 static const char *levels[] = {
   "NONE",
   "ERROR",
@@ -62,50 +66,11 @@ static swi_log_level_t str2Severity(const char *str)
   return NONE;
 }
 
-static void changeVerbosity(const char *module, swi_log_level_t *level)
-{
-  char *var, *str, *ptr, *tmp, *sep;
-
-  var = getenv("SWI_LOG_VERBOSITY");
-
-  if (var == NULL)
-    return;
-
-  ptr = strdup(var);
-  str = ptr;
-  while((tmp = strtok(str, ",")))
-  {
-    sep = strchr(tmp, ':');
-    if (sep == NULL)
-    {
-      str = NULL;
-      continue;
-    }
-    *sep = '\0';
-    if (!strcasecmp(tmp, module))
-    {
-      *level = str2Severity(sep+1);
-      goto end;
-    }
-    else if (!strcasecmp(tmp, "default"))
-    {
-      default_level = str2Severity(sep+1);
-      goto end;
-    }
-    str = NULL;
-  }
-end:
-  free(ptr);
-}
-
 static void default_displaylogger(const char *module, swi_log_level_t severity, const char *message)
 {
   const char *f = "\e[0m";
-  char *var;
-
-  var = getenv("SWI_LOG_COLOR");
 
-  if (var && !strcmp(var, "0"))
+  if (!color)
     goto display;
 
   switch(severity)
@@ -140,11 +105,10 @@ static void loggers(const char *module, swi_log_level_t severity, const char *me
     swi_log_storelogger(module, severity, message);
 }
 
-static void destroy()
+static void destroy_list(md_list_t *entry)
 {
-  md_list_t *entry, *tmp;
+  md_list_t *tmp;
 
-  entry = md_list;
   while(entry)
   {
     tmp = entry->next;
@@ -154,95 +118,177 @@ static void destroy()
   }
 }
 
-static void newlevel(const char *module, swi_log_level_t level)
+static void destroy()
 {
-  md_list_t *entry;
+  destroy_list(md_list);
+  destroy_list(env_list);
+}
+
+// Sets the level of a module in a list. New entries are appended fully
+// initialized, so that the list can be read while a level is set.
+static void newlevel(md_list_t **list, const char *module, swi_log_level_t level)
+{
+  md_list_t *entry, **last;
   int len;
 
-  if (md_list == NULL)
-  {
-    md_list = malloc(sizeof(md_list_t));
-    entry = md_list;
-    atexit(destroy);
-  }
-  else
+  for (last = list; *last; last = &(*last)->next)
   {
-    for (entry = md_list; entry->next; entry = entry->next)
-      ;
-    entry->next = malloc(sizeof(md_list_t));
-    entry = entry->next;
+    if (!strcmp((*last)->module, module))
+    {
+      (*last)->level = level;
+      return;
+    }
   }
+  entry = malloc(sizeof(md_list_t));
+  if (entry == NULL)
+    return;
   len = strlen(module);
   entry->module = malloc(len + 1);
-  memcpy(entry->module, module, len);
-  entry->module[len] = '\0';
+  if (entry->module == NULL)
+  {
+    free(entry);
+    return;
+  }
+  memcpy(entry->module, module, len + 1);
   entry->level = level;
   entry->next = NULL;
+  *last = entry;
 }
 
-static char * replace(const char * src, const char *occur, const char *by)
+// Reads the environment variables once, when the library is loaded.
+static void __attribute__((constructor)) init()
 {
-  const char *str;
-  char *token, *result;
-  int src_len, occur_len, by_len, result_len, len = 0;
-
-  result_len = strlen(src) - strlen(occur) + strlen(by);
-  src_len = strlen(src);
-  occur_len = strlen(occur);
-  by_len = strlen(by);
-
-  result = malloc(result_len + 1);
-  str = src;
-  while ((token = strstr(str, occur)))
-  {
-    memcpy(result + len, src, token - src);
-    len += (token - src);
+  char *var, *str, *ptr, *tmp, *sep;
 
-    memcpy(result + len, by, by_len);
-    len += by_len;
+  atexit(destroy);
 
-    memcpy(result + len, token+occur_len, (src + src_len) - (token + occur_len));
-    len += (src + src_len) - (token + occur_len);
+  var = getenv("SWI_LOG_COLOR");
+  if (var && !strcmp(var, "0"))
+    color = 0;
 
-    str += (token - str) + occur_len;
+  var = getenv("SWI_LOG_VERBOSITY");
+  if (var == NULL)
+    return;
+
+  ptr = strdup(var);
+  if (ptr == NULL)
+    return;
+  str = ptr;
+  while((tmp = strtok(str, ",")))
+  {
+    str = NULL;
+    sep = strchr(tmp, ':');
+    if (sep == NULL)
+      continue;
+    *sep = '\0';
+    if (!strcasecmp(tmp, "default"))
+      default_level = str2Severity(sep+1);
+    else
+      newlevel(&env_list, tmp, str2Severity(sep+1));
   }
-  result[result_len] = '\0';
-  return result;
+  free(ptr);
 }
 
-static char *format_message(const char *module, swi_log_level_t severity, const char *message)
+static swi_log_level_t getlevel(const char *module)
 {
-  const char *format;
-  char *pass1 = NULL, *pass2 = NULL, *pass3 = NULL, buf[32], *formatted_message = NULL;
-  static time_t s_t;
-  time_t t;
-  struct tm *tm;
+  md_list_t *entry;
+
+  for (entry = env_list; entry; entry = entry->next)
+    if (!strcasecmp(entry->module, module))
+      return entry->level;
+  for (entry = md_list; entry; entry = entry->next)
+    if (!strcmp(entry->module, module))
+      return entry->level;
+  return default_level;
+}
 
-  format = swi_log_format ? swi_log_format : "%t %m-%s: %l";
+// Returns the current time, formatted once per second and per thread.
+static const char *timestamp()
+{
+  static __thread time_t s_t;
+  static __thread char buf[32];
+  struct tm tm;
+  time_t t;
 
   t = time(NULL);
-  if (s_t == t && strstr(format_cached, module) && strstr(format_cached, levels[severity]))
+  if (t != s_t || !buf[0])
+  {
+    s_t = t;
+    localtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%F %H:%M:%S", &tm);
+  }
+  return buf;
+}
+
+static void append(char *dst, size_t size, size_t *len, const char *src, size_t n)
+{
+  if (*len + 1 < size)
+    memcpy(dst + *len, src, *len + n < size ? n : size - 1 - *len);
+  *len += n;
+}
+
+// Formats a message according to swi_log_format, snprintf like: returns the
+// length of the formatted message, of which at most size - 1 bytes are
+// written in dst.
+static size_t format_message(char *dst, size_t size, const char *module, swi_log_level_t severity,
+                             const char *format, va_list ap)
+{
+  const char *f, *s;
+  size_t len = 0;
+  va_list aq;
+  int n;
+
+  for (f = swi_log_format ? swi_log_format : "%t %m-%s: %l"; *f; f++)
+  {
+    s = NULL;
+    if (f[0] == '%')
+    {
+      switch (f[1])
+      {
+        case 't': s = timestamp(); break;
+        case 'm': s = module; break;
+        case 's': s = levels[severity]; break;
+        case 'l':
+          va_copy(aq, ap);
+          n = vsnprintf(len < size ? dst + len : NULL, len < size ? size - len : 0, format, aq);
+          va_end(aq);
+          len += n > 0 ? n : 0;
+          f++;
+          continue;
+        default: break;
+      }
+    }
+    if (s)
+    {
+      append(dst, size, &len, s, strlen(s));
+      f++;
+    }
+    else
+      append(dst, size, &len, f, 1);
+  }
+  dst[len < size ? len : size - 1] = '\0';
+  return len;
+}
+
+static void vprint(const char *module, swi_log_level_t severity, const char *format, va_list ap)
+{
+  char buf[MESSAGE_SIZE], *message = buf;
+  size_t len;
+
+  len = format_message(buf, sizeof(buf), module, severity, format, ap);
+  if (unlikely(len >= sizeof(buf)))
   {
-    pass3 = format_cached;
-    goto pass_3;
+    message = malloc(len + 1);
+    if (message == NULL)
+      message = buf; // log the truncated message
+    else
+      format_message(message, len + 1, module, severity, format, ap);
   }
 
-  s_t = t;
-  tm = localtime(&t);
-  memset(buf, 0, sizeof(buf));
-  strftime(buf, 32, "%F %H:%M:%S", tm);
-  pass1 = replace(format, "%t", buf);
-  pass2 = replace(pass1, "%m", module);
-  pass3 = replace(pass2, "%s", levels[severity]);
-  memcpy(format_cached, pass3, strlen(pass3) + 1);
-pass_3:
-  formatted_message = replace(pass3, "%l", message);
-
-  free(pass1);
-  free(pass2);
-  if (pass3 != format_cached)
-    free(pass3);
-  return formatted_message;
+  loggers(module, severity, message);
+
+  if (message != buf)
+    free(message);
 }
 
 void swi_log_setlevel(swi_log_level_t level, const char *module, ...)
@@ -250,77 +296,67 @@ void swi_log_setlevel(swi_log_level_t level, const char *module, ...)
   va_list ap;
   const char *mod = NULL;
 
-  va_start(ap, module);
-
   if (module == NULL)
-  {
     default_level = level;
-    return;
+  else
+  {
+    newlevel(&md_list, module, level);
+    va_start(ap, module);
+    while((mod = va_arg(ap, const char *)))
+      newlevel(&md_list, mod, level);
+    va_end(ap);
   }
 
-  newlevel(module, level);
-  while((mod = va_arg(ap, const char *)))
-    newlevel(mod, level);
-  va_end(ap);
+  // invalidate the call site caches, generation 0 << 3 is never cached
+  if (__sync_add_and_fetch(&swi_log_generation, 1) << 3 == 0)
+    __sync_add_and_fetch(&swi_log_generation, 1);
 }
 
 int swi_log_musttrace(const char *module, swi_log_level_t severity)
 {
-  md_list_t *entry;
-  swi_log_level_t lev;
-  static __thread char cache[64];
-
   if (unlikely(module == NULL))
     return 0;
 
-  if(!strcmp(cache, module))
-    return severity <= (cache[ (uint8_t)cache[63] ] - '0');
-
-  for (entry = md_list; entry; entry = entry->next)
-  {
-    if (!strcmp(entry->module, module))
-    {
-      lev = entry->level;
-      break;
-    }
-  }
-  if (entry == NULL)
-    lev = default_level;
-
-  changeVerbosity(module, &lev);
-
-  memset(cache, 0, 64);
-  memcpy(cache, module, strlen(module));
-  cache[63] = strlen(module);
-  cache[ (uint8_t)cache[63] ] = lev + '0';
+  return severity <= getlevel(module);
+}
 
-  return severity <= lev;
+int swi_log_siteupdate(swi_log_site_t *site, const char *module)
+{
+  unsigned int generation = swi_log_generation;
+  int level = module ? (int)getlevel(module) : -1;
+
+  // clear the state first: a thread reading the site meanwhile may use the
+  // level of the previous module for one message
+  site->state = 0;
+  __sync_synchronize();
+  site->module = module;
+  __sync_synchronize();
+  site->state = generation << 3 | (level + 1);
+  return level;
 }
 
 void swi_log_trace(const char *module, swi_log_level_t severity, const char *format, ...)
 {
-  char *user_message = NULL, *formatted_message = NULL;
   va_list ap;
-  int ret;
 
   if (!swi_log_musttrace(module, severity))
     return;
 
   va_start(ap, format);
+  vprint(module, severity, format, ap);
+  va_end(ap);
+}
 
-  ret = vasprintf(&user_message, format, ap);
-  (void)ret;
-  formatted_message = format_message(module, severity, user_message);
-
-  loggers(module, severity, formatted_message);
+void swi_log_print(const char *module, swi_log_level_t severity, const char *format, ...)
+{
+  va_list ap;
 
-  free(formatted_message);
-  free(user_message);
+  va_start(ap, format);
+  vprint(module, severity, format, ap);
   va_end(ap);
 }
 
 void swi_log_setformat(const char *format)
 {
   swi_log_format = format;
-  memset(format_cached, 0, sizeof(format_cached));
 }
@@ -26,10 +26,16 @@
 /**
  * A Macro function which must be used in programs to log messages.
  * This one can be disabled if the macro constant SWI_LOG_ENABLED is set to 0
+ *
+ * Each call site caches the level of verbosity of its module, until a level
+ * is changed with #swi_log_setlevel: disabled messages cost a comparison.
  **/
 #if SWI_LOG_ENABLED
-#define SWI_LOG(module, info, format, ...)        \
-  swi_log_trace(module, info, format, ##__VA_ARGS__)
+#define SWI_LOG(module, info, format, ...) do {                     \
+    static swi_log_site_t swi_log_site_;                              \
+    if ((int)(info) <= swi_log_sitelevel(&swi_log_site_, module))     \
+      swi_log_print(module, info, format, ##__VA_ARGS__);             \
+  } while (0)
 #else
 #define SWI_LOG(module, info, format, ...)
 #endif
@@ -61,25 +67,61 @@ typedef void (*swi_log_displaylogger_t)(const char *module, swi_log_level_t seve
 typedef void (*swi_log_storelogger_t)(const char *module, swi_log_level_t severity, const char *message);
 
 /**
- * displaylogger:
+ * swi_log_displaylogger:
  * The logging function used internally to display messages on screen.
  **/
-extern swi_log_displaylogger_t displaylogger;
+extern swi_log_displaylogger_t swi_log_displaylogger;
 
 /**
- * storelogger:
+ * swi_log_storelogger:
  * The logging function used internally to store messages on a disk or in a database.
  **/
-extern swi_log_storelogger_t storelogger;
+extern swi_log_storelogger_t swi_log_storelogger;
+
+/**
+ * swi_log_site_t:
+ * The level cache of a #SWI_LOG call site, internal purpose only.
+ **/
+typedef struct
+{
+  const char *module;
+  unsigned int state; // generation << 3 | (level + 1), 0 if not cached yet
+} swi_log_site_t;
+
+/**
+ * swi_log_generation:
+ * Incremented each time a level of verbosity changes, to invalidate the
+ * call site caches. Internal purpose only.
+ **/
+extern volatile unsigned int swi_log_generation;
+
+/**
+ * Compute the level of verbosity of a module and cache it in a call site, internal purpose only.
+ *
+ * @return the level of verbosity of the module, -1 if <B>module</B> is NULL.
+ */
+int swi_log_siteupdate(swi_log_site_t *site, const char *module);
+
+/**
+ * Get the level of verbosity of a module from a call site cache, internal purpose only.
+ */
+static inline int swi_log_sitelevel(swi_log_site_t *site, const char *module)
+{
+  unsigned int state = site->state;
+  if (site->module == module && (state & ~7u) == swi_log_generation << 3)
+    return (int)(state & 7) - 1;
+  return swi_log_siteupdate(site, module);
+}
 
 /**
 * Change the level of verbosity for a list of modules.
 *
 * This function changes the level of verbosity for a list of modules. The list must be
 * terminated by NULL. If <B>module</B> is NULL, this functions changes the default level of verbosity (#WARNING as default),
-* ie the level used by modules which have not changed their level yet. If you plan to change the verbosity dynamically,
+* ie the level used by modules which have not changed their level yet. If you plan to change the verbosity without rebuilding,
 * you can also set the environnement variable SWI_LOG_VERBOSITY, which must contain a list of modules names concatenated with
-* the required verbosity for the module or "default" to change the default verbosity level.
+* the required verbosity for the module or "default" to change the default verbosity level. The variable is read once, when
+* the library is loaded, and the levels it gives to modules take precedence over the ones set by this function.
 * Typically, if you want to change the verbosity for the modules "foo" and "bar" to info and debug, you need to set the variable like this:
 * @code
 * export SWI_LOG_VERBOSITY="foo:info,bar:debug"
@@ -110,8 +152,8 @@ int  swi_log_musttrace(const char *module, swi_log_level_t severity);
  *
  * This functions submits a message to be displayed to the logging framework only if the module with the given severity is
  * authorized to logs messages (the function swi_log_musttrace returns 1). The message is formated according to <B>format</B> and the list of
- * arguments (like printf). When the message is logged, it is displayed on the screen using the logging function #displaylogger and can be stored
- * on a disk or a remote device using the logging function #storelogger (NULL by default).
+ * arguments (like printf). When the message is logged, it is displayed on the screen using the logging function #swi_log_displaylogger and can be stored
+ * on a disk or a remote device using the logging function #swi_log_storelogger (NULL by default).
  *
  * @param[in] module The module which plans to log messages
  * @param[in] severity The severity for the message
@@ -120,10 +162,22 @@ int  swi_log_musttrace(const char *module, swi_log_level_t severity);
  */
 void swi_log_trace(const char *module, swi_log_level_t severity, const char *format, ...);
 
+/**
+ * Submit a message the logging messages framework, without checking the verbosity of the module.
+ *
+ * This function is used by #SWI_LOG once the verbosity of the module has been checked.
+ *
+ * @param[in] module The module which plans to log messages
+ * @param[in] severity The severity for the message
+ * @param[in] format The message itself with formatting characters if required
+ * @see swi_log_trace
+ */
+void swi_log_print(const char *module, swi_log_level_t severity, const char *format, ...);
+
 /**
  * Change the default rule to format messages
  *
- * This functions changes the default rule used to format messages before sending them to #displaylogger and #storelogger.
+ * This functions changes the default rule used to format messages before sending them to #swi_log_displaylogger and #swi_log_storelogger.
  * Basically, it is used to let the user personnalize the output. With such a feature, the user can choose the order for displaying
  * the message itself, the module name, the severity, the current time, or don't display them at all.
  *
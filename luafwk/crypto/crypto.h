@@ -16,6 +16,7 @@
 
 #include "lua.h"
 #include "lauxlib.h"
+#include "worker.h"
 
 #define CHECK(X) \
     do { \
@@ -27,6 +28,16 @@
         } \
     } while (0);
 
+/* Objects submitted to a job belong to a worker thread until it is done. */
+#define CHECK_IDLE(JOB) \
+    do { \
+        if (worker_busy(JOB)) { \
+            lua_pushnil(L); \
+            lua_pushstring(L, "BADSTATE"); \
+            return 2; \
+        } \
+    } while (0);
+
 #define AUTHOR      "libtomcryp " SCRYPT
 
 LUALIB_API int luaopen_crypto_hash(lua_State* L);
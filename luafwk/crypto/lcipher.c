@@ -9,6 +9,7 @@
  *     Gilles Cannenterre for Sierra Wireless - initial API and implementation
  *******************************************************************************/
 #include "crypto.h"
+#include "worker.h"
 
 
 #define MYNAME      "cipher"
@@ -57,6 +58,7 @@ typedef struct SCipher_ {
     SCipherPadding padding;
     int chunk_size;
     void* state;
+    worker_job_t* job; // last job submitted, NULL once it is collected
 } SCipher;
 
 static int get_cipher_desc(lua_State* L, int index, SCipherDesc* desc) {
@@ -198,6 +200,7 @@ static int get_cipher_padding(lua_State* L, int index, SCipherPadding* padding)
 static int Lnew(lua_State* L) {
     SCipher* cipher = (SCipher*) lua_newuserdata(L, sizeof(SCipher));
     cipher->state = NULL; // mark as invalid for GC
+    cipher->job = NULL;
     luaL_getmetatable(L, MYTYPE);
     lua_setmetatable(L, -2);
 
@@ -307,10 +310,59 @@ static int Lprocess(lua_State* L) {
     SCipher* cipher = luaL_checkudata(L, 1, MYTYPE);
     size_t text_size;
     unsigned char* text = (unsigned char*) luaL_checklstring(L, 2, &text_size);
+    CHECK_IDLE(cipher->job);
     CHECK(ciphertext(cipher, text, text_size));
     return 1;
 }
 
+/* Ciphering job: ciphers a copy of a string in a worker thread. */
+typedef struct SCipherJob_ {
+    worker_job_t job;
+    SCipher* cipher;
+    int status;
+    size_t text_size;
+    unsigned char text[1];
+} SCipherJob;
+
+static void cipherjob_run(worker_job_t* job) {
+    SCipherJob* j = (SCipherJob*) job;
+    j->status = ciphertext(j->cipher, j->text, j->text_size);
+}
+
+static int cipherjob_finish(lua_State* L, worker_job_t* job) {
+    SCipherJob* j = (SCipherJob*) job;
+    CHECK(j->status);
+    lua_pushlstring(L, (const char *) j->text, j->text_size);
+    return 1;
+}
+
+/* The cipher is anchored by the job, so it is still there. */
+static void cipherjob_release(worker_job_t* job) {
+    SCipherJob* j = (SCipherJob*) job;
+    if (j->cipher->job == job)
+        j->cipher->job = NULL;
+}
+
+/** job(userdata, s): submits a job which returns s ciphered, see `sched.worker`.
+ * Until the job is done, the cipher methods and filters return nil, "BADSTATE". */
+static int Ljob(lua_State* L) {
+    SCipher* cipher = luaL_checkudata(L, 1, MYTYPE);
+    size_t text_size;
+    const char* text = luaL_checklstring(L, 2, &text_size);
+    CHECK_IDLE(cipher->job);
+    SCipherJob* j = (SCipherJob*) worker_newjob(L, sizeof(SCipherJob) + text_size,
+            cipherjob_run, cipherjob_finish, cipherjob_release); // job
+    j->cipher = cipher;
+    cipher->job = &j->job;
+    j->text_size = text_size;
+    memcpy(j->text, text, text_size);
+    lua_getfenv(L, -1);                             // job, env
+    lua_pushvalue(L, 1);                            // job, env, cipher
+    lua_rawseti(L, -2, 1);                          // job, env
+    lua_pop(L, 1);                                  // job
+    return worker_submit(L, -1);
+}
+
 static int Ldone(lua_State* L) {
     SCipher* cipher = luaL_checkudata(L, 1, MYTYPE);
     if (cipher->state == NULL) {
@@ -344,6 +396,7 @@ static int aes_filter_dec(lua_State* L) {
     SCipher* cipher = luaL_checkudata(L, lua_upvalueindex(1), MYTYPE);
     unsigned char* partial = lua_touserdata(L, lua_upvalueindex(2));
     int partial_size = lua_tointeger(L, lua_upvalueindex(3));
+    CHECK_IDLE(cipher->job);
     if (lua_isnil(L, 1)) /* chunk == nil */{
         // printf("\ndec[nil]");
         // cipher if data in partial
@@ -410,6 +463,7 @@ static int aes_filter_enc(lua_State* L) {
     SCipher* cipher = luaL_checkudata(L, lua_upvalueindex(1), MYTYPE);
     unsigned char* partial = lua_touserdata(L, lua_upvalueindex(2));
     int partial_size = lua_tointeger(L, lua_upvalueindex(3));
+    CHECK_IDLE(cipher->job);
     if (lua_isnil(L, 1)) /* chunk == nil */{
         // printf("\nenc[nil]");
         // apply padding
@@ -531,6 +585,7 @@ static const luaL_Reg R[] = {
         { "__gc", Ldone },
         { "process", Lprocess },
         { "filter", Lfilter },
+        { "job", Ljob },
         { "new", Lnew },
         { "tostring", Ltostring },
         { "write", Lwrite },
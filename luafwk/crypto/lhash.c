@@ -9,6 +9,9 @@
  *     Gilles Cannenterre for Sierra Wireless - initial API and implementation
  *******************************************************************************/
 #include "crypto.h"
+#include "worker.h"
+#include <errno.h>
+#include <stdio.h>
 
 #define MYNAME      "hash"
 #define MYVERSION   MYNAME " library for " LUA_VERSION " / May 2011 / using " AUTHOR
@@ -17,6 +20,7 @@
 typedef struct SHash_ {
     int hash_id;
     hash_state state;
+    worker_job_t* job; // last job submitted, NULL once it is collected
 } SHash;
 
 static SHash* Pget(lua_State* L, int i) {
@@ -65,6 +69,7 @@ static int Lnew(lua_State* L) {
     }
     SHash* hash = Pnew(L);
     hash->hash_id = hash_id;
+    hash->job = NULL;
     CHECK(hash_descriptor[hash->hash_id].init(&(hash->state)));
     return 1;
 }
@@ -72,14 +77,17 @@ static int Lnew(lua_State* L) {
 /** clone(userdata) */
 static int Lclone(lua_State* L) {
     SHash* hash = Pget(L, 1);
+    CHECK_IDLE(hash->job);
     SHash* hashn = Pnew(L);
     *hashn = *hash;
+    hashn->job = NULL;
     return 1;
 }
 
 /** reset(userdata) */
 static int Lreset(lua_State* L) {
     SHash* hash = Pget(L, 1);
+    CHECK_IDLE(hash->job);
     CHECK(hash_descriptor[hash->hash_id].init(&(hash->state)));
     lua_settop(L, 1);
     return 1;
@@ -90,11 +98,81 @@ static int Lupdate(lua_State* L) {
     size_t size;
     SHash* hash = Pget(L, 1);
     const char* chunk = luaL_checklstring(L, 2, &size);
+    CHECK_IDLE(hash->job);
     CHECK(hash_descriptor[hash->hash_id].process(&(hash->state), (unsigned char*)chunk, (unsigned long)size));
     lua_settop(L, 1);
     return 1;
 }
 
+/* File hashing job: reads a file and updates the hash with its content in a
+ * worker thread. */
+typedef struct SHashJob_ {
+    worker_job_t job;
+    SHash* hash;
+    int status;
+    int error;
+    char path[1];
+} SHashJob;
+
+#define FILEJOB_BLOCKSIZE 4096
+
+static void hashjob_run(worker_job_t* job) {
+    SHashJob* j = (SHashJob*) job;
+    unsigned char buffer[FILEJOB_BLOCKSIZE];
+    size_t size;
+    FILE* f = fopen(j->path, "rb");
+    j->status = CRYPT_OK;
+    if (f == NULL) {
+        j->error = errno;
+        return;
+    }
+    while (j->status == CRYPT_OK && (size = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        j->status = hash_descriptor[j->hash->hash_id].process(&(j->hash->state), buffer, (unsigned long)size);
+    if (ferror(f))
+        j->error = errno;
+    fclose(f);
+}
+
+static int hashjob_finish(lua_State* L, worker_job_t* job) {
+    SHashJob* j = (SHashJob*) job;
+    if (j->error) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "%s: %s", j->path, strerror(j->error));
+        return 2;
+    }
+    CHECK(j->status);
+    lua_getfenv(L, 1);
+    lua_rawgeti(L, -1, 1);
+    return 1;
+}
+
+/* The hash is anchored by the job, so it is still there. */
+static void hashjob_release(worker_job_t* job) {
+    SHashJob* j = (SHashJob*) job;
+    if (j->hash->job == job)
+        j->hash->job = NULL;
+}
+
+/** filejob(userdata, path): submits a job which updates the hash with the
+ * content of a file and returns the hash, see `sched.worker`. Until the job is
+ * done, the hash methods and filters return nil, "BADSTATE". */
+static int Lfilejob(lua_State* L) {
+    SHash* hash = Pget(L, 1);
+    size_t size;
+    const char* path = luaL_checklstring(L, 2, &size);
+    CHECK_IDLE(hash->job);
+    SHashJob* j = (SHashJob*) worker_newjob(L, sizeof(SHashJob) + size,
+            hashjob_run, hashjob_finish, hashjob_release); // job
+    j->hash = hash;
+    hash->job = &j->job;
+    memcpy(j->path, path, size + 1);
+    lua_getfenv(L, -1);                         // job, env
+    lua_pushvalue(L, 1);                        // job, env, hash
+    lua_rawseti(L, -2, 1);                      // job, env
+    lua_pop(L, 1);                              // job
+    return worker_submit(L, -1);
+}
+
 /** digest(userdata, [raw]) or digest(s, [raw])*/
 static int Ldigest(lua_State* L) {
     unsigned char digest[MAXBLOCKSIZE];
@@ -102,6 +180,7 @@ static int Ldigest(lua_State* L) {
     int n = 2;
     if (lua_isuserdata(L, 1)) {
         SHash hash = *Pget(L, 1);
+        CHECK_IDLE(hash.job);
         hashsize = hash_descriptor[hash.hash_id].hashsize;
         CHECK(hash_descriptor[hash.hash_id].done(&(hash.state), digest));
     } else {
@@ -172,6 +251,7 @@ static int hash_filter(lua_State* L) {
     } else  {
         size_t size;
         const char* chunk = lua_tolstring(L, 1, &size);
+        CHECK_IDLE(hash->job);
         if (size > 0) {
             CHECK(hash_descriptor[hash->hash_id].process(&(hash->state), (unsigned char*)chunk, (unsigned long)size));
         }
@@ -199,6 +279,7 @@ static const luaL_reg R[] = {
         { "__gc", Ldone },
         { "clone", Lclone },
         { "digest", Ldigest },
+        { "filejob", Lfilejob },
         { "filter", Lfilter},
         { "new", Lnew },
         { "reset", Lreset },
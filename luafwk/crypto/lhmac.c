@@ -9,6 +9,7 @@
  *     Gilles Cannenterre for Sierra Wireless - initial API and implementation
  *******************************************************************************/
 #include "crypto.h"
+#include "worker.h"
 
 #define MYNAME      "hmac"
 #define MYVERSION   MYNAME " library for " LUA_VERSION " / May 2011 / using " AUTHOR
@@ -24,6 +25,7 @@ typedef struct SHmacDesc_ {
 typedef struct SHmac_ {
     SHmacDesc desc;
     hmac_state state;
+    worker_job_t* job; // last job submitted, NULL once it is collected
 } SHmac;
 
 static int get_hmac_desc(lua_State* L, int index, SHmacDesc* desc) {
@@ -92,6 +94,7 @@ static int get_hmac_desc(lua_State* L, int index, SHmacDesc* desc) {
 static int Lnew(lua_State* L) {
     SHmac* hmac = (SHmac*) lua_newuserdata(L, sizeof(SHmac));
     hmac->desc.key = NULL; // mark as invalid.
+    hmac->job = NULL;
     luaL_getmetatable(L, MYTYPE);
     lua_setmetatable(L, -2);
 
@@ -133,11 +136,64 @@ static int Lupdate(lua_State* L) {
     SHmac* hmac = luaL_checkudata(L, 1, MYTYPE);
     size_t in_size;
     unsigned char* in = (unsigned char*) luaL_checklstring(L, 2, &in_size);
+    CHECK_IDLE(hmac->job);
     CHECK(hmac_process(&(hmac->state), in, (unsigned long) in_size));
     lua_settop(L, 1);
     return 1;
 }
 
+/* Update job: processes a string in a worker thread. The string is anchored
+ * in the job's environment, so that it remains valid while the job runs. */
+typedef struct SHmacJob_ {
+    worker_job_t job;
+    SHmac* hmac;
+    const unsigned char* in;
+    size_t in_size;
+    int status;
+} SHmacJob;
+
+static void hmacjob_run(worker_job_t* job) {
+    SHmacJob* j = (SHmacJob*) job;
+    j->status = hmac_process(&(j->hmac->state), j->in, (unsigned long) j->in_size);
+}
+
+static int hmacjob_finish(lua_State* L, worker_job_t* job) {
+    CHECK(((SHmacJob*) job)->status);
+    lua_getfenv(L, 1);
+    lua_rawgeti(L, -1, 1);
+    return 1;
+}
+
+/* The hmac is anchored by the job, so it is still there. */
+static void hmacjob_release(worker_job_t* job) {
+    SHmacJob* j = (SHmacJob*) job;
+    if (j->hmac->job == job)
+        j->hmac->job = NULL;
+}
+
+/** job(userdata, s): submits a job which updates the hmac with s and returns
+ * the hmac, see `sched.worker`. Until the job is done, the hmac methods and
+ * filters return nil, "BADSTATE". */
+static int Ljob(lua_State* L) {
+    SHmac* hmac = luaL_checkudata(L, 1, MYTYPE);
+    size_t in_size;
+    const char* in = luaL_checklstring(L, 2, &in_size);
+    CHECK_IDLE(hmac->job);
+    SHmacJob* j = (SHmacJob*) worker_newjob(L, sizeof(SHmacJob),
+            hmacjob_run, hmacjob_finish, hmacjob_release); // job
+    j->hmac = hmac;
+    hmac->job = &j->job;
+    j->in = (const unsigned char*) in;
+    j->in_size = in_size;
+    lua_getfenv(L, -1);                         // job, env
+    lua_pushvalue(L, 1);                        // job, env, hmac
+    lua_rawseti(L, -2, 1);                      // job, env
+    lua_pushvalue(L, 2);                        // job, env, s
+    lua_rawseti(L, -2, 2);                      // job, env
+    lua_pop(L, 1);                              // job
+    return worker_submit(L, -1);
+}
+
 /** digest(userdata, [raw]) or digest(hash, key, s)*/
 static int Ldigest(lua_State* L) {
     unsigned char dst[MAXBLOCKSIZE];
@@ -145,6 +201,7 @@ static int Ldigest(lua_State* L) {
     int i;
     if (lua_isuserdata(L, 1)) {
         SHmac* hmac = luaL_checkudata(L, 1, MYTYPE);
+        CHECK_IDLE(hmac->job);
         hmac_state hstmp = hmac->state;
         hstmp.key = malloc(hash_descriptor[hmac->desc.hash_id].blocksize);
         memcpy(hstmp.key, hmac->state.key, hash_descriptor[hmac->desc.hash_id].blocksize);
@@ -210,6 +267,7 @@ static int hmac_filter(lua_State* L) {
     } else  {
         size_t in_size;
         const char* in = luaL_checklstring(L, 1, &in_size);
+        CHECK_IDLE(hmac->job);
         if (in_size > 0)
             CHECK(hmac_process(&(hmac->state), (unsigned char*)in, (unsigned long) in_size));
         lua_pushlstring(L, in, in_size);
@@ -241,6 +299,7 @@ static const luaL_Reg R[] = {
         { "__gc", Ldone },
         { "digest", Ldigest },
         { "filter", Lfilter },
+        { "job", Ljob },
         { "new", Lnew },
         { "tostring", Ltostring },
         { "update", Lupdate },
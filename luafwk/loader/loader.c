@@ -9,10 +9,21 @@
  *     Laurent Barthelemy for Sierra Wireless - initial API and implementation
  *******************************************************************************/
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "lua.h"
 #include "lualib.h"
 #include "lauxlib.h"
 
+#include "cdb.h"
+
+#define BUNDLE_MT "loader.bundle"
+
 #ifdef LOADER_PATH_BASE
 
 //CPATH_PATTERN:
@@ -87,20 +98,155 @@ int l_addpath(lua_State *L)
   lua_pushstring(L, "ok");
   return 1;
 }
-static const luaL_reg R[] = { { "addpath", l_addpath }, { NULL, NULL } };
+#endif
 
-int luaopen_loader(lua_State *L)
+// Bytecode bundle: a cdb file produced by bin/mkbundle.lua, keyed by module
+// name, holding for each module the path of its source relative to the Lua
+// directory, the source modification time, and the string.dump() of its main
+// chunk, separated by '\0'.
+// The file is mmapped once (cdb_init does it) and modules are undumped
+// straight from the mapping when they are required, so that boot does not pay
+// a package.path filesystem search per module, only a stat() of the source.
+typedef struct
 {
-  luaL_register(L, "loader", R);
-  return 1;
+  struct cdb cdb;
+} Bundle;
 
-}
-#else
-int luaopen_loader(lua_State *L)
+static int bundle_gc(lua_State *L)
 {
-  lua_pushstring(L, "no define for LOADER_PATH_BASE, loader module can't be loaded");
-  lua_error(L);
+  Bundle *b = (Bundle *) luaL_checkudata(L, 1, BUNDLE_MT);
+  if (b->cdb.fd >= 0)
+  {
+    cdb_free(&b->cdb);
+    close(b->cdb.fd);
+    b->cdb.fd = -1;
+  }
   return 0;
 }
+
+// package.loaders entry: upvalue 1 is the Bundle userdata, upvalue 2 the bundle path,
+// upvalue 3 the Lua directory the sources are relative to.
+// A module whose source was modified since the bundle was built is left to the
+// next searchers; a module without source (e.g. stripped from the device) is
+// loaded from the bundle.
+static int bundle_searcher(lua_State *L)
+{
+  size_t len, n;
+  const char *name = luaL_checklstring(L, 1, &len);
+  Bundle *b = (Bundle *) lua_touserdata(L, lua_upvalueindex(1));
+  const char *data, *mtime, *code;
+  struct stat st;
+
+  if (b->cdb.fd < 0 || cdb_find(&b->cdb, (char *) name, len) != 1)
+  {
+    lua_pushfstring(L, "\n\tno module '%s' in bundle '%s'", name, lua_tostring(L, lua_upvalueindex(2)));
+    return 1;
+  }
+  data = b->cdb.map + cdb_datapos(&b->cdb);
+  len = cdb_datalen(&b->cdb);
+  mtime = memchr(data, '\0', len);
+  code = mtime ? memchr(++mtime, '\0', len - (mtime - data)) : NULL;
+  if (code == NULL)
+    return luaL_error(L, "error loading module '%s' from bundle '%s':\n\tinvalid entry", name,
+        lua_tostring(L, lua_upvalueindex(2)));
+  n = len - (++code - data);
+
+  lua_pushfstring(L, "%s/%s", lua_tostring(L, lua_upvalueindex(3)), data);
+  if (stat(lua_tostring(L, -1), &st) == 0 && (long long) st.st_mtime != strtoll(mtime, NULL, 10))
+  {
+    lua_pushfstring(L, "\n\tmodule '%s' in bundle '%s' is older than %s", name,
+        lua_tostring(L, lua_upvalueindex(2)), lua_tostring(L, -1));
+    return 1;
+  }
+  // only used in load errors: binary chunks keep the name given by mkbundle
+  lua_pushfstring(L, "=%s", name);
+  if (luaL_loadbuffer(L, code, n, lua_tostring(L, -1)))
+    return luaL_error(L, "error loading module '%s' from bundle '%s':\n\t%s", name,
+        lua_tostring(L, lua_upvalueindex(2)), lua_tostring(L, -1));
+  return 1;
+}
+
+/* --- loader.bundle(path[, luadir])
+ * -- Register a precompiled bytecode bundle (see bin/mkbundle.lua) as a module searcher.
+ * -- The searcher is inserted right after the preload searcher, so bundled modules take
+ * -- precedence over package.path, unless their source file was modified since the
+ * -- bundle was built: such modules are loaded from package.path.
+ * -- @param path path of the bundle file.
+ * -- @param luadir directory the bundle was built from, defaults to the directory of the bundle.
+ * -- @return "ok" on success, nil+error message otherwise
+ */
+int l_bundle(lua_State *L)
+{
+  const char *path = luaL_checkstring(L, 1);
+  const char *luadir = luaL_optstring(L, 2, NULL);
+  const char *sep = strrchr(path, '/');
+  int fd, n, i;
+  Bundle *b;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    lua_pushnil(L);
+    lua_pushfstring(L, "cannot open bundle %s: %s", path, strerror(errno));
+    return 2;
+  }
+  b = (Bundle *) lua_newuserdata(L, sizeof(*b));
+  memset(b, 0, sizeof(*b));
+  cdb_init(&b->cdb, fd);
+  luaL_getmetatable(L, BUNDLE_MT);
+  lua_setmetatable(L, -2);
+  if (!b->cdb.map) // undumping in place requires the mapping
+  {
+    close(fd);
+    b->cdb.fd = -1;
+    lua_pushnil(L);
+    lua_pushfstring(L, "cannot map bundle %s", path);
+    return 2;
+  }
+
+  lua_pushvalue(L, 1);
+  if (luadir)
+    lua_pushstring(L, luadir);
+  else if (sep)
+    lua_pushlstring(L, path, sep - path);
+  else
+    lua_pushliteral(L, ".");
+  lua_pushcclosure(L, bundle_searcher, 3); //-1: searcher
+
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "loaders"); //-1: loaders -2: package -3: searcher
+  if (!lua_istable(L, -1))
+    return luaL_error(L, "package.loaders must be a table");
+  // shift loaders[2..n] to make room for the bundle searcher
+  n = lua_objlen(L, -1);
+  for (i = n; i >= 2; i--)
+  {
+    lua_rawgeti(L, -1, i);
+    lua_rawseti(L, -2, i+1);
+  }
+  lua_pushvalue(L, -3);
+  lua_rawseti(L, -2, n >= 1 ? 2 : 1);
+  lua_pop(L, 3);
+
+  lua_pushstring(L, "ok");
+  return 1;
+}
+
+static const luaL_reg R[] = {
+#ifdef LOADER_PATH_BASE
+    { "addpath", l_addpath },
 #endif
+    { "bundle", l_bundle },
+    { NULL, NULL } };
 
+int luaopen_loader(lua_State *L)
+{
+  luaL_newmetatable(L, BUNDLE_MT);
+  lua_pushcfunction(L, bundle_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+
+  luaL_register(L, "loader", R);
+  return 1;
+
+}
@@ -0,0 +1,78 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Startup time benchmark: loads the modules required by the agent boot
+-- sequence in a fresh Lua VM, with the regular package.path searchers and
+-- with the bytecode bundle built by the agent_bundle target. Reports the mean
+-- and worst time of `runs` VM starts of each kind.
+-- Cold runs drop the page cache first, which needs root privileges; they are
+-- skipped otherwise.
+--
+-- From the runtime directory, once the agent_bundle target is built:
+--
+--   bin/lua <this directory>/loader_perf.lua [runs]
+
+local socket = require 'socket'
+
+local LUA = "bin/lua"
+local BUNDLE = "lua/agent.bundle"
+local RUNS = tonumber(arg[1]) or 10
+
+local modules = { "sched", "strict", "log", "socket", "utils.loader", "coxpcall",
+    "posixsignal", "persist", "agent.config", "agent.treemgr", "agent.asscon",
+    "agent.srvcon", "agent.devman", "agent.monitoring", "racon", "m3da.bysant",
+    "stagedb", "rpc", "shell.telnet", "web.server", "timer", "utils.table", "utils.path" }
+
+local function printf(...) print(string.format(...)) end
+
+local function script(withbundle)
+    local s = { }
+    if withbundle then s[1] = string.format("assert(require 'loader'.bundle(%q))", BUNDLE) end
+    for _, m in ipairs(modules) do s[#s+1] = string.format("pcall(require, %q)", m) end
+    return table.concat(s, " ")
+end
+
+local function dropcaches()
+    return os.execute("sync && echo 3 > /proc/sys/vm/drop_caches 2>/dev/null") == 0
+end
+
+local function measure(withbundle, cold)
+    local cmd = string.format("%s -e %q > /dev/null 2>&1", LUA, script(withbundle))
+    local total, max = 0, 0
+    for _ = 1, RUNS do
+        if cold and not dropcaches() then return nil end
+        local t0 = socket.gettime()
+        os.execute(cmd)
+        local dt = socket.gettime() - t0
+        total, max = total + dt, math.max(max, dt)
+    end
+    return total / RUNS, max
+end
+
+local f = io.open(BUNDLE)
+if not f then
+    io.stderr:write("no "..BUNDLE..", build the agent_bundle target first\n")
+    os.exit(1)
+end
+f:close()
+
+printf("%-8s %-10s %12s %12s", "cache", "loader", "mean (ms)", "max (ms)")
+for _, cold in ipairs{ false, true } do
+    for _, withbundle in ipairs{ false, true } do
+        local mean, max = measure(withbundle, cold)
+        if mean then
+            printf("%-8s %-10s %12.1f %12.1f", cold and "cold" or "warm",
+                withbundle and "bundle" or "path", mean*1000, max*1000)
+        else
+            printf("%-8s %-10s %12s", "cold", withbundle and "bundle" or "path", "skipped")
+        end
+    end
+end
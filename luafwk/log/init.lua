@@ -122,6 +122,23 @@ end
 --
 storelogger = nil
 
+-------------------------------------------------------------------------------
+-- Logger function for unformatted logs.
+-- This logger can be replaced by a custom function.
+-- There is no default raw logger.
+-- It is called only if the log needs to be traced, before any formatting, with
+-- the arguments given to @{#log.trace}. The log is formatted afterwards only if
+-- @{#log.displaylogger} or @{#log.storelogger} is set; see @{#log.compose} to
+-- format it later.
+--
+-- @function [parent=#log] rawlogger
+-- @param module string identifying the module thats issues the log
+-- @param severity string representing the log level, see @{log#levels}.
+-- @param fmt string format of the log text.
+-- @param varargs arguments of the format.
+--
+rawlogger = nil
+
 -------------------------------------------------------------------------------
 -- Format is a string used to apply specific formating before the log is outputted.
 -- Within a format, the following tokens are available (in addition to standard text)
@@ -164,11 +181,34 @@ function musttrace(module, severity)
 end
 
 
+-- Applies @{#log.format} to the log text `s`
+local function layout(module, severity, timestamp, s)
+    local t
+    local function sub(p)
+        if     p=="l" then return s
+        elseif p=="t" then t = t or tostring(os.date(timestampformat, timestamp)) return t
+        elseif p=="m" then return module
+        elseif p=="s" then return severity
+        else return p end
+    end
+    return ((format or "%t %m-%s: %l"):gsub("%%(%a)", sub))
+end
+
+-- Lines printed when the formatting of a log failed with error `err`
+local function fallback(err, module, severity, fmt, ...)
+    local args = {}
+    local t = table.pack(...)
+    for k = 1, t.n do table.insert(args, tostring(k)..":["..tostring(t[k]).."]") end
+    return "Error in the log formating! ("..tostring(err)..") - Fallback to raw printing:",
+        string.format("\tmodule=(%s), severity=(%s), format=(%q), args=(%s)", module, severity, fmt, table.concat(args, " ") )
+end
+
 -------------------------------------------------------------------------------
 -- Prints out a log entry according to the module and the severity of the log entry.
 --
 -- This function uses @{#log.format} and @{#log.timestampformat} to create the
--- final message string. It calls @{#log.displaylogger} and @{#log.storelogger}.
+-- final message string. It calls @{#log.rawlogger}, @{#log.displaylogger} and
+-- @{#log.storelogger}.
 --
 -- @function [parent=#log] trace
 -- @param modulename string identifying the module that issues the log.
@@ -181,28 +221,39 @@ function trace(module, severity, fmt, ...)
     checks('string', 'string', 'string')
     if not musttrace(module, severity) then return end
 
+    if rawlogger then
+        rawlogger(module, severity, fmt, ...)
+        if not displaylogger and not storelogger then return end
+    end
+
     local c, s = pcall(string.format, fmt, ...)
     if c then
-        local t
-        local function sub(p)
-            if     p=="l" then return s
-            elseif p=="t" then t = t or tostring(os.date(timestampformat)) return t
-            elseif p=="m" then return module
-            elseif p=="s" then return severity
-            else return p end
-        end
-        local out = (format or "%t %m-%s: %l"):gsub("%%(%a)", sub)
-        loggers(module, severity, out)
+        loggers(module, severity, layout(module, severity, nil, s))
     else -- fallback printing when the formating failed. The fallback printing allow to safely print what was given to the log function, without crashing the thread !
-        local args = {}
-        local t = table.pack(...)
-        for k = 1, t.n do table.insert(args, tostring(k)..":["..tostring(t[k]).."]") end
-        --trace(module, severity, "\targs=("..table.concat(args, " ")..")" )
-        loggers(module, severity, "Error in the log formating! ("..tostring(s)..") - Fallback to raw printing:" )
-        loggers(module, severity, string.format("\tmodule=(%s), severity=(%s), format=(%q), args=(%s)", module, severity, fmt, table.concat(args, " ") ) )
+        local f1, f2 = fallback(s, module, severity, fmt, ...)
+        loggers(module, severity, f1)
+        loggers(module, severity, f2)
     end
 end
 
+-------------------------------------------------------------------------------
+-- Formats a log issued at a given time, the way @{#log.trace} does.
+-- This is used to format the logs stored by a @{#log.rawlogger}.
+--
+-- @function [parent=#log] compose
+-- @param timestamp time of the log, as returned by `os.time()`.
+-- @param modulename string identifying the module that issued the log.
+-- @param severity string representing the level in @{log#levels}.
+-- @param fmt string format that holds the log text the same way as string.format does.
+-- @param varargs additional arguments of the format.
+-- @return the formatted log.
+--
+function compose(timestamp, module, severity, fmt, ...)
+    local c, s = pcall(string.format, fmt, ...)
+    if c then return layout(module, severity, timestamp, s) end
+    return table.concat({ fallback(s, module, severity, fmt, ...) }, "\n")
+end
+
 
 -------------------------------------------------------------------------------
 -- Sets the log level for a list of module names.
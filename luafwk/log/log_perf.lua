@@ -0,0 +1,72 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of log calls at DEBUG level, stored in flash:
+-- * formatted by log.trace, then written by logflashstore, as the "sole" log
+--   policy does, without displaying them;
+-- * stored unformatted in the ram ring, written by the writer thread: the
+--   "binary" log policy in its default configuration, which does not display
+--   the logs. The time includes the writer thread, flushed at the end.
+-- The time to format the stored logs back is reported too.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/log_perf.lua [logs]
+
+local log = require 'log'
+local logstore = require 'log.store'
+local logtools = require 'log.tools'
+
+local N = tonumber(arg[1]) or 100000
+local function printf(...) print(string.format(...)) end
+
+local root = os.tmpname(); os.remove(root); root = root .. "/"
+LUA_AF_RW_PATH = root
+log.setlevel('DEBUG')
+log.timestampformat = "%F %T"
+
+local function bench()
+    local t = os.clock()
+    for i = 1, N do
+        log("BENCH", "DEBUG", "value %d of %s: %f", i, "sensor", i / 3)
+    end
+    return t
+end
+
+local function report(name, t)
+    t = os.clock() - t
+    printf("%-36s %9.0f logs/s", name, N / t)
+end
+
+local displaylogger = log.displaylogger
+log.displaylogger = nil
+assert(logstore.logflashinit{ size = 1024 * 1024, path = "flash" })
+log.storelogger = function(_, _, s) logstore.logflashstore(s .. "\n") end
+report("formatted, logflashstore", bench())
+log.storelogger = nil
+log.displaylogger = displaylogger
+
+logtools.init{ name = "binary", params = { size = 256 * 1024, flashlogger = { size = 1024 * 1024, path = "ring" } } }
+local t = bench()
+logstore.logringsource("flash", log.compose) -- flushes the ring
+report("binary ring, writer thread", t)
+log.rawlogger = nil
+
+local stats = logstore.logringstats()
+printf("  %d stored, %d dropped, %d bytes written, %d rotations",
+    stats.stored, stats.dropped, stats.written, stats.rotations)
+
+t = os.clock()
+local src, n = logstore.logringsource("flash", log.compose), 0
+for chunk in src do n = n + select(2, chunk:gsub("\n", "")) end
+printf("%-36s %9.0f logs/s (%d logs read)", "formatting stored logs", n / (os.clock() - t), n)
+
+os.execute("rm -rf " .. root)
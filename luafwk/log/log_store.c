@@ -19,6 +19,7 @@
 //get logstoreflash API
 #include "log_store.h"
 #include "log_storeflash.h"
+#include "log_storering.h"
 
 static uint16_t buf_size = 0;
 static uint8_t* buf = NULL;
@@ -243,10 +244,18 @@ static const luaL_Reg R[] =
 { "logflashstore", l_logflashstore },
 { "logflashgetsource", l_logflashgetsource },
 { "logflashdebug", l_logflashdebug },
+
+{ "logringinit", l_logringinit },
+{ "logringstore", l_logringstore },
+{ "logringsource", l_logringsource },
+{ "logringstats", l_logringstats },
 { NULL, NULL } };
 
 int luaopen_log_store(lua_State* L)
 {
+  //environment of the functions: ids of the strings stored by logringstore
+  lua_newtable(L);
+  lua_replace(L, LUA_ENVIRONINDEX);
   luaL_register(L, "log.store", R);
   return 1;
 
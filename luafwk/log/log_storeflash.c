@@ -84,89 +84,79 @@ int l_logflashstore(lua_State *L)
   return 1;
 }
 
-//init: create files names to store log, store size limits for ram/flash store.
-//ram and flash path given as params, init check access to those paths
-int l_logflashinit(lua_State *L)
+//create the log directory: `path` relative to LUA_AF_RW_PATH, or to the
+//current directory. Return the directory path, to be freed, or NULL.
+char* logflash_mkdir(lua_State *L, const char* path, size_t len)
 {
-  if (NULL != File1)
-  {
-    lua_pushstring(L, "logflashinit: init already done");
-    return 1;
-  }
-
-  if (lua_type(L, 1) != LUA_TTABLE){
-    LUA_RETURN_ERROR("logflashinit: Provided parameter is not correct: need table param with 'size' and 'path' fields");
-  }
-
-  LUA_CHECK_FIELD_TYPE(1, "size", LUA_TNUMBER, "logflashinit");
-  file_size_limit = luaL_checkinteger(L, -1);
-  LUA_CHECK_FIELD_TYPE(1, "path", LUA_TSTRING, "logflashinit");
-  size_t len_flash_path = 0;
-  const char* flash_path = luaL_checklstring(L, -1, &len_flash_path);
-
   char* log_path = NULL;
   char* mkdir_cmd = NULL;
+  int mkdir_status = -1;
+
   lua_getglobal(L, "LUA_AF_RW_PATH");
   if (lua_isstring(L, -1))
   {
     const char* working_dir = lua_tostring(L, -1);
-    log_path = malloc(strlen(working_dir) + len_flash_path + 1);
+    log_path = malloc(strlen(working_dir) + len + 1);
     if (log_path != NULL)
-      sprintf(log_path, "%s%s", working_dir, flash_path);
+      sprintf(log_path, "%s%s", working_dir, path);
   }
   else
   {
-    log_path = malloc(2 + len_flash_path + 1);
+    log_path = malloc(2 + len + 1);
     if (log_path != NULL)
-      sprintf(log_path, "./%s", flash_path);
+      sprintf(log_path, "./%s", path);
   }
+  lua_pop(L, 1);
   if (log_path == NULL)
-  {
-      LUA_RETURN_ERROR("logflashinit: Allocation failure");
-  }
-  len_flash_path = strlen(log_path);
-  int mkdir_status = -1;
-  mkdir_cmd = malloc(9 + len_flash_path + 1);
+    return NULL;
+
+  mkdir_cmd = malloc(9 + strlen(log_path) + 1);
   if (mkdir_cmd != NULL)
   {
     sprintf(mkdir_cmd, "mkdir -p %s", log_path);
     mkdir_status = system((const char*)mkdir_cmd);
+    free(mkdir_cmd);
   }
-  else
+  if ((mkdir_status != 0) || access(log_path, W_OK))
   {
-      LUA_RETURN_ERROR("logflashinit: Allocation failure");
+    free(log_path);
+    return NULL;
   }
-  if ((mkdir_status != 0) || access(log_path, W_OK))
+  return log_path;
+}
+
+//init: create files names to store log, store size limits for ram/flash store.
+//ram and flash path given as params, init check access to those paths
+int l_logflashinit(lua_State *L)
+{
+  if (NULL != File1)
   {
-    if (log_path != NULL)
-    {
-      free(log_path);
-      log_path = NULL;
-    }
-    if (mkdir_cmd != NULL)
-    {
-      free(mkdir_cmd);
-      mkdir_cmd = NULL;
-    }
-    LUA_RETURN_ERROR("logflashinit: Provided path is not correct: cannot create");
+    lua_pushstring(L, "logflashinit: init already done");
+    return 1;
+  }
+
+  if (lua_type(L, 1) != LUA_TTABLE){
+    LUA_RETURN_ERROR("logflashinit: Provided parameter is not correct: need table param with 'size' and 'path' fields");
   }
 
+  LUA_CHECK_FIELD_TYPE(1, "size", LUA_TNUMBER, "logflashinit");
+  file_size_limit = luaL_checkinteger(L, -1);
+  LUA_CHECK_FIELD_TYPE(1, "path", LUA_TSTRING, "logflashinit");
+  size_t len_flash_path = 0;
+  const char* flash_path = luaL_checklstring(L, -1, &len_flash_path);
+
+  char* log_path = logflash_mkdir(L, flash_path, len_flash_path);
+  if (log_path == NULL)
+    LUA_RETURN_ERROR("logflashinit: Provided path is not correct: cannot create");
+  len_flash_path = strlen(log_path);
+
   if (log_path[len_flash_path - 1] == '/')
     len_flash_path--;
 
   buf_file_names = malloc(2 * (len_flash_path + 25));
   if (NULL == buf_file_names)
   {
-      if (log_path != NULL)
-      {
-        free(log_path);
-        log_path = NULL;
-      }
-      if (mkdir_cmd != NULL)
-      {
-        free(mkdir_cmd);
-        mkdir_cmd = NULL;
-      }
+      free(log_path);
       LUA_RETURN_ERROR("Malloc error at init!");
   }
 
@@ -177,16 +167,7 @@ int l_logflashinit(lua_State *L)
   snprintf(filename2, len_flash_path + 25, "%.*s/%s2.log",
       (int) len_flash_path, log_path, FLASH_FILE_NAME_BASE);
 
-  if (log_path != NULL)
-  {
-    free(log_path);
-    log_path = NULL;
-  }
-  if (mkdir_cmd != NULL)
-  {
-    free(mkdir_cmd);
-    mkdir_cmd = NULL;
-  }
+  free(log_path);
 
   //create empty files if not existing yet
   File1 = fopen(filename2, "a");
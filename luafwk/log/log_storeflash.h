@@ -12,6 +12,7 @@
 #ifndef LOGSTOREFLASH_H_
 #define LOGSTOREFLASH_H_
 
+#include <stddef.h>
 #include "lua.h"
 
 int l_logflashinit(lua_State* L);
@@ -19,4 +20,6 @@ int l_logflashstore(lua_State* L);
 int l_logflashgetsource(lua_State* L);
 int l_logflashdebug(lua_State* L);
 
+char* logflash_mkdir(lua_State *L, const char* path, size_t len);
+
 #endif /* LOGSTOREFLASH_H_ */
@@ -0,0 +1,755 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+//Binary log store.
+//
+//Logs are not formatted when they are issued: a record holding the timestamp,
+//the ids of the module, severity and format strings, and the raw arguments is
+//appended to a ring mapped in memory. Strings are given an id the first time
+//they are logged; formats without any '%' are kept in the record instead, as
+//they are often built by concatenation.
+//
+//The Lua VM is the only producer of the ring. A writer thread copies the
+//records to the flash files, along with the definition of the string ids they
+//use, and tracks the file size itself to swap the files. Records are
+//overwritten once written to flash, or dropped when the writer lags behind.
+//
+//Logs are formatted when they are read, by the sources returned by
+//logringsource.
+
+#include "lua.h"
+#include "lauxlib.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+
+#include "log_store.h"
+#include "log_storeflash.h"
+#include "log_storering.h"
+
+#define RING_FILE_NAME_BASE  "logringstore_file"
+
+#define REC_LOG    1
+#define REC_DEF    2 //string definition: id in `fmt`, string as payload
+#define REC_RESET  3 //first record written by a writer: string ids are redefined
+
+#define RECORD_MAX  4096
+#define SOURCE_BATCH 64
+
+#define STR_CHUNK  256
+#define STR_MAX    (STR_CHUNK * STR_CHUNK - 1) //0 means the string is in the record
+
+//records are aligned on 4 bytes; a null `len` in the ring means that the next
+//record starts at offset 0
+typedef struct
+{
+  uint16_t len;      //record size, header included
+  uint8_t  kind;
+  uint8_t  level;    //numeric severity, 0 when not a built-in level
+  uint16_t module;   //string ids
+  uint16_t severity;
+  uint16_t fmt;
+  uint16_t nargs;
+  uint32_t time;
+} record_t;
+
+//argument tags, followed by a double, nothing, or a 16 bits length and the bytes
+#define ARG_NUMBER 'n'
+#define ARG_TRUE   't'
+#define ARG_FALSE  'f'
+#define ARG_NIL    'z'
+#define ARG_STRING 's'
+
+static const char* const level_names[] =
+{ "NONE", "ERROR", "WARNING", "INFO", "DETAIL", "DEBUG", "ALL", NULL };
+
+static struct
+{
+  uint8_t* buf;
+  uint32_t size;
+  uint32_t recmax;
+  uint64_t head;      //written by the Lua VM
+  uint64_t flushed;   //written by the writer thread
+  uint64_t tail;
+  uint64_t ramstart;  //first record not read from ram yet
+  unsigned stored;
+  unsigned dropped;
+
+  const char** strings[STR_CHUNK];
+  unsigned nstrings;
+
+  //writer
+  int writer;
+  int level;
+  unsigned period;    //ms
+  pthread_t thread;
+  pthread_mutex_t wlock;
+  sem_t kick;
+  int kicked;
+  FILE* file;
+  char* filename1;
+  char* filename2;
+  long filesize;
+  long filelimit;
+  uint8_t defined[(STR_MAX + 1) / 8];
+  unsigned long written;
+  unsigned rotations;
+} ring;
+
+static const char* getstring(unsigned id)
+{
+  return ring.strings[id / STR_CHUNK][id % STR_CHUNK];
+}
+
+static int getlevel(const char* s)
+{
+  int i;
+  for (i = 0; level_names[i]; i++)
+    if (!strcmp(level_names[i], s))
+      return i + 1;
+  return 0;
+}
+
+//return the id of the string at `idx` in the low 16 bits, and its level
+//above; 0 when the string table is full
+static uint32_t intern(lua_State *L, int idx)
+{
+  uint32_t v;
+  unsigned id;
+  size_t len;
+  const char* s;
+  char* copy;
+
+  lua_pushvalue(L, idx);
+  lua_rawget(L, LUA_ENVIRONINDEX);
+  v = (uint32_t) lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  if (v || ring.nstrings >= STR_MAX)
+    return v;
+
+  s = lua_tolstring(L, idx, &len);
+  copy = malloc(len + 1);
+  if (NULL == copy)
+    return 0;
+  memcpy(copy, s, len + 1);
+  id = ring.nstrings + 1;
+  if (NULL == ring.strings[id / STR_CHUNK])
+  {
+    ring.strings[id / STR_CHUNK] = calloc(STR_CHUNK, sizeof(char*));
+    if (NULL == ring.strings[id / STR_CHUNK])
+    {
+      free(copy);
+      return 0;
+    }
+  }
+  ring.strings[id / STR_CHUNK][id % STR_CHUNK] = copy;
+  ring.nstrings = id;
+
+  v = id | getlevel(s) << 16;
+  lua_pushvalue(L, idx);
+  lua_pushinteger(L, v);
+  lua_rawset(L, LUA_ENVIRONINDEX);
+  return v;
+}
+
+//append a string argument, truncated to what is left in the record
+static uint8_t* addstring(uint8_t* p, uint8_t* end, const char* s, size_t len)
+{
+  uint16_t l;
+  if (p + 3 > end)
+    return p;
+  if (len > (size_t)(end - p - 3))
+    len = end - p - 3;
+  l = (uint16_t) len;
+  *p++ = ARG_STRING;
+  memcpy(p, &l, 2);
+  memcpy(p + 2, s, len);
+  return p + 2 + len;
+}
+
+static uint32_t span(uint64_t pos)
+{
+  uint32_t off = pos % ring.size;
+  uint16_t len;
+  memcpy(&len, ring.buf + off, 2);
+  return len ? len : ring.size - off;
+}
+
+static void kick(void)
+{
+  if (ring.writer && !__atomic_exchange_n(&ring.kicked, 1, __ATOMIC_ACQ_REL))
+    sem_post(&ring.kick);
+}
+
+static int push(const uint8_t* rec, uint32_t len)
+{
+  uint64_t head = ring.head;
+  uint32_t off = head % ring.size;
+  uint32_t need = len + (ring.size - off < len ? ring.size - off : 0);
+  uint64_t limit = ring.writer ? __atomic_load_n(&ring.flushed, __ATOMIC_ACQUIRE) : head;
+
+  //reclaim the records already written to flash
+  while (head + need - ring.tail > ring.size && ring.tail < limit)
+    ring.tail += span(ring.tail);
+  if (head + need - ring.tail > ring.size)
+  {
+    ring.dropped++;
+    kick();
+    return 0;
+  }
+
+  if (ring.size - off < len)
+  {
+    memset(ring.buf + off, 0, 2);
+    head += ring.size - off;
+    off = 0;
+  }
+  memcpy(ring.buf + off, rec, len);
+  __atomic_store_n(&ring.head, head + len, __ATOMIC_RELEASE);
+  ring.stored++;
+
+  if (ring.writer && head + len - limit > ring.size / 2)
+    kick();
+  return 1;
+}
+
+//logringstore(module, severity, fmt, ...)
+int l_logringstore(lua_State *L)
+{
+  uint32_t buf[RECORD_MAX / 4];
+  record_t* r = (record_t*) buf;
+  uint8_t* p = (uint8_t*) (r + 1);
+  uint8_t* end = (uint8_t*) buf + ring.recmax;
+  uint32_t module, severity, fmt = 0;
+  size_t len;
+  const char* s;
+  int i, n = lua_gettop(L);
+
+  luaL_checkstring(L, 1);
+  luaL_checkstring(L, 2);
+  s = luaL_checklstring(L, 3, &len);
+  if (NULL == ring.buf)
+    LUA_RETURN_ERROR("logringstore: logringinit not done");
+
+  module = intern(L, 1);
+  severity = intern(L, 2);
+  if (memchr(s, '%', len))
+    fmt = intern(L, 3);
+
+  r->kind = REC_LOG;
+  r->level = severity >> 16;
+  r->module = module & 0xFFFF;
+  r->severity = severity & 0xFFFF;
+  r->fmt = fmt & 0xFFFF;
+  r->time = (uint32_t) time(NULL);
+
+  //strings without id come first, in the header order
+  if (!r->module)
+    p = addstring(p, end, lua_tostring(L, 1), lua_strlen(L, 1));
+  if (!r->severity)
+    p = addstring(p, end, lua_tostring(L, 2), lua_strlen(L, 2));
+  if (!r->fmt)
+    p = addstring(p, end, s, len);
+
+  for (i = 4; i <= n; i++)
+  {
+    if (p + 9 > end)
+      break;
+    switch (lua_type(L, i))
+    {
+      case LUA_TNUMBER:
+      {
+        lua_Number d = lua_tonumber(L, i);
+        *p++ = ARG_NUMBER;
+        memcpy(p, &d, sizeof(d));
+        p += sizeof(d);
+        break;
+      }
+      case LUA_TBOOLEAN:
+        *p++ = lua_toboolean(L, i) ? ARG_TRUE : ARG_FALSE;
+        break;
+      case LUA_TNIL:
+        *p++ = ARG_NIL;
+        break;
+      case LUA_TSTRING:
+        s = lua_tolstring(L, i, &len);
+        p = addstring(p, end, s, len);
+        break;
+      default:
+        //what tostring would give, objects may not be alive anymore when formatted
+        if (!luaL_callmeta(L, i, "__tostring"))
+          lua_pushfstring(L, "%s: %p", luaL_typename(L, i), lua_topointer(L, i));
+        s = lua_tolstring(L, -1, &len);
+        p = addstring(p, end, s ? s : "", s ? len : 0);
+        lua_pop(L, 1);
+        break;
+    }
+  }
+  r->nargs = n > 3 ? n - 3 : 0;
+
+  len = (p - (uint8_t*) buf + 3) & ~3;
+  memset(p, 0, (uint8_t*) buf + len - p);
+  r->len = (uint16_t) len;
+  push((uint8_t*) buf, len);
+  return 0;
+}
+
+//-------------------------------------------------------------------------
+//writer thread
+
+static void writefile(const void* data, size_t len)
+{
+  if (len && fwrite(data, 1, len, ring.file) == len)
+  {
+    ring.filesize += len;
+    ring.written += len;
+  }
+}
+
+static void openfile(const char* mode)
+{
+  record_t reset;
+  ring.file = fopen(ring.filename1, mode);
+  if (NULL == ring.file)
+    return;
+  //the only size query: writes are accounted afterwards
+  fseek(ring.file, 0, SEEK_END);
+  ring.filesize = ftell(ring.file);
+  memset(ring.defined, 0, sizeof(ring.defined));
+  memset(&reset, 0, sizeof(reset));
+  reset.len = sizeof(reset);
+  reset.kind = REC_RESET;
+  writefile(&reset, sizeof(reset));
+}
+
+static size_t defsize(unsigned id)
+{
+  size_t len;
+  if (!id || ring.defined[id / 8] & (1 << id % 8))
+    return 0;
+  len = strlen(getstring(id));
+  if (len > RECORD_MAX - sizeof(record_t))
+    len = RECORD_MAX - sizeof(record_t);
+  return (sizeof(record_t) + len + 3) & ~3;
+}
+
+static void define(unsigned id)
+{
+  static const uint8_t zeros[4];
+  const char* s;
+  record_t d;
+  size_t slen, len = defsize(id);
+  if (!len)
+    return;
+  s = getstring(id);
+  slen = strlen(s);
+  if (slen > len - sizeof(d))
+    slen = len - sizeof(d);
+  memset(&d, 0, sizeof(d));
+  d.len = (uint16_t) len;
+  d.kind = REC_DEF;
+  d.fmt = (uint16_t) id;
+  writefile(&d, sizeof(d));
+  writefile(s, slen);
+  writefile(zeros, len - sizeof(d) - slen);
+  ring.defined[id / 8] |= 1 << id % 8;
+}
+
+static void writerecord(const record_t* r)
+{
+  size_t len = r->len + defsize(r->module) + defsize(r->severity) + defsize(r->fmt);
+  if (ring.filesize > 0 && ring.filesize + (long) len > ring.filelimit)
+  {
+    fclose(ring.file);
+    remove(ring.filename2);
+    rename(ring.filename1, ring.filename2);
+    ring.rotations++;
+    openfile("w");
+    if (NULL == ring.file)
+      return;
+  }
+  define(r->module);
+  define(r->severity);
+  define(r->fmt);
+  writefile(r, r->len);
+}
+
+//write the records issued so far; called with wlock held
+static void flush(void)
+{
+  uint64_t pos = ring.flushed;
+  uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+  while (pos < head)
+  {
+    const record_t* r = (const record_t*) (ring.buf + pos % ring.size);
+    uint32_t len = span(pos);
+    if (ring.file && r->len && (!r->level || r->level <= ring.level))
+      writerecord(r);
+    pos += len;
+  }
+  if (ring.file)
+    fflush(ring.file);
+  __atomic_store_n(&ring.flushed, pos, __ATOMIC_RELEASE);
+}
+
+static void* writer(void* arg)
+{
+  for (;;)
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ring.period / 1000;
+    ts.tv_nsec += (ring.period % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+    }
+    sem_timedwait(&ring.kick, &ts);
+    __atomic_store_n(&ring.kicked, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&ring.wlock);
+    flush();
+    pthread_mutex_unlock(&ring.wlock);
+  }
+  return NULL;
+}
+
+static const char* initwriter(lua_State *L, int idx)
+{
+  size_t len = 0;
+  const char* path;
+  char* dir;
+
+  lua_getfield(L, idx, "size");
+  lua_getfield(L, idx, "path");
+  if (!lua_isnumber(L, -2) || !lua_isstring(L, -1))
+    return "logringinit: flashlogger needs 'size' and 'path' fields";
+  ring.filelimit = lua_tointeger(L, -2);
+  path = lua_tolstring(L, -1, &len);
+
+  dir = logflash_mkdir(L, path, len);
+  if (NULL == dir)
+    return "logringinit: Provided path is not correct: cannot create";
+  len = strlen(dir);
+  if (len && dir[len - 1] == '/')
+    len--;
+  ring.filename1 = malloc(2 * (len + 25));
+  if (NULL == ring.filename1)
+  {
+    free(dir);
+    return "logringinit: Allocation failure";
+  }
+  ring.filename2 = ring.filename1 + len + 25;
+  snprintf(ring.filename1, len + 25, "%.*s/%s1.log", (int) len, dir, RING_FILE_NAME_BASE);
+  snprintf(ring.filename2, len + 25, "%.*s/%s2.log", (int) len, dir, RING_FILE_NAME_BASE);
+  free(dir);
+
+  openfile("a");
+  if (NULL == ring.file)
+    return "logringinit: cannot open log file";
+  pthread_mutex_init(&ring.wlock, NULL);
+  sem_init(&ring.kick, 0, 0);
+  if (pthread_create(&ring.thread, NULL, writer, NULL))
+    return "logringinit: cannot start writer thread";
+  ring.writer = 1;
+  return NULL;
+}
+
+//logringinit{ size = ram size, level = max flash level, period = writer period in ms,
+//             flashlogger = { size = file size, path = files directory } }
+int l_logringinit(lua_State *L)
+{
+  uint32_t size = 64 * 1024;
+  const char* err;
+
+  if (NULL != ring.buf)
+  {
+    lua_pushstring(L, "logringinit: init already done");
+    return 1;
+  }
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  lua_getfield(L, 1, "size");
+  if (lua_isnumber(L, -1))
+    size = lua_tointeger(L, -1);
+  if (size < 256)
+    LUA_RETURN_ERROR("logringinit: provided size is too small: min is 256");
+  size = (size + 3) & ~3;
+  lua_getfield(L, 1, "level");
+  ring.level = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : 7;
+  lua_getfield(L, 1, "period");
+  ring.period = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : 1000;
+
+  ring.buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == ring.buf)
+  {
+    ring.buf = NULL;
+    LUA_RETURN_ERROR("logringinit: mmap failed");
+  }
+  ring.size = size;
+  ring.recmax = size / 2 < RECORD_MAX ? (size / 2) & ~3 : RECORD_MAX;
+
+  lua_getfield(L, 1, "flashlogger");
+  if (lua_istable(L, -1) && (err = initwriter(L, lua_gettop(L))))
+  {
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+
+  lua_pushstring(L, "ok");
+  return 1;
+}
+
+//-------------------------------------------------------------------------
+//sources: records are decoded, then formatted by a Lua function
+
+typedef struct
+{
+  int flash;
+  uint8_t* snapshot; //ram records
+  size_t len, pos;
+  FILE* files[2];
+  int cur;
+  uint32_t rec[RECORD_MAX / 4];
+} source_t;
+
+#define SOURCE_MT "log.store.ringsource"
+
+//next record, NULL at the end
+static const record_t* nextrecord(source_t* src)
+{
+  const record_t* r;
+  if (!src->flash)
+  {
+    if (src->pos + sizeof(record_t) > src->len)
+      return NULL;
+    r = (const record_t*) (src->snapshot + src->pos);
+    src->pos += r->len;
+    return r;
+  }
+  while (src->cur < 2)
+  {
+    FILE* f = src->files[src->cur];
+    r = (const record_t*) src->rec;
+    if (f && fread(src->rec, sizeof(record_t), 1, f) == 1 && r->len >= sizeof(record_t)
+        && (r->len == sizeof(record_t)
+            || fread((uint8_t*) src->rec + sizeof(record_t), r->len - sizeof(record_t), 1, f) == 1))
+      return r;
+    //end of file, or partial record being written
+    if (f)
+      fclose(f);
+    src->files[src->cur++] = NULL;
+  }
+  return NULL;
+}
+
+//push the string `id`, or the next string argument when the id is 0
+static void pushstring(lua_State *L, source_t* src, unsigned id, const uint8_t** p)
+{
+  uint16_t len;
+  if (id && !src->flash)
+    lua_pushstring(L, getstring(id));
+  else if (id)
+  {
+    lua_rawgeti(L, lua_upvalueindex(3), id);
+    if (lua_isnil(L, -1))
+    {
+      lua_pop(L, 1);
+      lua_pushliteral(L, "?");
+    }
+  }
+  else if (**p == ARG_STRING)
+  {
+    memcpy(&len, *p + 1, 2);
+    lua_pushlstring(L, (const char*) *p + 3, len);
+    *p += 3 + len;
+  }
+  else
+    lua_pushliteral(L, "?");
+}
+
+//push the formatted record
+static void format(lua_State *L, source_t* src, const record_t* r)
+{
+  const uint8_t* p = (const uint8_t*) (r + 1);
+  const uint8_t* end = (const uint8_t*) r + r->len;
+  int n = 0;
+
+  lua_pushvalue(L, lua_upvalueindex(2));
+  lua_pushnumber(L, r->time);
+  pushstring(L, src, r->module, &p);
+  pushstring(L, src, r->severity, &p);
+  pushstring(L, src, r->fmt, &p);
+  //args are decoded while they fit in the record, truncated ones are lost
+  while (n < r->nargs && p < end && *p)
+  {
+    switch (*p)
+    {
+      case ARG_NUMBER:
+      {
+        lua_Number d;
+        memcpy(&d, p + 1, sizeof(d));
+        lua_pushnumber(L, d);
+        p += 1 + sizeof(d);
+        break;
+      }
+      case ARG_TRUE: lua_pushboolean(L, 1); p++; break;
+      case ARG_FALSE: lua_pushboolean(L, 0); p++; break;
+      case ARG_NIL: lua_pushnil(L); p++; break;
+      default: pushstring(L, src, 0, &p); break;
+    }
+    n++;
+  }
+  lua_call(L, 4 + n, 1);
+}
+
+static int source(lua_State *L)
+{
+  source_t* src = (source_t*) lua_touserdata(L, lua_upvalueindex(1));
+  const record_t* r;
+  int n = 0;
+  luaL_Buffer b;
+
+  luaL_buffinit(L, &b);
+  while (n < SOURCE_BATCH && (r = nextrecord(src)))
+  {
+    if (REC_DEF == r->kind)
+    {
+      lua_pushlstring(L, (const char*) (r + 1), strnlen((const char*) (r + 1), r->len - sizeof(*r)));
+      lua_rawseti(L, lua_upvalueindex(3), r->fmt);
+    }
+    else if (REC_RESET == r->kind)
+    {
+      lua_newtable(L);
+      lua_replace(L, lua_upvalueindex(3));
+    }
+    else if (REC_LOG == r->kind)
+    {
+      format(L, src, r);
+      luaL_addvalue(&b);
+      luaL_addchar(&b, '\n');
+      n++;
+    }
+  }
+  luaL_pushresult(&b);
+  if (!n)
+    lua_pushnil(L);
+  return 1;
+}
+
+static int source_gc(lua_State *L)
+{
+  source_t* src = (source_t*) lua_touserdata(L, 1);
+  if (src->files[0])
+    fclose(src->files[0]);
+  if (src->files[1])
+    fclose(src->files[1]);
+  free(src->snapshot);
+  return 0;
+}
+
+//copy the records of the ram not read yet, without the wrap marks
+static int snapshot(source_t* src)
+{
+  uint64_t pos = ring.tail > ring.ramstart ? ring.tail : ring.ramstart;
+  src->snapshot = malloc(ring.head - pos + 1);
+  if (NULL == src->snapshot)
+    return 0;
+  for (; pos < ring.head; pos += span(pos))
+  {
+    const record_t* r = (const record_t*) (ring.buf + pos % ring.size);
+    if (r->len)
+    {
+      memcpy(src->snapshot + src->len, r, r->len);
+      src->len += r->len;
+    }
+  }
+  ring.ramstart = ring.head;
+  return 1;
+}
+
+//logringsource("ram"|"flash", formatter): ltn12 source of the logs, formatted by
+//formatter(timestamp, module, severity, fmt, ...)
+int l_logringsource(lua_State *L)
+{
+  const char* which = luaL_checkstring(L, 1);
+  source_t* src;
+
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+  if (NULL == ring.buf)
+    LUA_RETURN_ERROR("logringsource: logringinit not done");
+  if (strcmp(which, "ram") && strcmp(which, "flash"))
+    LUA_RETURN_ERROR("logringsource: source must be 'ram' or 'flash'");
+  if (!strcmp(which, "flash") && !ring.writer)
+    LUA_RETURN_ERROR("logringsource: no flashlogger configured");
+
+  src = lua_newuserdata(L, sizeof(*src));
+  memset(src, 0, sizeof(*src) - sizeof(src->rec));
+  if (luaL_newmetatable(L, SOURCE_MT))
+  {
+    lua_pushcfunction(L, source_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+
+  if (strcmp(which, "flash"))
+  {
+    if (!snapshot(src))
+      LUA_RETURN_ERROR("logringsource: Allocation failure");
+  }
+  else
+  {
+    src->flash = 1;
+    pthread_mutex_lock(&ring.wlock);
+    flush();
+    pthread_mutex_unlock(&ring.wlock);
+    src->files[0] = fopen(ring.filename2, "rb");
+    src->files[1] = fopen(ring.filename1, "rb");
+  }
+
+  lua_pushvalue(L, 2);
+  lua_newtable(L);
+  lua_pushcclosure(L, source, 3);
+  return 1;
+}
+
+int l_logringstats(lua_State *L)
+{
+  if (NULL == ring.buf)
+    LUA_RETURN_ERROR("logringstats: logringinit not done");
+  lua_newtable(L);
+  lua_pushinteger(L, ring.size);
+  lua_setfield(L, -2, "size");
+  lua_pushinteger(L, (lua_Integer) (ring.head - ring.tail));
+  lua_setfield(L, -2, "used");
+  lua_pushinteger(L, ring.stored);
+  lua_setfield(L, -2, "stored");
+  lua_pushinteger(L, ring.dropped);
+  lua_setfield(L, -2, "dropped");
+  lua_pushinteger(L, ring.nstrings);
+  lua_setfield(L, -2, "strings");
+  if (ring.writer)
+  {
+    pthread_mutex_lock(&ring.wlock);
+    lua_pushnumber(L, ring.written);
+    lua_setfield(L, -2, "written");
+    lua_pushinteger(L, ring.rotations);
+    lua_setfield(L, -2, "rotations");
+    pthread_mutex_unlock(&ring.wlock);
+  }
+  return 1;
+}
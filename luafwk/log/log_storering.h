@@ -0,0 +1,22 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+#ifndef LOGSTORERING_H_
+#define LOGSTORERING_H_
+
+#include "lua.h"
+
+int l_logringinit(lua_State* L);
+int l_logringstore(lua_State* L);
+int l_logringsource(lua_State* L);
+int l_logringstats(lua_State* L);
+
+#endif /* LOGSTORERING_H_ */
@@ -12,6 +12,7 @@
 local sched = require "sched"
 local logstore = require "log.store"
 local log = require "log"
+local ltn12 = require "ltn12"
 local unpack = unpack
 local assert = assert
 local tostring = tostring
@@ -93,6 +94,24 @@ function init_func.context(config)
 end
 
 
+----------------------
+-- log policy that stores:
+-- * all logs in ram, unformatted
+-- * logs up to *level* in flash, written by a background thread
+-- logs are formatted when read, see source()
+-- The logs are not displayed either, unless *display* is true: displaying
+-- them would format them anyway.
+----------------------
+
+function init_func.binary(config)
+  local ring = { size = config.size, period = config.period, flashlogger = config.flashlogger }
+  ring.level = levels[config.level or "ALL"]
+  assert(logstore.logringinit(ring))
+  log.rawlogger = logstore.logringstore
+  if not config.display then log.displaylogger = nil end
+end
+
+
 --external init function fun
 --takes as parameter a table with log tools config
 --this tables must have *name* parameter corresponding to one of the log policies,
@@ -109,4 +128,10 @@ function init(config)
     init_func[config.name](config.params)
 end
 
+--ltn12 source of the "ram" or "flash" logs stored by the given policy
+function source(policy, logtype)
+    if policy.name == "binary" then return assert(logstore.logringsource(logtype, log.compose)) end
+    return logtype == "flash" and logstore.logflashgetsource() or ltn12.source.string(logstore.logramget())
+end
+
 
@@ -2,6 +2,7 @@
 #include <yajl/yajl_gen.h>
 #include <lua.h>
 #include <lauxlib.h>
+#include "bytebuffer.h"
 #include <math.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -277,14 +278,30 @@ static yajl_callbacks js_to_value_callbacks = {
  * function.  As a final step, it removes the value at the top of the
  * stack.
  */
+/*
+ * to_value(data [, options [, i [, j]]]): data is a string or a
+ * bytebuffer, of which only the bytes from i to j are decoded when they are
+ * given, with the indexing rules of string.sub. Any JSON value is accepted
+ * at the top level, not only objects and arrays.
+ */
 static int js_to_value(lua_State *L) {
     yajl_handle          handle;
     size_t               len;
-    const unsigned char* buff = (const unsigned char*) luaL_checklstring(L, 1, &len);
+    const unsigned char* buff = (const unsigned char*) bytebuffer_checklstring(L, 1, &len);
     int                  expect_complete = 1;
+    long                 start = (long) luaL_optnumber(L, 3, 1);
+    long                 end = (long) luaL_optnumber(L, 4, -1);
 
     if ( NULL == buff ) return 0;
 
+    if ( start < 0 ) start = (long) len + start + 1;
+    if ( end < 0 ) end = (long) len + end + 1;
+    if ( start < 1 ) start = 1;
+    if ( end > (long) len ) end = (long) len;
+    buff += start - 1;
+    len = start <= end ? (size_t) (end - start + 1) : 0;
+    lua_settop(L, 2);
+
     handle = yajl_alloc(&js_to_value_callbacks, NULL, (void*)L);
     lua_pushcfunction(L, noop);
 
@@ -310,6 +327,17 @@ static int js_to_value(lua_State *L) {
                      expect_complete,
                      __FILE__,
                      __LINE__);
+    /* a top level number is only known to be complete at the end of the input */
+    if ( len > 0 ) {
+        js_parser_assert(L,
+                         yajl_complete_parse(handle),
+                         &handle,
+                         buff,
+                         len,
+                         expect_complete,
+                         __FILE__,
+                         __LINE__);
+    }
 
     yajl_free(handle);
 
@@ -511,7 +539,7 @@ static int js_parser_parse(lua_State *L) {
     } else {
         int expect_complete = 0;
         size_t len;
-        const unsigned char* buff = (const unsigned char*) luaL_checklstring(L, 1, &len);
+        const unsigned char* buff = (const unsigned char*) bytebuffer_checklstring(L, 1, &len);
         if ( NULL == buff ) return 0;
         js_parser_assert(L,
                          yajl_parse(*handle, buff, len),
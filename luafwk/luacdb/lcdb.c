@@ -6,6 +6,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include "byte.h"
+#include "error.h"
 #include "cdb.h"
 #include "lua.h"
 #include "lauxlib.h"
@@ -20,6 +21,19 @@ struct Cdb
 	char *name;
 };
 
+/*
+ * State of a lookup: the next hash slot to probe for the current key.
+ * Iterators have their own, so that several of them can run at once.
+ */
+typedef struct Find Find;
+
+struct Find
+{
+	uint32 loop, khash, kpos, hpos, hslots;
+	uint32 dpos, dlen;
+	int i;		/* findall(): index of the current key */
+};
+
 static void
 xfree(void *ptr)
 {
@@ -27,6 +41,135 @@ xfree(void *ptr)
 		free(ptr);
 }
 
+/*
+ * Returns a pointer to len bytes of the database at pos: into the map
+ * when the file is mapped, which cdb_init() does whenever it can, else
+ * read into buf, which must then hold len bytes. Returns 0 on error.
+ */
+static const char *
+lcdb_at(struct cdb *c, char *buf, uint32 len, uint32 pos)
+{
+	if(c->map){
+		if((pos > c->size) || (c->size - pos < len)){
+			errno = error_proto;
+			return 0;
+		}
+		return c->map + pos;
+	}
+	return cdb_read(c, buf, len, pos) < 0 ? 0 : buf;
+}
+
+static int
+lcdb_match(struct cdb *c, const char *k, uint32 len, uint32 pos)
+{
+	char buf[32];
+	const char *d;
+	uint32 n;
+
+	while(len > 0){
+		n = (c->map || len < sizeof(buf)) ? len : sizeof(buf);
+		if(!(d = lcdb_at(c, buf, n, pos)))
+			return -1;
+		if(memcmp(d, k, n))
+			return 0;
+		pos += n;
+		k += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/*
+ * cdb_findnext() for the key made of prefix p and k, with the lookup
+ * state in f rather than in c. Keys are compared in place when the
+ * file is mapped.
+ */
+static int
+lcdb_find(struct cdb *c, Find *f, const char *p, size_t plen, const char *k, size_t klen)
+{
+	char buf[8];
+	const char *d;
+	uint32 pos, u;
+	size_t n;
+
+	if(!f->loop){
+		u = CDB_HASHSTART;
+		for(n = 0; n < plen; n++)
+			u = (u + (u << 5)) ^ (unsigned char)p[n];
+		for(n = 0; n < klen; n++)
+			u = (u + (u << 5)) ^ (unsigned char)k[n];
+		if(!(d = lcdb_at(c, buf, 8, (u << 3) & 2047)))
+			return -1;
+		uint32_unpack((char *)d+4, &f->hslots);
+		if(!f->hslots)
+			return 0;
+		uint32_unpack((char *)d, &f->hpos);
+		f->khash = u;
+		f->kpos = f->hpos + (((u >> 8) % f->hslots) << 3);
+	}
+	while(f->loop < f->hslots){
+		if(!(d = lcdb_at(c, buf, 8, f->kpos)))
+			return -1;
+		uint32_unpack((char *)d+4, &pos);
+		if(!pos)
+			return 0;
+		f->loop += 1;
+		f->kpos += 8;
+		if(f->kpos == f->hpos + (f->hslots << 3))
+			f->kpos = f->hpos;
+		uint32_unpack((char *)d, &u);
+		if(u != f->khash)
+			continue;
+		if(!(d = lcdb_at(c, buf, 8, pos)))
+			return -1;
+		uint32_unpack((char *)d, &u);
+		if(u != plen+klen)
+			continue;
+		uint32_unpack((char *)d+4, &f->dlen);
+		switch(lcdb_match(c, p, plen, pos+8)){
+		case -1:
+			return -1;
+		case 1:
+			switch(lcdb_match(c, k, klen, pos+8+plen)){
+			case -1:
+				return -1;
+			case 1:
+				f->dpos = pos+8+plen+klen;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Pushes len bytes of the database at pos: straight from the map when
+ * the file is mapped. Returns -1 on error.
+ */
+static int
+lcdb_pushdata(lua_State *L, struct cdb *c, uint32 pos, uint32 len)
+{
+	char *d;
+
+	if(c->map){
+		if((pos > c->size) || (c->size - pos < len)){
+			errno = error_proto;
+			return -1;
+		}
+		lua_pushlstring(L, c->map+pos, len);
+		return 0;
+	}
+	if(!(d = malloc(len ? len : 1)) || (cdb_read(c, d, len, pos) < 0)){
+		int xerrno = errno;
+		xfree(d);
+		errno = xerrno;
+		return -1;
+	}
+	lua_pushlstring(L, d, len);		/* XXX double copy */
+	free(d);
+	return 0;
+}
+
 static Cdb *
 lcdb_get(lua_State *L, int index)
 {
@@ -132,24 +275,19 @@ static int
 lcdb_read(lua_State *L)
 {
 	struct cdb *cdb;
-	int dpos, dlen, nret;
-	char *d;
+	int dpos, dlen;
 
 	cdb = &lcdb_get(L, 1)->cdb;
 	dpos = luaL_checkint(L, 2);
 	dlen = luaL_checkint(L, 3);
-	if(!(d = malloc(dlen)) || (cdb_read(cdb, d, dlen, dpos) < 0)){
+	if(lcdb_pushdata(L, cdb, dpos, dlen) < 0){
 		int xerrno = errno;
 		lua_pushnil(L);
 		lua_pushnumber(L, xerrno);
 		lua_pushstring(L, strerror(xerrno));
-		nret = 3;
-	}else{
-		lua_pushlstring(L, d, dlen);		/* XXX double copy */
-		nret = 1;
+		return 3;
 	}
-	xfree(d);
-	return nret;
+	return 1;
 }
 
 static int
@@ -157,34 +295,31 @@ lcdb_pairs_aux(lua_State *L)
 {
 	struct cdb *cdb;
 	uint32 pos;
-	char buf[8], *kd=0;
+	char buf[8];
+	const char *d;
 	uint32 eod, klen, dlen;
 	int xerrno;
 
 	cdb = &lcdb_get(L, lua_upvalueindex(1))->cdb;
 	pos = lua_tonumber(L, lua_upvalueindex(2));
-	if(cdb_read(cdb, buf, 4, 0) < 0)
+	if(!(d = lcdb_at(cdb, buf, 4, 0)))
 		goto error;
-	uint32_unpack(buf, &eod);
+	uint32_unpack((char *)d, &eod);
 	if((pos < 2048) || (pos >= eod))
 		return 0;
-	if(cdb_read(cdb, buf, 8, pos) < 0)
+	if(!(d = lcdb_at(cdb, buf, 8, pos)))
 		goto error;
 	pos += 8;
-	uint32_unpack(buf, &klen);
-	uint32_unpack(buf+4, &dlen);
-	if(!(kd = malloc(klen+dlen)) || (cdb_read(cdb, kd, klen+dlen, pos) < 0))
+	uint32_unpack((char *)d, &klen);
+	uint32_unpack((char *)d+4, &dlen);
+	if((lcdb_pushdata(L, cdb, pos, klen) < 0) || (lcdb_pushdata(L, cdb, pos+klen, dlen) < 0))
 		goto error;
-	lua_pushlstring(L, kd, klen);		/* XXX double copy */
-	lua_pushlstring(L, kd+klen, dlen);	/* XXX double copy */
-	xfree(kd);
 	pos += klen+dlen;
 	lua_pushnumber(L, pos);
 	lua_replace(L, lua_upvalueindex(2));
 	return 2;
 
 error:	xerrno = errno;
-	xfree(kd);
 	return luaL_error(L, "lcdb_pairs_aux: %s (errno=%d)", strerror(xerrno), xerrno);
 }
 
@@ -201,42 +336,114 @@ static int
 lcdb_values_aux(lua_State *L)
 {
 	struct cdb *cdb;
+	Find *f;
 	const char *k;
 	size_t klen;
-	char *d=0;
 	int ret;
 
 	cdb = &lcdb_get(L, lua_upvalueindex(1))->cdb;
 	k = lua_tolstring(L, lua_upvalueindex(2), &klen);
-	if((ret = cdb_findnext(cdb, (char *)k, klen)) == 0)
+	f = lua_touserdata(L, lua_upvalueindex(3));
+	if((ret = lcdb_find(cdb, f, 0, 0, k, klen)) == 0)
 		return 0;
-	else if(ret < 0)
-		goto error;
-	else{
-		uint32 dpos, dlen;
-		dpos = cdb_datapos(cdb);
-		dlen = cdb_datalen(cdb);
-		d = malloc(dlen);
-		if(!d || (cdb_read(cdb, d, dlen, dpos) < 0))
-			goto error;
-		lua_pushlstring(L, d, dlen);		/* XXX double copy */
-		xfree(d);
-		return 1;
-	}
-
-error:	xfree(d);
-	return luaL_error(L, "lcdb_values_aux: %s (errno=%d)", strerror(errno), errno);
+	else if(ret < 0 || lcdb_pushdata(L, cdb, f->dpos, f->dlen) < 0)
+		return luaL_error(L, "lcdb_values_aux: %s (errno=%d)", strerror(errno), errno);
+	return 1;
 }
 
 static int
 lcdb_values(lua_State *L)
+{
+	Find *f;
+
+	(void)lcdb_get(L, 1);
+	(void)luaL_checkstring(L, 2);
+	lua_settop(L, 2);
+	f = lua_newuserdata(L, sizeof(*f));
+	memset(f, 0, sizeof(*f));
+	lua_pushcclosure(L, lcdb_values_aux, 3);
+	return 1;
+}
+
+/*
+ * get(k): returns the first value of key k, nil if there is none.
+ */
+static int
+lcdb_getvalue(lua_State *L)
 {
 	struct cdb *cdb;
+	Find f;
+	const char *k;
+	size_t klen;
+	int ret;
 
 	cdb = &lcdb_get(L, 1)->cdb;
-	cdb_findstart(cdb);
-	(void)luaL_checkstring(L, 2);
-	lua_pushcclosure(L, lcdb_values_aux, 2);
+	k = luaL_checklstring(L, 2, &klen);
+	f.loop = 0;
+	if((ret = lcdb_find(cdb, &f, 0, 0, k, klen)) == 0)
+		return 0;
+	if(ret < 0 || lcdb_pushdata(L, cdb, f.dpos, f.dlen) < 0){
+		int xerrno = errno;
+		lua_pushnil(L);
+		lua_pushnumber(L, xerrno);
+		lua_pushstring(L, strerror(xerrno));
+		return 3;
+	}
+	return 1;
+}
+
+static int
+lcdb_findall_aux(lua_State *L)
+{
+	struct cdb *cdb;
+	Find *f;
+	const char *p, *k;
+	size_t plen, klen;
+	int ret;
+
+	cdb = &lcdb_get(L, lua_upvalueindex(1))->cdb;
+	p = lua_tolstring(L, lua_upvalueindex(3), &plen);
+	f = lua_touserdata(L, lua_upvalueindex(4));
+	for(;;){
+		lua_rawgeti(L, lua_upvalueindex(2), f->i);
+		if(!(k = lua_tolstring(L, -1, &klen)))
+			return 0;
+		if((ret = lcdb_find(cdb, f, p, plen, k, klen)) > 0)
+			break;
+		if(ret < 0)
+			return luaL_error(L, "lcdb_findall_aux: %s (errno=%d)", strerror(errno), errno);
+		lua_pop(L, 1);
+		f->i++;
+		f->loop = 0;
+	}
+	lua_pushinteger(L, f->i);
+	if(lcdb_pushdata(L, cdb, f->dpos, f->dlen) < 0)
+		return luaL_error(L, "lcdb_findall_aux: %s (errno=%d)", strerror(errno), errno);
+	return 2;
+}
+
+/*
+ * findall(keys [, prefix]): returns an iterator over the values of every
+ * key of the list keys, in order, each key being prepended with prefix.
+ * Yields the index of the key in the list, then the value.
+ */
+static int
+lcdb_findall(lua_State *L)
+{
+	Find *f;
+
+	(void)lcdb_get(L, 1);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	(void)luaL_optstring(L, 3, "");
+	lua_settop(L, 3);
+	if(lua_isnil(L, 3)){
+		lua_pushliteral(L, "");
+		lua_replace(L, 3);
+	}
+	f = lua_newuserdata(L, sizeof(*f));
+	memset(f, 0, sizeof(*f));
+	f->i = 1;
+	lua_pushcclosure(L, lcdb_findall_aux, 4);
 	return 1;
 }
 
@@ -281,6 +488,8 @@ static struct luaL_reg lcdb_methods[] =
 	{ "read",	lcdb_read },
 	{ "pairs",	lcdb_pairs },
 	{ "values",	lcdb_values },
+	{ "get",	lcdb_getvalue },
+	{ "findall",	lcdb_findall },
 	{ "fd",		lcdb_fd },
 	{ "name",	lcdb_name },
 	{ 0, 0 }
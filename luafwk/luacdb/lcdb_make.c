@@ -10,6 +10,7 @@
 #include "cdb_make.h"
 #include "lua.h"
 #include "lauxlib.h"
+#include "worker.h"
 
 #define MYNAME "cdb_make"
 
@@ -79,12 +80,14 @@ lcdb_make_free(struct cdb_make *cdbm)
 
 	if(cdbm->split)
 		alloc_free(cdbm->split);
+	cdbm->split = 0;
 	head = cdbm->head;
 	while(head){
 		next = head->next;
 		alloc_free(head);
 		head = next;
 	}
+	cdbm->head = 0;
 	if(cdbm->fd >= 0)
 		close(cdbm->fd);		/* XXX ignores error */
 	cdbm->fd = -1;
@@ -121,32 +124,102 @@ lcdb_make_add(lua_State *L)
 	return 0;
 }
 
+/*
+ * Writes the hash tables, then syncs and renames the database file.
+ * Returns 0, or an errno on error.
+ */
 static int
-lcdb_make_finish(lua_State *L)
+lcdb_make_done(Cdbmake *cdbm)
 {
-	Cdbmake *cdbm;
-	int xerrno;
-
-	cdbm = lcdb_make_get(L, 1);
 	if(cdb_make_finish(&cdbm->cdbm) < 0)
-		goto error;
+		return errno;
 	if(fsync(cdbm->cdbm.fd) < 0)
-		goto error;
+		return errno;
 	if(close(cdbm->cdbm.fd) < 0)
-		goto error;
+		return errno;
 	cdbm->cdbm.fd = -1;
 	if(rename(cdbm->fntmp, cdbm->fn) < 0)
-		goto error;
+		return errno;
+	return 0;
+}
+
+static int
+lcdb_make_finish(lua_State *L)
+{
+	Cdbmake *cdbm;
+	int xerrno;
+
+	cdbm = lcdb_make_get(L, 1);
+	xerrno = lcdb_make_done(cdbm);
 	lcdb_make_free(&cdbm->cdbm);
+	if(xerrno){
+		lua_pushnumber(L, xerrno);
+		lua_pushstring(L, strerror(xerrno));
+		return 2;
+	}
 	lua_pushnil(L);
 	lua_setmetatable(L, 1);
 	return 0;
+}
 
-error:	xerrno = errno;
-	lua_pushnumber(L, xerrno);
-	lua_pushstring(L, strerror(xerrno));
-	lcdb_make_free(&cdbm->cdbm);
-	return 2;
+typedef struct Finishjob Finishjob;
+
+struct Finishjob
+{
+	worker_job_t job;
+	Cdbmake *cdbm;
+	int xerrno;
+};
+
+static void
+lcdb_make_finishjob_run(worker_job_t *job)
+{
+	Finishjob *j = (Finishjob *)job;
+
+	j->xerrno = lcdb_make_done(j->cdbm);
+}
+
+static int
+lcdb_make_finishjob_finish(lua_State *L, worker_job_t *job)
+{
+	Finishjob *j = (Finishjob *)job;
+
+	lcdb_make_free(&j->cdbm->cdbm);
+	if(j->xerrno){
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(j->xerrno));
+		return 2;
+	}
+	lua_getfenv(L, 1);
+	lua_rawgeti(L, -1, 1);
+	lua_pushnil(L);
+	lua_setmetatable(L, -2);
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+ * finishjob(): submits a job which does what finish() does in a worker
+ * thread, see `sched.worker`; its result is true, or nil and an error
+ * message. The database must not be used until the job is done, so
+ * that several databases can be finished at once.
+ */
+static int
+lcdb_make_finishjob(lua_State *L)
+{
+	Cdbmake *cdbm;
+	Finishjob *j;
+
+	cdbm = lcdb_make_get(L, 1);
+	j = (Finishjob *)worker_newjob(L, sizeof(*j), lcdb_make_finishjob_run,
+	    lcdb_make_finishjob_finish, 0);
+	j->cdbm = cdbm;
+	j->xerrno = 0;
+	lua_getfenv(L, -1);
+	lua_pushvalue(L, 1);
+	lua_rawseti(L, -2, 1);
+	lua_pop(L, 1);
+	return worker_submit(L, -1);
 }
 
 static int
@@ -166,6 +239,7 @@ static struct luaL_reg lcdb_make_methods[] =
 	{ "__tostring",	lcdb_make_tostring },
 	{ "add",	lcdb_make_add },
 	{ "finish",	lcdb_make_finish },
+	{ "finishjob",	lcdb_make_finishjob },
 	{ 0, 0 }
 };
 
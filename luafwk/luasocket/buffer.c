@@ -4,6 +4,9 @@
 *
 * RCS ID: $Id: buffer.c,v 1.28 2007/06/11 23:44:54 diego Exp $
 \*=========================================================================*/
+#include <stdlib.h>
+#include <string.h>
+
 #include "lua.h"
 #include "lauxlib.h"
 
@@ -18,6 +21,10 @@ static int recvall(p_buffer buf, luaL_Buffer *b);
 static int buffer_get(p_buffer buf, const char **data, size_t *count);
 static void buffer_skip(p_buffer buf, size_t count);
 static int sendraw(p_buffer buf, const char *data, size_t count, size_t *sent);
+static int sendvraw(lua_State *L, p_buffer buf, int n, size_t *pos);
+static int recvinto(lua_State *L, p_buffer buf, p_bytebuffer bb, size_t wanted,
+        size_t *got);
+static int recvpeek(p_buffer buf, size_t wanted);
 
 /* min and max macros */
 #ifndef MIN
@@ -43,12 +50,24 @@ int buffer_open(lua_State *L) {
 \*-------------------------------------------------------------------------*/
 void buffer_init(p_buffer buf, p_io io, p_timeout tm) {
 	buf->first = buf->last = 0;
+    buf->size = BUF_SIZE;
+    buf->heap = NULL;
     buf->io = io;
     buf->tm = tm;
     buf->received = buf->sent = 0;
     buf->birthday = timeout_gettime();
 }
 
+/*-------------------------------------------------------------------------*\
+* Frees the storage space set by setbuffersize, and drops buffered data
+\*-------------------------------------------------------------------------*/
+void buffer_destroy(p_buffer buf) {
+    free(buf->heap);
+    buf->heap = NULL;
+    buf->size = BUF_SIZE;
+    buf->first = buf->last = 0;
+}
+
 /*-------------------------------------------------------------------------*\
 * object:getstats() interface
 \*-------------------------------------------------------------------------*/
@@ -150,6 +169,125 @@ int buffer_meth_receive(lua_State *L, p_buffer buf) {
     return lua_gettop(L) - top;
 }
 
+/*-------------------------------------------------------------------------*\
+* object:sendv() interface: sends the concatenation of a list of strings and
+* bytebuffers, skipping its optional first bytes already sent. Returns the
+* number of bytes of the concatenation sent.
+\*-------------------------------------------------------------------------*/
+int buffer_meth_sendv(lua_State *L, p_buffer buf) {
+    int top = lua_gettop(L);
+    int err, n;
+    size_t pos;
+#ifdef LUASOCKET_DEBUG
+    p_timeout tm = timeout_markstart(buf->tm);
+#endif
+    luaL_checktype(L, 2, LUA_TTABLE);
+    pos = (size_t) luaL_optnumber(L, 3, 0);
+    n = (int) lua_objlen(L, 2);
+    err = sendvraw(L, buf, n, &pos);
+    if (err != IO_DONE) {
+        lua_pushnil(L);
+        lua_pushstring(L, buf->io->error(buf->io->ctx, err));
+        lua_pushnumber(L, pos);
+    } else {
+        lua_pushnumber(L, pos);
+        lua_pushnil(L);
+        lua_pushnil(L);
+    }
+#ifdef LUASOCKET_DEBUG
+    lua_pushnumber(L, timeout_gettime() - timeout_getstart(tm));
+#endif
+    return lua_gettop(L) - top;
+}
+
+/*-------------------------------------------------------------------------*\
+* object:receive_into() interface: appends a number of bytes to a
+* bytebuffer, or whatever is available when no number is given. Returns the
+* number of bytes appended.
+\*-------------------------------------------------------------------------*/
+int buffer_meth_receive_into(lua_State *L, p_buffer buf) {
+    int err = IO_DONE, top = lua_gettop(L);
+    p_bytebuffer bb = bytebuffer_check(L, 2);
+    size_t got = 0;
+#ifdef LUASOCKET_DEBUG
+    p_timeout tm = timeout_markstart(buf->tm);
+#endif
+    if (lua_isnoneornil(L, 3)) {
+        const char *data; size_t count;
+        err = buffer_get(buf, &data, &count);
+        memcpy(bytebuffer_reserve(L, bb, count), data, count);
+        bb->last += count;
+        buffer_skip(buf, count);
+        got = count;
+    } else err = recvinto(L, buf, bb, (size_t) luaL_checknumber(L, 3), &got);
+    if (err != IO_DONE) {
+        lua_pushnil(L);
+        lua_pushstring(L, buf->io->error(buf->io->ctx, err));
+        lua_pushnumber(L, got);
+    } else {
+        lua_pushnumber(L, got);
+        lua_pushnil(L);
+        lua_pushnil(L);
+    }
+#ifdef LUASOCKET_DEBUG
+    lua_pushnumber(L, timeout_gettime() - timeout_getstart(tm));
+#endif
+    return lua_gettop(L) - top;
+}
+
+/*-------------------------------------------------------------------------*\
+* object:peek() interface: returns the next bytes without consuming them.
+* Receives until the given number of bytes, at most the buffer size, are
+* buffered; returns the buffered bytes when no number is given.
+\*-------------------------------------------------------------------------*/
+int buffer_meth_peek(lua_State *L, p_buffer buf) {
+    int err;
+    size_t wanted = (size_t) luaL_optnumber(L, 2, 1);
+    luaL_argcheck(L, wanted <= buf->size, 2, "exceeds the buffer size");
+    err = recvpeek(buf, wanted);
+    if (err != IO_DONE) {
+        lua_pushnil(L);
+        lua_pushstring(L, buf->io->error(buf->io->ctx, err));
+        return 2;
+    }
+    if (!lua_isnoneornil(L, 2)) wanted = MIN(wanted, buf->last - buf->first);
+    else wanted = buf->last - buf->first;
+    lua_pushlstring(L, buffer_data(buf) + buf->first, wanted);
+    return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+* object:setbuffersize() interface: changes the size of the receive buffer,
+* keeping buffered data
+\*-------------------------------------------------------------------------*/
+int buffer_meth_setbuffersize(lua_State *L, p_buffer buf) {
+    size_t size = (size_t) luaL_checknumber(L, 2);
+    size_t pending = buf->last - buf->first;
+    char *heap = NULL;
+    luaL_argcheck(L, size > 0, 2, "positive size expected");
+    if (size < pending) {
+        lua_pushnil(L);
+        lua_pushstring(L, "buffered data exceeds the size");
+        return 2;
+    }
+    if (size > BUF_SIZE) {
+        heap = (char *) malloc(size);
+        if (!heap) {
+            lua_pushnil(L);
+            lua_pushstring(L, "not enough memory");
+            return 2;
+        }
+    }
+    memmove(heap? heap: buf->data, buffer_data(buf) + buf->first, pending);
+    free(buf->heap);
+    buf->heap = heap;
+    buf->size = size;
+    buf->first = 0;
+    buf->last = pending;
+    lua_pushnumber(L, 1);
+    return 1;
+}
+
 /*-------------------------------------------------------------------------*\
 * Determines if there is any data in the read buffer
 \*-------------------------------------------------------------------------*/
@@ -180,6 +318,109 @@ static int sendraw(p_buffer buf, const char *data, size_t count, size_t *sent) {
     return err;
 }
 
+/*-------------------------------------------------------------------------*\
+* Returns the element i of the list at index 2, a string or a bytebuffer.
+* The list keeps it alive.
+\*-------------------------------------------------------------------------*/
+static const char *sendvelement(lua_State *L, int i, size_t *len) {
+    const char *data;
+    lua_rawgeti(L, 2, i);
+    if (lua_type(L, -1) != LUA_TSTRING && lua_type(L, -1) != LUA_TUSERDATA)
+        luaL_error(L, "string or bytebuffer expected at index %d of the list", i);
+    data = bytebuffer_checklstring(L, -1, len);
+    lua_pop(L, 1);
+    return data;
+}
+
+/*-------------------------------------------------------------------------*\
+* Sends the n elements of the list at index 2 (unbuffered), from the byte
+* pos of their concatenation. Up to SENDV_BLOCKS elements are handed to a
+* single sendv call of the IO driver.
+\*-------------------------------------------------------------------------*/
+#define SENDV_BLOCKS 64
+static int sendvraw(lua_State *L, p_buffer buf, int n, size_t *pos) {
+    p_io io = buf->io;
+    int i = 1;
+    size_t start = 0; /* position of element i in the concatenation */
+    for ( ;; ) {
+        t_iovec vec[SENDV_BLOCKS];
+        size_t len, at, done = 0;
+        int err, j, k = 0;
+        /* skip the elements already sent */
+        for (; i <= n; i++) {
+            sendvelement(L, i, &len);
+            if (start + len > *pos) break;
+            start += len;
+        }
+        if (i > n) return IO_DONE;
+        for (j = i, at = start; j <= n && k < SENDV_BLOCKS; j++, at += len) {
+            const char *data = sendvelement(L, j, &len);
+            size_t skip = *pos > at? *pos - at: 0;
+            if (len <= skip) continue;
+            vec[k].data = data + skip;
+            vec[k].count = len - skip;
+            k++;
+        }
+        if (io->sendv) err = io->sendv(io->ctx, vec, k, &done, buf->tm);
+        else err = io->send(io->ctx, vec[0].data, vec[0].count, &done, buf->tm);
+        *pos += done;
+        buf->sent += done;
+        if (err != IO_DONE) return err;
+    }
+}
+
+/*-------------------------------------------------------------------------*\
+* Appends a fixed number of bytes to a bytebuffer. Once the read buffer is
+* empty, large enough reads go straight to the bytebuffer.
+\*-------------------------------------------------------------------------*/
+static int recvinto(lua_State *L, p_buffer buf, p_bytebuffer bb, size_t wanted,
+        size_t *got) {
+    int err = IO_DONE;
+    size_t total = 0;
+    while (total < wanted && err == IO_DONE) {
+        size_t count;
+        if (buffer_isempty(buf) && wanted - total >= buf->size) {
+            p_io io = buf->io;
+            char *tail = bytebuffer_reserve(L, bb, wanted - total);
+            err = io->recv(io->ctx, tail, wanted - total, &count, buf->tm);
+            buf->received += count;
+        } else {
+            const char *data;
+            err = buffer_get(buf, &data, &count);
+            count = MIN(count, wanted - total);
+            memcpy(bytebuffer_reserve(L, bb, count), data, count);
+            buffer_skip(buf, count);
+        }
+        bb->last += count;
+        total += count;
+    }
+    *got = total;
+    return total < wanted? err: IO_DONE;
+}
+
+/*-------------------------------------------------------------------------*\
+* Receives until a number of bytes are buffered, without consuming them
+\*-------------------------------------------------------------------------*/
+static int recvpeek(p_buffer buf, size_t wanted) {
+    p_io io = buf->io;
+    int err = IO_DONE;
+    if (buffer_isempty(buf)) buf->first = buf->last = 0;
+    while (buf->last - buf->first < wanted && err == IO_DONE) {
+        size_t got;
+        if (buf->size - buf->last < wanted - (buf->last - buf->first)) {
+            /* move buffered data to make room */
+            memmove(buffer_data(buf), buffer_data(buf) + buf->first,
+                buf->last - buf->first);
+            buf->last -= buf->first;
+            buf->first = 0;
+        }
+        err = io->recv(io->ctx, buffer_data(buf) + buf->last,
+            buf->size - buf->last, &got, buf->tm);
+        buf->last += got;
+    }
+    return buf->last - buf->first < wanted? err: IO_DONE;
+}
+
 /*-------------------------------------------------------------------------*\
 * Reads a fixed number of bytes (buffered)
 \*-------------------------------------------------------------------------*/
@@ -262,11 +503,11 @@ static int buffer_get(p_buffer buf, const char **data, size_t *count) {
     p_timeout tm = buf->tm;
     if (buffer_isempty(buf)) {
         size_t got;
-        err = io->recv(io->ctx, buf->data, BUF_SIZE, &got, tm);
+        err = io->recv(io->ctx, buffer_data(buf), buf->size, &got, tm);
         buf->first = 0;
         buf->last = got;
     }
     *count = buf->last - buf->first;
-    *data = buf->data + buf->first;
+    *data = buffer_data(buf) + buf->first;
     return err;
 }
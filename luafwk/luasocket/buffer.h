@@ -12,6 +12,10 @@
 * Input is buffered. Output is *not* buffered because there was no simple
 * way of making sure the buffered output data would ever be sent.
 *
+* Input can also be appended to a bytebuffer (see bytebuffer.h), read
+* straight from the transport layer when large enough, and lists of strings
+* are output with scatter-gather sends when the IO driver supports them.
+*
 * The module is built on top of the I/O abstraction defined in io.h and the
 * timeout management is done with the timeout.h interface.
 *
@@ -20,9 +24,10 @@
 #include "lua.h"
 
 #include "io.h"
+#include "bytebuffer.h"
 #include "timeout.h"
 
-/* buffer size in bytes */
+/* default buffer size in bytes */
 #define BUF_SIZE 8192
 
 /* buffer control structure */
@@ -32,16 +37,26 @@ typedef struct t_buffer_ {
     p_io io;                /* IO driver used for this buffer */
     p_timeout tm;           /* timeout management for this buffer */
 	size_t first, last;     /* index of first and last bytes of stored data */
-	char data[BUF_SIZE];    /* storage space for buffer data */
+    size_t size;            /* size of the storage space in use */
+    char *heap;             /* storage space set by setbuffersize, or NULL */
+	char data[BUF_SIZE];    /* default storage space for buffer data */
 } t_buffer;
 typedef t_buffer *p_buffer;
 
+/* storage space in use */
+#define buffer_data(buf) ((buf)->heap? (buf)->heap: (buf)->data)
+
 int buffer_open(lua_State *L);
 void buffer_init(p_buffer buf, p_io io, p_timeout tm);
 int buffer_meth_send(lua_State *L, p_buffer buf);
 int buffer_meth_receive(lua_State *L, p_buffer buf);
+int buffer_meth_sendv(lua_State *L, p_buffer buf);
+int buffer_meth_receive_into(lua_State *L, p_buffer buf);
+int buffer_meth_peek(lua_State *L, p_buffer buf);
+int buffer_meth_setbuffersize(lua_State *L, p_buffer buf);
 int buffer_meth_getstats(lua_State *L, p_buffer buf);
 int buffer_meth_setstats(lua_State *L, p_buffer buf);
 int buffer_isempty(p_buffer buf);
+void buffer_destroy(p_buffer buf);
 
 #endif /* BUF_H */
@@ -0,0 +1,195 @@
+/*=========================================================================*\
+* Growable byte buffer
+* LuaSocket toolkit
+\*=========================================================================*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "auxiliar.h"
+#include "bytebuffer.h"
+
+/* size of the storage allocated by the first append */
+#define BYTEBUFFER_MINSIZE 256
+
+/*=========================================================================*\
+* Internal function prototypes
+\*=========================================================================*/
+static int global_create(lua_State *L);
+static int meth_append(lua_State *L);
+static int meth_clear(lua_State *L);
+static int meth_consume(lua_State *L);
+static int meth_gc(lua_State *L);
+static int meth_len(lua_State *L);
+static int meth_sub(lua_State *L);
+
+/* bytebuffer object methods */
+static luaL_reg bytebuffer[] = {
+    {"__gc",        meth_gc},
+    {"__len",       meth_len},
+    {"__tostring",  auxiliar_tostring},
+    {"append",      meth_append},
+    {"clear",       meth_clear},
+    {"consume",     meth_consume},
+    {"len",         meth_len},
+    {"sub",         meth_sub},
+    {"tostring",    meth_sub},
+    {NULL,          NULL}
+};
+
+/* functions in library namespace */
+static luaL_reg func[] = {
+    {"bytebuffer",  global_create},
+    {NULL,          NULL}
+};
+
+/*=========================================================================*\
+* Exported functions
+\*=========================================================================*/
+/*-------------------------------------------------------------------------*\
+* Initializes module
+\*-------------------------------------------------------------------------*/
+int bytebuffer_open(lua_State *L) {
+    auxiliar_newclass(L, BYTEBUFFER_CLASS, bytebuffer);
+    luaL_openlib(L, NULL, func, 0);
+    return 0;
+}
+
+/*-------------------------------------------------------------------------*\
+* Checks that the value at index idx is a bytebuffer
+\*-------------------------------------------------------------------------*/
+p_bytebuffer bytebuffer_check(lua_State *L, int idx) {
+    return (p_bytebuffer) auxiliar_checkclass(L, BYTEBUFFER_CLASS, idx);
+}
+
+/*-------------------------------------------------------------------------*\
+* Makes room for count more bytes after the stored data, and returns where
+* they must be written. The caller adds the bytes actually written to last.
+\*-------------------------------------------------------------------------*/
+char *bytebuffer_reserve(lua_State *L, p_bytebuffer bb, size_t count) {
+    size_t pending = bb->last - bb->first;
+    if (bb->size - bb->last >= count) return bb->data + bb->last;
+    /* move stored data to the beginning of the storage */
+    if (bb->first > 0) {
+        memmove(bb->data, bb->data + bb->first, pending);
+        bb->first = 0;
+        bb->last = pending;
+    }
+    /* grow the storage if it is still too small */
+    if (bb->size - pending < count) {
+        size_t size = bb->size? bb->size: BYTEBUFFER_MINSIZE;
+        char *data;
+        while (size - pending < count) size *= 2;
+        data = (char *) realloc(bb->data, size);
+        if (!data) luaL_error(L, "not enough memory");
+        bb->data = data;
+        bb->size = size;
+    }
+    return bb->data + bb->last;
+}
+
+/*=========================================================================*\
+* Lua methods
+\*=========================================================================*/
+/*-------------------------------------------------------------------------*\
+* Appends strings and bytebuffers, returns the object
+\*-------------------------------------------------------------------------*/
+static int meth_append(lua_State *L) {
+    p_bytebuffer bb = bytebuffer_check(L, 1);
+    int i, top = lua_gettop(L);
+    for (i = 2; i <= top; i++) {
+        size_t len;
+        const char *data = bytebuffer_checklstring(L, i, &len);
+        char *tail;
+        if (data == bb->data + bb->first) {
+            /* appending the buffer to itself: reserve may move the data */
+            tail = bytebuffer_reserve(L, bb, len);
+            data = bb->data + bb->first;
+        } else tail = bytebuffer_reserve(L, bb, len);
+        memcpy(tail, data, len);
+        bb->last += len;
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+* Drops all stored data
+\*-------------------------------------------------------------------------*/
+static int meth_clear(lua_State *L) {
+    p_bytebuffer bb = bytebuffer_check(L, 1);
+    bb->first = bb->last = 0;
+    lua_settop(L, 1);
+    return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+* Drops the n first bytes, all of them by default. Returns the number of
+* bytes dropped.
+\*-------------------------------------------------------------------------*/
+static int meth_consume(lua_State *L) {
+    p_bytebuffer bb = bytebuffer_check(L, 1);
+    size_t pending = bb->last - bb->first;
+    lua_Number n = luaL_optnumber(L, 2, (lua_Number) pending);
+    size_t count = n < 0? 0: (n > pending? pending: (size_t) n);
+    bb->first += count;
+    if (bb->first >= bb->last) bb->first = bb->last = 0;
+    lua_pushnumber(L, (lua_Number) count);
+    return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+* Frees the storage space
+\*-------------------------------------------------------------------------*/
+static int meth_gc(lua_State *L) {
+    p_bytebuffer bb = bytebuffer_check(L, 1);
+    free(bb->data);
+    bb->data = NULL;
+    bb->first = bb->last = bb->size = 0;
+    return 0;
+}
+
+/*-------------------------------------------------------------------------*\
+* Returns the number of bytes stored
+\*-------------------------------------------------------------------------*/
+static int meth_len(lua_State *L) {
+    p_bytebuffer bb = bytebuffer_check(L, 1);
+    lua_pushnumber(L, (lua_Number) (bb->last - bb->first));
+    return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+* Returns stored bytes as a string, with the indexing rules of string.sub
+\*-------------------------------------------------------------------------*/
+static int meth_sub(lua_State *L) {
+    p_bytebuffer bb = bytebuffer_check(L, 1);
+    long size = (long) (bb->last - bb->first);
+    long start = (long) luaL_optnumber(L, 2, 1);
+    long end = (long) luaL_optnumber(L, 3, -1);
+    if (start < 0) start = size+start+1;
+    if (end < 0) end = size+end+1;
+    if (start < 1) start = 1;
+    if (end > size) end = size;
+    if (start <= end)
+        lua_pushlstring(L, bb->data + bb->first + start-1, end-start+1);
+    else lua_pushliteral(L, "");
+    return 1;
+}
+
+/*=========================================================================*\
+* Library functions
+\*=========================================================================*/
+/*-------------------------------------------------------------------------*\
+* Creates a bytebuffer, with an optional initial storage size
+\*-------------------------------------------------------------------------*/
+static int global_create(lua_State *L) {
+    size_t size = (size_t) luaL_optnumber(L, 1, 0);
+    p_bytebuffer bb = (p_bytebuffer) lua_newuserdata(L, sizeof(t_bytebuffer));
+    bb->first = bb->last = bb->size = 0;
+    bb->data = NULL;
+    auxiliar_setclass(L, BYTEBUFFER_CLASS, -1);
+    if (size > 0) bytebuffer_reserve(L, bb, size);
+    return 1;
+}
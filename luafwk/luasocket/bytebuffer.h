@@ -0,0 +1,45 @@
+#ifndef BYTEBUFFER_H
+#define BYTEBUFFER_H
+/*=========================================================================*\
+* Growable byte buffer
+* LuaSocket toolkit
+*
+* A bytebuffer accumulates bytes in C memory, as received by
+* sock:receive_into(). C modules which parse bytes can read a bytebuffer
+* in place, without any intermediate Lua string, by including this header
+* and calling bytebuffer_checklstring() where they called luaL_checklstring().
+\*=========================================================================*/
+#include "lua.h"
+#include "lauxlib.h"
+
+/* name of the bytebuffer class, and of its metatable in the registry */
+#define BYTEBUFFER_CLASS "bytebuffer"
+
+/* bytebuffer control structure */
+typedef struct t_bytebuffer_ {
+    size_t first, last;     /* index of first and last bytes of stored data */
+    size_t size;            /* size of the storage space */
+    char *data;             /* storage space, allocated on first use */
+} t_bytebuffer;
+typedef t_bytebuffer *p_bytebuffer;
+
+int bytebuffer_open(lua_State *L);
+p_bytebuffer bytebuffer_check(lua_State *L, int idx);
+char *bytebuffer_reserve(lua_State *L, p_bytebuffer bb, size_t count);
+
+/*-------------------------------------------------------------------------*\
+* Returns the bytes of the string or bytebuffer at index idx. The pointer
+* remains valid as long as the bytebuffer is neither modified nor collected.
+\*-------------------------------------------------------------------------*/
+static inline const char *bytebuffer_checklstring(lua_State *L, int idx,
+        size_t *len) {
+    if (lua_type(L, idx) == LUA_TUSERDATA) {
+        p_bytebuffer bb = (p_bytebuffer) luaL_checkudata(L, idx,
+            BYTEBUFFER_CLASS);
+        *len = bb->last - bb->first;
+        return bb->data? bb->data + bb->first: "";
+    }
+    return luaL_checklstring(L, idx, len);
+}
+
+#endif /* BYTEBUFFER_H */
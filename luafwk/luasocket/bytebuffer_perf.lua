@@ -0,0 +1,177 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of the EMP and M3DA receive paths over a localhost TCP
+-- connection, receiving strings as before, then bytebuffers:
+-- * EMP: 8 bytes headers, each followed by a JSON payload parsed by yajl;
+--   messages are sent with a concatenated header and payload, or with sendv;
+-- * M3DA: bysant envelopes received in chunks, accumulated until they are
+--   complete, then deserialized.
+-- Times are the CPU time of both ends of the connection.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/bytebuffer_perf.lua [messages]
+
+require 'strict'
+local sched  = require 'sched'
+local socket = require 'socket'
+local yajl   = require 'yajl'
+local m3da   = require 'm3da.bysant'
+require 'pack'
+
+local N = tonumber(arg[1]) or 20000
+local function printf(...) print(string.format(...)) end
+
+-- Runs `sender` and `receiver` on both ends of a new connection, returns
+-- the CPU time spent.
+local function run(sender, receiver)
+    local server = assert(socket.bind("127.0.0.1", 0))
+    local _, port = server:getsockname()
+    collectgarbage()
+    local t = os.clock()
+    sched.run(function()
+        local skt = assert(socket.connect("127.0.0.1", port))
+        sender(skt)
+        sched.wait(skt, 'done')
+        skt:close()
+    end)
+    local skt = assert(server:accept())
+    server:close()
+    receiver(skt)
+    t = os.clock() - t
+    skt:close()
+    return t
+end
+
+-------------------------------------------------------------------------------
+-- EMP
+-------------------------------------------------------------------------------
+local function jsonpayload(nvariables)
+    local t = { }
+    for i = 1, nvariables do t["variable"..i] = { value = i * 1.5, name = "sensor "..i } end
+    return yajl.to_string(t)
+end
+
+local function empsend(payload, count)
+    return function(skt)
+        local header = string.pack(">HbbI", 9, 0, 1, #payload)
+        for _ = 1, count do assert(skt:send(header..payload)) end
+        sched.signal(skt, 'done')
+    end
+end
+
+local function empsendv(payload, count)
+    return function(skt)
+        local header = string.pack(">HbbI", 9, 0, 1, #payload)
+        for _ = 1, count do assert(skt:sendv{ header, payload }) end
+        sched.signal(skt, 'done')
+    end
+end
+
+local function empreceive(count)
+    return function(skt)
+        for _ = 1, count do
+            local _, _, _, _, size = assert(skt:receive(8)):unpack(">HbbI")
+            local str = assert(skt:receive(size))
+            assert(yajl.to_value('['..str..']')[1])
+        end
+    end
+end
+
+local function empreceiveinto(count)
+    return function(skt)
+        local buf = socket.bytebuffer()
+        for _ = 1, count do
+            local _, _, _, _, size = assert(skt:receive(8)):unpack(">HbbI")
+            buf :clear() :append '['
+            assert(skt:receive_into(buf, size))
+            buf :append ']'
+            assert(yajl.to_value(buf)[1])
+        end
+    end
+end
+
+-------------------------------------------------------------------------------
+-- M3DA
+-------------------------------------------------------------------------------
+local function envelope(size)
+    local t = { }
+    for i = 1, size / 16 do t[i] = { i, "value" } end
+    local serializer, acc = m3da.serializer{ }
+    serializer :value(t)
+    return table.concat(acc)
+end
+
+local function m3dasend(data, count)
+    return function(skt)
+        for _ = 1, count do assert(skt:send(data)) end
+        sched.signal(skt, 'done')
+    end
+end
+
+-- Each receiver accumulates received chunks until a whole envelope is
+-- buffered, then deserializes it.
+local function m3dareceive(size, count)
+    return function(skt)
+        local d, pending = m3da.deserializer(), ''
+        for _ = 1, count do
+            while #pending < size do pending = pending .. assert(skt:receive '*') end
+            local _, offset = d(pending)
+            pending = pending:sub(offset)
+        end
+    end
+end
+
+local function m3dabytebuffer(size, count)
+    return function(skt)
+        local d, pending = m3da.deserializer(), socket.bytebuffer()
+        for _ = 1, count do
+            while #pending < size do pending :append (assert(skt:receive '*')) end
+            local _, offset = d(pending)
+            pending :consume (offset-1)
+        end
+    end
+end
+
+local function m3dareceiveinto(size, count)
+    return function(skt)
+        local d, pending = m3da.deserializer(), socket.bytebuffer()
+        for _ = 1, count do
+            while #pending < size do assert(skt:receive_into(pending)) end
+            local _, offset = d(pending)
+            pending :consume (offset-1)
+        end
+    end
+end
+
+sched.run(function()
+    for _, nvariables in ipairs{ 2, 32, 512 } do
+        local payload = jsonpayload(nvariables)
+        local count = math.max(1, math.floor(N * 32 / nvariables))
+        printf("EMP, %d messages of %d bytes:", count, 8 + #payload)
+        printf("  %-38s %8.0f msg/s", "receive, concatenated send", count / run(empsend(payload, count), empreceive(count)))
+        printf("  %-38s %8.0f msg/s", "receive_into, concatenated send", count / run(empsend(payload, count), empreceiveinto(count)))
+        printf("  %-38s %8.0f msg/s", "receive_into, sendv", count / run(empsendv(payload, count), empreceiveinto(count)))
+    end
+
+    for _, size in ipairs{ 4096, 65536, 1048576 } do
+        local data = envelope(size)
+        local count = math.max(1, math.floor(N * 1024 / #data))
+        printf("M3DA, %d envelopes of %d bytes:", count, #data)
+        local send = m3dasend(data, count)
+        printf("  %-38s %8.1f MB/s", "string concatenation", count * #data / 1e6 / run(send, m3dareceive(#data, count)))
+        printf("  %-38s %8.1f MB/s", "bytebuffer", count * #data / 1e6 / run(send, m3dabytebuffer(#data, count)))
+        printf("  %-38s %8.1f MB/s", "bytebuffer, receive_into", count * #data / 1e6 / run(send, m3dareceiveinto(#data, count)))
+    end
+    os.exit(0)
+end)
+sched.loop()
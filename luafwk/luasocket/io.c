@@ -17,6 +17,7 @@ void io_init(p_io io, p_send send, p_recv recv, p_error error, void *ctx) {
     io->recv = recv;
     io->error = error;
     io->ctx = ctx;
+    io->sendv = NULL;
 }
 
 /*-------------------------------------------------------------------------*\
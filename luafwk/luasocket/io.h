@@ -42,6 +42,21 @@ typedef int (*p_send) (
     p_timeout tm        /* timeout control */
 );
 
+/* one block of data in a scatter-gather send */
+typedef struct t_iovec_ {
+    const char *data;   /* pointer to the block */
+    size_t count;       /* number of bytes in the block */
+} t_iovec;
+
+/* interface to scatter-gather send function */
+typedef int (*p_sendv) (
+    void *ctx,          /* context needed by send */
+    const t_iovec *vec, /* blocks of data to send, in order */
+    int n,              /* number of blocks */
+    size_t *sent,       /* number of bytes sent uppon return */
+    p_timeout tm        /* timeout control */
+);
+
 /* interface to recv function */
 typedef int (*p_recv) (
     void *ctx,          /* context needed by recv */
@@ -57,6 +72,7 @@ typedef struct t_io_ {
     p_send send;        /* send function pointer */
     p_recv recv;        /* receive function pointer */
     p_error error;      /* strerror function */
+    p_sendv sendv;      /* optional scatter-gather send function pointer */
 } t_io;
 typedef t_io *p_io;
 
@@ -32,6 +32,7 @@
 #include "except.h"
 #include "timeout.h"
 #include "buffer.h"
+#include "bytebuffer.h"
 #include "inet.h"
 #include "tcp.h"
 #include "udp.h"
@@ -52,6 +53,7 @@ static const luaL_reg mod[] = {
     {"except", except_open},
     {"timeout", timeout_open},
     {"buffer", buffer_open},
+    {"bytebuffer", bytebuffer_open},
     {"inet", inet_open},
     {"tcp", tcp_open},
     {"udp", udp_open},
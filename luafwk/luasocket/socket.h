@@ -67,6 +67,8 @@ const char *socket_strerror(int err);
    and the buffered input module */
 int socket_send(p_socket ps, const char *data, size_t count,
         size_t *sent, p_timeout tm);
+int socket_sendv(p_socket ps, const t_iovec *vec, int n, size_t *sent,
+        p_timeout tm);
 int socket_recv(p_socket ps, char *data, size_t count, size_t *got, p_timeout tm);
 const char *socket_ioerror(p_socket ps, int err);
 
@@ -29,6 +29,10 @@ static int meth_getsockname(lua_State *L);
 static int meth_getpeername(lua_State *L);
 static int meth_shutdown(lua_State *L);
 static int meth_receive(lua_State *L);
+static int meth_receive_into(lua_State *L);
+static int meth_peek(lua_State *L);
+static int meth_sendv(lua_State *L);
+static int meth_setbuffersize(lua_State *L);
 static int meth_accept(lua_State *L);
 static int meth_close(lua_State *L);
 static int meth_setoption(lua_State *L);
@@ -52,8 +56,12 @@ static luaL_reg tcp[] = {
     {"getstats",    meth_getstats},
     {"setstats",    meth_setstats},
     {"listen",      meth_listen},
+    {"peek",        meth_peek},
     {"receive",     meth_receive},
+    {"receive_into", meth_receive_into},
     {"send",        meth_send},
+    {"sendv",       meth_sendv},
+    {"setbuffersize", meth_setbuffersize},
     {"setfd",       meth_setfd},
     {"setoption",   meth_setoption},
     {"setpeername", meth_connect},
@@ -112,6 +120,26 @@ static int meth_receive(lua_State *L) {
     return buffer_meth_receive(L, &tcp->buf);
 }
 
+static int meth_receive_into(lua_State *L) {
+    p_tcp tcp = (p_tcp) auxiliar_checkclass(L, "tcp{client}", 1);
+    return buffer_meth_receive_into(L, &tcp->buf);
+}
+
+static int meth_peek(lua_State *L) {
+    p_tcp tcp = (p_tcp) auxiliar_checkclass(L, "tcp{client}", 1);
+    return buffer_meth_peek(L, &tcp->buf);
+}
+
+static int meth_sendv(lua_State *L) {
+    p_tcp tcp = (p_tcp) auxiliar_checkclass(L, "tcp{client}", 1);
+    return buffer_meth_sendv(L, &tcp->buf);
+}
+
+static int meth_setbuffersize(lua_State *L) {
+    p_tcp tcp = (p_tcp) auxiliar_checkgroup(L, "tcp{any}", 1);
+    return buffer_meth_setbuffersize(L, &tcp->buf);
+}
+
 static int meth_getstats(lua_State *L) {
     p_tcp tcp = (p_tcp) auxiliar_checkclass(L, "tcp{client}", 1);
     return buffer_meth_getstats(L, &tcp->buf);
@@ -175,6 +203,7 @@ static int meth_accept(lua_State *L)
         clnt->sock = sock;
         io_init(&clnt->io, (p_send) socket_send, (p_recv) socket_recv,
                 (p_error) socket_ioerror, &clnt->sock);
+        clnt->io.sendv = (p_sendv) socket_sendv;
         timeout_init(&clnt->tm, -1, -1);
         buffer_init(&clnt->buf, &clnt->io, &clnt->tm);
         return 1;
@@ -232,6 +261,7 @@ static int meth_close(lua_State *L)
 {
     p_tcp tcp = (p_tcp) auxiliar_checkgroup(L, "tcp{any}", 1);
     socket_destroy(&tcp->sock);
+    buffer_destroy(&tcp->buf);
     lua_pushnumber(L, 1);
     return 1;
 }
@@ -328,6 +358,7 @@ static int global_create(lua_State *L)
         tcp->sock = sock;
         io_init(&tcp->io, (p_send) socket_send, (p_recv) socket_recv,
                 (p_error) socket_ioerror, &tcp->sock);
+        tcp->io.sendv = (p_sendv) socket_sendv;
         timeout_init(&tcp->tm, -1, -1);
         buffer_init(&tcp->buf, &tcp->io, &tcp->tm);
         return 1;
@@ -25,6 +25,10 @@ static int meth_bind(lua_State *L);
 static int meth_send(lua_State *L);
 static int meth_shutdown(lua_State *L);
 static int meth_receive(lua_State *L);
+static int meth_receive_into(lua_State *L);
+static int meth_peek(lua_State *L);
+static int meth_sendv(lua_State *L);
+static int meth_setbuffersize(lua_State *L);
 static int meth_accept(lua_State *L);
 static int meth_close(lua_State *L);
 static int meth_setoption(lua_State *L);
@@ -51,8 +55,12 @@ static luaL_reg un[] = {
     {"getstats",    meth_getstats},
     {"setstats",    meth_setstats},
     {"listen",      meth_listen},
+    {"peek",        meth_peek},
     {"receive",     meth_receive},
+    {"receive_into", meth_receive_into},
     {"send",        meth_send},
+    {"sendv",       meth_sendv},
+    {"setbuffersize", meth_setbuffersize},
     {"setfd",       meth_setfd},
     {"setoption",   meth_setoption},
     {"setpeername", meth_connect},
@@ -113,6 +121,26 @@ static int meth_receive(lua_State *L) {
     return buffer_meth_receive(L, &un->buf);
 }
 
+static int meth_receive_into(lua_State *L) {
+    p_unix un = (p_unix) auxiliar_checkclass(L, "unix{client}", 1);
+    return buffer_meth_receive_into(L, &un->buf);
+}
+
+static int meth_peek(lua_State *L) {
+    p_unix un = (p_unix) auxiliar_checkclass(L, "unix{client}", 1);
+    return buffer_meth_peek(L, &un->buf);
+}
+
+static int meth_sendv(lua_State *L) {
+    p_unix un = (p_unix) auxiliar_checkclass(L, "unix{client}", 1);
+    return buffer_meth_sendv(L, &un->buf);
+}
+
+static int meth_setbuffersize(lua_State *L) {
+    p_unix un = (p_unix) auxiliar_checkgroup(L, "unix{any}", 1);
+    return buffer_meth_setbuffersize(L, &un->buf);
+}
+
 static int meth_getstats(lua_State *L) {
     p_unix un = (p_unix) auxiliar_checkclass(L, "unix{client}", 1);
     return buffer_meth_getstats(L, &un->buf);
@@ -171,6 +199,7 @@ static int meth_accept(lua_State *L) {
         clnt->sock = sock;
         io_init(&clnt->io, (p_send)socket_send, (p_recv)socket_recv,
                 (p_error) socket_ioerror, &clnt->sock);
+        clnt->io.sendv = (p_sendv) socket_sendv;
         timeout_init(&clnt->tm, -1, -1);
         buffer_init(&clnt->buf, &clnt->io, &clnt->tm);
         return 1;
@@ -266,6 +295,7 @@ static int meth_close(lua_State *L)
 {
     p_unix un = (p_unix) auxiliar_checkgroup(L, "unix{any}", 1);
     socket_destroy(&un->sock);
+    buffer_destroy(&un->buf);
     lua_pushnumber(L, 1);
     return 1;
 }
@@ -345,6 +375,7 @@ static int global_create(lua_State *L) {
         un->sock = sock;
         io_init(&un->io, (p_send) socket_send, (p_recv) socket_recv,
                 (p_error) socket_ioerror, &un->sock);
+        un->io.sendv = (p_sendv) socket_sendv;
         timeout_init(&un->tm, -1, -1);
         buffer_init(&un->buf, &un->io, &un->tm);
         return 1;
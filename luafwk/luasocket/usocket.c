@@ -10,6 +10,7 @@
 \*=========================================================================*/
 #include <string.h>
 #include <signal.h>
+#include <sys/uio.h>
 
 #include "socket.h"
 
@@ -232,6 +233,38 @@ int socket_send(p_socket ps, const char *data, size_t count,
     return IO_UNKNOWN;
 }
 
+/*-------------------------------------------------------------------------*\
+* Scatter-gather send with timeout: at most SENDV_MAX blocks are written by
+* a single writev, the caller loops over the remaining ones
+\*-------------------------------------------------------------------------*/
+#define SENDV_MAX 64
+int socket_sendv(p_socket ps, const t_iovec *vec, int n, size_t *sent,
+        p_timeout tm)
+{
+    struct iovec iov[SENDV_MAX];
+    int i, err;
+    *sent = 0;
+    if (*ps == SOCKET_INVALID) return IO_CLOSED;
+    if (n > SENDV_MAX) n = SENDV_MAX;
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = (void *) vec[i].data;
+        iov[i].iov_len = vec[i].count;
+    }
+    for ( ;; ) {
+        long put = (long) writev(*ps, iov, n);
+        if (put > 0) {
+            *sent = put;
+            return IO_DONE;
+        }
+        err = errno;
+        if (put == 0 || err == EPIPE) return IO_CLOSED;
+        if (err == EINTR) continue;
+        if (err != EAGAIN) return err;
+        if ((err = socket_waitfd(ps, WAITFD_W, tm)) != IO_DONE) return err;
+    }
+    return IO_UNKNOWN;
+}
+
 /*-------------------------------------------------------------------------*\
 * Sendto with timeout
 \*-------------------------------------------------------------------------*/
@@ -224,6 +224,17 @@ int socket_send(p_socket ps, const char *data, size_t count,
     return IO_UNKNOWN;
 }
 
+/*-------------------------------------------------------------------------*\
+* Scatter-gather send with timeout: only the first block is sent, the
+* caller loops over the remaining ones
+\*-------------------------------------------------------------------------*/
+int socket_sendv(p_socket ps, const t_iovec *vec, int n, size_t *sent,
+        p_timeout tm)
+{
+    (void) n;
+    return socket_send(ps, vec[0].data, vec[0].count, sent, tm);
+}
+
 /*-------------------------------------------------------------------------*\
 * Sendto with timeout
 \*-------------------------------------------------------------------------*/
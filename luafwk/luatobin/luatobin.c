@@ -10,7 +10,7 @@
  *******************************************************************************/
 
 /*
- * Protocol description
+ * Protocol description, version 1
  * |type(1b)|[size(2b)]|[data(sizeb)]| (big endian)
  * 'number' type = LUA_TNUMBER, size = sizeof(lua_Number) (not serialized)
  * 'integer' type = LUA_TINT, size = sizeof(lua_Integer) (not serialized)
@@ -19,6 +19,23 @@
  * 'function' type = LUA_TFUNCTION, size = sizeof(function)
  * 'table' type = LUA_TTABLE, size = #table
  * 'nil' type = LUA_TNIL, size = 0 (not serialized)
+ *
+ * Protocol description, version 2
+ * Each serialized object starts with BIN_V2, which is not a version 1 type,
+ * so that both versions can be read, even from a single buffer.
+ * |type(1b)|[data]|, sizes and integers are varints: 7 bits per byte, least
+ * significant bits first, the high bit is set on all the bytes but the last.
+ * 'nil' BIN2_NIL, 'false' BIN2_FALSE, 'true' BIN2_TRUE
+ * 'number' BIN2_DOUBLE + 8 bytes (big endian)
+ * 'integer' BIN2_SMALLINT + n for 0 <= n < 128, BIN2_UINT + varint(n),
+ *   BIN2_NINT + varint(-n) for negative integers
+ * 'string' BIN2_STRING + varint(size) + data
+ * 'function' BIN2_FUNCTION + varint(size) + bytecode
+ * 'table' BIN2_TABLE + varint(narray) + varint(nhash) + the narray values of
+ *   keys 1 to narray + the nhash other key/value pairs
+ * Strings, functions and tables are numbered from 1 in order of appearance
+ * within a serialized object; later occurrences are serialized as
+ * BIN2_REF + varint(number).
  */
 #include "awt_endian.h"
 
@@ -26,7 +43,10 @@
 #include "lauxlib.h"
 #include "lualib.h"
 
+#include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 typedef enum {
     BIN_NONE = 0xFF,
@@ -37,15 +57,68 @@ typedef enum {
     BIN_TABLE = 0x05,
     BIN_FUNCTION = 0x06,
     BIN_INTEGER = 0x07,
-    BIN_REF = 0x14
+    BIN_REF = 0x14,
+    BIN_V2 = 0xB2
 } LuatobinTypes;
 
+typedef enum {
+    BIN2_NIL = 0x00,
+    BIN2_FALSE = 0x01,
+    BIN2_TRUE = 0x02,
+    BIN2_DOUBLE = 0x03,
+    BIN2_STRING = 0x04,
+    BIN2_TABLE = 0x05,
+    BIN2_FUNCTION = 0x06,
+    BIN2_UINT = 0x07,
+    BIN2_NINT = 0x08,
+    BIN2_REF = 0x09,
+    BIN2_SMALLINT = 0x80
+} Luatobin2Types;
+
+/* Numbers with no fractional part below this bound are serialized as integers */
+#define MAX_INTEGER 9007199254740992.0 /* 2^53 */
+
+#define DECODER_CLASS "luatobin.decoder"
+
 typedef struct Dfunction_ {
     int counter;
     int size;
     const char* buffer;
 } Dfunction;
 
+/* Version 2 serialization state. The output buffer is a userdata, replaced
+ * by a bigger one when it is full, so that errors do not leak memory. */
+typedef struct Encoder_ {
+    lua_State *L;
+    int cache;          // stack index of the object -> reference table
+    int out;            // stack index of the output buffer
+    int refs;           // references given
+    unsigned char *data;
+    size_t len, cap;
+} Encoder;
+
+/* Deserialization state, over contiguous bytes. When bytes are missing, a
+ * streaming decoder returns DECODE_MORE, otherwise an error is raised. */
+typedef struct Decoder_ {
+    lua_State *L;
+    const unsigned char *base, *p, *end;
+    int cache;          // stack index of the reference -> object table
+    int refs;           // references given
+    int streaming;
+    size_t need;        // streaming: bytes needed from base to go further
+    const char *eof;    // error message when bytes are missing
+} Decoder;
+
+#define DECODE_OK 0
+#define DECODE_MORE 1
+
+/* Incremental decoder: bytes pushed and not decoded yet are [off, len[. */
+typedef struct StreamDecoder_ {
+    unsigned char *data;
+    size_t off, len, cap;
+    size_t need;        // bytes needed before a new decoding attempt
+} StreamDecoder;
+
 static SEndian sendian;
 
 //static void pprint(unsigned char *p, size_t n) {
@@ -111,19 +184,6 @@ static uint16_t verify_cache(lua_State* L, int object, uint16_t* key) {
     return number;
 }
 
-static void add_to_cache(lua_State* L, uint16_t *key) {
-    // t[key] = object
-    *key = *key + 1;
-    lua_pushvalue(L, -1);
-    lua_rawseti(L, 2, *key);
-    //printf("c[%d]", *key);
-}
-
-static void get_from_cache(lua_State* L, uint16_t key) {
-    // get objet in luatobin_cache
-    lua_rawgeti(L, 2, key);
-}
-
 static uint8_t get_luatobin_type(lua_State* L, int pos) {
     switch (lua_type(L, pos)) {
     case LUA_TNIL:
@@ -145,64 +205,6 @@ static uint8_t get_luatobin_type(lua_State* L, int pos) {
     }
 }
 
-static int get_local_index(lua_State *L, int gindex, int indice, int last) {
-    int objlen = lua_objlen(L, -1); // 5
-    int lindex = 0;
-    // printf("\r\n\tindex[l=%d,g=%d,indice=%d]", lindex, gindex, indice);
-    while ((lindex + objlen) < gindex) {
-        if (indice >= last) {
-            luaL_error(L, "cannot deserialize: end of table");
-        }
-        lua_pop(L, 1); //4
-        lindex = lindex + objlen;
-        indice++;
-        lua_rawgeti(L, 1, indice); //5
-        objlen = lua_objlen(L, -1);
-        // printf("\r\n\tindex+[l=%d,g=%d,indice=%d]", lindex, gindex, indice);
-    }
-    lua_pushinteger(L, indice); //6
-    lua_replace(L, 4); //5
-    return gindex - lindex;
-}
-
-static void read_object(lua_State *L, luaL_Buffer* b, char** frame, int* index, int call, size_t* len) {
-    // printf("\r\n\tread[%d/call=%d/index=%d/len=%d/%p]", (*index + call - ((int) (*len))), call,*index, *len, *frame);
-    if ((*index + call - ((int) (*len))) > 0) {
-        if (lua_istable(L, 1)) {
-            int last = lua_tointeger(L, 3); // TableMax 3
-            int indice = lua_tointeger(L, 4); // TableCurrentIndice 4
-            size_t current = 0;
-            luaL_buffinit(L, b);
-            if (*index < *len){
-                lua_pushvalue(L, 5);
-                luaL_addvalue(b);
-                current = *len-*index;
-                // printf("\r\n\taddcur[indice=%d,index=%d,current=%d]", indice, *index, current);
-            } else {
-                *index = 0;
-            }
-            while (current < call) {
-                if (indice >= last) {
-                    luaL_error(L, "cannot deserialize: end of table");
-                }
-                indice++;
-                lua_rawgeti(L, 1, indice);
-                current = current + lua_objlen(L, -1);
-                luaL_addvalue(b);
-                // printf("\r\n\tadd[indice=%d,index=%d,current=%d]", indice, *index, current);
-            }
-            luaL_pushresult(b); // StringBuffer 5
-            lua_replace(L, 5);
-            lua_pushinteger(L, indice); // TableCurrentIndice 4
-            lua_replace(L, 4);
-            *frame = (char*) luaL_checklstring(L, 5, len);
-            // printf("\r\n\t->[%p]", *frame);
-        } else {
-            luaL_error(L, "cannot deserialize: end of string");
-        }
-    }
-}
-
 static int write_object(lua_State *L, int* indice) {
     *indice = *indice + 1;
     lua_rawseti(L, 3, *indice);
@@ -363,146 +365,411 @@ static void serialize_value(lua_State *L, int pos, luaL_Buffer* frame, int* indi
     }
 }
 
-static void deserialize_value(lua_State *L, luaL_Buffer* buffer, char** frame, int* index, int* gindex, size_t* len, uint16_t* key) {
+/*
+ * Version 2 serialization
+ */
+
+static void enc_reserve(Encoder* e, size_t n) {
+    if (e->len + n > e->cap) {
+        size_t cap = 2 * e->cap > e->len + n ? 2 * e->cap : e->len + n;
+        unsigned char* data = (unsigned char*) lua_newuserdata(e->L, cap);
+        memcpy(data, e->data, e->len);
+        lua_replace(e->L, e->out);
+        e->data = data;
+        e->cap = cap;
+    }
+}
+
+static void enc_byte(Encoder* e, uint8_t byte) {
+    enc_reserve(e, 1);
+    e->data[e->len++] = byte;
+}
+
+static void enc_varint(Encoder* e, uint64_t v) {
+    enc_reserve(e, 10);
+    while (v >= 0x80) {
+        e->data[e->len++] = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    e->data[e->len++] = (uint8_t) v;
+}
+
+static void enc_bytes(Encoder* e, uint8_t type, const char* data, size_t size) {
+    enc_byte(e, type);
+    enc_varint(e, size);
+    enc_reserve(e, size);
+    memcpy(e->data + e->len, data, size);
+    e->len += size;
+}
+
+// Serializes a reference to the object at pos if it was already serialized,
+// otherwise numbers it and returns 0.
+static int enc_ref(Encoder* e, int pos) {
+    lua_State* L = e->L;
+    lua_pushvalue(L, pos);
+    lua_rawget(L, e->cache);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_pushvalue(L, pos);
+        lua_pushinteger(L, ++e->refs);
+        lua_rawset(L, e->cache);
+        return 0;
+    }
+    enc_byte(e, BIN2_REF);
+    enc_varint(e, (uint64_t) lua_tointeger(L, -1));
+    lua_pop(L, 1);
+    return 1;
+}
+
+static void encode_value(Encoder* e, int pos) {
+    lua_State* L = e->L;
+    if (!lua_checkstack(L, 4)) {
+        luaL_error(L, "cannot serialize: stack won't grow");
+    }
+    switch (lua_type(L, pos)) {
+    case LUA_TNIL:
+        enc_byte(e, BIN2_NIL);
+        break;
+
+    case LUA_TBOOLEAN:
+        enc_byte(e, lua_toboolean(L, pos) ? BIN2_TRUE : BIN2_FALSE);
+        break;
+
+    case LUA_TNUMBER: {
+        double number = lua_tonumber(L, pos);
+        if (number == floor(number) && fabs(number) < MAX_INTEGER) {
+            if (number >= 0 && number < 0x80) {
+                enc_byte(e, BIN2_SMALLINT + (uint8_t) number);
+            } else {
+                enc_byte(e, number >= 0 ? BIN2_UINT : BIN2_NINT);
+                enc_varint(e, (uint64_t) fabs(number));
+            }
+            break;
+        }
+        if (sendian.double_) hton(&number, sizeof(number), sendian.double_);
+        enc_byte(e, BIN2_DOUBLE);
+        enc_reserve(e, sizeof(number));
+        memcpy(e->data + e->len, &number, sizeof(number));
+        e->len += sizeof(number);
+        break;
+    }
+
+    case LUA_TSTRING: {
+        if (enc_ref(e, pos)) break;
+        size_t size;
+        const char* string = lua_tolstring(L, pos, &size);
+        enc_bytes(e, BIN2_STRING, string, size);
+        break;
+    }
+
+    case LUA_TFUNCTION: {
+        if (enc_ref(e, pos)) break;
+        luaL_Buffer b;
+        size_t size;
+        serialize_function(L, &b, pos);
+        const char* bytecode = lua_tolstring(L, -1, &size);
+        enc_bytes(e, BIN2_FUNCTION, bytecode, size);
+        lua_pop(L, 1); // remove the serialized function
+        break;
+    }
+
+    case LUA_TTABLE: {
+        if (enc_ref(e, pos)) break;
+        // the array part holds the values of keys 1 to narray, the hash part
+        // the other pairs: both are counted first, as size hints
+        size_t narray = 0, total = 0;
+        for (;;) {
+            lua_rawgeti(L, pos, (int) narray + 1);
+            int isnil = lua_isnil(L, -1);
+            lua_pop(L, 1);
+            if (isnil) break;
+            narray++;
+        }
+        lua_pushnil(L);
+        while (lua_next(L, pos) != 0) {
+            lua_pop(L, 1);
+            total++;
+        }
+        enc_byte(e, BIN2_TABLE);
+        enc_varint(e, narray);
+        enc_varint(e, total - narray);
+        size_t i;
+        for (i = 1; i <= narray; i++) {
+            lua_rawgeti(L, pos, (int) i);
+            encode_value(e, lua_gettop(L));
+            lua_pop(L, 1);
+        }
+        lua_pushnil(L);
+        while (lua_next(L, pos) != 0) {
+            int top = lua_gettop(L);
+            if (lua_type(L, top - 1) == LUA_TNUMBER) {
+                double k = lua_tonumber(L, top - 1);
+                if (k >= 1 && k <= narray && k == floor(k)) {
+                    lua_pop(L, 1);
+                    continue;
+                }
+            }
+            encode_value(e, top - 1);
+            encode_value(e, top);
+            lua_pop(L, 1);
+        }
+        break;
+    }
+
+    default:
+        luaL_error(L, "cannot serialize: unsupported type (%d)", lua_type(L, pos));
+    }
+}
+
+/*
+ * Deserialization, of both versions
+ */
+
+static int need(Decoder* d, size_t n) {
+    if (d->streaming) {
+        d->need = (size_t) (d->p - d->base) + n;
+        return DECODE_MORE;
+    }
+    return luaL_error(d->L, "%s", d->eof);
+}
+
+#define NEED(d, n) \
+    if ((uint64_t) ((d)->end - (d)->p) < (uint64_t) (n)) return need((d), (size_t) (n))
+
+#define CHECK(x) do { int status_ = (x); if (status_ != DECODE_OK) return status_; } while (0)
+
+static int dec_varint(Decoder* d, uint64_t* v) {
+    int shift = 0;
+    *v = 0;
+    for (;;) {
+        NEED(d, 1);
+        uint8_t byte = *d->p++;
+        if (shift > 63) {
+            return luaL_error(d->L, "cannot deserialize: invalid varint at %d", (int) (d->p - d->base));
+        }
+        *v |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return DECODE_OK;
+        shift += 7;
+    }
+}
+
+static uint16_t dec_uint16(Decoder* d) {
+    uint16_t v;
+    memcpy(&v, d->p, sizeof(v));
+    if (sendian.int16_) ntoh(&v, sizeof(v), sendian.int16_);
+    d->p += sizeof(v);
+    return v;
+}
+
+static void dec_function(Decoder* d, size_t size) {
+    Dfunction dfunction;
+    dfunction.counter = 0;
+    dfunction.size = (int) size;
+    dfunction.buffer = (const char*) d->p;
+    if (lua_load(d->L, f_reader, &dfunction, "function") != 0) {
+        luaL_error(d->L, "cannot deserialize: %s", lua_tostring(d->L, -1));
+    }
+    d->p += size;
+}
+
+// Gives the next reference number to the object on top of the stack
+static void dec_cache(Decoder* d, int v1) {
+    d->refs = v1 ? (uint16_t) (d->refs + 1) : d->refs + 1;
+    lua_pushvalue(d->L, -1);
+    lua_rawseti(d->L, d->cache, d->refs);
+}
+
+static int decode_v1(Decoder* d) {
+    lua_State* L = d->L;
+    uint16_t size;
     if (!lua_checkstack(L, 2)) {
         luaL_error(L, "cannot deserialize: stack won't grow");
     }
-    uint16_t size = 0x0000;
-    read_object(L, buffer, frame, index, 1, len);
-    uint8_t type = (*frame)[*index];
-    *index = *index + 1;
-    *gindex = *gindex + 1;
+    NEED(d, 1);
+    uint8_t type = *d->p++;
     switch (type) {
-    case BIN_NIL: {
-        // printf("\r\n\t(nil[1])[%p]", *frame);
+    case BIN_NIL:
         lua_pushnil(L);
         break;
-    }
 
-    case BIN_BOOLEAN: {
-        read_object(L, buffer, frame, index, 1, len);
-        // printf("\r\n\t(boolean[2][%p]", *frame);
-        lua_pushboolean(L, (*frame)[*index]);
-        *index = *index + 1;
-        *gindex = *gindex + 1;
+    case BIN_BOOLEAN:
+        NEED(d, 1);
+        lua_pushboolean(L, *d->p++);
         break;
-    }
 
     case BIN_DOUBLE: {
-        double number = 0;
-        size = sizeof(number);
-        read_object(L, buffer, frame, index, size, len);
-        // printf("\r\n\t(number[%d])[%p]", size, *frame);
-        char* b = (char*) &number;
-        int i;
-        for (i = 0; i < size; i++) {
-            b[i] = (*frame)[*index + i];
-        }
+        double number;
+        NEED(d, sizeof(number));
+        memcpy(&number, d->p, sizeof(number));
         if (sendian.double_) ntoh(&number, sizeof(number), sendian.double_);
+        d->p += sizeof(number);
         lua_pushnumber(L, number);
-        *index = *index + size;
-        *gindex = *gindex + size;
         break;
     }
 
     case BIN_INTEGER: {
-        int32_t number = 0;
-        size = sizeof(number);
-        read_object(L, buffer, frame, index, size, len);
-        // printf("\r\n\t(number[%d])[%p]", size, *frame);
-        char* b = (char*) &number;
-        int i;
-        for (i = 0; i < size; i++) {
-            b[i] = (*frame)[*index + i];
-        }
+        int32_t number;
+        NEED(d, sizeof(number));
+        memcpy(&number, d->p, sizeof(number));
         if (sendian.int32_) ntoh(&number, sizeof(number), sendian.int32_);
+        d->p += sizeof(number);
         lua_pushinteger(L, number);
-        *index = *index + size;
-        *gindex = *gindex + size;
         break;
     }
 
-    case BIN_REF: {
-        read_object(L, buffer, frame, index, 2, len);
-        ((char*) &size)[0] =(*frame)[*index];
-        ((char*) &size)[1] = (*frame)[*index + 1];
-        if (sendian.int16_) ntoh(&size, sizeof(size), sendian.int16_);
-        *index = *index + 2;
-        *gindex = *gindex + 2;
-        // printf("\r\n\t(ref[%d])[%p]", size, *frame);
-        get_from_cache(L, size);
+    case BIN_REF:
+        NEED(d, 2);
+        lua_rawgeti(L, d->cache, dec_uint16(d));
         break;
-    }
 
-    case BIN_STRING: {
-        read_object(L, buffer, frame, index, 2, len);
-        ((char*) &size)[0] = (*frame)[*index];
-        ((char*) &size)[1] = (*frame)[*index + 1];
-        if (sendian.int16_) ntoh(&size, sizeof(size), sendian.int16_);
-        *index = *index + 2;
-        *gindex = *gindex + 2;
-        read_object(L, buffer, frame, index, size, len);
-        // printf("\r\n\t(string[%d])[%p]", size, *frame);
-        lua_pushlstring(L, &((*frame)[*index]), size);
-        *index = *index + size;
-        *gindex = *gindex + size;
-        add_to_cache(L, key);
+    case BIN_STRING:
+        NEED(d, 2);
+        size = dec_uint16(d);
+        NEED(d, size);
+        lua_pushlstring(L, (const char*) d->p, size);
+        d->p += size;
+        dec_cache(d, 1);
         break;
-    }
 
-    case BIN_FUNCTION: {
-        read_object(L, buffer, frame, index, 2, len);
-        ((char*) &size)[0] = (*frame)[*index];
-        ((char*) &size)[1] = (*frame)[*index + 1];
-        if (sendian.int16_) ntoh(&size, sizeof(size), sendian.int16_);
-        *index = *index + 2;
-        *gindex = *gindex + 2;
-        // printf("\r\n\t(function[%d])[%p]", size, *frame);
-        read_object(L, buffer, frame, index, size, len);
-        Dfunction dfunction;
-        dfunction.counter = 0;
-        dfunction.size = size;
-        dfunction.buffer = &((*frame)[*index]);
-        lua_load(L, f_reader, &dfunction, "function");
-        *index = *index + size;
-        *gindex = *gindex + size;
-        add_to_cache(L, key);
+    case BIN_FUNCTION:
+        NEED(d, 2);
+        size = dec_uint16(d);
+        NEED(d, size);
+        dec_function(d, size);
+        dec_cache(d, 1);
         break;
-    }
 
     case BIN_TABLE: {
-        read_object(L, buffer, frame, index, 2, len);
-        ((char*) &size)[0] = (*frame)[*index];
-        ((char*) &size)[1] = (*frame)[*index + 1];
-        if (sendian.int16_) ntoh(&size, sizeof(size), sendian.int16_);
-        *index = *index + 2;
-        *gindex = *gindex + 2;
+        NEED(d, 2);
+        size = dec_uint16(d);
         lua_newtable(L);
-        // printf("\r\n\t{table[%d][%p]=", size, *frame);
-        add_to_cache(L, key);
+        dec_cache(d, 1);
         int top = lua_gettop(L);
         while (size > 0) {
-            // printf("\r\n\t|key[%d][%p]", *index, *frame);
-            deserialize_value(L, buffer, frame, index, gindex, len, key);
-            // printf("\r\n\t+value[%d][%p]", *index, *frame);
-            deserialize_value(L, buffer, frame, index, gindex, len, key);
+            CHECK(decode_v1(d));
+            CHECK(decode_v1(d));
             lua_rawset(L, top);
             size--;
         }
-        // printf("\r\n\t)");
-        // printf("\r\n\t}");
         break;
     }
 
     default:
-        luaL_error(L, "cannot deserialize: unsupported type [%d] at %d", type, *gindex);
+        luaL_error(L, "cannot deserialize: unsupported type [%d] at %d", type, (int) (d->p - d->base));
+    }
+    return DECODE_OK;
+}
+
+static int decode_v2(Decoder* d) {
+    lua_State* L = d->L;
+    uint64_t v;
+    if (!lua_checkstack(L, 3)) {
+        luaL_error(L, "cannot deserialize: stack won't grow");
+    }
+    NEED(d, 1);
+    uint8_t type = *d->p++;
+    if (type >= BIN2_SMALLINT) {
+        lua_pushinteger(L, type - BIN2_SMALLINT);
+        return DECODE_OK;
+    }
+    switch (type) {
+    case BIN2_NIL:
+        lua_pushnil(L);
+        break;
+
+    case BIN2_FALSE:
+    case BIN2_TRUE:
+        lua_pushboolean(L, type == BIN2_TRUE);
+        break;
+
+    case BIN2_DOUBLE: {
+        double number;
+        NEED(d, sizeof(number));
+        memcpy(&number, d->p, sizeof(number));
+        if (sendian.double_) ntoh(&number, sizeof(number), sendian.double_);
+        d->p += sizeof(number);
+        lua_pushnumber(L, number);
+        break;
+    }
+
+    case BIN2_UINT:
+    case BIN2_NINT:
+        CHECK(dec_varint(d, &v));
+        lua_pushnumber(L, type == BIN2_UINT ? (lua_Number) v : -(lua_Number) v);
+        break;
+
+    case BIN2_REF:
+        CHECK(dec_varint(d, &v));
+        if (v == 0 || v > (uint64_t) d->refs) {
+            luaL_error(L, "cannot deserialize: invalid reference at %d", (int) (d->p - d->base));
+        }
+        lua_rawgeti(L, d->cache, (int) v);
+        break;
+
+    case BIN2_STRING:
+        CHECK(dec_varint(d, &v));
+        NEED(d, v);
+        lua_pushlstring(L, (const char*) d->p, (size_t) v);
+        d->p += v;
+        dec_cache(d, 0);
+        break;
+
+    case BIN2_FUNCTION:
+        CHECK(dec_varint(d, &v));
+        NEED(d, v);
+        dec_function(d, (size_t) v);
+        dec_cache(d, 0);
+        break;
+
+    case BIN2_TABLE: {
+        uint64_t narray, nhash, i;
+        CHECK(dec_varint(d, &narray));
+        CHECK(dec_varint(d, &nhash));
+        // every value takes a byte at least: do not trust hints beyond the data
+        NEED(d, narray + 2 * nhash);
+        lua_createtable(L, (int) narray, (int) nhash);
+        dec_cache(d, 0);
+        int top = lua_gettop(L);
+        for (i = 1; i <= narray; i++) {
+            CHECK(decode_v2(d));
+            lua_rawseti(L, top, (int) i);
+        }
+        for (i = 0; i < nhash; i++) {
+            CHECK(decode_v2(d));
+            CHECK(decode_v2(d));
+            if (lua_isnil(L, -2)) {
+                luaL_error(L, "cannot deserialize: nil key at %d", (int) (d->p - d->base));
+            }
+            lua_rawset(L, top);
+        }
+        break;
+    }
+
+    default:
+        luaL_error(L, "cannot deserialize: unsupported type [%d] at %d", type, (int) (d->p - d->base));
+    }
+    return DECODE_OK;
+}
+
+// Decodes a serialized object, of either version, with a new reference table
+static int decode_object(Decoder* d) {
+    lua_newtable(d->L);
+    lua_replace(d->L, d->cache);
+    d->refs = 0;
+    NEED(d, 1);
+    if (*d->p == BIN_V2) {
+        d->p++;
+        return decode_v2(d);
     }
+    return decode_v1(d);
 }
 
 /*
- * serialize(obj, totable)
+ * serialize(obj, totable, version)
  *   - obj: object to serialize
  *   - totable: if true, returns a string buffer containing the serialized object instead of a buffer
+ *   - version: protocol version, optional default value 2; version 1 is
+ *     for peers which cannot read version 2
  *  returns a string buffer (table) or a string containing obj serialization
  */
 static int serialize(lua_State *L) {
@@ -511,8 +778,29 @@ static int serialize(lua_State *L) {
     if (lua_isboolean(L, 2)) {
         buffer = lua_toboolean(L, 2);
     }
+    int version = luaL_optint(L, 3, 2);
+    luaL_argcheck(L, version == 1 || version == 2, 3, "unsupported version");
     lua_settop(L, 1); // Object 1
     lua_newtable(L); // CacheTable 2
+    if (version == 2) {
+        Encoder e;
+        e.L = L;
+        e.cache = 2;
+        e.out = 3;
+        e.refs = 0;
+        e.len = 0;
+        e.cap = 64;
+        e.data = (unsigned char*) lua_newuserdata(L, e.cap); // OutBuffer 3
+        enc_byte(&e, BIN_V2);
+        encode_value(&e, 1);
+        lua_pushlstring(L, (const char*) e.data, e.len); // SerializedObject
+        if (buffer) {
+            lua_createtable(L, 1, 0); // return { SerializedObject }
+            lua_insert(L, -2);
+            lua_rawseti(L, -2, 1);
+        }
+        return 1;
+    }
     lua_newtable(L); // OutTable 3
     luaL_Buffer frame;
     uint16_t key = 0;
@@ -541,52 +829,139 @@ static int deserialize(lua_State *L) {
     }
     int nobj = luaL_optint(L, 2, 0);
     int gindex = luaL_optint(L, 3, 1)-1;
-    int lindex = 0;
-    uint16_t key = 0;
-    luaL_Buffer buffer;
     int result = 0;
     size_t len = 0;
+    Decoder d;
     lua_settop(L, 1); // SerializedObject 1
-    lua_newtable(L); // CacheTable 2
-    // get frame
-    char* frame = NULL;
     if (lua_istable(L, 1)) {
-        int last = lua_objlen(L, 1);
-        lua_pushinteger(L, last); // TableMax 3
-        lua_pushinteger(L, 1); // TableCurrentIndice 4
-        lua_rawgeti(L, 1, 1); // StringBuffer 5
-        lindex = get_local_index(L, gindex, 1, last);
-        frame = (char*)luaL_checklstring(L, 5, &len);
+        luaL_Buffer b;
+        concat_table(L, 1, &b);
+        lua_replace(L, 1);
+        d.eof = "cannot deserialize: end of table";
     } else {
-        lindex = gindex;
-        frame = (char*)luaL_checklstring(L, 1, &len);
-    }
-    // printf("\r\n\tlindex=%d, gindex=%d", lindex, gindex);
-    // deserialize frame
-    lua_pushnil(L); // index of next obj
-    while ((lindex < len) && ((nobj <= 0) || (result < nobj))) {
-        deserialize_value(L, &buffer, &frame, &lindex, &gindex, &len, &key);
+        d.eof = "cannot deserialize: end of string";
+    }
+    d.L = L;
+    d.base = (const unsigned char*) luaL_checklstring(L, 1, &len);
+    d.end = d.base + len;
+    d.p = d.base + (gindex < 0 ? 0 : gindex < (int) len ? gindex : len);
+    d.cache = 2;
+    d.streaming = 0;
+    lua_pushnil(L); // CacheTable 2
+    lua_pushnil(L); // index of next obj 3
+    while ((d.p < d.end) && ((nobj <= 0) || (result < nobj))) {
+        decode_object(&d);
         result++;
-        lua_newtable(L); // New CacheTable 2
-        lua_replace(L, 2);
-        key = 0;
     }
-    lua_pushinteger(L, gindex+1); // index of next obj
-    lua_replace(L, -result-2);
+    lua_pushinteger(L, (int) (d.p - d.base) + 1); // index of next obj
+    lua_replace(L, 3);
     // printf("\r\nenddeserialize[%d]", result);
     return result + 1;
 }
 
+/*
+ * decoder(): returns an incremental decoder, for data read by chunks, e.g.
+ * from a file or a socket.
+ *   - decoder:push(data): appends data to decode
+ *   - decoder:next(): returns true and the next object, or false if the
+ *     data pushed does not hold a complete object yet
+ *   - decoder:pending(): returns the number of bytes pushed and not decoded
+ *     yet, e.g. a truncated object at the end of a file
+ */
+static int decoder_new(lua_State *L) {
+    StreamDecoder* s = (StreamDecoder*) lua_newuserdata(L, sizeof(*s));
+    memset(s, 0, sizeof(*s));
+    luaL_getmetatable(L, DECODER_CLASS);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+static int decoder_push(lua_State *L) {
+    StreamDecoder* s = (StreamDecoder*) luaL_checkudata(L, 1, DECODER_CLASS);
+    size_t n;
+    const char* data = luaL_checklstring(L, 2, &n);
+    if (s->len + n > s->cap && s->off > 0) { // drop the bytes decoded
+        memmove(s->data, s->data + s->off, s->len - s->off);
+        s->len -= s->off;
+        s->off = 0;
+    }
+    if (s->len + n > s->cap) {
+        size_t cap = 2 * s->cap > s->len + n ? 2 * s->cap : s->len + n;
+        unsigned char* p = (unsigned char*) realloc(s->data, cap);
+        if (p == NULL) luaL_error(L, "not enough memory");
+        s->data = p;
+        s->cap = cap;
+    }
+    memcpy(s->data + s->len, data, n);
+    s->len += n;
+    return 0;
+}
+
+static int decoder_next(lua_State *L) {
+    StreamDecoder* s = (StreamDecoder*) luaL_checkudata(L, 1, DECODER_CLASS);
+    Decoder d;
+    if (s->len - s->off == 0 || s->len - s->off < s->need) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    lua_settop(L, 1);
+    lua_pushnil(L); // CacheTable 2
+    d.L = L;
+    d.base = d.p = s->data + s->off;
+    d.end = s->data + s->len;
+    d.cache = 2;
+    d.streaming = 1;
+    d.eof = NULL;
+    if (decode_object(&d) == DECODE_MORE) {
+        s->need = d.need;
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    s->off += d.p - d.base;
+    s->need = 0;
+    lua_pushboolean(L, 1);
+    lua_insert(L, 3);
+    return 2;
+}
+
+static int decoder_pending(lua_State *L) {
+    StreamDecoder* s = (StreamDecoder*) luaL_checkudata(L, 1, DECODER_CLASS);
+    lua_pushinteger(L, (lua_Integer) (s->len - s->off));
+    return 1;
+}
+
+static int decoder_gc(lua_State *L) {
+    StreamDecoder* s = (StreamDecoder*) luaL_checkudata(L, 1, DECODER_CLASS);
+    free(s->data);
+    s->data = NULL;
+    s->off = s->len = s->cap = 0;
+    return 0;
+}
+
 /**
  * Register functions.
  */
 static const luaL_Reg R[] = {
         { "serialize", serialize },
         { "deserialize", deserialize },
+        { "decoder", decoder_new },
+        { NULL, NULL } };
+
+static const luaL_Reg decoder_methods[] = {
+        { "push", decoder_push },
+        { "next", decoder_next },
+        { "pending", decoder_pending },
         { NULL, NULL } };
 
 int luaopen_luatobin(lua_State* L) {
     check_endian(&sendian);
+    luaL_newmetatable(L, DECODER_CLASS);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, decoder_gc);
+    lua_setfield(L, -2, "__gc");
+    luaL_register(L, NULL, decoder_methods);
+    lua_pop(L, 1);
     luaL_register(L, "luatobin", R);
     return 1;
 }
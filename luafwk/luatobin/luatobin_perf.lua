@@ -0,0 +1,66 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of luatobin versions 1 and 2 on two corpora: the key/value pairs
+-- of a persisted table, serialized one by one as persist.file does, and RPC
+-- calls with data maps as parameters. Reports the output size, and the
+-- encoding and decoding throughputs: in MB of output per second, and in
+-- corpora per second, which compares versions for the same data.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/luatobin_perf.lua [rounds]
+
+local l2b  = require 'luatobin'
+local time = require 'sched.timer.core'.time
+
+local ROUNDS = tonumber(arg[1]) or 20
+local function printf(...) print(string.format(...)) end
+
+local persist = { }
+for i = 1, 2000 do
+    table.insert(persist, "config.item"..i)
+    if i % 3 == 0 then table.insert(persist, i * 17)
+    elseif i % 3 == 1 then table.insert(persist, "value of item "..i)
+    else table.insert(persist, { enabled = true, period = i % 60, url = "http://server/"..i, tags = { "a", "b" } }) end
+end
+
+local rpc = { }
+for i = 1, 200 do
+    local map = { timestamp = 1370000000 + i }
+    for j = 1, 20 do map["system.sensors.sensor"..j..".value"] = j * 1.5 + i end
+    table.insert(rpc, "agent.treemgr.set")
+    table.insert(rpc, map)
+end
+
+local function bench(corpus, version)
+    local out, size = { }, 0
+    local start = time()
+    for _ = 1, ROUNDS do
+        for i, obj in ipairs(corpus) do out[i] = l2b.serialize(obj, nil, version) end
+    end
+    local encode = time() - start
+    local data = table.concat(out)
+    start = time()
+    for _ = 1, ROUNDS do
+        for i = 1, #out do l2b.deserialize(out[i]) end
+    end
+    local decode = time() - start
+    local MB = #data * ROUNDS / 2^20
+    return #data, MB / encode, ROUNDS / encode, MB / decode, ROUNDS / decode
+end
+
+printf("%-8s %8s %8s %9s %9s %9s %9s", "corpus", "version", "bytes", "enc MB/s", "enc /s", "dec MB/s", "dec /s")
+for _, c in ipairs{ { "persist", persist }, { "rpc", rpc } } do
+    for version = 1, 2 do
+        printf("%-8s %8d %8d %9.1f %9.1f %9.1f %9.1f", c[1], version, bench(c[2], version))
+    end
+end
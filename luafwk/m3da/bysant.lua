@@ -93,8 +93,9 @@ end
 --- Creates a new M3DA deserializer object. M3DA standard classes are predefined
 --  in the deserializer.
 --
--- It deserializes data, passed as a string or list of strings parameter, through
--- method `:deserialize(data)`.
+-- It deserializes data, passed as a string, a list of strings or a
+-- `socket.bytebuffer` parameter, through method `:deserialize(data)`.
+-- A bytebuffer is read in place, without copying it into a string.
 --
 -- @usage
 --
@@ -113,6 +114,52 @@ function M.deserializer()
     return instance
 end
 
+--- Creates a new M3DA stream deserializer object. M3DA standard classes are
+--  predefined in the deserializer.
+--
+-- Data is fed to the deserializer with method `:feed(data)` as it is
+-- received, split in arbitrary chunks passed as strings or
+-- `socket.bytebuffer`. Each call returns the list of values completed by the
+-- chunk, possibly empty, or `nil` and an error message if data is invalid.
+-- Incomplete values are kept in the deserializer, and resumed without
+-- reading their beginning again; `:reset()` drops them. The length operator
+-- returns the number of bytes buffered, which are not deserialized yet.
+--
+-- Containers nested up to level `depth` (top-level containers are at
+-- level 1) are not built: instead, each value they contain is returned as
+-- soon as it is complete, and the container is returned empty after its
+-- content. With a non-zero depth, the returned list alternates paths, as
+-- used by `utils.path`, and values. Chunks of chunked strings are returned
+-- one by one, and followed by an empty string.
+--
+-- @param depth the nesting level of streamed containers, 0 by default.
+-- @return the stream deserializer.
+--
+-- @usage
+--
+-- m3da = require 'm3da.bysant'
+-- d = m3da.streamdeserializer()
+-- assert(#d :feed "\228" == 0)
+-- assert(d :feed "\145" [1] == 1234)
+--
+-- -- Streams the fields of envelopes, and the chunks of their payload
+-- d = m3da.streamdeserializer(2)
+-- local events = d :feed (data)
+-- for i = 1, #events, 2 do
+--     local path, value = events[i], events[i+1] -- e.g. "payload", chunk
+-- end
+--
+function M.streamdeserializer(depth)
+    checks('?number')
+    local instance, errmsg = core.streamdeserializer(depth)
+    if not instance then return nil, errmsg end
+
+    local r, errmsg = add_classes (instance, 'addClass')
+    if not r then return nil, errmsg end
+
+    return instance
+end
+
 local function serialize_value(self, x)
     if(x==m3da.niltoken) then return core["null"](self) end
     local t = type(x)
@@ -138,7 +185,12 @@ end
 
 local function serialize_array(self, x)
     local status, err_msg
-    status, err_msg = core.list(self, #x)
+    local n, numeric = #x, true
+    for i = 1, n do
+        if type(x[i]) ~= 'number' then numeric = false; break end
+    end
+    if numeric then return core.array(self, x) end
+    status, err_msg = core.list(self, n)
     if not status then return status, err_msg end
     for _, v in ipairs(x) do
         status, err_msg = serialize_value(self, v)
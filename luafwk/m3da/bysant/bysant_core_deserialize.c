@@ -13,6 +13,7 @@
 #include "lua.h"
 #include "lauxlib.h"
 #include "bysantd.h"
+#include "bytebuffer.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -37,12 +38,6 @@ static void push_niltoken(lua_State *L){
  * when `bysant2lua` is called.
  * */
 static int bysant2lua( lua_State *L, const bsd_data_t *x) {
-    /* This buffer will be used to efficiently concatenate chunked strings. Since objects are
-     * guaranted to be only chunks (or errors), there is no stack manipulation problem.
-     * Instead of allocating as global, it is allocated as userdata when needed. */
-    //FIXME: this assume that the function is always called with the same lua_State.
-    static luaL_Buffer *buf;
-
     CKSTACK( L, 1); /* at least one object will be pushed */
 
     /* step 1: the object is pushed on stack */
@@ -54,7 +49,12 @@ static int bysant2lua( lua_State *L, const bsd_data_t *x) {
     case BSD_BOOL:    lua_pushboolean( L, x->content.bool); break;
     case BSD_DOUBLE:  lua_pushnumber( L, x->content.d);     break;
     case BSD_STRING:  lua_pushlstring( L, x->content.string.data, x->content.string.length); break;
-    case BSD_CHUNK:   luaL_addlstring( buf, x->content.chunk.data, x->content.chunk.length); break;
+    /* Chunks are accumulated in a list, concatenated when the string is closed.
+     * Unlike a luaL_Buffer, the list can be hibernated between two calls. */
+    case BSD_CHUNK:   // chunks
+        lua_pushlstring( L, x->content.chunk.data, x->content.chunk.length); // chunks, chunk
+        lua_rawseti( L, -2, lua_objlen( L, -2) + 1); // chunks
+        break;
 
     case BSD_MAP: case BSD_ZMAP: {
         int len = BSD_ZMAP==x->type ? 0 : x->content.length;
@@ -91,16 +91,23 @@ static int bysant2lua( lua_State *L, const bsd_data_t *x) {
         break;
 
     case BSD_CHUNKED_STRING:
-        buf = lua_newuserdata( L, sizeof(luaL_Buffer)); // buffer
-        luaL_buffinit( L, buf);
+        lua_newtable( L); // chunks
         break;
 
     case BSD_CLOSE:
         switch( x->content.cont_type) {
-        case BSD_CHUNKED_STRING:   // buffer
-            luaL_pushresult( buf); // buffer, result_string
-            lua_replace( L, -2);   // result_string
+        case BSD_CHUNKED_STRING: { // chunks
+            luaL_Buffer b;
+            int i, chunks = lua_gettop( L), n = lua_objlen( L, chunks);
+            luaL_buffinit( L, &b);
+            for( i=1; i<=n; i++) {
+                lua_rawgeti( L, chunks, i);
+                luaL_addvalue( &b);
+            }
+            luaL_pushresult( &b);   // chunks, result_string
+            lua_replace( L, -2);    // result_string
             break;
+        }
         case BSD_OBJECT: case BSD_LIST: case BSD_ZLIST: // idx, table
             lua_replace( L, -2); // table
             break;
@@ -221,8 +228,8 @@ static int deserialize_or_skip( lua_State *L, int skip) {
         // ctx, tbl_buff, ?offset, ?partial, tbl_buff[1] ... tbl_buff[n]
         lua_concat( L, n); // ctx, tbl_buff, ?offset, ?partial, str_buff
         buffer = (const uint8_t *) luaL_checklstring( L, -1, &len);
-    } else { // ctx, str_buff, ?offset, ?partial
-        buffer = (const uint8_t *) luaL_checklstring( L, 2, &len);
+    } else { // ctx, str_buff or bytebuffer, ?offset, ?partial
+        buffer = (const uint8_t *) bytebuffer_checklstring( L, 2, &len);
     }
 
     // TODO: not good enough. It must be impossible for users to mix up an hibernation
@@ -321,8 +328,8 @@ static int api_dump( lua_State *L) {
     return 0;
 }
 
-static int api_addClass( lua_State *L) {
-    bsd_ctx_t *ctx = (bsd_ctx_t *) luaL_checkudata( L, 1, MT_NAME); // 1=>udata
+/* Registers the class definition at index 2 in `ctx`. */
+static int add_class( lua_State *L, bsd_ctx_t *ctx) {
     bs_class_t *classdef = lua_bs_toclassdef( L, 2);
     int r = bsd_addClass( ctx, classdef);
     if( 0 != r) free(classdef);
@@ -330,6 +337,317 @@ static int api_addClass( lua_State *L) {
     else { lua_pushinteger( L, r); return 1; }
 }
 
+static int api_addClass( lua_State *L) {
+    return add_class( L, (bsd_ctx_t *) luaL_checkudata( L, 1, MT_NAME));
+}
+
+/*
+ * Stream deserializer: bytes are fed in arbitrary chunks, and values are
+ * returned as soon as their last byte has been read.
+ *
+ * Bytes which don't form a complete item yet are kept in a C buffer, and
+ * containers under construction are kept on the stack of a dedicated Lua
+ * thread between two calls, so that nothing is parsed twice, whatever the
+ * chunk boundaries.
+ *
+ * Containers up to nesting level `depth` (top-level containers are at level 1)
+ * are streamed rather than built: each value they contain is returned with
+ * its path as soon as it is complete, and the container itself is returned
+ * empty after its content. Chunks of streamed chunked strings are returned
+ * one by one, then the empty string.
+ */
+#define STREAM_MT_NAME "m3da.bysant.core.sdctx"
+
+typedef struct stream_t {
+    bsd_ctx_t ctx;
+    uint8_t *data;             /* bytes received but not consumed yet */
+    size_t first, last, size;  /* consumed and received bytes, allocated size */
+    size_t need;               /* bytes needed before bsd_read() can progress */
+    int depth;                 /* streamed containers nesting level */
+    int index[BSD_STACK_SIZE]; /* last list index in each streamed container */
+} stream_t;
+
+/* Stack layout of api_feed(). The userdata's environment holds the thread
+ * and three lists indexed by nesting levels: the path of streamed containers
+ * (and of containers built directly in them), the current key of streamed
+ * maps, and the empty containers returned when streamed containers close.
+ * S_PATH holds the path of the item being read; containers being built are
+ * above it. */
+enum { S_SELF=1, S_DATA, S_RESULT, S_THREAD, S_PATHS, S_KEYS, S_SHELLS, S_PATH };
+
+/* Pops a path and a value, appends the value to the result list. With
+ * streamed containers, the path is appended first. */
+static void stream_emit( lua_State *L, stream_t *s) {
+    int n = lua_objlen( L, S_RESULT);
+    if( s->depth) {
+        lua_pushvalue( L, -2);           // path, value, path
+        lua_rawseti( L, S_RESULT, ++n);  // path, value
+    }
+    lua_rawseti( L, S_RESULT, ++n);      // path
+    lua_pop( L, 1);
+}
+
+/* Pushes the path of the next value to be read in the streamed container
+ * at the top of the bsd stack, or nil if it is a map key. */
+static void stream_pushpath( lua_State *L, stream_t *s) {
+    int level = s->ctx.stacksize;
+    struct bsd_stackframe_t *f = s->ctx.stack + level;
+    switch( f->kind) {
+    case BS_FMAP: case BS_FZMAP:
+        if( f->content.map.even) { lua_pushnil( L); return; }
+        lua_rawgeti( L, S_KEYS, level); // key
+        break;
+    case BS_FOBJECT: {
+        const bs_class_t *classdef = f->content.object.classdef;
+        if( f->missing > 0 && NULL != classdef->fields[classdef->nfields - f->missing].name) {
+            lua_pushstring( L, classdef->fields[classdef->nfields - f->missing].name); // key
+            break;
+        }
+    } /* fall through */
+    default: lua_pushinteger( L, s->index[level] + 1); break; // key
+    }
+    lua_rawgeti( L, S_PATHS, level); // key, parent_path
+    if( lua_objlen( L, -1)) {
+        lua_pushliteral( L, ".");    // key, parent_path, "."
+        lua_pushvalue( L, -3);       // key, parent_path, ".", key
+        lua_concat( L, 3);           // key, path
+    } else {
+        lua_pop( L, 1);              // key
+        lua_pushstring( L, lua_tostring( L, -1)); // key, path
+    }
+    lua_remove( L, -2);              // path
+}
+
+/* Pushes an empty container, returned in place of a streamed container. */
+static void stream_pushshell( lua_State *L, const bsd_data_t *x) {
+    if( BSD_CHUNKED_STRING == x->type) { lua_pushliteral( L, ""); return; }
+    lua_newtable( L);
+    if( BSD_OBJECT != x->type) return;
+    if( NULL == x->content.classdef->classname) lua_pushinteger( L, x->content.classdef->classid);
+    else lua_pushstring( L, x->content.classdef->classname);
+    lua_setfield( L, -2, "__class");
+}
+
+/* Reads as many items as possible from `buffer`. Returns the number of
+ * bytes consumed, or -1 with an error message on top of the stack. */
+static int stream_read( lua_State *L, stream_t *s, const uint8_t *buffer, size_t length) {
+    size_t offset = 0;
+    s->need = 0;
+    while( offset < length || s->ctx.stacksize > 0) {
+        int before = s->ctx.stacksize, after, r;
+        int streamed = before > 0 && before <= s->depth; // parent is streamed
+        bsd_data_t x;
+        if( streamed) {
+            stream_pushpath( L, s);
+            lua_replace( L, S_PATH);
+        } else if( 0 == before) {
+            lua_pushliteral( L, "");
+            lua_replace( L, S_PATH);
+        }
+        r = bsd_read( &s->ctx, &x, buffer + offset, length - offset);
+        if( r < 0) { s->need = -r; break; }
+        if( BSD_ERROR == x.type) { bysant2lua( L, &x); return -1; }
+        offset += r;
+        after = s->ctx.stacksize;
+
+        switch( x.type) {
+        case BSD_CLASSDEF: break;
+
+        case BSD_CLOSE:
+            if( before <= s->depth) { /* streamed container */
+                lua_rawgeti( L, S_PATHS, before);  // path
+                lua_rawgeti( L, S_SHELLS, before); // path, shell
+                stream_emit( L, s);
+                break;
+            }
+            if( after > s->depth) { /* container nested in a built container */
+                if( bysant2lua( L, &x)) return -1;
+                break;
+            }
+            x.kind = BSD_KTOPLEVEL;
+            if( bysant2lua( L, &x)) return -1; // value
+            lua_rawgeti( L, S_PATHS, before);  // value, path
+            lua_insert( L, -2);                // path, value
+            stream_emit( L, s);
+            break;
+
+        case BSD_MAP: case BSD_ZMAP: case BSD_LIST: case BSD_ZLIST:
+        case BSD_OBJECT: case BSD_CHUNKED_STRING:
+            if( streamed || 0 == before) {
+                if( lua_isnil( L, S_PATH)) { lua_pushliteral( L, "container used as a map key"); return -1; }
+                s->index[before]++;
+                lua_pushvalue( L, S_PATH);
+                lua_rawseti( L, S_PATHS, after);
+            }
+            if( after <= s->depth) {
+                s->index[after] = 0;
+                stream_pushshell( L, &x);
+                lua_rawseti( L, S_SHELLS, after);
+            } else if( bysant2lua( L, &x)) return -1;
+            break;
+
+        case BSD_CHUNK:
+            if( before > s->depth) {
+                if( bysant2lua( L, &x)) return -1;
+                break;
+            }
+            lua_rawgeti( L, S_PATHS, before); // path
+            lua_pushlstring( L, x.content.chunk.data, x.content.chunk.length); // path, chunk
+            stream_emit( L, s);
+            break;
+
+        default: /* scalar value */
+            if( ! streamed && before > 0) { /* nested in a built container */
+                if( bysant2lua( L, &x)) return -1;
+                break;
+            }
+            x.kind = BSD_KTOPLEVEL;
+            if( bysant2lua( L, &x)) return -1;        // value
+            if( lua_isnil( L, S_PATH)) {               // map key
+                lua_rawseti( L, S_KEYS, before);
+                break;
+            }
+            s->index[before]++;
+            lua_pushvalue( L, S_PATH);                 // value, path
+            lua_insert( L, -2);                        // path, value
+            stream_emit( L, s);
+            break;
+        }
+    }
+    return offset;
+}
+
+/* Appends `length` bytes to the pending bytes, growing the buffer as needed. */
+static void stream_append( lua_State *L, stream_t *s, const uint8_t *data, size_t length) {
+    size_t pending = s->last - s->first;
+    if( s->size - s->last < length) {
+        memmove( s->data, s->data + s->first, pending);
+        s->first = 0;
+        s->last = pending;
+    }
+    if( s->size - s->last < length) {
+        size_t size = s->size ? s->size : 256;
+        uint8_t *buffer;
+        while( size - pending < length) size *= 2;
+        buffer = realloc( s->data, size);
+        if( NULL == buffer) luaL_error( L, "not enough memory");
+        s->data = buffer;
+        s->size = size;
+    }
+    memcpy( s->data + s->last, data, length);
+    s->last += length;
+}
+
+/* Drops any partially deserialized value; class definitions are kept.
+ * Returns true if some data has been dropped. */
+static int stream_clear( stream_t *s, lua_State *T) {
+    int dropped = s->ctx.stacksize > 0 || s->last > s->first;
+    s->ctx.stacksize = 0;
+    s->first = s->last = s->need = 0;
+    lua_settop( T, 0);
+    return dropped;
+}
+
+/* Feeds a string or bytebuffer to the stream deserializer.
+ * Returns the list of completed values, possibly empty; with streamed
+ * containers, each value is preceded by its path in the list.
+ * Returns nil and an error message if the data is invalid, after having
+ * dropped the partially deserialized value. */
+static int api_feed( lua_State *L) {
+    stream_t *s = (stream_t *) luaL_checkudata( L, S_SELF, STREAM_MT_NAME);
+    size_t length;
+    const uint8_t *data = (const uint8_t *) bytebuffer_checklstring( L, S_DATA, &length);
+    lua_State *T;
+    int r, i;
+
+    lua_settop( L, S_DATA);
+    lua_newtable( L);               // result
+    lua_getfenv( L, S_SELF);        // result, env
+    for( i=1; i<=4; i++) lua_rawgeti( L, S_RESULT + 1, i); // result, env, thread, paths, keys, shells
+    lua_remove( L, S_RESULT + 1);   // result, thread, paths, keys, shells
+    lua_pushnil( L);                // result, thread, paths, keys, shells, path
+    T = lua_tothread( L, S_THREAD);
+
+    if( s->last > s->first || length < s->need) { /* complete the pending bytes */
+        stream_append( L, s, data, length);
+        if( s->last - s->first < s->need) { lua_settop( L, S_RESULT); return 1; }
+        data = s->data + s->first;
+        length = s->last - s->first;
+        lua_xmove( T, L, lua_gettop( T));
+        r = stream_read( L, s, data, length);
+        if( r >= 0) {
+            s->first += r;
+            if( s->first == s->last) s->first = s->last = 0;
+        }
+    } else { /* read data in place, only keep what's left */
+        lua_xmove( T, L, lua_gettop( T));
+        r = stream_read( L, s, data, length);
+        if( r >= 0) stream_append( L, s, data + r, length - r);
+    }
+    if( r < 0) {
+        stream_clear( s, T);
+        lua_pushnil( L);
+        lua_insert( L, -2);
+        return 2;
+    }
+    lua_xmove( L, T, lua_gettop( L) - S_PATH);
+    lua_settop( L, S_RESULT);
+    return 1;
+}
+
+/* Drops any partially deserialized value.
+ * Returns true if some data has been dropped, false otherwise. */
+static int api_reset( lua_State *L) {
+    stream_t *s = (stream_t *) luaL_checkudata( L, 1, STREAM_MT_NAME);
+    lua_getfenv( L, 1);
+    lua_rawgeti( L, -1, 1);
+    lua_pushboolean( L, stream_clear( s, lua_tothread( L, -1)));
+    return 1;
+}
+
+/* Returns the number of bytes received but not deserialized yet. */
+static int api_streamLen( lua_State *L) {
+    stream_t *s = (stream_t *) luaL_checkudata( L, 1, STREAM_MT_NAME);
+    lua_pushnumber( L, s->last - s->first);
+    return 1;
+}
+
+static int api_streamAddClass( lua_State *L) {
+    return add_class( L, & ((stream_t *) luaL_checkudata( L, 1, STREAM_MT_NAME))->ctx);
+}
+
+static int api_streamCollect( lua_State *L) {
+    stream_t *s = (stream_t *) luaL_checkudata( L, 1, STREAM_MT_NAME);
+    bsd_reset( & s->ctx);
+    free( s->data);
+    s->data = NULL;
+    return 0;
+}
+
+/* Creates a stream deserializer; containers up to nesting level `depth`,
+ * 0 by default, are streamed. */
+static int api_streamInit( lua_State *L) {
+    int depth = luaL_optint( L, 1, 0);
+    stream_t *s;
+    luaL_argcheck( L, 0 <= depth && depth < BSD_STACK_SIZE, 1, "invalid depth");
+    s = (stream_t *) lua_newuserdata( L, sizeof( stream_t)); // udata
+    bsd_init( & s->ctx);
+    s->data = NULL;
+    s->first = s->last = s->size = s->need = 0;
+    s->depth = depth;
+    lua_getfield( L, LUA_REGISTRYINDEX, STREAM_MT_NAME); // udata, mt
+    lua_setmetatable( L, -2);       // udata
+    lua_createtable( L, 4, 0);      // udata, env
+    lua_newthread( L);              // udata, env, thread
+    lua_rawseti( L, -2, 1);         // udata, env
+    for( depth=2; depth<=4; depth++) {
+        lua_newtable( L);           // udata, env, list
+        lua_rawseti( L, -2, depth); // udata, env
+    }
+    lua_setfenv( L, -2);            // udata
+    return 1;
+}
+
 int luaopen_m3da_bysant_core_deserialize( lua_State *L) {
     luaL_findtable( L, LUA_GLOBALSINDEX, "m3da.bysant.core", 14); // m3da.bysant.core
 
@@ -384,6 +702,22 @@ int luaopen_m3da_bysant_core_deserialize( lua_State *L) {
     lua_setfield( L, -2, "__type");            // m3da.bysant.core, mt[__type="bysant.deserializer"]
     lua_pop( L, 1);                            // m3da.bysant.core
 
+    luaL_newmetatable( L, STREAM_MT_NAME); // m3da.bysant.core, mt
+    lua_pushcfunction( L, api_streamCollect); lua_setfield( L, -2, "__gc");
+    lua_pushcfunction( L, api_streamLen);     lua_setfield( L, -2, "__len");
+    lua_createtable( L, 0, 3);             // m3da.bysant.core, mt, __index
+    lua_pushcfunction( L, api_feed);       // m3da.bysant.core, mt, __index, feed
+    lua_pushvalue( L, -1);                 // m3da.bysant.core, mt, __index, feed, feed
+    lua_setfield( L, -3, "feed");          // m3da.bysant.core, mt, __index[feed], feed
+    lua_setfield( L, -3, "__call");        // m3da.bysant.core, mt[__call=feed], __index
+    lua_pushcfunction( L, api_reset);          lua_setfield( L, -2, "reset");
+    lua_pushcfunction( L, api_streamAddClass); lua_setfield( L, -2, "addClass");
+    lua_setfield( L, -2, "__index");                  // m3da.bysant.core, mt[__index]
+    lua_pushstring( L, "bysant.streamdeserializer");  // m3da.bysant.core, mt, "bysant.streamdeserializer"
+    lua_setfield( L, -2, "__type");                   // m3da.bysant.core, mt[__type="bysant.streamdeserializer"]
+    lua_pop( L, 1);                                   // m3da.bysant.core
+    lua_pushcfunction( L, api_streamInit); lua_setfield( L, -2, "streamdeserializer");
+
     lua_pushcfunction( L, api_init);       // m3da.bysant.core, deserializer
     lua_pushvalue( L, -1);                 // m3da.bysant.core, deserializer, deserializer
     lua_setfield( L, -3, "deserializer");  // m3da.bysant.core[deserializer], deserializer
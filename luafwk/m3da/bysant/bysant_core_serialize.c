@@ -49,10 +49,12 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "bysant_core.h"
 #include "lua.h"
 #include "lauxlib.h"
 #include "bysants.h"
+#include "bytebuffer.h"
 
 /* Userdata content. */
 typedef struct luactx_t {
@@ -335,6 +337,58 @@ static int api_double( lua_State *L) {
   RETURN_SELF;
 }
 
+/* export bss_int_array() and bss_double_array(): serialize a list of numbers
+ * in one call. Numbers are either a Lua list, or a string or bytebuffer of
+ * packed native numbers, whose format is given as 3rd parameter: "d" for
+ * doubles (the default), "f" for floats, "i" for 32 bits integers. */
+static int api_array( lua_State *L) {
+  bss_ctx_t *ctx = lua_bss_checkctx( L, 1);
+  int i, n;
+
+  if( lua_istable( L, 2)) {
+    double *values;
+    n = lua_objlen( L, 2);
+    values = (double *) lua_newuserdata( L, n * sizeof( double));
+    for( i = 0; i < n; i++) {
+      lua_rawgeti( L, 2, i + 1);
+      if( ! lua_isnumber( L, -1))
+        return luaL_argerror( L, 2, lua_pushfstring( L, "number expected at index %d", i + 1));
+      values[i] = lua_tonumber( L, -1);
+      lua_pop( L, 1);
+    }
+    CHECK( bss_double_array( ctx, values, n));
+  } else {
+    size_t len;
+    const char *data = bytebuffer_checklstring( L, 2, &len);
+    char format = *luaL_optstring( L, 3, "d");
+    size_t size = 'd' == format ? sizeof( double) : 'f' == format ? sizeof( float) :
+        'i' == format ? sizeof( int32_t) : 0;
+    luaL_argcheck( L, size > 0, 3, "invalid format");
+    luaL_argcheck( L, 0 == len % size, 2, "truncated number");
+    n = len / size;
+    if( 'i' == format) {
+      int64_t *values = (int64_t *) lua_newuserdata( L, n * sizeof( int64_t));
+      for( i = 0; i < n; i++) {
+        int32_t x;
+        memcpy( &x, data + i * size, size);
+        values[i] = x;
+      }
+      CHECK( bss_int_array( ctx, values, n));
+    } else {
+      /* data are copied anyway, as they may not be aligned */
+      double *values = (double *) lua_newuserdata( L, n * sizeof( double));
+      if( 'd' == format) memcpy( values, data, len);
+      else for( i = 0; i < n; i++) {
+        float x;
+        memcpy( &x, data + i * size, size);
+        values[i] = x;
+      }
+      CHECK( bss_double_array( ctx, values, n));
+    }
+  }
+  RETURN_SELF;
+}
+
 /* export bss_bool(). */
 static int api_boolean( lua_State *L) {
   bss_ctx_t *ctx = lua_bss_checkctx( L, 1);
@@ -452,6 +506,7 @@ int luaopen_m3da_bysant_core_serialize( lua_State *L) {
   /* Register C functions. */
   luaL_findtable( L, LUA_GLOBALSINDEX, "m3da.bysant.core", 14); // m3da.bysant.core
 #define REG(x) lua_pushcfunction( L, api_##x); lua_setfield( L, -2, #x)
+  REG( array);
   REG( boolean);
   REG( broken);
   REG( list);
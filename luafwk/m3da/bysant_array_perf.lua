@@ -0,0 +1,76 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of the serialization of numeric columns, in values/s:
+-- * value by value: a list, then one number() call per value, as done by
+--   the table serializer before numeric arrays;
+-- * array(), from a Lua list;
+-- * array(), from a string of packed native numbers.
+-- Columns are integers (a counter), floats (exact in 32 bits) and doubles
+-- (temperatures with a 0.1 precision). Payload sizes are reported, since
+-- array() chooses the most compact list context.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/bysant_array_perf.lua [values per column]
+
+require 'strict'
+require 'pack'
+local m3da = require 'm3da.bysant'
+
+local N = tonumber(arg[1]) or 10000
+local function printf(...) print(string.format(...)) end
+
+local columns = { { "int", 'i', { } }, { "float", 'f', { } }, { "double", 'd', { } } }
+local counter, temperature = 0, 21.5
+for i = 1, N do
+    counter = counter + math.random(0, 4)
+    temperature = temperature + math.random(-1, 1) * 0.1
+    columns[1][3][i] = counter
+    columns[2][3][i] = math.random(0, 4095) / 16
+    columns[3][3][i] = temperature
+end
+
+-- Serializes `x` with `f` until one second is spent, returns values/s and
+-- the payload size.
+local function run(f, x, fmt)
+    local size = 0
+    local serializer = m3da.serializer(function(data) size = size + #data; return #data end)
+    local count, t = 0, os.clock()
+    repeat
+        size = 0
+        assert(f(serializer, x, fmt))
+        count = count + 1
+    until os.clock() - t > 1
+    return count * N / (os.clock() - t), size
+end
+
+local function valuebyvalue(serializer, t)
+    serializer :list (#t)
+    for i = 1, #t do serializer :number (t[i]) end
+    return serializer :close()
+end
+
+local function array(serializer, x, fmt) return serializer :array (x, fmt) end
+
+printf("Columns of %d values:", N)
+printf("  %-8s %-18s %14s %12s", "column", "method", "values/s", "payload (B)")
+for _, c in ipairs(columns) do
+    local name, fmt, t = unpack(c)
+    local packed = { }
+    for i = 1, N do packed[i] = string.pack(fmt, t[i]) end
+    packed = table.concat(packed)
+    for _, b in ipairs{ { "value by value", valuebyvalue, t }, { "array, Lua list", array, t },
+                        { "array, packed", array, packed, fmt } } do
+        local rate, size = run(b[2], b[3], b[4])
+        printf("  %-8s %-18s %14.0f %12d", name, b[1], rate, size)
+    end
+end
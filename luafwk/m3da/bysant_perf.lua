@@ -0,0 +1,113 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of the reception of a large M3DA envelope, fed in chunks as
+-- read from a socket:
+-- * accumulated in a bytebuffer and deserialized when complete, then its
+--   payload is deserialized message by message, as done formerly by the
+--   default session and srvcon;
+-- * streamed: the envelope's payload chunks are fed to a second stream
+--   deserializer, which returns messages as soon as they are complete.
+-- Reports the latency to the first message, the total time, and the peak
+-- memory: the live Lua heap plus the bytes buffered in C by the bytebuffer
+-- or the stream deserializers.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/bysant_perf.lua [envelope size in MB] [chunk size]
+
+require 'strict'
+require 'sched'
+rawset(_G, 'log', require 'log')
+local m3da   = require 'm3da.bysant'
+local socket = require 'socket'
+local ltn12  = require 'ltn12'
+
+local SIZE  = (tonumber(arg[1]) or 10) * 1e6
+local CHUNK = tonumber(arg[2]) or 8192
+local function printf(...) print(string.format(...)) end
+
+local function envelope()
+    local acc, n = { }, 0
+    local serializer = m3da.serializer(function(x) table.insert(acc, x); n = n + #x; return #x end)
+    for ticketid = 1, math.huge do
+        if n >= SIZE then break end
+        serializer :value { __class='Message', path='asset.commands', ticketid=ticketid,
+            body={ temperature=ticketid * 1.5, status="running", samples={ 1, 2, 3, 4 } } }
+    end
+    local payload, result = table.concat(acc), { }
+    log.setlevel('WARNING', 'BYSANT-M3DA')
+    local sink = ltn12.sink.table(result)
+    ltn12.pump.all(ltn12.source.chain(ltn12.source.string(payload), m3da.envelope{ status=200 }), sink)
+    return table.concat(result)
+end
+
+-- Feeds `data` by chunks to `receiver`, which returns the number of messages
+-- it completed and the number of bytes it buffered out of the Lua heap.
+-- Returns the number of messages, the time to the first one and the total
+-- time; if `memory` is true, returns the peak memory in KB instead, as
+-- measured after a full garbage collection following each chunk.
+local function run(data, receiver, memory)
+    local count, first, peak = 0, nil, 0
+    collectgarbage()
+    local base = collectgarbage 'count'
+    local t = os.clock()
+    for i = 1, #data, CHUNK do
+        local n, buffered = receiver(data :sub (i, i+CHUNK-1))
+        count = count + n
+        if count > 0 and not first then first = os.clock() - t end
+        if memory then
+            collectgarbage()
+            peak = math.max(peak, collectgarbage 'count' - base + buffered / 1024)
+        end
+    end
+    if memory then return peak end
+    return count, first, os.clock() - t
+end
+
+local function accumulated()
+    local d, pending = m3da.deserializer(), socket.bytebuffer()
+    local partial = nil
+    return function(chunk)
+        pending :append (chunk)
+        local envelope, offset
+        envelope, offset, partial = d (pending, partial)
+        if offset == 'partial' then return 0, #pending end
+        local buffered, payload = #pending, envelope.payload
+        pending :consume (offset-1)
+        local count, offset, msg = 0, 1
+        while offset <= #payload do
+            msg, offset = d (payload, offset)
+            count = count + 1
+        end
+        return count, buffered
+    end
+end
+
+local function streamed()
+    local d, messages = m3da.streamdeserializer(2), m3da.streamdeserializer()
+    return function(chunk)
+        local events, count = assert(d :feed (chunk)), 0
+        for i = 1, #events, 2 do
+            if events[i] == 'payload' then count = count + #assert(messages :feed (events[i+1])) end
+        end
+        return count, #d + #messages
+    end
+end
+
+local data = envelope()
+printf("Envelope of %d bytes, fed in chunks of %d bytes:", #data, CHUNK)
+printf("  %-24s %9s %12s %11s %11s", "", "messages", "1st message", "total", "peak memory")
+for _, b in ipairs{ { "accumulated", accumulated }, { "streamed", streamed } } do
+    local count, first, total = run(data, b[2]())
+    local peak = run(data, b[2](), true)
+    printf("  %-24s %9d %10.1fms %9.1fms %9.0fKB", b[1], count, first * 1e3, total * 1e3, peak)
+end
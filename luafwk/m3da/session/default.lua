@@ -16,14 +16,12 @@
 --   instance, wrapping them into M3DA envelopes as needed';
 -- * sets a sink in the transport instance, to receive incoming data;
 --
---   pushes completed, serialized M3MDA messages to the `msghandler()` passed
---   at init time.
+--   pushes serialized M3DA messages to the `msghandler()` passed at init
+--   time, in envelope payload fragments as soon as they are received.
 
 local log      = require "log"
 local ltn12    = require "ltn12"
 local m3da     = require 'm3da.bysant'
-local niltoken = require 'niltoken'
-local m3da_deserialize = m3da.deserializer()
 
 local M  = { }
 local MT = { __index=M, __type='m3da.session' }
@@ -32,31 +30,45 @@ local MT = { __index=M, __type='m3da.session' }
 M.last_session_id = 0
 
 -------------------------------------------------------------------------------
--- Creates an ltn12 sink to receive transport data as a bytes, and turn them
--- into complete M3DA envelopes pushed in the `self.incoming` pipe.
+-- Creates an ltn12 sink to receive transport data as a bytes, and push the
+-- payload of M3DA envelopes in the `self.incoming` pipe as it is received:
+-- payload fragments are followed by an empty string once the envelope is
+-- complete.
 function M :newsink()
-    local pending_data = ''
-    local partial = nil
+    -- header, payload and footer fields are returned as soon as received
+    local m3da_deserialize = m3da.streamdeserializer(2)
+    local status, fragments = nil, false
+    -- The connection broke in the middle of an envelope: drop it, and end the
+    -- payload fragments already pushed so that their reader drops them too,
+    -- instead of taking the next envelope for their continuation.
+    local function abort()
+        m3da_deserialize :reset()
+        status = nil
+        if fragments then self.incoming :send (''); fragments = false end
+    end
     return function (data, err)
         if not data then
+            abort()
             sched.signal(self, 'connection_closed')
             return nil, err
         end
-        pending_data = pending_data .. data
-        local envelope, offset
-        envelope, offset, partial = m3da_deserialize (pending_data, partial)
-        if offset=='partial' then return 'ok'
-        elseif envelope then
-            sched.signal(self, 'status', envelope.header.status)
-            local payload = envelope.payload
-            if payload==nil then payload=niltoken end
-            self.incoming :send (payload)
-            pending_data = pending_data :sub (offset, -1)
-            return 'ok'
-        else
-            m3da_deserialize :reset()
-            return nil, offset -- actually an error msg
+        local events, errmsg = m3da_deserialize :feed (data)
+        if not events then abort(); return nil, errmsg end
+        for i = 1, #events, 2 do
+            local path, value = events[i], events[i+1]
+            if path == 'payload' then -- whole payload, or one of its chunks
+                if type(value) == 'string' and value ~= '' then
+                    self.incoming :send (value)
+                    fragments = true
+                end
+            elseif path == 'header.status' then status = value
+            elseif path == '' then -- envelope complete
+                self.incoming :send ('')
+                sched.signal(self, 'status', status)
+                status, fragments = nil, false
+            end
         end
+        return 'ok'
     end
 end
 
@@ -92,12 +104,14 @@ end
 
 -------------------------------------------------------------------------------
 -- Report server messages to the handler provided by srvcon at module init time.
+-- The handler receives payload fragments, with a second `true` argument
+-- if more fragments of the same payload follow.
 function M :monitor (handler)
     checks('m3da.session', 'function')
     while true do
-        local msg = niltoken(self.incoming :receive()) or ''-- TODO: handle timeouts ?
-        log('M3DA-SESSION', 'DEBUG', "Received a %d bytes message", #msg)
-        handler(msg)
+        local fragment = self.incoming :receive() -- TODO: handle timeouts ?
+        log('M3DA-SESSION', 'DEBUG', "Received a %d bytes payload fragment", #fragment)
+        handler(fragment, fragment ~= '')
     end
 end
 
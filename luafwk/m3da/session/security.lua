@@ -22,6 +22,7 @@ local cipher = require "crypto.cipher"
 local hmac   = require "crypto.hmac"
 local hash   = require "crypto.hash"
 local rng    = require "crypto.rng"
+local worker = require "sched.worker"
 
 local M  = { }
 local MT = { __index=M, __type='m3da.session' }
@@ -210,14 +211,10 @@ function M :receive()
 end
 
 -------------------------------------------------------------------------------
--- Transport sink state:
--- `pending_data` is a string which contains the beginning of an incomplete
--- envelope;
--- `partial` is the deserializer's frozen state, to be passed back at next
--- invocation to resume the parsing where it stopped due to lack of data.
+-- Transport sink state: the beginning of an incomplete envelope is kept in
+-- the stream deserializer, partially deserialized, until it is complete.
 --
-local pending_data = ''
-local partial = nil
+local envelope_deserialize = m3da.streamdeserializer()
 
 -------------------------------------------------------------------------------
 -- sink to be passed to the transport layer, to accept incoming data from the
@@ -234,29 +231,22 @@ function M :newsink()
         if not src_data then
             sched.signal(self, 'reception_error', src_error)
             return nil, src_error
-        else -- some data received
-            pending_data = pending_data .. src_data
-            local status, envelope, offset
-            status, envelope, offset, partial = pcall(m3da_deserialize, pending_data, partial)
-            if not status then
-                local err_msg = envelope
-                local log_msg =  #pending_data>80 and pending_data:sub(1, 75).."..." or pending_data
-                log('M3DA-SESSION', 'ERROR', "Received non-M3DA DATA (%s): %s", err_msg, sprint(log_msg))
-                sched.signal(self, 'reception_error', "Received non-M3DA data")
-                return nil, err_msg
-            elseif offset=='partial' then -- incomplete envelope, wait for more data
-                return 'ok'
-            else -- got a complete envelope: broadcast it
-                assert(envelope)
-                if self.waitingresponse then -- response to a request
-                    sched.signal(self, 'envelope_received', envelope)
-                else -- unsollicited incoming message
-                    sched.run(self.parse, self, envelope)
-                end
-                pending_data = pending_data :sub (offset, -1)
-                return 'ok'
+        end
+        local envelopes, err_msg = envelope_deserialize :feed (src_data)
+        if not envelopes then
+            local log_msg =  #src_data>80 and src_data:sub(1, 75).."..." or src_data
+            log('M3DA-SESSION', 'ERROR', "Received non-M3DA DATA (%s): %s", err_msg, sprint(log_msg))
+            sched.signal(self, 'reception_error', "Received non-M3DA data")
+            return nil, err_msg
+        end
+        for _, envelope in ipairs(envelopes) do -- got complete envelopes: broadcast them
+            if self.waitingresponse then -- response to a request
+                sched.signal(self, 'envelope_received', envelope)
+            else -- unsollicited incoming message
+                sched.run(self.parse, self, envelope)
             end
         end
+        return 'ok'
     end
 end
 
@@ -384,7 +374,7 @@ function M :unprotectedparse(nonce, outer_env)
     local payload = outer_env.payload
     if self.encryption then
         local cipher = self :getencryption ("dec", nonce)
-        payload = assert(cipher :process(payload))
+        payload = assert(worker.run(cipher :job (payload)))
     end
 
     log("M3DA-SESSION", "INFO", "Accepted authenticated%s response from server",
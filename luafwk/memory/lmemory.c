@@ -0,0 +1,192 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Lua API of the pooled allocator (see lmempool.h).
+ * When the running VM does not use the pooled allocator (plain Lua
+ * interpreter for instance), memory.enabled() returns false and the other
+ * functions are harmless no-ops.
+ */
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "lmempool.h"
+
+#define PRESSURE_CB "memory.onpressure"
+
+static lmp_pool_t *getpool(lua_State *L)
+{
+  void *ud;
+  lua_getallocf(L, &ud);
+  if (ud && ((lmp_pool_t *) ud)->magic == LMP_MAGIC)
+    return (lmp_pool_t *) ud;
+  return NULL;
+}
+
+/* --- memory.enabled()
+ * -- @return true when the VM runs on the pooled allocator
+ */
+static int l_enabled(lua_State *L)
+{
+  lua_pushboolean(L, getpool(L) != NULL);
+  return 1;
+}
+
+/* --- memory.stats()
+ * -- @return a table {total, peak, limit, large, failures, classes={ [size]={pages, used} },
+ * --         owners={ [name]={bytes, peak, allocs} }}, or nil+error.
+ */
+static int l_stats(lua_State *L)
+{
+  int i;
+  lmp_pool_t *pool = getpool(L);
+  if (!pool)
+  {
+    lua_pushnil(L);
+    lua_pushstring(L, "pooled allocator not in use");
+    return 2;
+  }
+
+  lua_createtable(L, 0, 7);
+  lua_pushnumber(L, pool->total);
+  lua_setfield(L, -2, "total");
+  lua_pushnumber(L, pool->peak);
+  lua_setfield(L, -2, "peak");
+  lua_pushnumber(L, pool->limit);
+  lua_setfield(L, -2, "limit");
+  lua_pushnumber(L, pool->large);
+  lua_setfield(L, -2, "large");
+  lua_pushnumber(L, pool->failures);
+  lua_setfield(L, -2, "failures");
+
+  lua_createtable(L, 0, LMP_NCLASSES);
+  for (i = 0; i < LMP_NCLASSES; i++)
+  {
+    lua_createtable(L, 0, 2);
+    lua_pushnumber(L, pool->classes[i].pages);
+    lua_setfield(L, -2, "pages");
+    lua_pushnumber(L, pool->classes[i].used);
+    lua_setfield(L, -2, "used");
+    lua_rawseti(L, -2, pool->classes[i].size);
+  }
+  lua_setfield(L, -2, "classes");
+
+  lua_createtable(L, 0, pool->nowners);
+  for (i = 0; i < pool->nowners; i++)
+  {
+    lua_createtable(L, 0, 3);
+    lua_pushnumber(L, pool->owners[i].bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushnumber(L, pool->owners[i].peak);
+    lua_setfield(L, -2, "peak");
+    lua_pushnumber(L, pool->owners[i].allocs);
+    lua_setfield(L, -2, "allocs");
+    lua_setfield(L, -2, pool->owners[i].name);
+  }
+  lua_setfield(L, -2, "owners");
+  return 1;
+}
+
+/* --- memory.setlimit(bytes)
+ * -- Set the hard limit of the pool, 0 to remove it.
+ * -- Collection is requested (see memory.check) when 7/8 of the limit is reached.
+ */
+static int l_setlimit(lua_State *L)
+{
+  lmp_pool_t *pool = getpool(L);
+  size_t limit = (size_t) luaL_checknumber(L, 1);
+  if (pool)
+    lmp_setlimit(pool, limit);
+  lua_pushboolean(L, pool != NULL);
+  return 1;
+}
+
+/* --- memory.owner(name)
+ * -- @return the numeric id of an owner, to be given to memory.setowner.
+ */
+static int l_owner(lua_State *L)
+{
+  lmp_pool_t *pool = getpool(L);
+  const char *name = luaL_checkstring(L, 1);
+  lua_pushinteger(L, pool ? lmp_owner(pool, name) : LMP_DEFAULT_OWNER);
+  return 1;
+}
+
+/* --- memory.setowner(id)
+ * -- Account subsequent allocations to an owner id, as returned by memory.owner.
+ * -- @return the previous owner id
+ */
+static int l_setowner(lua_State *L)
+{
+  lmp_pool_t *pool = getpool(L);
+  int owner = luaL_checkint(L, 1);
+  lua_pushinteger(L, pool ? lmp_setowner(pool, owner) : LMP_DEFAULT_OWNER);
+  return 1;
+}
+
+/* --- memory.onpressure(f)
+ * -- Register a function called by memory.check() after an emergency collection.
+ * -- It receives the stats table and can drop caches held by the application.
+ */
+static int l_onpressure(lua_State *L)
+{
+  if (!lua_isnil(L, 1))
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+  lua_settop(L, 1);
+  lua_setfield(L, LUA_REGISTRYINDEX, PRESSURE_CB);
+  return 0;
+}
+
+/* --- memory.check()
+ * -- The allocator cannot run the garbage collector itself. It raises a flag when
+ * -- the soft limit is exceeded or an allocation was refused; this function, meant to
+ * -- be called regularly (the scheduler does it after each step), then runs a full
+ * -- collection and the pressure callback.
+ * -- @return true when a collection was performed
+ */
+static int l_check(lua_State *L)
+{
+  lmp_pool_t *pool = getpool(L);
+  if (!pool || !pool->pressure)
+  {
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+  pool->pressure = 0;
+  lua_gc(L, LUA_GCCOLLECT, 0);
+  lua_getfield(L, LUA_REGISTRYINDEX, PRESSURE_CB);
+  if (lua_isfunction(L, -1))
+  {
+    l_stats(L);
+    lua_call(L, 1, 0);
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+static const luaL_Reg R[] =
+{
+  { "enabled", l_enabled },
+  { "stats", l_stats },
+  { "setlimit", l_setlimit },
+  { "owner", l_owner },
+  { "setowner", l_setowner },
+  { "onpressure", l_onpressure },
+  { "check", l_check },
+  { NULL, NULL }
+};
+
+int luaopen_memory(lua_State *L)
+{
+  luaL_register(L, "memory", R);
+  return 1;
+}
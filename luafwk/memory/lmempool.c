@@ -0,0 +1,371 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "lmempool.h"
+
+struct lmp_page
+{
+  lmp_page_t *next, *prev; // links in the partial list of (owner, class)
+  void *free;              // list of released blocks
+  char *bump;              // first never used block
+  uint16_t used;
+  uint16_t nblocks;
+  uint8_t cls;
+  uint8_t owner;
+};
+
+// Slabs are carved out of page aligned chunks obtained with mmap, so that
+// released slabs can be handed back to the system (madvise) without the
+// alignment overhead malloc would have.
+#define LMP_CHUNK_PAGES 64
+
+struct lmp_chunk
+{
+  lmp_chunk_t *next;
+  char *base;
+  uint64_t freemap;        // bit i set: page i of the chunk is not in use
+};
+
+#define CHUNK_FULL_FREE (~(uint64_t) 0)
+
+// slab header size, rounded so that blocks stay 16 bytes aligned
+#define LMP_HDR_SIZE ((sizeof(lmp_page_t) + 15) & ~(size_t)15)
+// header of large blocks, storing the owner; keeps the payload 16 bytes aligned
+#define LMP_LARGE_HDR 16
+
+#define PAGE_OF(p) ((lmp_page_t *) ((uintptr_t) (p) & ~(uintptr_t) (LMP_PAGE_SIZE - 1)))
+
+static const uint16_t class_size[LMP_NCLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+
+// (size + 15) / 16 -> size class
+static const uint8_t class_of[LMP_MAX_SMALL / 16 + 1] = { 0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7 };
+
+#define CLASS(size) class_of[((size) + 15) >> 4]
+
+static void account(lmp_pool_t *pool, int owner, size_t size, int add)
+{
+  lmp_owner_t *o = &pool->owners[owner];
+  if (add)
+  {
+    o->bytes += size;
+    o->allocs++;
+    if (o->bytes > o->peak)
+      o->peak = o->bytes;
+  }
+  else
+    o->bytes -= size;
+}
+
+// Reserve `size` more bytes from the system, honoring the hard limit unless `force` is set.
+static int reserve(lmp_pool_t *pool, size_t size, int force)
+{
+  if (!force && pool->limit && pool->total + size > pool->limit)
+  {
+    if (!pool->emergency || !pool->emergency(pool, size, pool->emergency_ud)
+        || pool->total + size > pool->limit)
+    {
+      pool->failures++;
+      pool->pressure = 1;
+      return 0;
+    }
+  }
+  pool->total += size;
+  if (pool->total > pool->peak)
+    pool->peak = pool->total;
+  if (pool->softlimit && pool->total > pool->softlimit)
+    pool->pressure = 1;
+  return 1;
+}
+
+static lmp_page_t *page_get(lmp_pool_t *pool)
+{
+  lmp_chunk_t *chunk;
+  int i;
+
+  for (chunk = pool->chunks; chunk; chunk = chunk->next)
+    if (chunk->freemap)
+      break;
+  if (!chunk)
+  {
+    chunk = malloc(sizeof(*chunk));
+    if (!chunk)
+      return NULL;
+    chunk->base = mmap(NULL, LMP_CHUNK_PAGES * LMP_PAGE_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (chunk->base == MAP_FAILED)
+    {
+      free(chunk);
+      return NULL;
+    }
+    chunk->freemap = CHUNK_FULL_FREE;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+  }
+  i = __builtin_ctzll(chunk->freemap);
+  chunk->freemap &= ~((uint64_t) 1 << i);
+  return (lmp_page_t *) (chunk->base + i * LMP_PAGE_SIZE);
+}
+
+static void page_release(lmp_pool_t *pool, lmp_page_t *page)
+{
+  lmp_chunk_t **pc, *chunk;
+  for (pc = &pool->chunks; (chunk = *pc); pc = &chunk->next)
+  {
+    if ((char *) page >= chunk->base && (char *) page < chunk->base + LMP_CHUNK_PAGES * LMP_PAGE_SIZE)
+    {
+      chunk->freemap |= (uint64_t) 1 << (((char *) page - chunk->base) / LMP_PAGE_SIZE);
+      if (chunk->freemap == CHUNK_FULL_FREE)
+      {
+        *pc = chunk->next;
+        munmap(chunk->base, LMP_CHUNK_PAGES * LMP_PAGE_SIZE);
+        free(chunk);
+      }
+      else
+        madvise(page, LMP_PAGE_SIZE, MADV_DONTNEED);
+      return;
+    }
+  }
+}
+
+static void unlink_page(lmp_pool_t *pool, lmp_page_t *page)
+{
+  if (page->prev)
+    page->prev->next = page->next;
+  else
+    pool->partial[page->owner][page->cls] = page->next;
+  if (page->next)
+    page->next->prev = page->prev;
+  page->next = page->prev = NULL;
+}
+
+static void *small_alloc(lmp_pool_t *pool, int cls, int force)
+{
+  int owner = pool->owner;
+  lmp_page_t *page = pool->partial[owner][cls];
+  void *block;
+
+  if (!page)
+  {
+    if (!reserve(pool, LMP_PAGE_SIZE, force))
+      return NULL;
+    page = page_get(pool);
+    if (!page)
+    {
+      pool->total -= LMP_PAGE_SIZE;
+      return NULL;
+    }
+    page->next = page->prev = NULL;
+    page->free = NULL;
+    page->bump = (char *) page + LMP_HDR_SIZE;
+    page->used = 0;
+    page->nblocks = (LMP_PAGE_SIZE - LMP_HDR_SIZE) / class_size[cls];
+    page->cls = cls;
+    page->owner = owner;
+    pool->partial[owner][cls] = page;
+    pool->classes[cls].pages++;
+  }
+
+  if (page->free)
+  {
+    block = page->free;
+    page->free = *(void **) block;
+  }
+  else
+  {
+    block = page->bump;
+    page->bump += class_size[cls];
+  }
+  page->used++;
+  if (page->used == page->nblocks) // full: no longer a candidate for allocation
+    unlink_page(pool, page);
+
+  pool->classes[cls].used++;
+  account(pool, owner, class_size[cls], 1);
+  return block;
+}
+
+static void small_free(lmp_pool_t *pool, void *block)
+{
+  lmp_page_t *page = PAGE_OF(block);
+  int cls = page->cls;
+  lmp_page_t **head = &pool->partial[page->owner][cls];
+
+  if (page->used == page->nblocks) // was full, make it available again
+  {
+    page->next = *head;
+    page->prev = NULL;
+    if (*head)
+      (*head)->prev = page;
+    *head = page;
+  }
+  *(void **) block = page->free;
+  page->free = block;
+  page->used--;
+  pool->classes[cls].used--;
+  account(pool, page->owner, class_size[cls], 0);
+
+  // Give empty slabs back to the system, except the last one of the list,
+  // to avoid allocating a new slab on the next request.
+  if (!page->used && (page->next || page->prev))
+  {
+    unlink_page(pool, page);
+    pool->classes[cls].pages--;
+    pool->total -= LMP_PAGE_SIZE;
+    page_release(pool, page);
+  }
+}
+
+static void *large_alloc(lmp_pool_t *pool, size_t size, int force)
+{
+  uint8_t *p;
+  if (!reserve(pool, size + LMP_LARGE_HDR, force))
+    return NULL;
+  p = malloc(size + LMP_LARGE_HDR);
+  if (!p)
+  {
+    pool->total -= size + LMP_LARGE_HDR;
+    return NULL;
+  }
+  *p = pool->owner;
+  pool->large += size;
+  account(pool, pool->owner, size, 1);
+  return p + LMP_LARGE_HDR;
+}
+
+static void large_free(lmp_pool_t *pool, void *block, size_t size)
+{
+  uint8_t *p = (uint8_t *) block - LMP_LARGE_HDR;
+  account(pool, *p, size, 0);
+  pool->large -= size;
+  pool->total -= size + LMP_LARGE_HDR;
+  free(p);
+}
+
+static void *large_realloc(lmp_pool_t *pool, void *block, size_t osize, size_t nsize)
+{
+  uint8_t *p = (uint8_t *) block - LMP_LARGE_HDR;
+  int owner = *p;
+  if (nsize > osize && !reserve(pool, nsize - osize, 0))
+    return NULL;
+  p = realloc(p, nsize + LMP_LARGE_HDR);
+  if (!p)
+  {
+    if (nsize > osize)
+      pool->total -= nsize - osize;
+    return NULL;
+  }
+  if (nsize < osize)
+    pool->total -= osize - nsize;
+  pool->large += nsize - osize;
+  account(pool, owner, osize, 0);
+  account(pool, owner, nsize, 1);
+  return p + LMP_LARGE_HDR;
+}
+
+void *lmp_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+  lmp_pool_t *pool = (lmp_pool_t *) ud;
+  void *nptr;
+  int force;
+
+  if (nsize == 0)
+  {
+    if (ptr)
+    {
+      if (osize <= LMP_MAX_SMALL)
+        small_free(pool, ptr);
+      else
+        large_free(pool, ptr, osize);
+    }
+    return NULL;
+  }
+
+  if (!ptr)
+    return nsize <= LMP_MAX_SMALL ? small_alloc(pool, CLASS(nsize), 0) : large_alloc(pool, nsize, 0);
+
+  if (osize <= LMP_MAX_SMALL && nsize <= LMP_MAX_SMALL && CLASS(osize) == CLASS(nsize))
+    return ptr;
+  if (osize > LMP_MAX_SMALL && nsize > LMP_MAX_SMALL)
+    return large_realloc(pool, ptr, osize, nsize);
+
+  // moving between the slabs and the large blocks, or between size classes.
+  // Shrinking is never refused because of the limit.
+  force = nsize < osize;
+  nptr = nsize <= LMP_MAX_SMALL ? small_alloc(pool, CLASS(nsize), force) : large_alloc(pool, nsize, force);
+  if (!nptr)
+    return NULL;
+  memcpy(nptr, ptr, osize < nsize ? osize : nsize);
+  if (osize <= LMP_MAX_SMALL)
+    small_free(pool, ptr);
+  else
+    large_free(pool, ptr, osize);
+  return nptr;
+}
+
+lmp_pool_t *lmp_new(size_t limit)
+{
+  int i;
+  lmp_pool_t *pool = calloc(1, sizeof(*pool));
+  if (!pool)
+    return NULL;
+  pool->magic = LMP_MAGIC;
+  for (i = 0; i < LMP_NCLASSES; i++)
+    pool->classes[i].size = class_size[i];
+  strcpy(pool->owners[LMP_DEFAULT_OWNER].name, "default");
+  pool->nowners = 1;
+  lmp_setlimit(pool, limit);
+  return pool;
+}
+
+// To be called once the Lua state using the pool is closed.
+void lmp_delete(lmp_pool_t *pool)
+{
+  lmp_chunk_t *chunk, *next;
+  for (chunk = pool->chunks; chunk; chunk = next)
+  {
+    next = chunk->next;
+    munmap(chunk->base, LMP_CHUNK_PAGES * LMP_PAGE_SIZE);
+    free(chunk);
+  }
+  pool->magic = 0;
+  free(pool);
+}
+
+void lmp_setlimit(lmp_pool_t *pool, size_t limit)
+{
+  pool->limit = limit;
+  pool->softlimit = limit - limit / 8;
+}
+
+int lmp_owner(lmp_pool_t *pool, const char *name)
+{
+  int i;
+  for (i = 0; i < pool->nowners; i++)
+    if (!strncmp(pool->owners[i].name, name, LMP_OWNER_NAME_LEN - 1))
+      return i;
+  if (pool->nowners == LMP_MAX_OWNERS)
+    return LMP_DEFAULT_OWNER;
+  strncpy(pool->owners[i].name, name, LMP_OWNER_NAME_LEN - 1);
+  pool->owners[i].name[LMP_OWNER_NAME_LEN - 1] = '\0';
+  return pool->nowners++;
+}
+
+int lmp_setowner(lmp_pool_t *pool, int owner)
+{
+  int previous = pool->owner;
+  if (owner >= 0 && owner < pool->nowners)
+    pool->owner = owner;
+  return previous;
+}
@@ -0,0 +1,102 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Pooled allocator for the Lua VM.
+ *
+ * Small blocks (up to LMP_MAX_SMALL bytes) are carved out of page-aligned
+ * slabs, one slab list per size class and per owner; slabs are taken from
+ * mmapped chunks and given back to the system once empty. Larger blocks go to
+ * malloc with a small header. Lua always tells the allocator the size of the
+ * block it frees, so small blocks carry no header at all: the slab header is
+ * found by masking the block address.
+ *
+ * Every allocation is accounted to the current "owner" (a module or a
+ * scheduler task), and the whole pool can be bounded by a hard limit.
+ *
+ * A pool is bound to one lua_State and is therefore only ever used by the
+ * thread running that state: no locking is done.
+ */
+
+#ifndef LMEMPOOL_H_
+#define LMEMPOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LMP_MAGIC          0x4c4d5031 // "LMP1", used to recognize a pool from lua_getallocf
+#define LMP_PAGE_SIZE      4096
+#define LMP_MAX_SMALL      256
+#define LMP_NCLASSES       8
+#define LMP_MAX_OWNERS     32
+#define LMP_OWNER_NAME_LEN 32
+#define LMP_DEFAULT_OWNER  0
+
+typedef struct lmp_page lmp_page_t;
+typedef struct lmp_chunk lmp_chunk_t;
+typedef struct lmp_pool lmp_pool_t;
+
+// Called before an allocation fails because of the hard limit; it may release
+// memory held outside of the Lua VM. It must not call back into the Lua state.
+// Returns non-zero when some memory was released and the allocation should be retried.
+typedef int (*lmp_emergency_cb)(lmp_pool_t *pool, size_t request, void *ud);
+
+typedef struct
+{
+  char name[LMP_OWNER_NAME_LEN];
+  size_t bytes;          // bytes currently allocated on behalf of the owner
+  size_t peak;           // highest value of bytes
+  unsigned long allocs;  // number of allocations performed
+} lmp_owner_t;
+
+typedef struct
+{
+  size_t size;           // block size of the class
+  size_t pages;          // slabs currently held
+  size_t used;           // blocks currently in use
+} lmp_class_t;
+
+struct lmp_pool
+{
+  uint32_t magic;
+  size_t total;          // bytes obtained from the system (slabs + large blocks)
+  size_t peak;           // highest value of total
+  size_t limit;          // hard limit on total, 0 for none
+  size_t softlimit;      // when total exceeds it, pressure is raised
+  int pressure;          // set by the allocator, cleared by the Lua side after a collection
+  unsigned long failures;// allocations refused because of the limit
+  size_t large;          // bytes in blocks bigger than LMP_MAX_SMALL
+  uint8_t owner;         // owner of the allocations being performed
+  uint8_t nowners;
+  lmp_owner_t owners[LMP_MAX_OWNERS];
+  lmp_class_t classes[LMP_NCLASSES];
+  lmp_page_t *partial[LMP_MAX_OWNERS][LMP_NCLASSES]; // slabs with free blocks
+  lmp_chunk_t *chunks;   // mmapped areas the slabs are taken from
+  lmp_emergency_cb emergency;
+  void *emergency_ud;
+};
+
+lmp_pool_t *lmp_new(size_t limit);
+void lmp_delete(lmp_pool_t *pool);
+
+// lua_Alloc compatible entry point, ud must be a lmp_pool_t
+void *lmp_alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+
+void lmp_setlimit(lmp_pool_t *pool, size_t limit);
+
+// Return the id of the owner named `name`, registering it if needed.
+// When the owner table is full, the default owner id is returned.
+int lmp_owner(lmp_pool_t *pool, const char *name);
+
+// Select the owner of subsequent allocations, returns the previous one.
+int lmp_setowner(lmp_pool_t *pool, int owner);
+
+#endif /* LMEMPOOL_H_ */
@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Soak benchmark of the pooled Lua allocator.
+ *
+ * Runs a synthetic agent workload (short lived strings and tables from
+ * notifications and log formatting, a sliding window of buffered data
+ * records, periodic flushes of large tables) in a Lua VM using either the
+ * default realloc based allocator or the pooled allocator, and reports the
+ * process RSS after each simulated hour.
+ *
+ * Usage: mempool_perf [default|pool] [hours]
+ * Without a mode, both allocators are run in separate processes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#include "lmempool.h"
+
+#define DEFAULT_HOURS 24
+
+// One simulated hour of agent activity.
+static const char *workload =
+  "local hour = ...\n"
+  "buffered = buffered or { }\n"
+  "cache = cache or { }\n"
+  "for i = 1, 20000 do\n"
+  "  local path = string.format('asset%d.sensor%d.value', i % 37, i % 113)\n"
+  "  local n = { path = path, value = i * 1.5, ts = hour * 3600 + i, tag = ('x'):rep(i % 200) }\n"
+  "  buffered[#buffered + 1] = n\n"
+  "  cache[path] = tostring(n.value)\n"
+  "  if #buffered > 4000 then\n"
+  "    local flush = { }\n"
+  "    for j, r in ipairs(buffered) do flush[j] = r.path .. '=' .. r.value end\n"
+  "    flush = table.concat(flush, ';')\n"
+  "    buffered = { }\n"
+  "  end\n"
+  "  if i % 5000 == 0 then\n"
+  "    for k in pairs(cache) do if #k % 3 == hour % 3 then cache[k] = nil end end\n"
+  "  end\n"
+  "end\n";
+
+static long rss_kb(void)
+{
+  long pages = 0, rss = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return -1;
+  if (fscanf(f, "%ld %ld", &pages, &rss) != 2)
+    rss = -1;
+  fclose(f);
+  return rss < 0 ? -1 : rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int run(int usepool, int hours)
+{
+  lmp_pool_t *pool = NULL;
+  lua_State *L;
+  int h;
+
+  if (usepool)
+  {
+    pool = lmp_new(0);
+    L = lua_newstate(lmp_alloc, pool);
+  }
+  else
+    L = luaL_newstate();
+  luaL_openlibs(L);
+
+  if (luaL_loadstring(L, workload))
+  {
+    printf("%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+  lua_setglobal(L, "workload");
+
+  printf("%-8s %6s %10s %10s\n", "alloc", "hour", "rss (kB)", "lua (kB)");
+  for (h = 1; h <= hours; h++)
+  {
+    lua_getglobal(L, "workload");
+    lua_pushinteger(L, h);
+    if (lua_pcall(L, 1, 0, 0))
+    {
+      printf("%s\n", lua_tostring(L, -1));
+      return 1;
+    }
+    printf("%-8s %6d %10ld %10d\n", usepool ? "pool" : "default", h, rss_kb(), lua_gc(L, LUA_GCCOUNT, 0));
+    fflush(stdout);
+  }
+  if (pool)
+    printf("pool: total %lu bytes, peak %lu bytes\n", (unsigned long) pool->total, (unsigned long) pool->peak);
+
+  lua_close(L);
+  if (pool)
+    lmp_delete(pool);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  int hours = argc > 2 ? atoi(argv[2]) : DEFAULT_HOURS;
+  int status, mode;
+
+  if (argc > 1)
+    return run(!strcmp(argv[1], "pool"), hours);
+
+  for (mode = 0; mode < 2; mode++)
+  {
+    pid_t pid = fork();
+    if (pid == 0)
+      return run(mode, hours);
+    waitpid(pid, &status, 0);
+  }
+  return 0;
+}
@@ -0,0 +1,47 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* File system helpers of the `persist.file` module. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+/* datasync(file): flushes a Lua file, then waits for its data to be written
+ * to the storage device. Returns true, or nil and an error message. */
+static int l_datasync( lua_State *L) {
+  FILE **f = (FILE **) luaL_checkudata( L, 1, LUA_FILEHANDLE);
+  luaL_argcheck( L, NULL != *f, 1, "closed file");
+  if( fflush( *f) || fdatasync( fileno( *f))) {
+    lua_pushnil( L);
+    lua_pushstring( L, strerror( errno));
+    return 2;
+  }
+  lua_pushboolean( L, 1);
+  return 1;
+}
+
+static const luaL_Reg R[] = {
+  { "datasync", l_datasync },
+  { NULL, NULL } };
+
+/* No global table is created: `persist` is a global variable of another
+ * type once the `persist` module is loaded. */
+int luaopen_persist_core( lua_State *L) {
+  lua_newtable( L);
+  luaL_register( L, NULL, R);
+  return 1;
+}
@@ -112,6 +112,17 @@
 -- functions, no preservation of table and function identities.
 --
 --
+-- Group commit.
+-- -------------
+--
+-- By default, every assignment to a persisted table is written to its file
+-- at once. Callers which change many keys in bursts can rather have writes
+-- buffered in memory, and committed by a background task in a single write
+-- per table, with @{#persist.setcommit}; values are readable as soon as they
+-- are assigned. Buffered writes are lost if the process dies before they
+-- are committed: @{#persist.flush} commits them, and waits for them to
+-- reach the storage device, when durability matters.
+--
 -- POSIX implementation details.
 -- -----------------------------
 --
@@ -122,6 +133,7 @@
 --
 
 local l2b      = require 'luatobin'
+local core     = require 'persist.core'
 local checks   = require 'checks'
 local log      = require 'log'
 
@@ -131,6 +143,7 @@ if global then global 'WORKING_DIR' end
 
 if global then global 'LUA_AF_RW_PATH' end
 local persist_path = (LUA_AF_RW_PATH or "./").."persist/"
+local READ_SIZE = 16384 -- bytes read at once when loading a table
 --force using non-sched aware os.execute function to avoid "cross boundaries" issues
 local exec = os.execute_orig or os.execute
 exec("mkdir -p "..persist_path)
@@ -145,6 +158,13 @@ M.MIN_LOSS = 256
 -- Cache to share multiple instances of the same table
 local cache = setmetatable({},{__mode = "v"})
 
+-- Group commit settings, see `setcommit`: delay is nil when writes are not
+-- buffered.
+local commit = { delay = nil, sync = false, scheduled = false }
+local sched -- loaded by setcommit
+local pending  = { } -- tables with buffered writes
+local unsynced = setmetatable({ }, { __mode = "k" }) -- tables written since their last sync
+
 -- initialize the whole persist module
 function M.init()
     if M.initialized then return 'already initialized' end
@@ -165,18 +185,75 @@ end
 
 M.table = { } -- sub-module persist.table
 
+-- Writes the buffered data of a table in its file, then syncs the file if
+-- `sync` is true.
+local function commitfile(self, sync)
+    local buffer = self.__buffer
+    if buffer[1] then
+        local ok, errmsg = self.__file :write(table.concat(buffer))
+        if ok then ok, errmsg = self.__file :flush() end
+        if not ok then log('PERSIST-FILE', 'ERROR', "Can't write table %s: %s", self.__id, tostring(errmsg)) end
+        self.__buffer = { }
+        unsynced[self] = true
+    end
+    pending[self] = nil
+    if sync and unsynced[self] then
+        local ok, errmsg = core.datasync(self.__file)
+        if not ok then log('PERSIST-FILE', 'ERROR', "Can't sync table %s: %s", self.__id, tostring(errmsg)) end
+        unsynced[self] = nil
+    end
+end
+
+-- Commits the buffered writes of every table.
+local function commitall(sync)
+    for self in pairs(pending) do commitfile(self, sync) end
+    if sync then for self in pairs(unsynced) do commitfile(self, sync) end end
+end
+
+-- Appends serialized data to a table's file, or to its buffer in group
+-- commit mode; the first buffered write schedules the commit.
+local function write(self, ...)
+    if commit.delay then
+        local buffer = self.__buffer
+        for i = 1, select('#', ...) do buffer[#buffer+1] = select(i, ...) end
+        pending[self] = true
+        if not commit.scheduled then
+            commit.scheduled = true
+            -- a new task runs after the tasks already ready in this scheduler step
+            sched.run(function()
+                if commit.delay and commit.delay > 0 then sched.wait(commit.delay) end
+                commit.scheduled = false
+                commitall(commit.sync)
+            end)
+        end
+    else
+        self.__file :write(...)
+        self.__file :flush()
+        unsynced[self] = true
+        if commit.sync then commitfile(self, true) end
+    end
+end
+
 -- Remove useless entries from a table
 local function recompact(self)
     log('PERSIST-FILE', 'DEBUG',
         "%d entries wasted for %d entries, recompacting table %s",
         self.__overridden, self.__length, self.__id)
-    local file = io.open(persist_path..self.__id..'.l2b', 'wb') -- overwrite
+    local data = { }
     for k, v in pairs(self.__cache) do
-        file :write(l2b.serialize(k))
-        file :write(l2b.serialize(v))
+        data[#data+1] = l2b.serialize(k)
+        data[#data+1] = l2b.serialize(v)
     end
+    -- Buffered writes are included; the new content is written at once, as
+    -- the file is truncated.
+    self.__buffer = { }
+    pending[self] = nil
+    self.__file :close()
+    self.__file = io.open(persist_path..self.__id..'.l2b', 'wb') -- overwrite
+    self.__file :write(table.concat(data))
     self.__file :flush()
-    self.__file = file
+    unsynced[self] = true
+    if commit.sync then commitfile(self, true) end
     self.__overridden = 0
 end
 
@@ -194,11 +271,7 @@ function TABLE_MT :__newindex (k, v)
         recompact(self)
     else
         log('PERSIST-FILE', 'DEBUG', "wrote %s=%s", tostring(k), tostring(v))
-        local sk = l2b.serialize(k)
-        self.__file :write(sk)
-        local sv = l2b.serialize(v)
-        self.__file :write(sv)
-        self.__file :flush()
+        write(self, l2b.serialize(k), l2b.serialize(v))
     end
 end
 
@@ -235,43 +308,56 @@ function M.table.new(name)
     local cached = cache[name]
     if cached then return cached end
 
+    local self = {
+        __id         = name,
+        __cache      = { },
+        __buffer     = { },
+        __overridden = 0,
+        __length     = 0 }
+
     local filename = persist_path .. name .. '.l2b'
     local file, errmsg = io.open(filename, 'rb')
-    local filecontent
+    local truncated = false
     if file then -- file existed
         log('PERSIST-FILE', 'DEBUG', "Loading %s from file %s",
             name, filename)
-        filecontent = file :read '*a'
+        -- decode keys and values as the file is read
+        local decoder, k, haskey = l2b.decoder(), nil, false
+        for chunk in function() return file :read(READ_SIZE) end do
+            decoder :push(chunk)
+            while true do
+                local ok, obj = decoder :next()
+                if not ok then break end
+                if not haskey then k, haskey = obj, true
+                else
+                    haskey = false
+                    if k~=nil then
+                        if self.__cache[k] then
+                            self.__overridden = self.__overridden+1
+                        else self.__length = self.__length + 1 end
+                        self.__cache[k] = obj
+                    end
+                end
+            end
+        end
         file :close()
+        -- an interrupted write leaves a truncated pair at the end of the
+        -- file: it is dropped, so that later pairs are not appended to it
+        if haskey or decoder :pending() > 0 then
+            log('PERSIST-FILE', 'ERROR', "Truncated entry at the end of %s, dropped", filename)
+            truncated = true
+        end
     end
     file, errmsg = io.open(filename, 'ab') -- append binary
     if not file then
         log('PERSIST-FILE', 'ERROR', "Can't open persistence file for writing: %q", errmsg)
         return nil, errmsg
     end
-
-    local self = {
-        __id         = name,
-        __cache      = { },
-        __overridden = 0,
-        __length     = 0,
-        __file       = file }
+    self.__file = file
 
     cache[name] = self
-
-    if filecontent then
-        local offset=1
-        while true do
-            local k, v
-            offset, k, v = l2b.deserialize(filecontent, 2, offset)
-            if k==nil then break end
-            if self.__cache[k] then
-                self.__overridden = self.__overridden+1
-            else self.__length = self.__length + 1 end
-            self.__cache[k] = v
-        end
-    end
     setmetatable(self, TABLE_MT)
+    if truncated then recompact(self) end
     return self
 end
 
@@ -288,6 +374,8 @@ function M.table.empty(self)
     self.__file :close()
     self.__file = assert(io.open(persist_path..self.__id..'.l2b', 'wb')); -- truncate file to 0
     self.__cache = { }
+    self.__buffer = { }
+    pending[self] = nil
 end
 
 local store = assert(M.table.new("PersistStore"))
@@ -307,6 +395,39 @@ function M.table.emptyall()
 end
 
 
+------------------------------------------------------------------------------
+-- Sets how assignments to persisted tables are written to their files.
+--
+-- Buffered writes are committed by a background task, which requires the
+-- scheduler to run. Buffered writes are committed before switching back to
+-- immediate writes.
+--
+-- @function [parent=#persist] setcommit
+-- @param delay `nil` to write every assignment at once, the default;
+--  otherwise, writes are buffered, and committed after `delay` seconds,
+--  or at the end of the current scheduler step if `delay` is 0.
+-- @param sync if true, files are synced after each write or commit, i.e.
+--  data is written to the storage device before going on.
+--
+
+function M.setcommit(delay, sync)
+    checks('?number', '?')
+    if not delay then commitall(sync) end
+    commit.delay, commit.sync = delay, sync and true or false
+    if delay then sched = require 'sched' end
+end
+
+------------------------------------------------------------------------------
+-- Commits the buffered writes of every persisted table, and waits for all
+-- the data written so far to be written to the storage device.
+--
+-- @function [parent=#persist] flush
+--
+
+function M.flush()
+    commitall(true)
+end
+
 ------------------------------------------------------------------------------
 -- Saves an object for later retrieval.
 --
@@ -0,0 +1,62 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of persisted table writes under burst load: a task assigns keys
+-- to a persisted table by bursts, as config or the update state do, yielding
+-- to the scheduler between bursts. Reports the number of assignments per
+-- second, until they are all written, and the number of file syncs, with
+-- immediate writes and with group commits.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/persist_perf.lua [bursts] [assignments per burst]
+
+require 'sched'
+rawset(_G, 'log', require 'log')
+local persist = require 'persist.file'
+local core    = require 'persist.core'
+local time    = require 'sched.timer.core'.time
+
+local BURSTS = tonumber(arg[1]) or 200
+local SIZE   = tonumber(arg[2]) or 20
+local function printf(...) print(string.format(...)) end
+
+-- Count the file syncs
+local syncs, datasync = 0, core.datasync
+function core.datasync(...) syncs = syncs + 1; return datasync(...) end
+
+local function bench(delay, sync)
+    local t = assert(persist.table.new("PersistPerf"))
+    persist.table.empty(t)
+    persist.setcommit(delay, sync)
+    syncs = 0
+    local start = time()
+    for i = 1, BURSTS do
+        for j = 1, SIZE do t["config.section"..i..".key"..j] = { value = i * j, date = i } end
+        sched.wait()
+    end
+    persist.setcommit(nil, sync) -- commits the last writes
+    local elapsed = time() - start
+    persist.table.empty(t)
+    return BURSTS * SIZE / elapsed, syncs, syncs / elapsed
+end
+
+sched.run(function()
+    printf("%-24s %12s %8s %10s", "mode", "writes/s", "syncs", "syncs/s")
+    for _, mode in ipairs{
+        { "immediate" }, { "immediate, sync", nil, true },
+        { "each step", 0 }, { "each step, sync", 0, true },
+        { "every 100ms, sync", 0.1, true } } do
+        printf("%-24s %12.0f %8d %10.1f", mode[1], bench(mode[2], mode[3]))
+    end
+    os.exit(0)
+end)
+sched.loop()
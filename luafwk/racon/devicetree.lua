@@ -26,6 +26,7 @@
 
 local common      = require 'racon.common'
 local niltoken    = require 'niltoken'
+local time        = require 'sched.timer.core'.time
 
 local M = {
     initialized=false; -- has M.init() been run?
@@ -35,6 +36,112 @@ local M = {
     sem_value = 1
 }
 
+-- Local cache of the variables read, `nil` when disabled (see M.cache):
+-- * `ttl`, `ttls`: the time to live settings;
+-- * `entries`: path -> { ttl=seconds, value=v, expiry=time, seq=n }, the value
+--   being `nil` when it must be read from the agent, `seq` being bumped when a
+--   notification or a set changes the value;
+-- * `regs`: RegisterVariable id -> list of the paths registered.
+-- The whole state is replaced when the cache is flushed, readers check that
+-- it is still the current one after a round-trip.
+local cache
+
+local function newcache(ttl, ttls)
+    return { ttl=ttl, ttls=ttls, entries={ }, regs={ } }
+end
+
+-- Time to live of a variable: the one of its longest configured prefix.
+local function cachettl(c, path)
+    local ttl, len = c.ttl, -1
+    for prefix, t in pairs(c.ttls) do
+        if #prefix > len and (path == prefix or path:sub(1, #prefix+1) == prefix..".") then
+            ttl, len = t, #prefix
+        end
+    end
+    return ttl
+end
+
+-- Returns true + the cached value of a path, or a record of the values of a
+-- list of paths; `nil` when one of them must be read from the agent.
+local function cacheget(c, path)
+    local now = time()
+    if type(path) == "string" then
+        local e = c.entries[path]
+        if e and e.value ~= nil and e.expiry > now then return true, e.value end
+        return nil
+    end
+    local record = { }
+    for _, p in ipairs(path) do
+        local e = c.entries[p]
+        if not (e and e.value ~= nil and e.expiry > now) then return nil end
+        record[p] = e.value
+    end
+    return true, record
+end
+
+-- Registers for the changes of the paths read for the first time, before
+-- they are read, so that no change is missed.
+local function cacheregister(c, path)
+    local new = { }
+    for _, p in ipairs(type(path) == "string" and { path } or path) do
+        if not c.entries[p] then
+            local e = { ttl=cachettl(c, p), expiry=0, seq=0 }
+            c.entries[p] = e
+            if e.ttl > 0 then table.insert(new, p) end
+        end
+    end
+    if not new[1] then return end
+    local s, id = common.sendcmd("RegisterVariable", { new, { }, 0 })
+    if s == "ok" then c.regs[id] = new; return end
+    log("DT", "DEBUG", "Cannot register %s for caching: %s", new[1], tostring(id))
+    for _, p in ipairs(new) do c.entries[p].ttl = 0 end
+end
+
+-- Returns the sequences of the paths about to be read, to give to cachestore.
+local function cacheseqs(c, path)
+    local seqs = { }
+    for _, p in ipairs(type(path) == "string" and { path } or path) do
+        local e = c.entries[p]
+        seqs[p] = e and e.seq
+    end
+    return seqs
+end
+
+-- Caches the leaf values of a GetVariable response. The values of the paths
+-- notified or set since `seqs` was taken are dropped: they may be older than
+-- the cached ones. Node paths are never cached, a registration which only
+-- holds nodes is cancelled.
+local function cachestore(c, path, b, seqs)
+    local now = time()
+    local function store(p, v)
+        local e = c.entries[p]
+        if e and e.ttl > 0 and e.seq == seqs[p] then e.value, e.expiry = v, now + e.ttl end
+    end
+    if type(path) == "table" then
+        if type(b[1]) ~= "table" then return end
+        for _, p in ipairs(path) do store(p, b[1][p]) end
+    elseif b[1] ~= niltoken then
+        store(path, b[1])
+    elseif type(b[2]) == "table" and c.entries[path] then
+        c.entries[path].ttl = 0
+        for id, paths in pairs(c.regs) do
+            if paths[1] == path and not paths[2] then
+                c.regs[id] = nil
+                common.sendcmd("UnregisterVariable", id)
+                break
+            end
+        end
+    end
+end
+
+-- Drops the cached values of a path and of the variables below it.
+local function cacheinvalidate(c, path)
+    local prefix = path.."."
+    for p, e in pairs(c.entries) do
+        if p == path or p:sub(1, #prefix) == prefix then e.value, e.seq = nil, e.seq + 1 end
+    end
+end
+
 
 local function sem_wait()
    while M.sem_value <= 0 do
@@ -73,6 +180,7 @@ function M.set(path, value)
     sem_wait()
     s, b = common.sendcmd("SetVariable", { path, value })
     sem_post()
+    if cache then cacheinvalidate(cache, path) end
     return s, b
 end
 
@@ -94,6 +202,9 @@ end
 -- a second list, of all direct children of all non-leaf paths, is also
 -- returned.
 --
+-- When the cache is enabled with @{devicetree.cache}, the values are read
+-- from the agent only the first time, or once their time to live expired.
+--
 -- @usage `devicetree.get("system.sw_info.fw_ver")` may return `"4.2.5"`.
 -- @usage `devicetree.get("system.sw_info")` may return
 --   `nil, {"system.sw_info.fw_ver", "system.sw_info.boot_ver"}`.
@@ -111,12 +222,59 @@ end
 function M.get(path)
     checks("string|table")
     if not M.initialized then error "Module not initialized" end
+    local c, seqs = cache
+    if c then
+        local found, value = cacheget(c, path)
+        if found then return value end
+        cacheregister(c, path)
+        seqs = cacheseqs(c, path)
+    end
     local s, b = common.sendcmd("GetVariable", path)
     if s~="ok" then return nil, (b or "unknown error") end
+    if c and c == cache then cachestore(c, path, b, seqs) end
     if b[1] == niltoken then return nil, b[2] end
     return b[1]
 end
 
+--------------------------------------------------------------------------------
+-- Enables, configures or disables the local cache of the variables read
+-- with @{devicetree.get}.
+--
+-- When the cache is enabled, the first read of a variable registers for its
+-- changes, and the following reads are served from memory: the changes
+-- notified by the agent update the cached values, and a variable set with
+-- @{devicetree.set} is read from the agent again. The cache is flushed when
+-- the connection to the agent is lost.
+--
+-- Some variables are not notified when they change, e.g. values computed
+-- by their handler when read: they must be given a time to live, after
+-- which they are read again from the agent, or a time to live of 0 which
+-- disables their caching. Non-leaf paths are never cached.
+--
+-- @usage devicetree.cache(true, { ["system.sensors"]=1, ["system.clock"]=0 })
+--
+-- @function [parent=#devicetree] cache
+-- @param ttl `true` to keep the values until they change, a number of
+--   seconds to read them again at least that often, `false` to disable
+--   the cache.
+-- @param ttls optional record of path/seconds pairs: the time to live of
+--   the variables below each path, overriding `ttl`. The longest matching
+--   path applies.
+-- @return `"ok"` on success.
+--
+
+function M.cache(ttl, ttls)
+    checks("boolean|number", "?table")
+    if not M.initialized then error "Module not initialized" end
+    local c = cache
+    if ttl == true then ttl = math.huge end
+    cache = ttl and newcache(ttl, ttls or { }) or nil
+    if c then
+        for id in pairs(c.regs) do common.sendcmd("UnregisterVariable", id) end
+    end
+    return "ok"
+end
+
 --------------------------------------------------------------------------------
 -- Registers to receive a notification when one or several variables change.
 --
@@ -142,18 +300,21 @@ end
 --   keys and values as values.
 -- @param passivevars optional variables to always pass to `callback`,
 --   whether they changed or not.
+-- @param window optional coalescing window in seconds: changes happening
+--   within the window are merged (last value wins) and reported by a single
+--   `callback` call. Defaults to the agent's `device.notifywindow` setting.
 -- @return a registration id, to be passed to @{devicetree.unregister}
 --   in order to unsubscribe.
 -- @return `nil` + error message in case of error.
 --
 
-function M.register(regvars, callback, passivevars)
-    checks("string|table", "function", "?string|table")
+function M.register(regvars, callback, passivevars, window)
+    checks("string|table", "function", "?string|table", "?number")
     if not M.initialized then error "Module not initialized" end
 
     sem_wait()
     --possible niltoken value for passivevars is managed in devman.
-    local status, id = common.sendcmd("RegisterVariable", { regvars, passivevars})
+    local status, id = common.sendcmd("RegisterVariable", { regvars, passivevars, window})
     if status~="ok" then
        sem_post()
        return nil, (id or "unknown error")
@@ -164,7 +325,7 @@ function M.register(regvars, callback, passivevars)
     end
     userId = userId + 1
     -- A user identifier is required to avoid gaps in the list (when the callback is unregistered)
-    table.insert(M.notifyvarid, {userId=userId, regId=id, cb=callback, regvars=regvars, passivevars=passivevars})
+    table.insert(M.notifyvarid, {userId=userId, regId=id, cb=callback, regvars=regvars, passivevars=passivevars, window=window})
     sem_post()
     return userId
 end
@@ -202,6 +363,14 @@ end
 -- React to a notification by treemgr sent through racon.
 local function emp_handler_NotifyVariable(payload)
     local id, varmap = unpack(payload) -- do not filter niltoken here ?
+    if cache and cache.regs[id] then
+       local now = time()
+       for path, val in pairs(varmap) do
+          local e = cache.entries[path]
+          if e and e.ttl > 0 then e.value, e.expiry, e.seq = niltoken(val), now + e.ttl, e.seq + 1 end
+       end
+       return 0
+    end
     for path, val in pairs(varmap) do
        if val then varmap[path]=niltoken(val) end
     end
@@ -220,9 +389,11 @@ local function emp_ipc_broken_handler()
    --block sem: services using EMP are blocked until sem is released
    -- This avoids data races between reregistration and other threads which send EMP commands
    M.sem_value=0
+   -- cache registrations are lost: read everything again
+   if cache then cache = newcache(cache.ttl, cache.ttls) end
    sched.run(function()
         for _, reg in pairs(M.notifyvarid) do
-           local status, id = common.sendcmd("RegisterVariable", { reg.regvars, reg.passivevars})
+           local status, id = common.sendcmd("RegisterVariable", { reg.regvars, reg.passivevars, reg.window})
            if status ~= "ok" then
               log("DT", "WARNING", "Failed to register back callback notification %s", tostring(reg.cb))
            else
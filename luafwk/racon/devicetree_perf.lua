@@ -0,0 +1,54 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of device tree reads, with and without the local cache: sets
+-- variables config.dt_perf.var<i>, then reads all of them in a loop, as a
+-- control loop does, one `devicetree.get` per variable, and reports the
+-- reads per second. The agent must be running.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/devicetree_perf.lua [variables] [rounds]
+
+require 'strict'
+require 'sched'
+rawset(_G, 'log', require 'log')
+local devicetree = require 'racon.devicetree'
+local time = require 'sched.timer.core'.time
+
+local VARS, ROUNDS = tonumber(arg[1]) or 50, tonumber(arg[2]) or 20
+local function printf(...) print(string.format(...)) end
+
+local function bench(paths, rounds)
+    local start = time()
+    for _ = 1, rounds do
+        for _, path in ipairs(paths) do assert(devicetree.get(path)) end
+    end
+    return #paths * rounds / (time() - start)
+end
+
+sched.run(function()
+    assert(devicetree.init())
+    local paths, values = { }, { }
+    for i = 1, VARS do paths[i], values["var"..i] = "config.dt_perf.var"..i, i end
+    assert(devicetree.set("config.dt_perf", values))
+
+    local uncached = bench(paths, ROUNDS)
+    devicetree.cache(true)
+    bench(paths, 1) -- registers the variables
+    local cached = bench(paths, ROUNDS * 100)
+    printf("%d variables: uncached %10.0f reads/s, cached %10.0f reads/s", VARS, uncached, cached)
+
+    devicetree.cache(false)
+    devicetree.set("config.dt_perf", nil)
+    os.exit(0)
+end)
+sched.loop()
@@ -17,6 +17,8 @@ local sched   = require 'sched'
 local log     = require 'log'
 local status  = require 'status'
 local yajl    = require 'yajl'
+local core    = require 'racon.empparser.core'
+local socket  = require 'socket'
 local errnum  = require 'status' .tonumber
 
 require 'pack'
@@ -35,6 +37,9 @@ local M = { cmd_timeout = 60 }
 
 local COMMAND_NAMES = { }
 
+-- Command 0 is reserved for the negotiation of the transport, see `transporthook`
+local TRANSPORT = 0
+
 -- make the table symmetric
 for k, v in pairs{
     [1]='SendData',
@@ -79,57 +84,104 @@ local api = { }; api.__index = api
 
 local serialize = yajl.to_string
 
-local function deserialize(str)
-    return str and yajl.to_value('['..str..']')[1] or yajl.null
+-- Payloads from this size on are received directly, rather than with whatever
+-- else is pending on the stream, and sent with `sendv` when the stream
+-- supports it; smaller ones are cheaper to handle as strings.
+local LARGE_PAYLOAD = 4096
+
+-- Event signaled with the response to the request `rid`, indexed by rid
+local RESPONSE = { }
+for rid = 1, 256 do RESPONSE[rid] = "response"..rid end
+
+-- Receive the next frame into the buffer, and return its fields as
+-- `racon.empparser.core.frame` does. Streams which support `receive_into`
+-- append whatever they have pending, possibly several frames at once, to
+-- the buffer; the other ones are read frame by frame.
+local function receiveframe(self)
+    local buf = self.buffer
+    while true do
+        local cmd, type, rid, status, first, last = core.frame(buf)
+        if cmd then return cmd, type, rid, status, first, last end
+        local skt, missing = self.skt, type
+        if skt.receive_into then
+            assert(skt:receive_into(buf, missing >= LARGE_PAYLOAD and missing or nil))
+        else
+            buf:append(assert(skt:receive(missing)))
+        end
+    end
+end
+
+-- Decode the payload of the frame being parsed, from the buffer itself;
+-- return it, and the serialized payload when it must be logged.
+local function decodepayload(self, first, last)
+    if first > last then return nil end
+    local buf = self.buffer
+    local payload = yajl.to_value(buf, nil, first, last)
+    if payload == yajl.null then payload = nil end
+    return payload, log.musttrace('EMP', 'DEBUG') and buf:sub(first, last) or nil
+end
+
+-- Send a message header followed by its payload, without concatenating them
+-- when the payload is large.
+local function sendmessage(skt, header, payload)
+    if #payload >= LARGE_PAYLOAD and skt.sendv then return skt:sendv{ header, payload } end
+    return skt:send(header..payload)
 end
 
 -- Create and return a new instance of an EMP Parser
 -- skt must be a "stream" object that supports read/write calls (as for channels/sockets)
+-- An optional `transporthook(skt, rid, request)` field may be set on the
+-- instance to accept transport negotiation requests: it must answer the
+-- request and return the stream to be used afterwards (possibly skt itself).
+-- Without it, such requests are answered with an UNKNOWN_COMMAND status.
 function M.new(skt, cmdhook)
-    return setmetatable({skt = skt, inprogress = {n=0}, cmdhook = cmdhook}, api)
+    return setmetatable({skt = skt, buffer = socket.bytebuffer(), inprogress = {n=0}, cmdhook = cmdhook}, api)
 end
 
 
 -- Listen for messages coming from the agent and send a signal on message reception
 local function parse(self)
-    local skt = self.skt
+    local buf = self.buffer
     while true do
-        local _, cmd, type, size, status, cmdname, rid
-        _, cmd, type, rid, size = assert(skt:receive(8)):unpack(">HbbI") -- get the message header
+        local cmd, type, rid, status, first, last = receiveframe(self)
+        local cmdname = COMMAND_NAMES[cmd] or cmd
         rid = rid+1
-        cmdname = COMMAND_NAMES[cmd] or cmd
-        if type%2 == 1 then -- this is a reply message
+        if cmd == TRANSPORT then -- transport negotiation, sent by local assets right after connecting
+            local request = buf:sub(first, last)
+            buf:consume(last)
+            log('EMP', 'DEBUG', "[->RCV] [CMD] #%d transport request", rid)
+            if self.transporthook then
+                -- the hook answers the request itself, and returns the stream to use from now on
+                self.skt = assert(self.transporthook(self.skt, rid-1, request))
+            else
+                assert(self.skt:send(string.pack(">HbbIH", cmd, 1, rid-1, 2, errnum 'UNKNOWN_COMMAND')))
+            end
+
+        elseif type%2 == 1 then -- this is a reply message
 
-            if size < 2 then
+            if not status then
                 log("EMP", "ERROR", "Missing status bytes in EMP ack, defaulting status to OK")
                 status = 0
-            else
-                _, status = assert(skt:receive(2)):unpack(">H")
-                size = size -2
             end
-            local serialized_payload = size>0 and assert(skt:receive(size)) or nil
-            local payload = deserialize(serialized_payload)
-            if payload == yajl.null then payload=nil end
+            local payload, serialized_payload = decodepayload(self, first, last)
+            buf:consume(last)
 
             log('EMP', 'DEBUG', "[->RCV] [RSP] #%d %s %s", rid, cmdname, serialized_payload)
 
-        if self.inprogress[rid] == "TIMEDOUT" then
-           self.inprogress[rid] = nil
-           self.inprogress.n = self.inprogress.n-1
-            elseif self.inprogress[rid] then
-           self.inprogress[rid] = nil -- this finishes an in-progress command
-           self.inprogress.n = self.inprogress.n-1
-
-           sched.signal(self, cmdname..tostring(rid), status, payload)
+            local inprogress = self.inprogress
+            if inprogress[rid] then -- this finishes an in-progress command
+                local timedout = inprogress[rid] == "TIMEDOUT"
+                inprogress[rid] = nil
+                inprogress.n = inprogress.n-1
+                if not timedout then sched.signal(self, RESPONSE[rid], status, payload) end
             else
-           log("EMP", "ERROR", "Received an unexpected response: cmd [%s], payload [%s], rid[%d]", cmdname, payload, rid)
+                log("EMP", "ERROR", "Received an unexpected response: cmd [%s], payload [%s], rid[%d]", cmdname, payload, rid)
             end
 
-
         else -- this is a command message
-            local serialized_cmd_payload = size>0 and assert(skt:receive(size))
-            local cmd_payload = serialized_cmd_payload and deserialize(serialized_cmd_payload)
-            if cmd_payload == yajl.null then cmd_payload=nil end
+            local cmd_payload, serialized_cmd_payload = decodepayload(self, first, last)
+            buf:consume(last)
+            local skt = self.skt
 
             log('EMP', 'DEBUG', "[->RCV] [CMD] #%d %s %s", rid, cmdname, serialized_cmd_payload or '<none>')
             local function execcmd()
@@ -143,7 +195,7 @@ local function parse(self)
                 end
                 local serialized_resp_payload = serialize (resp_payload)
                 log('EMP', 'DEBUG', "[<-SND] [RSP] #%d %s %s", rid-1, cmdname, serialized_resp_payload)
-                assert(skt:send(string.pack(">HbbIH", cmd, 1, rid-1, 2+#serialized_resp_payload, cmd_status)..serialized_resp_payload))
+                assert(sendmessage(skt, string.pack(">HbbIH", cmd, 1, rid-1, 2+#serialized_resp_payload, cmd_status), serialized_resp_payload))
             end
             sched.run(execcmd)
         end
@@ -165,6 +217,7 @@ function api:run(reconnect_handler)
        -- If the reconnection is impossible, then die
        if not status then break end
        self.skt = skt
+       self.buffer:clear()
     end
     self.skt = 512
     sched.signal(self, "server unreachable")
@@ -194,7 +247,7 @@ local function sendcmd(self, cmdname, rid, payload)
     local cmd = COMMAND_NAMES[cmdname] -- convert to number id
     local serialized_payload = serialize(payload)
     log('EMP', 'DEBUG', "[<-SND] [CMD] #%d %s %s", rid, cmdname, serialized_payload)
-    assert(self.skt:send(string.pack(">HbbI", cmd, 0, rid-1, #serialized_payload)..serialized_payload))
+    assert(sendmessage(self.skt, string.pack(">HbbI", cmd, 0, rid-1, #serialized_payload), serialized_payload))
 end
 
 function api:send_emp_cmd(cmd, payload)
@@ -219,7 +272,7 @@ function api:send_emp_cmd_wait(cmd, payload)
     -- launch it in background (sched.run does not cause a yield) so we are sure that the following wait will not miss an event !!
     sched.run(sendcmd, self, cmd, rid, payload)
 
-    local ev, s, p = sched.wait(self, {cmd..tostring(rid), 'closed', 'ipc broken', M.cmd_timeout})
+    local ev, s, p = sched.wait(self, {RESPONSE[rid], 'closed', 'ipc broken', M.cmd_timeout})
     if ev == 'closed' then
        self.inprogress[rid] = nil
        return errnum 'SERVER_UNREACHABLE', "server unreachable"
@@ -0,0 +1,85 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* EMP framing for the `racon.empparser` module.
+ *
+ * The parser receives the stream into a bytebuffer, and asks this module
+ * whether it starts with a complete frame. Frames are read in place: neither
+ * the header nor the payload is copied into a Lua string; the payload is
+ * decoded from the bytebuffer itself, then the frame is consumed.
+ *
+ * A frame is an 8 bytes header, big endian:
+ *   command (2 bytes), type (1 byte), request id (1 byte), size (4 bytes)
+ * followed by `size` bytes. The first 2 of them are the status of replies,
+ * which have an odd type, the others are the JSON payload. */
+
+#include <stdint.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "bytebuffer.h"
+
+#define HEADER_SIZE 8
+#define STATUS_SIZE 2
+
+static uint32_t getuint( const unsigned char *p, int n) {
+  uint32_t v = 0;
+  while( n-- > 0) v = (v << 8) | *p++;
+  return v;
+}
+
+/* frame(buffer): when the bytebuffer starts with a complete frame, returns
+ * its command, type, request id, status, and the indexes of the first and
+ * last bytes of its payload in the buffer, as expected by `buffer:sub`; the
+ * last one is also the length of the frame. The status is nil for commands,
+ * and for replies without status bytes. The payload is empty when
+ * first > last.
+ * Otherwise returns nil and the number of bytes missing, at least, to
+ * complete the frame. */
+static int l_frame( lua_State *L) {
+  size_t len, size, first = HEADER_SIZE + 1;
+  const unsigned char *p = (const unsigned char *) bytebuffer_checklstring( L, 1, &len);
+  int type;
+
+  if( len < HEADER_SIZE) {
+    lua_pushnil( L);
+    lua_pushnumber( L, HEADER_SIZE - len);
+    return 2;
+  }
+  size = getuint( p + 4, 4);
+  if( len - HEADER_SIZE < size) {
+    lua_pushnil( L);
+    lua_pushnumber( L, (lua_Number) (size - (len - HEADER_SIZE)));
+    return 2;
+  }
+  type = p[2];
+  lua_pushnumber( L, getuint( p, 2));
+  lua_pushnumber( L, type);
+  lua_pushnumber( L, p[3]);
+  if( type % 2 == 1 && size >= STATUS_SIZE) {
+    lua_pushnumber( L, getuint( p + HEADER_SIZE, STATUS_SIZE));
+    first += STATUS_SIZE;
+  } else lua_pushnil( L);
+  lua_pushnumber( L, first);
+  lua_pushnumber( L, (lua_Number) (HEADER_SIZE + size));
+  return 6;
+}
+
+static const luaL_Reg R[] = {
+  { "frame", l_frame },
+  { NULL, NULL } };
+
+/* No global table is created: it would be stored in the racon module. */
+int luaopen_racon_empparser_core( lua_State *L) {
+  lua_newtable( L);
+  luaL_register( L, NULL, R);
+  return 1;
+}
@@ -0,0 +1,80 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Throughput benchmark of the EMP parser, as the agent runs it: an asset
+-- sends SendData commands of various payload sizes back to back, which the
+-- agent parser answers, over the in-process pipe (racon.ipc) of the @sys
+-- asset and over a TCP loopback connection. Reports the number of commands
+-- answered per second, and of EMP messages (commands and replies) parsed.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/empparser_perf.lua [commands]
+
+require 'strict'
+require 'sched'
+rawset(_G, 'log', require 'log')
+local socket    = require 'socket'
+local yajl      = require 'yajl'
+local ipc       = require 'racon.ipc'
+local empparser = require 'racon.empparser'
+local time      = require 'sched.timer.core'.time
+
+local COUNT = tonumber(arg[1]) or 20000
+local function printf(...) print(string.format(...)) end
+
+local function jsonpayload(nvariables)
+    local t = { }
+    for i = 1, nvariables do t["variable"..i] = { value = i * 1.5, name = "sensor "..i } end
+    return t
+end
+
+local function tcp()
+    local server = assert(socket.bind("127.0.0.1", 0))
+    local _, port = server:getsockname()
+    local client
+    sched.run(function() client = assert(socket.connect("127.0.0.1", port)) end)
+    local skt = assert(server:accept())
+    server:close()
+    while not client do sched.wait() end
+    client:setoption('tcp-nodelay', true); skt:setoption('tcp-nodelay', true)
+    return client, skt
+end
+
+-- An asset sends COUNT commands without waiting for their replies, as many
+-- as the request ids allow, which the agent parser answers.
+local function bench(transport, payload)
+    local assetskt, agentskt = transport()
+    local handled = 0
+    local agent = empparser.new(agentskt, function() handled = handled + 1; return 0 end)
+    local asset = empparser.new(assetskt, function() return 0 end)
+    sched.run(agent.run, agent)
+    sched.run(asset.run, asset)
+    local start = time()
+    for _ = 1, COUNT do assert(asset:send_emp_cmd("SendData", payload)) end
+    while handled < COUNT or asset.inprogress.n > 0 do sched.wait(0.001) end
+    local elapsed = time() - start
+    assetskt:close(); agentskt:close()
+    return COUNT / elapsed
+end
+
+sched.run(function()
+    printf("%-6s %10s %12s %12s", "stream", "payload", "commands/s", "msgs/s")
+    for _, transport in ipairs{ { "ipc", ipc.new }, { "tcp", tcp } } do
+        for _, n in ipairs{ 1, 16, 256 } do
+            local payload = jsonpayload(n)
+            local rate = bench(transport[2], payload)
+            printf("%-6s %9dB %12.0f %12.0f", transport[1], #yajl.to_string(payload), rate, 2 * rate)
+        end
+    end
+    os.exit(0)
+end)
+sched.loop()
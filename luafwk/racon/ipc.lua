@@ -10,59 +10,113 @@
 -------------------------------------------------------------------------------
 
 local sched = require 'sched'
+local core = require 'racon.ipc.core'
 local string = require 'string'
 local setmetatable = setmetatable
 local tostring = tostring
 local error = error
+local ipairs = ipairs
 
 local M = { }
 
 ------------------------------------------------------------------------------------------------------------------------------------------
 -- String FIFO definition
 -- If needed by someone else this could be exported in its own module
+--
+-- The bytes are kept in a racon.ipc.core queue, as the strings written: a
+-- writer waits until less than BUFFER_MAX_SIZE bytes are pending, then
+-- queues its whole message at once, which wakes up the reader once. A read
+-- of exactly one written string returns that string, without copy.
 ------------------------------------------------------------------------------------------------------------------------------------------
 
 local FIFO_MT = {BUFFER_MAX_SIZE = 5*1024}; FIFO_MT.__index = FIFO_MT
 
 local function newfifo()
-    return setmetatable({buffer = ""}, FIFO_MT)
+    return setmetatable({queue = core.queue(), writers = 0}, FIFO_MT)
 end
 
-function FIFO_MT:read(n)
-    local b = ""
+-- Wait for the next read or write on the fifo, fail on any other event
+local function waitevent(self, what)
+    local event = sched.wait(self, "*")
+    if event ~= "write" and event ~= "read" then return nil, string.format("Event %s occured while %s", tostring(event), what) end
+    return true
+end
 
+-- Read with a queue method, waiting until it returns something
+local function read(self, method, ...)
+    local queue = self.queue
     while true do
-        local c = #self.buffer >= n and n or #self.buffer -- get the min value between n and #self.buffer
-        b = b..self.buffer:sub(1, c)
-        self.buffer = self.buffer:sub(c+1, -1)
-        n = n - c
-        sched.signal(self, "read")
-        if n == 0 then break end
-        local event = sched.wait(self, "*")
-        if event ~= "write" and event ~= "read" then return nil, string.format("Event %s occured while reading", tostring(event)), b end
+        local b = queue[method](queue, ...)
+        if b then
+            if self.writers > 0 then sched.signal(self, "read") end
+            return b
+        end
+        local s, err = waitevent(self, "reading")
+        if not s then return nil, err, queue:read(queue:len()) end
     end
+end
 
-    return b
+function FIFO_MT:read(n)
+    return read(self, "read", n)
 end
 
-function FIFO_MT:write(buffer)
+-- Append n bytes, all the pending ones without n, to a bytebuffer
+function FIFO_MT:readinto(buffer, n)
+    return read(self, "readinto", buffer, n)
+end
 
-    local idx = 1
-    while true do
-        local space = self.BUFFER_MAX_SIZE - #self.buffer
-        local remaining = #buffer - idx +1
-        local c = space >= remaining and remaining or space -- get the min value between #buffer-idx and BUFFER_MAX_SIZE-#self.buffer
-        self.buffer = self.buffer..buffer:sub(idx, idx+c-1)
-        idx = idx + c
-        sched.signal(self, "write")
-        if idx == #buffer+1 then break end
-        local event = sched.wait(self, "*")
-        if event ~= "write" and event ~= "read" then return nil, string.format("Event %s occured while writing", tostring(event)), idx end
+function FIFO_MT:readline()
+    return read(self, "readline")
+end
+
+-- Wait until n bytes are pending, at least one by default, return them without consuming them
+function FIFO_MT:peek(n)
+    while self.queue:len() < (n or 1) do
+        local s, err = waitevent(self, "peeking")
+        if not s then return nil, err end
+    end
+    return self.queue:peek(n)
+end
+
+-- Wait until there is space in the fifo
+local function waitspace(self)
+    while self.queue:len() >= self.BUFFER_MAX_SIZE do
+        self.writers = self.writers + 1
+        local s, err = waitevent(self, "writing")
+        self.writers = self.writers - 1
+        if not s then return nil, err end
     end
+    return true
+end
 
+function FIFO_MT:write(buffer)
+    local s, err = waitspace(self)
+    if not s then return nil, err, 0 end
+    self.queue:push(buffer)
+    sched.signal(self, "write")
     return #buffer
 end
 
+-- Write the concatenation of a list of strings and bytebuffers, skipping its first `skip` bytes
+function FIFO_MT:writev(t, skip)
+    skip = skip or 0
+    local s, err = waitspace(self)
+    if not s then return nil, err, skip end
+    local size = 0
+    for _, b in ipairs(t) do
+        local len = #b
+        if skip < len then
+            self.queue:push(skip > 0 and b:sub(skip+1) or b)
+            skip = 0
+        else
+            skip = skip - len
+        end
+        size = size + len
+    end
+    sched.signal(self, "write")
+    return size
+end
+
 function FIFO_MT:close()
     sched.signal(self, "close")
     return true
@@ -94,21 +148,40 @@ function M.new()
     return a, b
 end
 
---TODO could implement the "standard" masks for receiveing data (line, all it can, etc)
-function IPC_MT:receive(n)
+-- Receive a number of bytes, or a line with the "*l" pattern (the default), as luasocket does
+function IPC_MT:receive(pattern)
     if not self.fifo then return nil, "ipc closed locally" end
-    return self.fifo:read(n)
+    if not pattern or pattern == "*l" then return self.fifo:readline() end
+    return self.fifo:read(pattern)
+end
+-- Append `n` bytes, or whatever is pending when `n` is nil, to a bytebuffer, as luasocket does
+function IPC_MT:receive_into(buffer, n)
+    if not self.fifo then return nil, "ipc closed locally", 0 end
+    local count, err, partial = self.fifo:readinto(buffer, n)
+    if not count then
+        buffer:append(partial)
+        return nil, err, #partial
+    end
+    return count
 end
 function IPC_MT:read(n)
     if not self.fifo then error("ipc closed locally") end
     return try(self.fifo:read(n))
 end
+function IPC_MT:peek(n)
+    if not self.fifo then return nil, "ipc closed locally" end
+    return self.fifo:peek(n)
+end
 
--- TODO could implement full luasocket API for sending
 function IPC_MT:send(buffer)
     if not self.peer.fifo then return nil, "ipc closed remotely" end
     return self.peer.fifo:write(buffer)
 end
+-- Send the concatenation of a list of strings, each one queued without copy
+function IPC_MT:sendv(t, i)
+    if not self.peer.fifo then return nil, "ipc closed remotely" end
+    return self.peer.fifo:writev(t, i)
+end
 function IPC_MT:write(buffer)
     if not self.peer.fifo then error("ipc closed locally") end
     return try(self.peer.fifo:write(buffer))
@@ -0,0 +1,229 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* Byte queues for the `racon.ipc` in-process pipes.
+ *
+ * A queue is a list of chunks: the strings pushed to it, kept in the
+ * environment table of the queue userdata, from index `head` to `tail - 1`.
+ * Pushed strings are not copied, and a read which matches exactly the first
+ * chunk returns that string itself; other reads copy the bytes read into a
+ * new string, once. Reads never block: they return nil when not enough
+ * bytes are queued. */
+
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "bytebuffer.h"
+
+#define QUEUE_CLASS "racon.ipc.queue"
+
+typedef struct {
+  int head, tail; /* environment indexes of the first chunk and after the last one */
+  size_t offset;  /* bytes already read in the first chunk */
+  size_t len;     /* bytes queued */
+} queue_t;
+
+/* Checks that the first argument is a queue, pushes its environment at
+ * index ENV: the functions below take no optional arguments. */
+#define ENV 3
+static queue_t *checkqueue( lua_State *L) {
+  queue_t *q = (queue_t *) luaL_checkudata( L, 1, QUEUE_CLASS);
+  lua_settop( L, ENV - 1);
+  lua_getfenv( L, 1);
+  return q;
+}
+
+/* Returns chunk i of the queue. The chunk remains valid as long as it is
+ * in the queue. */
+static const char *getchunk( lua_State *L, int i, size_t *len) {
+  const char *data;
+  lua_rawgeti( L, ENV, i);
+  data = lua_tolstring( L, -1, len);
+  lua_pop( L, 1);
+  return data;
+}
+
+/* Drops the first n queued bytes. */
+static void consume( lua_State *L, queue_t *q, size_t n) {
+  size_t len;
+  q->len -= n;
+  while( n > 0) {
+    getchunk( L, q->head, &len);
+    len -= q->offset;
+    if( n < len) { q->offset += n; return; }
+    n -= len;
+    lua_pushnil( L);
+    lua_rawseti( L, ENV, q->head++);
+    q->offset = 0;
+  }
+  if( q->head == q->tail) q->head = q->tail = 1; /* keep indexes small */
+}
+
+/* Pushes a string of the first n queued bytes, n <= q->len. */
+static void pushbytes( lua_State *L, queue_t *q, size_t n) {
+  luaL_Buffer b;
+  const char *data;
+  size_t len, c, offset = q->offset;
+  int i = q->head;
+
+  if( 0 == n) { lua_pushliteral( L, ""); return; }
+  if( 0 == offset) {
+    getchunk( L, i, &len);
+    if( len == n) { lua_rawgeti( L, ENV, i); return; } /* the chunk itself */
+  }
+  luaL_buffinit( L, &b);
+  for( ; n > 0; i++, offset = 0) {
+    data = getchunk( L, i, &len);
+    c = len - offset < n ? len - offset : n;
+    luaL_addlstring( &b, data + offset, c);
+    n -= c;
+  }
+  luaL_pushresult( &b);
+}
+
+/* queue:push(data): queues a string, or a copy of a bytebuffer, returns
+ * the number of bytes queued. */
+static int l_push( lua_State *L) {
+  queue_t *q = checkqueue( L);
+  size_t len;
+  const char *data = bytebuffer_checklstring( L, 2, &len);
+  if( len > 0) {
+    if( LUA_TSTRING == lua_type( L, 2)) lua_pushvalue( L, 2);
+    else lua_pushlstring( L, data, len);
+    lua_rawseti( L, ENV, q->tail++);
+    q->len += len;
+  }
+  lua_pushnumber( L, q->len);
+  return 1;
+}
+
+/* queue:read(n): returns the first n queued bytes, nil if less are queued. */
+static int l_read( lua_State *L) {
+  queue_t *q = checkqueue( L);
+  lua_Number n = luaL_checknumber( L, 2);
+  luaL_argcheck( L, n >= 0, 2, "invalid size");
+  if( n > q->len) { lua_pushnil( L); return 1; }
+  pushbytes( L, q, (size_t) n);
+  consume( L, q, (size_t) n);
+  return 1;
+}
+
+/* queue:readinto(buffer [, n]): appends the first n queued bytes, all of them
+ * without n, to a bytebuffer, returns the number of bytes appended, nil if
+ * less than n or, without n, no bytes are queued. */
+static int l_readinto( lua_State *L) {
+  lua_Number n = luaL_optnumber( L, 3, -1); /* read before checkqueue drops it */
+  p_bytebuffer bb = bytebuffer_check( L, 2);
+  queue_t *q = checkqueue( L);
+  size_t len, c, count, offset = q->offset;
+  const char *data;
+  char *tail;
+  int i = q->head;
+
+  if( n < 0) n = q->len ? q->len : 1;
+  if( n > q->len) { lua_pushnil( L); return 1; }
+  count = (size_t) n;
+  tail = bytebuffer_reserve( L, bb, count);
+  for( c = count; c > 0; i++, offset = 0) {
+    data = getchunk( L, i, &len);
+    len = len - offset < c ? len - offset : c;
+    memcpy( tail, data + offset, len);
+    tail += len;
+    c -= len;
+  }
+  bb->last += count;
+  consume( L, q, count);
+  lua_pushnumber( L, count);
+  return 1;
+}
+
+/* queue:readline(): returns the first queued line, without its LF and CR
+ * characters as luasocket does, nil if no complete line is queued. */
+static int l_readline( lua_State *L) {
+  queue_t *q = checkqueue( L);
+  luaL_Buffer b;
+  const char *data, *lf = NULL;
+  size_t len, n = 0, offset = q->offset, c;
+  int i;
+
+  for( i = q->head; i < q->tail && ! lf; i++, offset = 0) {
+    data = getchunk( L, i, &len);
+    lf = memchr( data + offset, '\n', len - offset);
+    n += lf ? (size_t)(lf - data - offset) : len - offset;
+  }
+  if( ! lf) { lua_pushnil( L); return 1; }
+
+  luaL_buffinit( L, &b);
+  for( i = q->head, offset = q->offset, c = n; c > 0; i++, offset = 0) {
+    size_t k;
+    data = getchunk( L, i, &len);
+    for( k = offset; k < len && c > 0; k++, c--)
+      if( '\r' != data[k]) luaL_addchar( &b, data[k]);
+  }
+  luaL_pushresult( &b);
+  consume( L, q, n + 1);
+  return 1;
+}
+
+/* queue:peek([n]): returns the first n queued bytes, or less if less are
+ * queued, all the queued bytes without n, without consuming them. */
+static int l_peek( lua_State *L) {
+  queue_t *q = checkqueue( L);
+  lua_Number n = luaL_optnumber( L, 2, q->len);
+  luaL_argcheck( L, n >= 0, 2, "invalid size");
+  pushbytes( L, q, n < q->len ? (size_t) n : q->len);
+  return 1;
+}
+
+/* queue:len(): returns the number of bytes queued. */
+static int l_len( lua_State *L) {
+  queue_t *q = (queue_t *) luaL_checkudata( L, 1, QUEUE_CLASS);
+  lua_pushnumber( L, q->len);
+  return 1;
+}
+
+/* queue(): returns a new empty queue. */
+static int l_queue( lua_State *L) {
+  queue_t *q = (queue_t *) lua_newuserdata( L, sizeof( *q));
+  q->head = q->tail = 1;
+  q->offset = q->len = 0;
+  luaL_getmetatable( L, QUEUE_CLASS);
+  lua_setmetatable( L, -2);
+  lua_newtable( L);
+  lua_setfenv( L, -2);
+  return 1;
+}
+
+static const luaL_Reg queue_methods[] = {
+  { "len",      l_len },
+  { "peek",     l_peek },
+  { "push",     l_push },
+  { "read",     l_read },
+  { "readinto", l_readinto },
+  { "readline", l_readline },
+  { NULL, NULL } };
+
+static const luaL_Reg R[] = {
+  { "queue", l_queue },
+  { NULL, NULL } };
+
+int luaopen_racon_ipc_core( lua_State *L) {
+  luaL_newmetatable( L, QUEUE_CLASS);
+  lua_pushvalue( L, -1);
+  lua_setfield( L, -2, "__index");
+  lua_pushcfunction( L, l_len);
+  lua_setfield( L, -2, "__len");
+  luaL_register( L, NULL, queue_methods);
+  lua_pop( L, 1);
+  luaL_register( L, "racon.ipc.core", R);
+  return 1;
+}
@@ -0,0 +1,65 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Throughput benchmark of the in-process EMP pipe (racon.ipc): a task sends
+-- EMP like messages, an 8 bytes header followed by a payload of 1 KB to
+-- 1 MB, which another task receives the way the EMP parser does. Payloads
+-- of 4 KB or more are sent with `sendv`, as the EMP parser does.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/ipc_perf.lua [MB sent per message size]
+
+require 'strict'
+require 'sched'
+rawset(_G, 'log', require 'log')
+require 'pack'
+local ipc  = require 'racon.ipc'
+local time = require 'sched.timer.core'.time
+
+local VOLUME = (tonumber(arg[1]) or 32) * 2^20
+local function printf(...) print(string.format(...)) end
+
+local function bench(size)
+    local a, b = ipc.new()
+    local count = math.max(4, math.floor(VOLUME / size))
+    local payload = string.rep("x", size)
+    local done = { }
+    local start = time()
+    sched.run(function()
+        for i = 1, count do
+            local header = string.pack(">HbbI", 1, 0, i % 256, size)
+            if size >= 4096 and a.sendv then assert(a:sendv{ header, payload })
+            else assert(a:send(header..payload)) end
+        end
+    end)
+    sched.run(function()
+        for i = 1, count do
+            local _, _, _, _, n = assert(b:receive(8)) :unpack ">HbbI"
+            assert(#assert(b:receive(n)) == size)
+        end
+        sched.signal(done, 'done')
+    end)
+    sched.wait(done, 'done')
+    local elapsed = time() - start
+    a:close()
+    return count, elapsed
+end
+
+sched.run(function()
+    printf("%10s %8s %10s %12s", "payload", "msgs", "msgs/s", "MB/s")
+    for _, size in ipairs{ 2^10, 2^12, 2^14, 2^16, 2^18, 2^20 } do
+        local count, elapsed = bench(size)
+        printf("%8dKB %8d %10.0f %12.1f", size / 2^10, count, count / elapsed, count * size / elapsed / 2^20)
+    end
+    os.exit(0)
+end)
+sched.loop()
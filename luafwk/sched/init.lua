@@ -497,9 +497,41 @@ __tasks.waiting = setmetatable({ }, {__mode='k'})
 ------------------------------------------------------------------------------
 __tasks.running = nil
 
+------------------------------------------------------------------------------
+--  Hooks of the profiler while it is started, see @{sched.profiler};
+--  `nil` otherwise.
+------------------------------------------------------------------------------
+__tasks.profiler = nil
+
 local getinfo=debug.getinfo
 local function iscfunction(f) return getinfo(f).what=='C' end
 
+--
+-- Memory accounting: when the VM runs on the pooled allocator (see module
+-- `memory`), the allocations performed by a task are accounted to the source
+-- file of the function it was created from, and emergency collections
+-- requested by the allocator are performed between steps.
+-- Both are disabled (nil) on a regular Lua VM.
+--
+local memowner, memcheck, taskowner
+do
+    local ok, memory = pcall(require, 'memory')
+    if ok and memory.enabled() then
+        memowner, memcheck = memory.setowner, memory.check
+        local ids = { } -- source -> owner id
+        function taskowner(f)
+            local src = getinfo(f, 'S').source
+            local id = ids[src]
+            if not id then
+                local name = src :gsub("^[@=]", "") :gsub("^.-lua/", "") :gsub("%.lua$", "")
+                id = memory.owner(name); ids[src] = id
+            end
+            return id
+        end
+        __tasks.owners = setmetatable({ }, {__mode='k'})
+    end
+end
+
 ------------------------------------------------------------------------------
 -- Runs a function as a new thread.
 --
@@ -521,6 +553,9 @@ function sched.run (f, ...)
     local thread = coroutine.create (f)
     local cell   = { thread, ... }
     table.insert (ready, cell)
+    if memowner then __tasks.owners[thread] = taskowner(f) end
+    local profiler = __tasks.profiler
+    if profiler then profiler.run(thread, f) end
     log.trace('SCHED', 'DEBUG', "SCHEDULE %s", tostring (thread))
 
     return thread
@@ -552,7 +587,11 @@ function sched.step()
         local thread = cell[1]
         __tasks.running = thread
         log.trace('SCHED', 'DEBUG', "STEP %s", tostring (thread))
+        if memowner then memowner(__tasks.owners[thread] or 0) end
+        local profiler = __tasks.profiler
+        local t0 = profiler and profiler.enter(thread)
         local success, msg = coroutine.resume (unpack (cell))
+        if profiler then profiler.leave(thread, t0) end
         if not success and msg ~= KILL_TOKEN then
             -- report the error msg
             print ("In " .. tostring(thread)..": error: " .. tostring(msg))
@@ -568,6 +607,7 @@ function sched.step()
     end
 
     __tasks.running = nil
+    if memowner then memowner(0); memcheck() end
 
     -- IMPROVE: a better test for idleness is required: maybe there are
     -- TCP data coming at a fast pace, for instance. Putting the cleanup
@@ -614,7 +654,10 @@ local function runcell(c, emitter, event, args, wokenup_tasks, new_queue)
 
     elseif c.hook then -- callback is run synchronously
         local function f() return c.hook(unpack(args, 1, nargs)) end
+        local profiler, hook = __tasks.profiler, c.hook
+        local t0 = profiler and profiler.enter()
         local ok, errmsg = xpcall(f, debug.traceback)
+        if profiler then profiler.hook(hook, t0) end
         local reattach_hook = not c.once
         if ok then -- pass
         elseif errmsg == KILL_TOKEN then -- killed with killself()
@@ -656,6 +699,8 @@ end
 function sched.signal (emitter, event, ...)
     checks('!', '!') -- TODO should we accept non-string events?
     log.trace('SCHED', 'DEBUG', "SIGNAL %s.%s", tostring(emitter), event)
+    local profiler = __tasks.profiler
+    if profiler then profiler.signal(emitter, event) end
     local args  = table.pack(event, ...) -- args passed to hooks & rescheduled tasks
     local ptw   = __tasks.waiting
     local ptr   = __tasks.running
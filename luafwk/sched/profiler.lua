@@ -0,0 +1,227 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+--------------------------------------------------------------------------------
+-- Scheduler profiler: finds out which tasks and hooks burn the CPU.
+--
+-- While started, the profiler accounts:
+--
+-- * for each task and signal hook, the CPU time it used, the number of
+--   times it ran, and its longest run. Tasks and hooks are named after the
+--   function they run, as `"<source>:<line>"`. A hook's time is also
+--   included in the time of the task which emitted the signal;
+-- * for each signal emitter and event, the number of signals. Emitters
+--   which are not strings are named after their type, or after their task
+--   name for tasks;
+-- * optionally, samples of the Lua stacks, taken every `sampling` VM
+--   instructions by a count hook, which @{#folded} returns in the folded
+--   format of flame graph tools.
+--
+-- When it is stopped, the scheduler only checks that it is not started.
+--
+--     local profiler = require 'sched.profiler'
+--     profiler.start(1000)
+--     sched.wait(60)
+--     print(profiler.report(10))
+--     io.open("/tmp/agent.folded", "w") :write(profiler.folded())
+--
+-- @module sched.profiler
+--------------------------------------------------------------------------------
+
+local core = require 'sched.profiler.core'
+require 'sched'
+
+local M = { }
+
+local clock, attach, getinfo = core.clock, core.attach, debug.getinfo
+
+-- Task names, by thread, and function names, by function.
+local names = setmetatable({ }, { __mode='k' })
+
+-- name -> { time, runs, maxrun } for tasks and hooks; emitter -> event -> count.
+local tasks, hooks, signals
+
+local function funcname(f, level)
+    local info = level and getinfo(f, level, 'S') or getinfo(f, 'S')
+    return info.source :gsub("^[@=]", "") :gsub("^.-lua/", "") :gsub("%.lua$", "") ..
+        ":" .. info.linedefined
+end
+
+-- Returns the name of a task, after its function: the deepest frame of
+-- the thread once it has run.
+local function taskname(thread)
+    local name = names[thread]
+    if name then return name end
+    local level = 0
+    while getinfo(thread, level + 1, 'S') do level = level + 1 end
+    if getinfo(thread, level, 'S') then name = funcname(thread, level); names[thread] = name end
+    return name or "?"
+end
+
+local function account(stats, name, t)
+    local s = stats[name]
+    if not s then s = { time=0, runs=0, maxrun=0 }; stats[name] = s end
+    s.time, s.runs = s.time + t, s.runs + 1
+    if t > s.maxrun then s.maxrun = t end
+end
+
+-- Hooks called by the scheduler while the profiler is started.
+local profiler = { }
+
+function profiler.run(thread, f)
+    names[thread] = funcname(f)
+end
+
+function profiler.enter(thread)
+    attach(thread)
+    return clock()
+end
+
+function profiler.leave(thread, t0)
+    account(tasks, taskname(thread), clock() - t0)
+end
+
+function profiler.hook(f, t0)
+    local name = names[f]
+    if not name then name = funcname(f); names[f] = name end
+    account(hooks, name, clock() - t0)
+end
+
+function profiler.signal(emitter, event)
+    local te = type(emitter)
+    if te == 'thread' then emitter = "task " .. taskname(emitter)
+    elseif te ~= 'string' then emitter = "<" .. te .. ">" end
+    local s = signals[emitter]
+    if not s then s = { }; signals[emitter] = s end
+    event = tostring(event)
+    s[event] = (s[event] or 0) + 1
+end
+
+--------------------------------------------------------------------------------
+-- Starts profiling, or changes the sampling period if already started.
+--
+-- @param sampling number of VM instructions between two stack samples;
+--  if `nil` or 0, stacks are not sampled.
+-- @return `true`.
+--------------------------------------------------------------------------------
+function M.start(sampling)
+    checks('?number')
+    if not tasks then M.reset() end
+    core.setperiod(sampling or 0)
+    __tasks.profiler = profiler
+    return true
+end
+
+--------------------------------------------------------------------------------
+-- Stops profiling; the statistics are kept until @{#reset} is called.
+--
+-- @return `true`.
+--------------------------------------------------------------------------------
+function M.stop()
+    __tasks.profiler = nil
+    core.setperiod(0)
+    return true
+end
+
+--------------------------------------------------------------------------------
+-- Drops the statistics and samples gathered so far.
+--
+-- @return `true`.
+--------------------------------------------------------------------------------
+function M.reset()
+    tasks, hooks, signals = { }, { }, { }
+    core.reset()
+    return true
+end
+
+--------------------------------------------------------------------------------
+-- Tells whether the profiler is started.
+--
+-- @return `true` if started, `false` otherwise, followed by the sampling
+--  period.
+--------------------------------------------------------------------------------
+function M.running()
+    return __tasks.profiler == profiler, core.getperiod()
+end
+
+local function sorted(stats)
+    local list = { }
+    for name, s in pairs(stats or { }) do
+        table.insert(list, { name=name, time=s.time, runs=s.runs, maxrun=s.maxrun })
+    end
+    table.sort(list, function(a, b) return a.time > b.time end)
+    return list
+end
+
+--------------------------------------------------------------------------------
+-- Returns the statistics gathered so far.
+--
+-- @return a table with fields:
+--
+-- * `tasks` and `hooks`: lists of `{ name, time, runs, maxrun }` records,
+--   sorted by decreasing CPU time, in seconds;
+-- * `signals`: list of `{ emitter, event, count }` records, sorted by
+--   decreasing count.
+--------------------------------------------------------------------------------
+function M.stats()
+    local s = { tasks = sorted(tasks), hooks = sorted(hooks), signals = { } }
+    for emitter, events in pairs(signals or { }) do
+        for event, count in pairs(events) do
+            table.insert(s.signals, { emitter=emitter, event=event, count=count })
+        end
+    end
+    table.sort(s.signals, function(a, b) return a.count > b.count end)
+    return s
+end
+
+--------------------------------------------------------------------------------
+-- Returns the stack samples in the folded format, one `"root;...;leaf count"`
+-- line per distinct stack, as expected by flame graph tools.
+--
+-- @return the folded stacks, as a string.
+--------------------------------------------------------------------------------
+function M.folded()
+    local lines = { }
+    for stack, count in pairs(core.samples()) do
+        table.insert(lines, stack .. " " .. count)
+    end
+    table.sort(lines)
+    table.insert(lines, "")
+    return table.concat(lines, "\n")
+end
+
+--------------------------------------------------------------------------------
+-- Returns a human readable report of the statistics.
+--
+-- @param n maximum number of tasks, hooks and signals listed, 10 by default.
+-- @return the report, as a string.
+--------------------------------------------------------------------------------
+function M.report(n)
+    checks('?number')
+    n = n or 10
+    local s, lines = M.stats(), { }
+    local function printf(...) table.insert(lines, string.format(...)) end
+    for _, kind in ipairs{ "tasks", "hooks" } do
+        printf("%-48s %10s %8s %10s", kind, "time (ms)", "runs", "max (ms)")
+        for i = 1, math.min(n, #s[kind]) do
+            local r = s[kind][i]
+            printf("%-48s %10.1f %8d %10.2f", r.name, r.time * 1e3, r.runs, r.maxrun * 1e3)
+        end
+    end
+    printf("%-48s %-20s %8s", "signals", "event", "count")
+    for i = 1, math.min(n, #s.signals) do
+        local r = s.signals[i]
+        printf("%-48s %-20s %8d", r.emitter, r.event, r.count)
+    end
+    return table.concat(lines, "\n")
+end
+
+return M
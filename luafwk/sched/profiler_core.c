@@ -0,0 +1,143 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* CPU clock and Lua stack sampling for the `sched.profiler` module.
+ *
+ * Samples are taken by a count hook, every `period` VM instructions, in each
+ * thread attached with attach(). The sampled stacks are folded into strings
+ * "root;...;leaf", whose number of occurrences are counted in a registry
+ * table. When sampling stops, hooks remove themselves on their next call. */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#define SAMPLES_REGISTRY "sched.profiler.samples"
+
+/* Deepest frames kept in a sample, the outer ones are dropped. */
+#define SAMPLE_DEPTH 32
+
+static int period = 0; /* instructions between two samples, 0 if not sampling */
+
+/* Appends `name@source:line` for a stack frame to the buffer. */
+static void addframe( luaL_Buffer *b, lua_Debug *ar) {
+  char line[16];
+  luaL_addstring( b, ar->name ? ar->name : strcmp( ar->what, "main") ? "?" : "main");
+  if( '=' == ar->source[0] && ! strcmp( ar->what, "C")) return; /* [C] */
+  luaL_addchar( b, '@');
+  luaL_addstring( b, ar->short_src);
+  if( ar->linedefined > 0) {
+    sprintf( line, ":%d", ar->linedefined);
+    luaL_addstring( b, line);
+  }
+}
+
+static void sample( lua_State *L, lua_Debug *ar) {
+  lua_Debug frame;
+  luaL_Buffer b;
+  int depth, level, count;
+  (void) ar;
+  if( 0 == period) { lua_sethook( L, NULL, 0, 0); return; }
+
+  for( depth = 0; depth < SAMPLE_DEPTH && lua_getstack( L, depth, &frame); depth++);
+  luaL_buffinit( L, &b);
+  for( level = depth - 1; level >= 0; level--) {
+    lua_getstack( L, level, &frame);
+    lua_getinfo( L, "Sn", &frame);
+    addframe( &b, &frame);
+    if( level) luaL_addchar( &b, ';');
+  }
+  luaL_pushresult( &b);                                 // stack
+  lua_getfield( L, LUA_REGISTRYINDEX, SAMPLES_REGISTRY); // stack, samples
+  if( lua_istable( L, -1)) {
+    lua_pushvalue( L, -2);                              // stack, samples, stack
+    lua_rawget( L, -2);                                 // stack, samples, count
+    count = lua_tointeger( L, -1);
+    lua_pop( L, 1);                                     // stack, samples
+    lua_pushvalue( L, -2);                              // stack, samples, stack
+    lua_pushinteger( L, count + 1);                     // stack, samples, stack, count+1
+    lua_rawset( L, -3);                                 // stack, samples
+  }
+  lua_pop( L, 2);
+}
+
+static void attach( lua_State *T) {
+  lua_Hook hook = lua_gethook( T);
+  if( period && (NULL == hook || sample == hook) && lua_gethookcount( T) != period)
+    lua_sethook( T, sample, LUA_MASKCOUNT, period);
+}
+
+/* clock(): returns the CPU time used by the calling thread, in seconds. */
+static int l_clock( lua_State *L) {
+  struct timespec tp;
+  if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &tp)) clock_gettime( CLOCK_MONOTONIC, &tp);
+  lua_pushnumber( L, tp.tv_sec + (double) tp.tv_nsec / 1e9);
+  return 1;
+}
+
+/* attach([thread]): samples the calling thread, and `thread` if given. */
+static int l_attach( lua_State *L) {
+  if( period) {
+    attach( L);
+    if( lua_isthread( L, 1)) attach( lua_tothread( L, 1));
+  }
+  return 0;
+}
+
+/* setperiod(n): samples attached threads every `n` instructions, 0 to stop. */
+static int l_setperiod( lua_State *L) {
+  int n = luaL_checkint( L, 1);
+  luaL_argcheck( L, n >= 0, 1, "invalid period");
+  period = n;
+  lua_getfield( L, LUA_REGISTRYINDEX, SAMPLES_REGISTRY);
+  if( ! lua_istable( L, -1)) {
+    lua_newtable( L);
+    lua_setfield( L, LUA_REGISTRYINDEX, SAMPLES_REGISTRY);
+  }
+  return 0;
+}
+
+/* getperiod(): returns the sampling period, 0 if not sampling. */
+static int l_getperiod( lua_State *L) {
+  lua_pushinteger( L, period);
+  return 1;
+}
+
+/* samples(): returns the table of sample counts, indexed by folded stacks. */
+static int l_samples( lua_State *L) {
+  lua_getfield( L, LUA_REGISTRYINDEX, SAMPLES_REGISTRY);
+  if( ! lua_istable( L, -1)) lua_newtable( L);
+  return 1;
+}
+
+/* reset(): drops the samples taken so far. */
+static int l_reset( lua_State *L) {
+  lua_newtable( L);
+  lua_setfield( L, LUA_REGISTRYINDEX, SAMPLES_REGISTRY);
+  return 0;
+}
+
+static const luaL_Reg R[] = {
+  { "attach",    l_attach },
+  { "clock",     l_clock },
+  { "getperiod", l_getperiod },
+  { "reset",     l_reset },
+  { "samples",   l_samples },
+  { "setperiod", l_setperiod },
+  { NULL, NULL } };
+
+int luaopen_sched_profiler_core( lua_State *L) {
+  luaL_register( L, "sched.profiler.core", R);
+  return 1;
+}
@@ -27,6 +27,7 @@ local table = table
 local pairs = pairs
 local next = next
 local type = type
+local ipairs = ipairs
 local _G=_G
 local time = require'sched.timer.core'.time
 
@@ -103,6 +104,48 @@ function removetimer(timer)
     return "ok"
 end
 
+-------------------------------------------------------------------------------------
+-- Offset between the wall clock and the monotonic clock, which changes when
+-- the wall clock is set.
+-------------------------------------------------------------------------------------
+local clockoffset = os.time() - time()
+
+-------------------------------------------------------------------------------------
+-- Reschedule the timers whose due dates follow the wall clock, which have a
+-- `wallclock` field, after the wall clock has been set: their due dates are
+-- all recomputed, then the list of dates is rebuilt once.
+-- This is called by step() when a change of the wall clock is detected, and
+-- can be called when the wall clock is known to be set.
+-------------------------------------------------------------------------------------
+function clockchanged()
+    clockoffset = os.time() - time()
+    local dates, kept, moved = {}, {}, {}
+    for i = 1, #events do
+        local d = events[i]
+        local entries = events[d]
+        -- the list may hold dates of removed timers, and duplicates
+        if entries and not kept[d] then
+            for timer, _ in pairs(entries) do
+                if timer.wallclock then entries[timer] = nil; table.insert(moved, timer) end
+            end
+            if next(entries) then kept[d] = true; table.insert(dates, d) else events[d] = nil end
+        end
+        events[i] = nil
+    end
+    for _, timer in ipairs(moved) do
+        timer.nd = nil
+        local nd = timer:nextevent()
+        timer.nd = nd
+        if nd then
+            if not events[nd] then events[nd] = { }; table.insert(dates, nd) end
+            events[nd][timer] = true
+        end
+    end
+    table.sort(dates)
+    for i, d in ipairs(dates) do events[i] = d end
+    if update_first_timer then update_first_timer() end
+end
+
 -------------------------------------------------------------------------------------
 -- Signal all elapsed timer events.
 -- This must be called by the scheduler every time a due date elapses.
@@ -111,6 +154,7 @@ function step()
     if not events[1] then return end -- if no timer is set just return and prevent further processing
 
     local now = time()
+    if math.abs(os.time() - now - clockoffset) > 2 then clockchanged() end
     while events[1] and now >= events[1] do
         local d = table.remove(events, 1)
         local entries = events[d]
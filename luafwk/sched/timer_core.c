@@ -13,6 +13,10 @@
 #include <time.h>
 #include <errno.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
 
 static int l_time(lua_State *L)
 {
@@ -30,14 +34,286 @@ static int l_time(lua_State *L)
     return 1;
 }
 
+/* Compiled cron entries.
+ *
+ * Each field of a cron entry is compiled into a bitset of the values it
+ * matches; the next date of an entry is found field by field, from the month
+ * to the minute, by looking up the next set bit of each bitset. Dates are
+ * computed in local time, through localtime_r and mktime, so that daylight
+ * saving time changes are accounted for: a date which does not exist, in the
+ * hour skipped in spring, is due one hour later as mktime normalizes it, and
+ * a date which exists twice, in the hour repeated in autumn, is due once. */
+
+#define CRON_CLASS "sched.timer.cron"
+
+#define CRON_ANYDAY  1 /* day of month field is "*" */
+#define CRON_ANYWDAY 2 /* day of week field is "*" */
+
+/* Years searched for a date before giving up, e.g. for "0 0 30 2 *"; 29th of
+ * February can be 8 years away. */
+#define CRON_MAXYEARS 9
+
+typedef struct
+{
+    uint64_t minutes; /* bits 0-59 */
+    uint64_t hours;   /* bits 0-23 */
+    uint64_t days;    /* days of month, bits 1-31 */
+    uint64_t months;  /* bits 1-12 */
+    uint64_t wdays;   /* days of week, bits 0-6, Sunday is 0 */
+    int flags;
+} cron_t;
+
+typedef struct
+{
+    int min, max;           /* accepted values */
+    int period;             /* number of distinct values, bounds steps */
+    const char *const *names; /* names of the values, starting at min */
+} cronfield_t;
+
+static const char *const monthnames[] =
+    { "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec", NULL };
+static const char *const wdaynames[] =
+    { "sun", "mon", "tue", "wed", "thu", "fri", "sat", NULL };
+
+static const cronfield_t cronfields[] =
+{
+    { 0, 59, 60, NULL },      /* minute */
+    { 0, 23, 24, NULL },      /* hour */
+    { 1, 31, 31, NULL },      /* day of month */
+    { 1, 12, 12, monthnames },
+    { 0, 7,  7,  wdaynames }  /* day of week, Sunday is 0 or 7 */
+};
+
+/* Returns the first set bit of mask from bit `from`, -1 if none. */
+static int nextbit(uint64_t mask, int from)
+{
+    if (from > 63) return -1;
+    mask &= ~(uint64_t) 0 << from;
+    if (!mask) return -1;
+#ifdef __GNUC__
+    return __builtin_ctzll(mask);
+#else
+    for (; !(mask & ((uint64_t) 1 << from)); from++);
+    return from;
+#endif
+}
+
+/* Parses a value of a field: a number or a name, returns -1 on error. */
+static int cronvalue(const cronfield_t *f, const char **s, const char *end)
+{
+    const char *p = *s;
+    int v = 0, i;
+    if (p < end && isdigit((unsigned char) *p))
+    {
+        for (; p < end && isdigit((unsigned char) *p) && v <= f->max; p++) v = 10 * v + *p - '0';
+        *s = p;
+        return v >= f->min && v <= f->max ? v : -1;
+    }
+    for (i = 0; f->names && f->names[i]; i++)
+    {
+        if (end - p >= 3 && !strncasecmp(p, f->names[i], 3))
+        {
+            *s = p + 3;
+            return f->min + i;
+        }
+    }
+    return -1;
+}
+
+/* Compiles the field [s, end) into a bitset. Fields are lists of items
+ * separated by commas; an item is "*", a value or a range of values
+ * "first-last", optionally followed by a step "/n". With a step, "*" matches
+ * the multiples of n, and a single value matches every n values from it. */
+static int cronfield(lua_State *L, const cronfield_t *f, const char *s, const char *end, uint64_t *bits)
+{
+    const char *field = s, *item, *error = "error in pattern %s";
+    int first, last, step, range, v;
+
+    *bits = 0;
+    while (s < end)
+    {
+        item = s;
+        step = range = 0;
+        if ('*' == *s)
+        {
+            first = f->min; last = f->max; range = 1; s++;
+        }
+        else
+        {
+            if ((first = cronvalue(f, &s, end)) < 0) goto error;
+            last = first;
+            if (s < end && '-' == *s)
+            {
+                s++; range = 1;
+                if ((last = cronvalue(f, &s, end)) < 0 || last < first)
+                {
+                    error = "error in range pattern: %s";
+                    goto error;
+                }
+            }
+        }
+        if (s < end && '/' == *s)
+        {
+            for (s++, step = 0; s < end && isdigit((unsigned char) *s) && step <= f->period; s++)
+                step = 10 * step + *s - '0';
+            if (step < 1) goto error;
+            if (step > f->period / 2)
+            {
+                error = "step too big in %s";
+                goto error;
+            }
+            if (!range) last = f->max;
+        }
+        if (s < end && ',' != *s++) goto error;
+        for (v = first; v <= last; v++)
+        {
+            if (step && ('*' == *item ? v % step : (v - first) % step)) continue;
+            *bits |= (uint64_t) 1 << v;
+        }
+    }
+    if (*bits) return 0;
+error:
+    lua_pushlstring(L, field, end - field);
+    return luaL_error(L, error, lua_tostring(L, -1));
+}
+
+/* Returns the bitset of the days of month `mon` in `year` (as in struct tm)
+ * matching the day of month and day of week fields: either of them when both
+ * are restricted, as cron does. */
+static uint64_t crondays(const cron_t *c, int year, int mon)
+{
+    static const int mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    static const int offsets[] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+    int y = year + 1900, ndays = mdays[mon], w1;
+    uint64_t wdays;
+
+    if (1 == mon && (0 == y % 4 && (0 != y % 100 || 0 == y % 400))) ndays++;
+    if (c->flags & CRON_ANYWDAY) return c->days & (((uint64_t) 2 << ndays) - 2);
+
+    /* week day of the 1st of the month, then days matching the week days */
+    if (mon < 2) y--;
+    w1 = (y + y / 4 - y / 100 + y / 400 + offsets[mon] + 1) % 7;
+    wdays = ((c->wdays >> w1) | (c->wdays << (7 - w1))) & 0x7f;
+    wdays |= wdays << 7 | wdays << 14 | wdays << 21 | wdays << 28;
+    wdays <<= 1;
+    if (!(c->flags & CRON_ANYDAY)) wdays |= c->days;
+    return wdays & (((uint64_t) 2 << ndays) - 2);
+}
+
+/* Computes the first date after `now` matching the entry. Returns 0 if none
+ * is found within CRON_MAXYEARS. */
+static time_t cronnext(const cron_t *c, time_t now)
+{
+    struct tm tm, r;
+    time_t t = now - now % 60 + 60;
+    int maxyear, v;
+
+    localtime_r(&t, &tm);
+    maxyear = tm.tm_year + CRON_MAXYEARS;
+    while (tm.tm_year <= maxyear)
+    {
+        if ((v = nextbit(c->months, tm.tm_mon + 1)) < 0)
+        {
+            tm.tm_year++; tm.tm_mon = 0; tm.tm_mday = 1; tm.tm_hour = tm.tm_min = 0;
+            continue;
+        }
+        if (v != tm.tm_mon + 1) { tm.tm_mon = v - 1; tm.tm_mday = 1; tm.tm_hour = tm.tm_min = 0; }
+        if ((v = nextbit(crondays(c, tm.tm_year, tm.tm_mon), tm.tm_mday)) < 0)
+        {
+            tm.tm_mon++; tm.tm_mday = 1; tm.tm_hour = tm.tm_min = 0;
+            continue;
+        }
+        if (v != tm.tm_mday) { tm.tm_mday = v; tm.tm_hour = tm.tm_min = 0; }
+        if ((v = nextbit(c->hours, tm.tm_hour)) < 0)
+        {
+            tm.tm_mday++; tm.tm_hour = tm.tm_min = 0;
+            continue;
+        }
+        if (v != tm.tm_hour) { tm.tm_hour = v; tm.tm_min = 0; }
+        if ((v = nextbit(c->minutes, tm.tm_min)) < 0)
+        {
+            tm.tm_hour++; tm.tm_min = 0;
+            continue;
+        }
+        tm.tm_min = v;
+
+        /* In the hour repeated when DST ends, mktime may choose the first
+         * occurrence of the date, which may be already past */
+        r = tm; r.tm_sec = 0; r.tm_isdst = -1;
+        t = mktime(&r);
+        if (t <= now) { r = tm; r.tm_sec = 0; r.tm_isdst = 0; t = mktime(&r); }
+        if (t > now) return t;
+        tm.tm_min++;
+    }
+    return 0;
+}
+
+/* cron(entry): compiles a cron entry, "minute hour day month weekday
+ * [jitter]". Returns the compiled entry and the jitter, if any. Raises an
+ * error if the entry is invalid. */
+static int l_cron(lua_State *L)
+{
+    size_t len;
+    const char *s = luaL_checklstring(L, 1, &len), *end = s + len, *e;
+    uint64_t *bits[5];
+    cron_t *c = (cron_t *) lua_newuserdata(L, sizeof(*c));
+    int i;
+
+    memset(c, 0, sizeof(*c));
+    bits[0] = &c->minutes; bits[1] = &c->hours; bits[2] = &c->days;
+    bits[3] = &c->months; bits[4] = &c->wdays;
+    for (i = 0; i < 5; i++)
+    {
+        while (s < end && isspace((unsigned char) *s)) s++;
+        for (e = s; e < end && !isspace((unsigned char) *e); e++);
+        if (e == s) return luaL_error(L, "error in entry syntax: %s", lua_tostring(L, 1));
+        cronfield(L, &cronfields[i], s, e, bits[i]);
+        if (1 == e - s && '*' == *s) c->flags |= 2 == i ? CRON_ANYDAY : 4 == i ? CRON_ANYWDAY : 0;
+        s = e;
+    }
+    if (c->wdays & (1 << 7)) c->wdays = (c->wdays | 1) & 0x7f;
+    luaL_getmetatable(L, CRON_CLASS);
+    lua_setmetatable(L, -2);
+
+    while (s < end && isspace((unsigned char) *s)) s++;
+    if (s == end) return 1;
+    i = isdigit((unsigned char) *s) ? strtol(s, (char **) &e, 10) : -1;
+    while (e < end && isspace((unsigned char) *e)) e++;
+    if (i < 0 || e != end) return luaL_error(L, "Invalid cron jitter");
+    lua_pushinteger(L, i);
+    return 2;
+}
+
+/* cron:nextdate(now): returns the first date after `now`, in os.time()
+ * format, matching the entry, nil if there is none. */
+static int l_cron_nextdate(lua_State *L)
+{
+    cron_t *c = (cron_t *) luaL_checkudata(L, 1, CRON_CLASS);
+    time_t t = cronnext(c, (time_t) luaL_checknumber(L, 2));
+    if (t) lua_pushnumber(L, t); else lua_pushnil(L);
+    return 1;
+}
+
+static const luaL_Reg cron_methods[] =
+{
+    { "nextdate", l_cron_nextdate },
+    { NULL, NULL }
+};
+
 static const luaL_Reg R[] =
 {
     { "time", l_time },
+    { "cron", l_cron },
     { NULL, NULL }
 };
 
 int luaopen_sched_timer_core(lua_State* L)
 {
+    luaL_newmetatable(L, CRON_CLASS);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_register(L, NULL, cron_methods);
+    lua_pop(L, 1);
     luaL_register(L, "timer.core", R);
     return 1;
 }
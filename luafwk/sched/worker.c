@@ -0,0 +1,287 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "worker.h"
+
+/* Niceness of the worker threads relative to the scheduler thread, so that
+ * the scheduler keeps its latency when they compete for a CPU. */
+#define WORKER_NICENESS 10
+
+/* Registry table which anchors the submitted jobs, indexed by address. */
+#define JOBS_REGISTRY "sched.worker.jobs"
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER; /* a job has been queued */
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;   /* a job is done */
+static worker_job_t *queue_first, *queue_last; /* jobs waiting for a thread */
+static worker_job_t *done_first, *done_last;   /* jobs done, not collected */
+static int nthreads = 0;   /* number of threads to start, 0 for default */
+static int started = 0;    /* number of threads started */
+static int efd = -1;
+
+static void *worker_main( void *arg) {
+  uint64_t one = 1;
+  (void) arg;
+  /* On Linux, the niceness is a per thread attribute. */
+  setpriority( PRIO_PROCESS, syscall( SYS_gettid),
+      getpriority( PRIO_PROCESS, 0) + WORKER_NICENESS);
+  for( ;;) {
+    worker_job_t *job;
+    pthread_mutex_lock( &mutex);
+    while( NULL == queue_first) pthread_cond_wait( &queued, &mutex);
+    job = queue_first;
+    queue_first = job->next;
+    if( NULL == queue_first) queue_last = NULL;
+    job->state = WORKER_RUNNING;
+    pthread_mutex_unlock( &mutex);
+
+    job->run( job);
+
+    pthread_mutex_lock( &mutex);
+    job->state = WORKER_DONE;
+    job->next = NULL;
+    if( done_last) done_last->next = job; else done_first = job;
+    done_last = job;
+    pthread_cond_broadcast( &done);
+    pthread_mutex_unlock( &mutex);
+    while( write( efd, &one, sizeof( one)) < 0 && EINTR == errno);
+  }
+  return NULL;
+}
+
+static int openfd( void) {
+  if( efd < 0) efd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC);
+  return efd;
+}
+
+/* Starts the worker threads if needed. Returns NULL on success, or an error
+ * message. Signals are blocked in the worker threads, so that they are
+ * delivered to the scheduler thread. */
+static const char *start( void) {
+  sigset_t all, saved;
+  const char *error = NULL;
+  if( started) return NULL;
+  if( openfd() < 0) return strerror( errno);
+  if( 0 == nthreads) {
+    long n = sysconf( _SC_NPROCESSORS_ONLN);
+    nthreads = n < 1 ? 1 : n > WORKER_MAX_THREADS ? WORKER_MAX_THREADS : n;
+  }
+  sigfillset( &all);
+  pthread_sigmask( SIG_SETMASK, &all, &saved);
+  while( started < nthreads) {
+    pthread_t thread;
+    int r = pthread_create( &thread, NULL, worker_main, NULL);
+    if( r) { error = strerror( r); break; }
+    pthread_detach( thread);
+    started++;
+  }
+  pthread_sigmask( SIG_SETMASK, &saved, NULL);
+  return started ? NULL : error;
+}
+
+worker_state_t worker_state( worker_job_t *job) {
+  worker_state_t state;
+  pthread_mutex_lock( &mutex);
+  state = job->state;
+  pthread_mutex_unlock( &mutex);
+  return state;
+}
+
+int worker_busy( worker_job_t *job) {
+  worker_state_t state;
+  if( ! job) return 0;
+  state = worker_state( job);
+  return WORKER_QUEUED == state || WORKER_RUNNING == state;
+}
+
+worker_job_t *worker_checkjob( lua_State *L, int idx) {
+  return (worker_job_t *) luaL_checkudata( L, idx, WORKER_JOB_MT);
+}
+
+int worker_getfd( void) {
+  int fd;
+  pthread_mutex_lock( &mutex);
+  fd = openfd();
+  pthread_mutex_unlock( &mutex);
+  return fd;
+}
+
+int worker_setthreads( int n) {
+  int r = -1;
+  pthread_mutex_lock( &mutex);
+  if( ! started && n > 0) { nthreads = n; r = 0; }
+  pthread_mutex_unlock( &mutex);
+  return r;
+}
+
+static void wait_done( worker_job_t *job) {
+  pthread_mutex_lock( &mutex);
+  while( WORKER_QUEUED == job->state || WORKER_RUNNING == job->state)
+    pthread_cond_wait( &done, &mutex);
+  pthread_mutex_unlock( &mutex);
+}
+
+/* Collects a single job whose results are retrieved without waiting for
+ * worker_collect(): removes it from the done list, and releases its registry
+ * anchor. The eventfd is reset when no other job is left in the list. */
+static void collect_job( lua_State *L, worker_job_t *job) {
+  worker_job_t *prev = NULL, *j;
+  uint64_t count;
+  pthread_mutex_lock( &mutex);
+  if( WORKER_DONE != job->state) {
+    pthread_mutex_unlock( &mutex);
+    return;
+  }
+  for( j = done_first; j != job; prev = j, j = j->next);
+  if( prev) prev->next = job->next; else done_first = job->next;
+  if( done_last == job) done_last = prev;
+  job->state = WORKER_COLLECTED;
+  if( NULL == done_first && efd >= 0) while( read( efd, &count, sizeof( count)) < 0 && EINTR == errno);
+  pthread_mutex_unlock( &mutex);
+
+  luaL_findtable( L, LUA_REGISTRYINDEX, JOBS_REGISTRY, 0); // jobs
+  lua_pushlightuserdata( L, job); // jobs, ptr
+  lua_pushnil( L);                // jobs, ptr, nil
+  lua_rawset( L, -3);             // jobs
+  lua_pop( L, 1);
+}
+
+void worker_wait( lua_State *L, int idx) {
+  worker_job_t *job = worker_checkjob( L, idx);
+  wait_done( job);
+  collect_job( L, job);
+}
+
+int worker_submit( lua_State *L, int idx) {
+  worker_job_t *job = worker_checkjob( L, idx);
+  const char *error;
+  if( idx < 0) idx = lua_gettop( L) + idx + 1;
+  if( WORKER_NEW != job->state) {
+    lua_pushnil( L);
+    lua_pushstring( L, "job already submitted");
+    return 2;
+  }
+  pthread_mutex_lock( &mutex);
+  error = start();
+  pthread_mutex_unlock( &mutex);
+  if( error) {
+    lua_pushnil( L);
+    lua_pushfstring( L, "cannot start worker threads: %s", error);
+    return 2;
+  }
+
+  luaL_findtable( L, LUA_REGISTRYINDEX, JOBS_REGISTRY, 0); // jobs
+  lua_pushlightuserdata( L, job); // jobs, ptr
+  lua_pushvalue( L, idx);         // jobs, ptr, job
+  lua_rawset( L, -3);             // jobs
+  lua_pop( L, 1);
+
+  pthread_mutex_lock( &mutex);
+  job->state = WORKER_QUEUED;
+  job->next = NULL;
+  if( queue_last) queue_last->next = job; else queue_first = job;
+  queue_last = job;
+  pthread_cond_signal( &queued);
+  pthread_mutex_unlock( &mutex);
+
+  lua_pushvalue( L, idx);
+  return 1;
+}
+
+int worker_collect( lua_State *L) {
+  worker_job_t *job, *j;
+  uint64_t count;
+  int n = 0;
+
+  pthread_mutex_lock( &mutex);
+  job = done_first;
+  done_first = done_last = NULL;
+  for( j = job; j; j = j->next) j->state = WORKER_COLLECTED;
+  if( efd >= 0) while( read( efd, &count, sizeof( count)) < 0 && EINTR == errno);
+  pthread_mutex_unlock( &mutex);
+
+  lua_newtable( L);                                         // list
+  luaL_findtable( L, LUA_REGISTRYINDEX, JOBS_REGISTRY, 0); // list, jobs
+  for( ; job; job = job->next) {
+    lua_pushlightuserdata( L, job); // list, jobs, ptr
+    lua_rawget( L, -2);             // list, jobs, job
+    lua_rawseti( L, -3, ++n);       // list, jobs
+    lua_pushlightuserdata( L, job); // list, jobs, ptr
+    lua_pushnil( L);                // list, jobs, ptr, nil
+    lua_rawset( L, -3);             // list, jobs
+  }
+  lua_pop( L, 1);                   // list
+  return n;
+}
+
+/* job :result(): returns the job's results, or nil and an error message if
+ * the job is not done yet. */
+static int job_result( lua_State *L) {
+  worker_job_t *job = worker_checkjob( L, 1);
+  worker_state_t state = worker_state( job);
+  if( WORKER_DONE != state && WORKER_COLLECTED != state) {
+    lua_pushnil( L);
+    lua_pushstring( L, "job not done");
+    return 2;
+  }
+  collect_job( L, job);
+  return job->finish( L, job);
+}
+
+/* job :state(): returns "new", "queued", "running" or "done". */
+static int job_state( lua_State *L) {
+  static const char *const names[] = { "new", "queued", "running", "done", "done" };
+  lua_pushstring( L, names[worker_state( worker_checkjob( L, 1))]);
+  return 1;
+}
+
+/* Jobs are anchored while they are queued or running, so they can only be
+ * collected in that state when the Lua state is closed: wait for them. */
+static int job_gc( lua_State *L) {
+  worker_job_t *job = worker_checkjob( L, 1);
+  wait_done( job);
+  if( job->release) job->release( job);
+  return 0;
+}
+
+worker_job_t *worker_newjob( lua_State *L, size_t size,
+    void (*run)( worker_job_t *),
+    int (*finish)( lua_State *, worker_job_t *),
+    void (*release)( worker_job_t *)) {
+  worker_job_t *job = (worker_job_t *) lua_newuserdata( L, size); // job
+  memset( job, 0, size);
+  job->run = run;
+  job->finish = finish;
+  job->release = release;
+  job->state = WORKER_NEW;
+  if( luaL_newmetatable( L, WORKER_JOB_MT)) {                     // job, mt
+    lua_newtable( L);                                             // job, mt, methods
+    lua_pushcfunction( L, job_result); lua_setfield( L, -2, "result");
+    lua_pushcfunction( L, job_state);  lua_setfield( L, -2, "state");
+    lua_setfield( L, -2, "__index");                              // job, mt
+    lua_pushcfunction( L, job_gc); lua_setfield( L, -2, "__gc");
+  }
+  lua_setmetatable( L, -2); // job
+  lua_newtable( L);         // job, env
+  lua_setfenv( L, -2);      // job
+  return job;
+}
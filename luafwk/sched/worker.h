@@ -0,0 +1,102 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* Worker threads pool.
+ *
+ * Long CPU or I/O bound operations (serialization, ciphering, hashing of
+ * files...) can be run by worker threads, so that they don't freeze the
+ * scheduler. Lua code keeps running in the scheduler thread only: a job
+ * must be self-contained, i.e. its run() function must neither call the
+ * Lua API nor touch data which Lua code may access before the job is done.
+ *
+ * A job is a userdata which starts with a worker_job_t. C modules create
+ * them with worker_newjob(), with the Lua values the job uses in the
+ * userdata's environment, then submit them with worker_submit(). Jobs are
+ * anchored in the registry until they are done, so neither them nor the
+ * values they use can be collected while they run.
+ *
+ * When a job is done, the eventfd returned by worker_getfd() becomes
+ * readable; the `sched.worker` Lua module then signals the job with event
+ * "done", and the job's results are retrieved with `job :result()`, which
+ * calls its finish() function in the scheduler thread.
+ */
+
+#ifndef __WORKER_H_INCLUDED__
+#define __WORKER_H_INCLUDED__
+
+#include "lua.h"
+
+/* Name of the jobs metatable in the registry. */
+#define WORKER_JOB_MT "sched.worker.job"
+
+typedef enum worker_state_t {
+  WORKER_NEW,     /* created, not submitted yet */
+  WORKER_QUEUED,  /* waiting for a worker thread */
+  WORKER_RUNNING, /* being run by a worker thread */
+  WORKER_DONE,    /* run, not collected by the scheduler thread yet */
+  WORKER_COLLECTED
+} worker_state_t;
+
+typedef struct worker_job_t {
+  /* Run in a worker thread: must not call the Lua API. */
+  void (*run)( struct worker_job_t *job);
+  /* Run in the scheduler thread by `job :result()`: pushes the results
+   * and returns their number. */
+  int (*finish)( lua_State *L, struct worker_job_t *job);
+  /* Run when the job is collected, optional: frees the job's resources. */
+  void (*release)( struct worker_job_t *job);
+  worker_state_t state;
+  struct worker_job_t *next;
+} worker_job_t;
+
+/* Pushes a new job userdata of `size` bytes, which start with a
+ * worker_job_t, and returns it. Its environment is a new empty table. */
+worker_job_t *worker_newjob( lua_State *L, size_t size,
+    void (*run)( worker_job_t *),
+    int (*finish)( lua_State *, worker_job_t *),
+    void (*release)( worker_job_t *));
+
+/* Checks that a job is at index `idx` of the Lua stack and returns it. */
+worker_job_t *worker_checkjob( lua_State *L, int idx);
+
+/* Submits the job at index `idx` to the worker threads, which are started
+ * on first use. Returns 1 with the job on top of the stack, or 2 with nil
+ * and an error message. */
+int worker_submit( lua_State *L, int idx);
+
+/* Returns the eventfd which is readable when some jobs are done, -1 on
+ * error. */
+int worker_getfd( void);
+
+/* Pushes a single value, the list of the jobs done since the last call, and
+ * releases their registry anchor. Returns the length of that list, not a
+ * number of pushed values. */
+int worker_collect( lua_State *L);
+
+/* Blocks until the job at index `idx` is done, and releases its registry
+ * anchor, so that the job does not wait for worker_collect(). */
+void worker_wait( lua_State *L, int idx);
+
+/* Returns the state of a job, as seen by the scheduler thread. */
+worker_state_t worker_state( worker_job_t *job);
+
+/* Returns 1 if the job is queued or running, i.e. if the values it uses
+ * must not be touched, 0 otherwise or if `job` is NULL. */
+int worker_busy( worker_job_t *job);
+
+/* Sets the number of worker threads; can only be called before the first
+ * job is submitted. By default, one thread per online CPU, up to
+ * WORKER_MAX_THREADS. Returns 0 on success. */
+int worker_setthreads( int n);
+
+#define WORKER_MAX_THREADS 4
+
+#endif
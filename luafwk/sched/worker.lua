@@ -0,0 +1,80 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+--------------------------------------------------------------------------------
+-- Runs jobs in worker threads, without blocking the scheduler.
+--
+-- Jobs are created by C modules, e.g. `sdb :serializejob()`,
+-- `cipher :job()`, `hmac :job()` or `hash :filejob()`; they perform a
+-- self-contained operation in a worker thread, while Lua code keeps
+-- running in the scheduler thread only.
+--
+-- When a job is done, a worker thread writes to an eventfd watched by
+-- `sched.fd`; the job is then signaled with event `"done"`.
+--
+--     local worker = require 'sched.worker'
+--     local payload = assert(worker.run(cipher :job (payload)))
+--
+-- @module sched.worker
+--------------------------------------------------------------------------------
+
+local core = require 'sched.worker.core'
+require 'sched'
+
+local M = { core = core }
+
+-- Object watched by `sched.fd`, readable when some jobs are done.
+local jobsdone = { getfd = function() return core.fd() or -1 end }
+local watching = false
+
+-- Signals the jobs done; called when the eventfd is readable.
+local function collect()
+    for _, job in ipairs(core.collect()) do sched.signal(job, 'done') end
+    return 'again'
+end
+
+--------------------------------------------------------------------------------
+-- Waits for a submitted job to be done and returns its results.
+-- From a scheduled task, other tasks keep running meanwhile; otherwise,
+-- including from a coroutine which is not a task, the calling thread blocks
+-- until the job is done.
+--
+-- @param job the job, as returned by a job constructor; if it is `nil`,
+--  `run` returns `nil` and the error message passed as 2nd parameter.
+-- @return the job's results, or `nil` followed by an error message.
+--------------------------------------------------------------------------------
+function M.run(job, errmsg)
+    if not job then return nil, errmsg end
+    if job :state() ~= 'done' then
+        local thread = coroutine.running()
+        if thread and thread == proc.tasks.running then
+            if not watching then
+                assert(core.fd())
+                watching = assert(sched.fd.when_readable(jobsdone, collect))
+            end
+            sched.wait(job, 'done')
+        else core.wait(job) end
+    end
+    return job :result()
+end
+
+--------------------------------------------------------------------------------
+-- Sets the number of worker threads. It can only be called before the first
+-- job is submitted; by default, there is one thread per CPU, up to 4.
+--
+-- @param n number of threads.
+-- @return `true`, or `nil` followed by an error message.
+--------------------------------------------------------------------------------
+function M.setthreads(n)
+    return core.setthreads(n)
+end
+
+return M
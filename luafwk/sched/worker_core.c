@@ -0,0 +1,64 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+#include <string.h>
+#include <errno.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "worker.h"
+
+/* fd(): returns the eventfd which is readable when some jobs are done. */
+static int l_fd( lua_State *L) {
+  int fd = worker_getfd();
+  if( fd < 0) {
+    lua_pushnil( L);
+    lua_pushstring( L, strerror( errno));
+    return 2;
+  }
+  lua_pushinteger( L, fd);
+  return 1;
+}
+
+/* collect(): returns the list of the jobs done since the last call. */
+static int l_collect( lua_State *L) {
+  worker_collect( L);
+  return 1;
+}
+
+/* wait(job): blocks until the job is done, returns it. */
+static int l_wait( lua_State *L) {
+  worker_wait( L, 1);
+  lua_settop( L, 1);
+  return 1;
+}
+
+/* setthreads(n): sets the number of worker threads, before the first job. */
+static int l_setthreads( lua_State *L) {
+  if( worker_setthreads( luaL_checkint( L, 1))) {
+    lua_pushnil( L);
+    lua_pushstring( L, "worker threads already started");
+    return 2;
+  }
+  lua_pushboolean( L, 1);
+  return 1;
+}
+
+static const luaL_Reg R[] = {
+  { "collect",    l_collect },
+  { "fd",         l_fd },
+  { "setthreads", l_setthreads },
+  { "wait",       l_wait },
+  { NULL, NULL } };
+
+int luaopen_sched_worker_core( lua_State *L) {
+  luaL_register( L, "sched.worker.core", R);
+  return 1;
+}
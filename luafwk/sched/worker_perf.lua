@@ -0,0 +1,98 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of the scheduler's responsiveness during the flush of a large
+-- stagedb table, as done by the data manager: the table is serialized and
+-- goes through the AES and HMAC filters of an M3DA session, into a sink
+-- which never blocks. Meanwhile, a task wakes up every 10ms, and measures
+-- how late it is woken up: the maximum is the longest scheduler step.
+-- * serialized by the scheduler thread (JOBSIZE = false);
+-- * serialized by worker threads, by chunks of JOBSIZE bytes.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/worker_perf.lua [table size in MB]
+
+require 'strict'
+require 'sched'
+rawset(_G, 'log', require 'log')
+local stagedb = require 'stagedb'
+local cipher  = require 'crypto.cipher'
+local hmac    = require 'crypto.hmac'
+local ltn12   = require 'ltn12'
+local time    = require 'sched.timer.core'.time
+
+local SIZE = (tonumber(arg[1]) or 20) * 1e6
+local PERIOD = 0.01
+local function printf(...) print(string.format(...)) end
+
+-- Rows of about 20 serialized bytes: a timestamp, a double and a string.
+local function newtable()
+    local t = assert(stagedb("ram:bench", { "timestamp", "temperature", "status" }))
+    local ts, temp = 1.3e9, 21.5
+    for i = 1, SIZE / 20 do
+        temp = temp + math.random(-1, 1) * 0.1
+        assert(t :row{ timestamp=ts + i, temperature=temp, status="running"..(i % 1000) })
+    end
+    return t
+end
+
+-- Flushes the table, returns the flushed size and the elapsed time.
+local function flush(t, jobsize)
+    local size = 0
+    local function sink(chunk) if chunk then size = size + #chunk end; return 1 end
+    local aes = assert(cipher.new({ name="aes", mode="enc", key=string.rep("k", 16) },
+                                  { name="ctr", iv=string.rep("i", 16) }))
+    local mac = assert(hmac.new{ name="md5", key="secret" })
+    t.JOBSIZE = jobsize
+    local start = time()
+    local src = ltn12.source.chain(assert(t :serialize()),
+        ltn12.filter.chain(aes :filter { name="none" }, mac :filter()))
+    assert(ltn12.pump.all(src, sink))
+    mac :digest()
+    return size, time() - start
+end
+
+-- Runs a flush while a ticker task measures its wake up delays.
+local function run(t, jobsize)
+    local steps, max, sum, running = 0, 0, 0, true
+    local ticker = { }
+    sched.run(function()
+        local last = time()
+        while running do
+            sched.wait(PERIOD)
+            local now = time()
+            local late = now - last - PERIOD
+            steps, sum, max, last = steps + 1, sum + late, math.max(max, late), now
+        end
+        sched.signal(ticker, 'done')
+    end)
+    sched.wait(PERIOD * 5)
+    local size, elapsed = flush(t, jobsize)
+    running = false
+    sched.wait(ticker, 'done')
+    return size, elapsed, steps, sum / math.max(steps, 1), max
+end
+
+sched.run(function()
+    local t = newtable()
+    printf("Flush of a stagedb table through AES-CTR and HMAC-MD5 filters:")
+    printf("  %-28s %9s %9s %7s %12s %12s", "", "size (MB)", "time (s)", "ticks", "avg. delay", "max. delay")
+    for _, b in ipairs{ { "scheduler thread", false }, { "worker thread", 32768 } } do
+        local size, elapsed, ticks, avg, max = run(t, b[2])
+        printf("  %-28s %9.1f %9.2f %7d %10.1fms %10.1fms", b[1], size / 1e6, elapsed, ticks, avg * 1e3, max * 1e3)
+        t :reset()
+        t :close()
+        t = newtable()
+    end
+    os.exit(0)
+end)
+sched.loop()
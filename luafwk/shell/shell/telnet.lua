@@ -26,6 +26,7 @@ local next = next
 local pairs = pairs
 local print = print
 local proc = proc
+local require = require
 local select = select
 local setmetatable = setmetatable
 local siprint = siprint
@@ -352,6 +353,18 @@ function _G.killjob(jobid)
     sched.kill(self.runningjobs[jobid])
 end
 
+-- Prints the n tasks, hooks and signals which used the CPU the most, see
+-- sched.profiler. The profiler is started on first call.
+function _G.top(n)
+    local profiler = require 'sched.profiler'
+    if not profiler.running() then
+        profiler.start()
+        print "Profiler started, call top() again later"
+        return
+    end
+    for line in profiler.report(n) :gmatch "[^\n]+" do print(line) end
+end
+
 -- Start the server socket so that new shell can be instanciated on new connections
 -- config is a table that hols shell params:
 --   address: local address to bind to (default: "localhost")
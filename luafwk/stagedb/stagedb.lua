@@ -11,6 +11,7 @@
 
 local sdb_core = require 'stagedb.core'
 local m3da = require 'm3da.bysant'
+local worker = require 'sched.worker'
 
 require 'checks'
 require 'ltn12'
@@ -19,9 +20,16 @@ require 'ltn12'
 
 local SDB_TABLE = { __type='stagedb.table' }; SDB_TABLE.__index = SDB_TABLE
 
+-- Size of the chunks serialized by worker threads; if false, tables are
+-- always serialized by the scheduler thread.
+SDB_TABLE.JOBSIZE = 32768
+
 -- Create and return an ltn12 source serving the table's serialized content.
 -- The source serves chunks whose size is determined by self.BLOCKSIZE.
 -- If not defined, it defaults to ltn12.BLOCKSIZE.
+-- When the source is called from a scheduled task, chunks of self.JOBSIZE
+-- bytes are serialized by a worker thread instead, and other tasks keep
+-- running meanwhile.
 -- While serializing, the table is locked and doesn't support other operations,
 -- including data reading.
 function SDB_TABLE :serialize(bss)
@@ -57,8 +65,18 @@ function SDB_TABLE :serialize(bss)
             first_time = false
         end
         if done then return nil, nil end
-        n, i, buffer = ltn12.BLOCKSIZE, 0, { }
         local error
+        if self.JOBSIZE and coroutine.running() then
+            local data
+            self.busy = true
+            data, error = worker.run(self.sdb :serializejob (bss, self.JOBSIZE))
+            self.busy = nil
+            if not data then return nil, error end
+            done = error
+            if done then sched.signal(self, 'serialized') end
+            return data
+        end
+        n, i, buffer = ltn12.BLOCKSIZE, 0, { }
         done, error = self.sdb :serialize (bss)
         if done then -- last chunk
             sched.signal(self, 'serialized')
@@ -95,6 +113,8 @@ for _, name in pairs{ 'state', 'close', 'reset', 'consolidate', 'row', 'trim',
     'serialize_cancel' } do
     local f = sdb_core[name]
     SDB_TABLE[name] = function(self, ...)
+        -- only the state can be read while a worker thread serializes the table
+        if self.busy and name ~= 'state' then return nil, "BADSTATE" end
         local sdb = self.sdb
         local r, msg = f(sdb, ...)
         if r==sdb then return self else return r, msg end
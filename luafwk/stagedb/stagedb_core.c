@@ -10,6 +10,7 @@
  *******************************************************************************/
 #include "stagedb.h"
 #include "bysant_core.h"
+#include "worker.h"
 #include "lua.h"
 #include "lauxlib.h"
 #include <stdarg.h>
@@ -405,6 +406,73 @@ static int api_serialize( lua_State *L) {
     }
 }
 
+/* Serialization job: serializes the next `size` bytes of a table in a worker
+ * thread, into a buffer which follows the structure. The bss context's
+ * writer is replaced by the buffer's one while the job runs. */
+typedef struct serialize_job_t {
+    worker_job_t job;
+    sdb_table_t *tbl;
+    bss_ctx_t *bss;
+    bss_writer_t *writer;   /* bss context's own writer and its argument */
+    void *writerctx;
+    size_t size, used;      /* buffer size and number of bytes written */
+    int status;             /* sdb_serialize() result */
+    unsigned char data[1];
+} serialize_job_t;
+
+static int serialize_job_writer( unsigned const char *data, int length, void *ctx) {
+    serialize_job_t *j = (serialize_job_t *) ctx;
+    size_t n = j->size - j->used;
+    if( (size_t) length < n) n = length;
+    memcpy( j->data + j->used, data, n);
+    j->used += n;
+    return n;
+}
+
+static void serialize_job_run( worker_job_t *job) {
+    serialize_job_t *j = (serialize_job_t *) job;
+    j->bss->writer = serialize_job_writer;
+    j->bss->writerctx = j;
+    j->status = sdb_serialize( j->tbl, j->bss);
+    j->bss->writer = j->writer;
+    j->bss->writerctx = j->writerctx;
+}
+
+/* Returns the serialized bytes, and true if the serialization is complete,
+ * false if there are more bytes to serialize; nil and an error otherwise. */
+static int serialize_job_finish( lua_State *L, worker_job_t *job) {
+    serialize_job_t *j = (serialize_job_t *) job;
+    if( BSS_EOK != j->status && BSS_EAGAIN != j->status) return push_sdb_error( L, j->status);
+    lua_pushlstring( L, (const char *) j->data, j->used);
+    lua_pushboolean( L, BSS_EOK == j->status);
+    return 2;
+}
+
+// mysdb :serializejob(bss, size)
+// Submits a job which serializes the next `size` bytes of the table, see
+// `sched.worker`. Neither the table nor `bss` may be used until it is done.
+static int api_serializejob( lua_State *L) {
+    struct sdb_table_t *tbl = lua_sdb_checktable( L, 1);
+    struct bss_ctx_t   *bss = lua_bss_checkctx( L, 2);
+    int size = luaL_checkint( L, 3);
+    serialize_job_t *j;
+    luaL_argcheck( L, size > 0, 3, "invalid size");
+    j = (serialize_job_t *) worker_newjob( L, sizeof( *j) + size, serialize_job_run,
+            serialize_job_finish, NULL); // job
+    j->tbl = tbl;
+    j->bss = bss;
+    j->writer = bss->writer;
+    j->writerctx = bss->writerctx;
+    j->size = size;
+    lua_getfenv( L, -1);       // job, env
+    lua_pushvalue( L, 1);      // job, env, tbl
+    lua_rawseti( L, -2, 1);    // job, env
+    lua_pushvalue( L, 2);      // job, env, bss
+    lua_rawseti( L, -2, 2);    // job, env
+    lua_pop( L, 1);            // job
+    return worker_submit( L, -1);
+}
+
 // mysdb :serialize_cancel()
 static int api_serialize_cancel( lua_State *L) {
     int r = sdb_serialize_cancel( lua_sdb_checktable( L, 1));
@@ -438,6 +506,7 @@ int luaopen_stagedb_core( lua_State *L) {
     REG( row);
     REG( consolidate);
     REG( serialize);
+    REG( serializejob);
     REG( serialize_cancel);
     REG( reset);
     REG( close);
@@ -251,6 +251,29 @@ function globals :test_list()
     u.assert_nil(bysants(true):list():null())
 end
 
+-- A list whose opening is interrupted by a full writer can be opened again,
+-- even when a complete list has left its frame on the stack.
+function globals :test_list_resumed()
+    local buffer, room = { }, math.huge
+    local ctx = core.init(function(data)
+        local n = math.min(#data, room)
+        room = room - n
+        table.insert(buffer, data :sub (1, n))
+        return n
+    end)
+    u.assert(ctx :list (1) :number (0) :close ())
+    room = 1 -- only the opcode of the long list fits
+    local r, err = ctx :list (20)
+    u.assert_nil(r)
+    u.assert_equal("AGAIN", err)
+    room = math.huge
+    u.assert(ctx :list (20))
+    local expected = bysants():list(1):number(0):close():list(20)
+    for i = 1, 20 do u.assert(ctx :number (i)); expected :number (i) end
+    u.assert(ctx :close ())
+    u.assert_equal(expected :close() :serialize(), table.concat(buffer))
+end
+
 function globals :test_map()
     for _, case in ipairs(GLOBAL_MAP) do
         local ctx, bysant, _ = unpack(case)
@@ -715,3 +738,120 @@ function floatd :test()
     bysantd_assert_double('ffffffffffffffff00', niltoken)
     u.assert_true(isnan(bysantd('3605ffffffffffffffff01')[1]))
 end
+
+--------------------------------------------------------------------------------
+--- Numeric arrays
+--------------------------------------------------------------------------------
+local arrays = u.newtestsuite 'Bysant Serializer - numeric arrays'
+
+-- Checks that serializing `t` with array() is the same as serializing it
+-- value by value, in a list of context `ctxid`.
+local function bysants_assert_array(t, ctxid)
+    local expected = bysants():list(#t, ctxid)
+    for _, v in ipairs(t) do expected :number (v) end
+    bysants_assert(bysants():array(t), hexdump(expected :close() :serialize()))
+end
+
+function arrays :test_context()
+    bysants_assert(bysants():array{ }, hexdump(bysants():list(0):close():serialize()))
+    bysants_assert_array({ 1, 2, 3 }, "global")
+    bysants_assert_array({ 0.25, 1.5, 3 }, "global")
+    bysants_assert_array({ 0.25, 0.75, 1.25 }, "float")
+    bysants_assert_array({ 1e30/13, 1e30/7, 0.1 }, "double")
+    bysants_assert_array({ 100000000, -100000000, -2147483648 }, "float")
+    bysants_assert_array({ 100000001, -100000001, -2147483648 }, "int32")
+    bysants_assert_array({ 2^40 + 1, 1 }, "global")
+    bysants_assert_array({ 2^40, 2^40 + 0.5 }, "double")
+end
+
+function arrays :test_packed()
+    local t = { 1.5, -2, 1e30/13, 0 }
+    local d = string.pack('dddd', unpack(t))
+    u.assert_clone_tables(t, bysantd(hexdump(bysants():array(d):serialize())))
+    u.assert_clone_tables(t, bysantd(hexdump(bysants():array(d, 'd'):serialize())))
+    local f = string.pack('ffff', unpack(t))
+    u.assert_clone_tables({ select(2, string.unpack(f, 'ffff')) }, bysantd(hexdump(bysants():array(f, 'f'):serialize())))
+    local i = { 7, -1, 2147483647, -2147483648 }
+    bysants_assert_array(i, "global")
+    u.assert_equal(bysants():array(i):serialize(), bysants():array(string.pack('iiii', unpack(i)), 'i'):serialize())
+end
+
+function arrays :test_errors()
+    u.assert_nil(bysants(true):list(1, "int32"):array{ 1 })
+    u.assert_nil(bysants(true):map():array{ 1 })
+    u.assert_false(pcall(bysants().array, bysants(), { 1, "x" }))
+    u.assert_false(pcall(bysants().array, bysants(), "abc", 'd'))
+    u.assert_false(pcall(bysants().array, bysants(), "abcd", 'x'))
+end
+
+--------------------------------------------------------------------------------
+--- Stream deserializer
+--------------------------------------------------------------------------------
+local streamd = u.newtestsuite 'Bysant Stream Deserializer'
+
+-- Feeds `data` to `d` in chunks of `size` bytes, returns the concatenation
+-- of the returned lists.
+local function feed(d, data, size)
+    local result = { }
+    for i = 1, #data, size do
+        for _, v in ipairs(assert(d :feed (data :sub (i, i+size-1)))) do table.insert(result, v) end
+    end
+    return result
+end
+
+function streamd :test_chunks()
+    -- 42, "hello", { 1, 2 }, { k="v" }, instance of class 0
+    local data = encode('c9'..'0868656c6c6f'..'2ca0a1'..'4c026b047600'..'723b3d0000602ca0a19f')
+    local expected = { 42, "hello", { 1, 2 }, { k="v" }, { {1, 2}, 0, __class=0} }
+    for size = 1, #data do
+        u.assert_clone_tables(expected, feed(core.streamdeserializer(), data, size))
+    end
+end
+
+function streamd :test_depth()
+    local data = bysants():map():string("k"):list():number(1):close()
+        :string("c"):chunked():chunk("ab"):chunk("c"):close():close():serialize()
+    for size = 1, #data do
+        u.assert_clone_tables({ "k", { 1 }, "c", "abc", "", { } },
+            feed(core.streamdeserializer(1), data, size))
+        u.assert_clone_tables({ "k.1", 1, "k", { }, "c", "ab", "c", "c", "c", "", "", { } },
+            feed(core.streamdeserializer(2), data, size))
+    end
+end
+
+function streamd :test_errors()
+    local d = core.streamdeserializer()
+    u.assert_true(d :reset() == false)
+    u.assert_equal(0, #d :feed (encode '2ca0'))
+    u.assert_true(d :reset())
+    u.assert_nil(d :feed (encode '2c73'))
+    u.assert_clone_tables({ { 1, 2 } }, d :feed (encode '2ca0a1'))
+end
+
+local session = u.newtestsuite 'M3DA default session'
+
+local function envelope(payload)
+    local m3da, ltn12 = require 'm3da.bysant', require 'ltn12'
+    local t = { }
+    ltn12.pump.all(ltn12.source.chain(ltn12.source.string(payload), m3da.envelope{ id='test' }),
+        (ltn12.sink.table(t)))
+    return table.concat(t)
+end
+
+function session :test_truncated_envelope()
+    local transport, fragments = { }, { }
+    assert(require 'm3da.session.default'.new{ transport=transport, localid='test',
+        msghandler=function(fragment) table.insert(fragments, fragment) end })
+    -- big enough to be sent in several chunks, the first one being pushed
+    -- before the connection breaks
+    local big = envelope(string.rep('a', 70000))
+    u.assert_equal('ok', transport.sink(big :sub (1, -100)))
+    u.assert_nil(transport.sink(nil, 'closed'))
+    u.assert_equal('ok', transport.sink(envelope 'hello'))
+    sched.wait(0.1)
+    u.assert_equal(4, #fragments)
+    u.assert_equal(string.rep('a', 65535), fragments[1])
+    u.assert_equal('', fragments[2])
+    u.assert_equal('hello', fragments[3])
+    u.assert_equal('', fragments[4])
+end
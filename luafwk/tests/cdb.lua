@@ -0,0 +1,81 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+local cdb      = require 'cdb'
+local cdb_make = require 'cdb_make'
+local worker   = require 'sched.worker'
+local u        = require 'unittest'
+
+local t = u.newtestsuite("cdb")
+
+local FILE = os.tmpname()
+
+local function list(...)
+    local l = { }
+    for a, b in ... do table.insert(l, b and a..'='..b or a) end
+    return table.concat(l, ',')
+end
+
+function t :setup()
+    local m = assert(cdb_make.start(FILE, FILE..'.tmp'))
+    m :add("a", "1"); m :add("a", "2"); m :add("b", "3")
+    m :add("p:a", "4"); m :add("p:c", ""); m :add("10", "5")
+    m :add(string.rep("k", 100), string.rep("v", 100000))
+    u.assert_nil(m :finish())
+end
+
+function t :teardown()
+    os.remove(FILE)
+end
+
+function t :test_values()
+    local db = assert(cdb.init(FILE))
+    u.assert_equal("1,2", list(db :values "a"))
+    u.assert_equal("", list(db :values "x"))
+    -- Iterators don't share their state
+    local i1, i2 = db :values "a", db :values "a"
+    u.assert_equal("1", i1()); u.assert_equal("1", i2())
+    u.assert_equal("2", i1()); u.assert_equal("2", i2())
+    u.assert_nil(i1())
+    u.assert_equal(100000, #db :values (string.rep("k", 100)) ())
+    local n = 0
+    for _ in db :pairs () do n = n + 1 end
+    u.assert_equal(7, n)
+    db :free()
+end
+
+function t :test_get()
+    local db = assert(cdb.init(FILE))
+    u.assert_equal("1", db :get "a")
+    u.assert_equal("", db :get "p:c")
+    u.assert_nil(db :get "p")
+    db :free()
+end
+
+function t :test_findall()
+    local db = assert(cdb.init(FILE))
+    u.assert_equal("1=1,1=2,3=3", list(db :findall { "a", "x", "b" }))
+    u.assert_equal("1=4,3=", list(db :findall({ "a", "b", "c" }, "p:")))
+    u.assert_equal("1=5", list(db :findall { 10 }))
+    u.assert_equal("", list(db :findall { }))
+    db :free()
+end
+
+function t :test_finishjob()
+    local file = FILE..'.job'
+    local m = assert(cdb_make.start(file, file..'.tmp'))
+    m :add("x", "y")
+    u.assert_true(worker.run(m :finishjob()))
+    u.assert_equal("y", assert(cdb.init(file)) :get "x")
+    os.remove(file)
+end
+
+return t
@@ -196,6 +196,61 @@ function t:test_cipher()
     test_cipher_filter({name="aes", mode="...", nonce="2", keyidx=1, keysize=32},{name="ctr", iv="azertyuiopqsdfgh"},{name="pkcs5"})
 end
 
+-- objects are not usable while one of their jobs runs
+local function assert_badstate(r, err)
+    u.assert_nil(r)
+    u.assert_equal("BADSTATE", err)
+end
+
+function t:test_job_badstate()
+    local worker = require 'sched.worker'
+    -- the file job blocks on the fifo until it is written
+    local fifo = os.tmpname()
+    os.remove(fifo)
+    u.assert_equal(0, os.execute("mkfifo "..fifo))
+    local h = hash.new("md5")
+    local job = assert(h:filejob(fifo))
+    assert_badstate(h:filejob(fifo))
+    assert_badstate(h:update("x"))
+    assert_badstate(h:digest())
+    assert_badstate(h:filter()("x"))
+    local f = assert(io.open(fifo, "w"))
+    f:write(F)
+    f:close()
+    u.assert_equal(h, worker.run(job))
+    os.remove(fifo)
+    u.assert_equal(hash.digest("md5", F), h:digest())
+
+    -- the ciphering and hmac jobs may be done already
+    local data = string.rep(F, 1000)
+    local c = cipher.new({name="aes", mode="enc", key="12345678912345671234567891234567"},{name="ctr", iv="azertyuiopqsdfgh"})
+    job = assert(c:job(data))
+    if job:state() ~= "done" then assert_badstate(c:process(F)) end
+    u.assert_not_nil(worker.run(job))
+    u.assert_not_nil(c:process(F))
+    local mac = hmac.new({name="md5", key="1251523654256548"})
+    job = assert(mac:job(data))
+    if job:state() ~= "done" then assert_badstate(mac:update(F)) end
+    u.assert_equal(mac, worker.run(job))
+    u.assert_not_nil(mac:digest())
+end
+
+-- jobs waited without the scheduler are released all the same
+function t:test_job_wait()
+    local worker = require 'sched.worker'
+    local h = hash.new("md5")
+    local job = assert(h:filejob("/dev/null"))
+    worker.core.wait(job)
+    for _, anchored in pairs(debug.getregistry().sched.worker.jobs) do
+        u.assert_not_equal(job, anchored)
+    end
+    u.assert_equal(h, job:result())
+    -- from a coroutine which is not a scheduled task
+    local r
+    coroutine.wrap(function() r = worker.run(h:filejob("/dev/null")) end)()
+    u.assert_equal(h, r)
+end
+
 function t:test_rng()
     local handle = rng.new()
     for j=1,100 do
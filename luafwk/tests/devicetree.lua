@@ -96,6 +96,66 @@ function t :test_dt_SetAndGet()
    assert(err == "handler not found")
 end
 
+function t :test_dt_Cache()
+   local common = require 'racon.common'
+   local niltoken = require 'niltoken'
+   while true do
+      local status, err = devicetree.set("config", { toto="toto", tata="tata" })
+      if status and not err then break end
+      if not status and err ~= "error 517 [hint: ipc broken]" then assert(nil) end
+      sched.wait(1)
+   end
+   local sendcmd, sent, cacheId, notify = common.sendcmd, { }, nil, nil
+   common.sendcmd = function(cmd, payload)
+      sent[cmd] = (sent[cmd] or 0) + 1
+      local s, b = sendcmd(cmd, payload)
+      if cmd == "RegisterVariable" and payload[3] == 0 then cacheId = b end
+      if cmd == "GetVariable" and notify then notify() end
+      return s, b
+   end
+   local function count(cmd) local n = sent[cmd] or 0; sent[cmd] = 0; return n end
+
+   assert(devicetree.cache(true, { ["config.tata"]=0 }))
+   assert(devicetree.get("config.toto") == "toto")
+   assert(count "RegisterVariable" == 1 and count "GetVariable" == 1)
+   assert(devicetree.get("config.toto") == "toto")
+   assert(devicetree.get({ "config.toto" })["config.toto"] == "toto")
+   assert(count "GetVariable" == 0)
+
+   -- a time to live of 0 disables the caching
+   assert(devicetree.get("config.tata") == "tata")
+   assert(devicetree.get("config.tata") == "tata")
+   assert(count "GetVariable" == 2)
+
+   -- notifications update the cached values
+   assert(common.emphandlers.NotifyVariable({ cacheId, { ["config.toto"]="notified" } }) == 0)
+   assert(devicetree.get("config.toto") == "notified")
+   common.emphandlers.NotifyVariable({ cacheId, { ["config.toto"]=niltoken } })
+   assert(count "GetVariable" == 0)
+   assert(devicetree.get("config.toto") == "toto")
+   assert(count "GetVariable" == 1)
+
+   -- values set are read again
+   assert(devicetree.set("config.toto", "toto"))
+   assert(devicetree.get("config.toto") == "toto")
+   assert(count "GetVariable" == 1)
+
+   -- a value notified while it is read is not overwritten by the value read
+   assert(devicetree.set("config.toto", "toto"))
+   notify = function() common.emphandlers.NotifyVariable({ cacheId, { ["config.toto"]="notified" } }) end
+   assert(devicetree.get("config.toto") == "toto")
+   notify = nil
+   assert(devicetree.get("config.toto") == "notified")
+   assert(devicetree.get({ "config.toto" })["config.toto"] == "notified")
+   assert(count "GetVariable" == 1)
+
+   assert(devicetree.cache(false))
+   assert(count "UnregisterVariable" == 1)
+   assert(devicetree.get("config.toto") == "toto")
+   assert(count "GetVariable" == 1)
+   common.sendcmd = sendcmd
+end
+
 function t :test_dt_Unregister()
    while true do
       local status, err = devicetree.unregister(regId)
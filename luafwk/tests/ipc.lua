@@ -0,0 +1,161 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+local u = require 'unittest'
+local sched = require 'sched'
+local core = require 'racon.ipc.core'
+local ipc = require 'racon.ipc'
+local empparser = require 'racon.empparser'
+local socket = require 'socket'
+require 'pack'
+
+local t = u.newtestsuite("ipc")
+
+function t:test_queue()
+    local q = core.queue()
+    u.assert_equal(0, q:len())
+    u.assert_nil(q:read(1))
+    u.assert_equal("", q:read(0))
+    u.assert_equal(3, q:push "abc")
+    u.assert_equal(9, q:push "de\r\nfg")
+    q:push ""
+    u.assert_equal(9, #q)
+    u.assert_equal("abcd", q:peek(4))
+    u.assert_equal("abcde\r\nfg", q:peek(100) .. q:peek(0) .. "")
+    u.assert_equal("ab", q:read(2))
+    u.assert_equal("cde", q:readline())
+    u.assert_nil(q:readline())
+    u.assert_nil(q:read(3))
+    u.assert_equal("fg", q:read(2))
+    u.assert_equal(0, q:len())
+
+    -- a read of exactly one chunk returns it
+    local s = string.rep("x", 100)
+    q:push(s); q:push "y"
+    u.assert_equal(s, q:read(100))
+    u.assert_equal("y", q:peek())
+    u.assert_equal("y", q:read(1))
+
+    -- large reads across chunks
+    local chunks = { }
+    for i = 1, 1000 do chunks[i] = tostring(i) .. "\n"; q:push(chunks[i]) end
+    local all = table.concat(chunks)
+    u.assert_equal(all:sub(1, 2000), q:read(2000))
+    u.assert_equal(all:sub(2001, -1), q:peek())
+    u.assert_equal(all:sub(2001, -1):match "^([^\n]*)\n", q:readline())
+end
+
+function t:test_pipe()
+    local a, b = ipc.new()
+    local s = string.rep("0123456789", 10000)
+    local wakeups, received = 0, { }
+    local hook = sched.sighook(b.fifo, "write", function() wakeups = wakeups + 1 end)
+    local reader = sched.run(function()
+        received.header = b:receive(8)
+        received.payload = b:receive(#s)
+        received.line = b:receive "*l"
+        received.rest = b:receive(2)
+    end)
+    u.assert_equal(8 + #s, a:sendv({ "HEADER..", s }))
+    u.assert_equal(7, a:send "line\nzz")
+    sched.wait(reader, "die")
+    u.assert_equal("HEADER..", received.header)
+    u.assert_equal(s, received.payload)
+    u.assert_equal("line", received.line)
+    u.assert_equal("zz", received.rest)
+    u.assert_equal(2, wakeups) -- one per message
+    sched.kill(hook)
+
+    -- writers wait for space, messages are not split
+    local writer = sched.run(function()
+        for i = 1, 3 do a:send(string.rep(tostring(i), 4096)) end
+    end)
+    sched.wait(0.01)
+    u.assert_equal(8192, b.fifo.queue:len())
+    u.assert_equal(string.rep("1", 4096), b:receive(4096))
+    u.assert_equal(string.rep("2", 4096) .. string.rep("3", 4096), b:receive(8192))
+
+    -- a reader waiting on a closed pipe fails with the bytes received
+    a:send "abc"
+    sched.run(function() sched.wait(0.01); a:close() end)
+    local data, err, partial = b:receive(4)
+    u.assert_nil(data)
+    u.assert_match("close", err)
+    u.assert_equal("abc", partial)
+end
+
+function t:test_receive_into()
+    local a, b = ipc.new()
+    local buf = socket.bytebuffer()
+    a:send "abc"; a:send "defg"
+    u.assert_equal(2, b:receive_into(buf, 2))
+    u.assert_equal(5, b:receive_into(buf))
+    u.assert_equal("abcdefg", buf:sub())
+    sched.run(function() sched.wait(0.01); a:send "hi" end)
+    u.assert_equal(2, b:receive_into(buf)) -- waits for some bytes
+    u.assert_equal("abcdefghi", buf:sub())
+end
+
+function t:test_empparser()
+    local a, b = ipc.new()
+    local commands = { }
+    local parser = empparser.new(b, function(cmdname, payload)
+        table.insert(commands, { cmdname, payload })
+        return 0, payload
+    end)
+    local function frame(cmd, type, rid, payload, status)
+        local header = status and string.pack(">HbbIH", cmd, type, rid, #payload + 2, status)
+            or string.pack(">HbbI", cmd, type, rid, #payload)
+        return header..payload
+    end
+    sched.run(parser.run, parser)
+
+    -- several commands in one write, one split across writes
+    local large = string.rep("x", 10000)
+    a:send(frame(1, 0, 0, '{"a":[1,2]}')..frame(12, 0, 1, '42')..frame(9, 0, 2, ''))
+    local f = frame(1, 0, 3, '"'..large..'"')
+    a:send(f:sub(1, 5)); sched.wait(0.01); a:send(f:sub(6, 100)); sched.wait(0.01); a:send(f:sub(101))
+    sched.wait(0.01)
+    u.assert_equal(4, #commands)
+    u.assert_equal("SendData", commands[1][1])
+    u.assert_equal(2, commands[1][2].a[2])
+    u.assert_equal("NotifyVariable", commands[2][1])
+    u.assert_equal(42, commands[2][2])
+    u.assert_equal("GetVariable", commands[3][1])
+    u.assert_nil(commands[3][2])
+    u.assert_equal(large, commands[4][2])
+    -- the replies, with the same rid and payload
+    local header = b.peer.fifo.queue:read(10)
+    local _, cmd, type, rid, size, status = header:unpack ">HbbIH"
+    u.assert_equal(1, cmd); u.assert_equal(1, type); u.assert_equal(0, rid)
+    u.assert_equal(0, status)
+    u.assert_equal('{"a":[1,2]}', b.peer.fifo.queue:read(size - 2))
+    b.peer.fifo.queue:read(b.peer.fifo.queue:len())
+
+    -- responses are dispatched to the waiting request by rid
+    local results = { }
+    for i = 1, 2 do
+        sched.run(function() results[i] = { parser:send_emp_cmd_wait("GetVariable", "var"..i) } end)
+    end
+    sched.wait(0.01)
+    local q = b.peer.fifo.queue
+    local rids = { }
+    while q:len() > 0 do
+        local _, _, _, rid, size = q:read(8):unpack ">HbbI"
+        table.insert(rids, rid); q:read(size)
+    end
+    u.assert_equal(2, #rids)
+    a:send(frame(9, 1, rids[2], '"two"', 0)..frame(9, 1, rids[1], '', 3))
+    sched.wait(0.01)
+    u.assert_equal(3, results[1][1]); u.assert_nil(results[1][2])
+    u.assert_equal(0, results[2][1]); u.assert_equal("two", results[2][2])
+    a:close()
+end
@@ -10,6 +10,7 @@
 -------------------------------------------------------------------------------
 
 local logstore = require'log.store'
+local log = require 'log'
 local u = require 'unittest'
 local config = require 'agent.config'
 
@@ -138,3 +139,35 @@ end
 
 
 
+
+local function getallring(which)
+    local t = {}
+    u.assert(ltn12.pump.all(u.assert(logstore.logringsource(which, log.compose)), (ltn12.sink.table(t))))
+    return table.concat(t)
+end
+
+function t:test_05_ring()
+    local format = log.format
+    log.format = "%m-%s: %l"
+    u.assert(logstore.logringinit{ size = 64 * 1024, level = log.levels.WARNING,
+        flashlogger = { size = 2048, path = "logs/ring" } })
+    local ram, flash = { }, { }
+    for i = 1, 200 do
+        local sev = i % 2 == 0 and "WARNING" or "DEBUG"
+        logstore.logringstore("RING", sev, "log %d of %s", i, "ring")
+        local line = string.format("RING-%s: log %d of ring\n", sev, i)
+        table.insert(ram, line)
+        if sev == "WARNING" then table.insert(flash, line) end
+    end
+
+    -- ram: all the logs, once
+    u.assert_equal(table.concat(ram), getallring("ram"))
+    u.assert_equal("", getallring("ram"))
+
+    -- flash: the most recent WARNING logs, within the two files
+    local got = getallring("flash")
+    u.assert(#got > 0 and #got < 2 * 2048)
+    u.assert_equal(table.concat(flash):sub(-#got), got)
+    u.assert_equal(0, logstore.logringstats().dropped)
+    log.format = format
+end
@@ -273,6 +273,91 @@ function t:test_number()
     end
 end
 
+function t:test_v2()
+    local function roundtrip(v, version)
+        local s = target.serialize(v, nil, version)
+        local n, obj = target.deserialize(s)
+        u.assert_equal(#s+1, n)
+        return obj, s
+    end
+    local numbers = { 0, 127, 128, 300, 65535, 2^31, 2^40, 2^53-1, 2^53, -1, -128, -2^31-1, -2^52, 0.5, -1e300, 1/0, -1/0 }
+    for _, n in ipairs(numbers) do u.assert_equal(n, roundtrip(n)) end
+    local nan = roundtrip(0/0)
+    u.assert_not_equal(nan, nan)
+
+    -- integers and sizes as varints
+    u.assert_equal(2, #target.serialize(5))
+    u.assert_equal(4, #target.serialize(300))
+    u.assert_equal(8, #target.serialize("abcde"))
+    u.assert_equal(10, #target.serialize(12345.5))
+
+    -- array and hash parts, references beyond 65k
+    local tab = { "a", "b", "c", nil, 5, x="a", [2.5]=true, [-1]=false }
+    tab.self = tab
+    local obj = roundtrip(tab)
+    u.assert_equal("c", obj[3])
+    u.assert_nil(obj[4])
+    u.assert_equal(5, obj[5])
+    u.assert_equal("a", obj.x)
+    u.assert_true(obj[2.5])
+    u.assert_false(obj[-1])
+    u.assert_equal(obj, obj.self)
+    local big = { }
+    for i = 1, 70000 do big[i] = { tostring(i) } end
+    big[70001] = big[69999]
+    obj = roundtrip(big)
+    u.assert_equal("69999", obj[69999][1])
+    u.assert_equal(obj[69999], obj[70001])
+
+    -- version 1 is still read, alone or mixed with version 2
+    local v1 = target.serialize(tab, nil, 1)
+    u.assert_not_equal(target.serialize(tab), v1)
+    obj = roundtrip(tab, 1)
+    u.assert_equal("a", obj.x)
+    u.assert_equal(obj, obj.self)
+    local res = { target.deserialize(v1 .. target.serialize("v2") .. target.serialize(3, nil, 1)) }
+    u.assert_equal("a", res[2].x)
+    u.assert_equal("v2", res[3])
+    u.assert_equal(3, res[4])
+end
+
+function t:test_decoder()
+    local objs = { "abc", 42, { 1, 2, k={ "v" } }, function() return "f" end, false, string.rep("x", 300) }
+    local data = { }
+    for i, o in ipairs(objs) do data[i] = target.serialize(o, nil, i % 2 + 1) end
+    data = table.concat(data)
+
+    for _, chunksize in ipairs{ 1, 7, #data } do
+        local d, got = target.decoder(), { }
+        for i = 1, #data, chunksize do
+            d :push(data :sub(i, i+chunksize-1))
+            while true do
+                local ok, obj = d :next()
+                if not ok then break end
+                table.insert(got, obj)
+            end
+        end
+        u.assert_equal(#objs, #got)
+        u.assert_equal("abc", got[1])
+        u.assert_equal(42, got[2])
+        u.assert_equal("v", got[3].k[1])
+        u.assert_equal("f", got[4]())
+        u.assert_false(got[5])
+        u.assert_equal(objs[6], got[6])
+        u.assert_false(d :next())
+        u.assert_equal(0, d :pending())
+    end
+    local d = target.decoder()
+    d :push(data :sub(1, -2))
+    while d :next() do end
+    u.assert_equal(#target.serialize(objs[6], nil, 1) - 1, d :pending()) -- the last object, but one byte
+    u.assert_error(function()
+        local d = target.decoder()
+        d :push "\178\42"
+        d :next()
+    end)
+end
+
 --[[ micro-bench (~4.2 seconds on my laptop)
 local tab = { a='a', b='b', c='c', d='d', hop='jump', skip='foo', answer=42 }
 local s = target.serialize(tab)
@@ -76,6 +76,69 @@ local function  persist_testsuite(persist_impl, name)
         u.assert_nil(val)
     end
 
+    function t:test_groupcommit()
+        if not target.setcommit then return end
+        local lfs = require 'lfs'
+        local file = (LUA_AF_RW_PATH or "./").."persist/testNewtable.l2b"
+        target.table.empty(nt)
+        target.setcommit(0)
+        for i=1,100 do nt["key"..i] = "value"..i end
+        u.assert_equal("value100", nt.key100)
+        u.assert_equal(0, lfs.attributes(file, 'size'))
+        sched.wait() -- buffered writes are committed at the end of the scheduler step
+        local size = lfs.attributes(file, 'size')
+        u.assert_gt(0, size)
+
+        target.setcommit(1, true)
+        nt.key1 = "other value"
+        u.assert_equal(size, lfs.attributes(file, 'size'))
+        target.flush()
+        u.assert_gt(size, lfs.attributes(file, 'size'))
+        size = lfs.attributes(file, 'size')
+
+        nt.key2 = "other value"
+        target.setcommit(nil) -- commits the buffered writes
+        u.assert_gt(size, lfs.attributes(file, 'size'))
+        size = lfs.attributes(file, 'size')
+        nt.key3 = "other value"
+        u.assert_gt(size, lfs.attributes(file, 'size'))
+    end
+
+    function t:test_truncated()
+        if name ~= "file" then return end
+        local l2b = require 'luatobin'
+        local function pairs2b(...)
+            local data = { }
+            for i, o in ipairs{ ... } do data[i] = l2b.serialize(o) end
+            return table.concat(data)
+        end
+        local file = (LUA_AF_RW_PATH or "./").."persist/testTruncated"
+        -- a key without its value, then a value cut in the middle
+        for i, tail in ipairs{ l2b.serialize "k2", pairs2b("k2", "value2"):sub(1, -3) } do
+            local f = assert(io.open(file..i..".l2b", "wb"))
+            f:write(pairs2b("k1", "v1")..tail)
+            f:close()
+            local tt = target.table.new("testTruncated"..i)
+            u.assert_equal("v1", tt.k1)
+            u.assert_nil(tt.k2)
+            tt.k3 = "v3"
+            f = assert(io.open(file..i..".l2b", "rb"))
+            local d = l2b.decoder()
+            d :push(f:read "*a")
+            f:close()
+            local got = { }
+            while true do
+                local ok, obj = d :next()
+                if not ok then break end
+                table.insert(got, obj)
+            end
+            u.assert_equal(0, d :pending())
+            u.assert_equal(4, #got)
+            target.table.empty(tt)
+            os.remove(file..i..".l2b")
+        end
+    end
+
     function t:teardown()
         target.table.empty(nt)
         nt = nil
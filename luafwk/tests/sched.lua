@@ -473,3 +473,30 @@ function t: test_wait_various_time()
    ensure_correct_wait(1.15)
    ensure_correct_wait(2.333)
 end
+
+-- check the profiler's accounting of tasks, hooks, signals and stack samples
+function t :test_profiler()
+    local profiler = require 'sched.profiler'
+    local function burn() local x = 0; for i = 1, 1e5 do x = x + i % 7 end; return x end
+    profiler.reset()
+    profiler.start(100)
+    local h = sched.sighook('foo', 'bar', burn)
+    local task = sched.run(function() for i = 1, 3 do burn(); signal('foo', 'bar'); wait() end end)
+    wait(task, 'die')
+    sched.kill(h)
+    profiler.stop()
+    local s, found = profiler.stats(), { }
+    for _, r in ipairs(s.tasks) do if r.runs == 4 then found.task = r end end
+    for _, r in ipairs(s.hooks) do if r.runs == 3 then found.hook = r end end
+    for _, r in ipairs(s.signals) do
+        if r.emitter == 'foo' and r.event == 'bar' then found.signal = r end
+    end
+    assert(found.task and found.hook and found.signal)
+    u.assert_equal(3, found.signal.count)
+    u.assert_gt(0, found.hook.time)
+    u.assert_gte(found.hook.maxrun, found.task.time)
+    u.assert_match("burn@[^\n]* %d+\n", profiler.folded())
+    profiler.reset()
+    u.assert_equal("", profiler.folded())
+    checkleak()
+end
@@ -82,8 +82,12 @@ function t:test_tcp_methods()
     "getstats",
     "setstats",
     "listen",
+    "peek",
     "receive",
+    "receive_into",
     "send",
+    "sendv",
+    "setbuffersize",
     "setfd",
     "setoption",
     "setpeername",
@@ -478,6 +482,33 @@ function t:test_raw()
 end
 
 
+local function test_sendv_receive_into(len, bufsize)
+    reconnect()
+    if bufsize then assert(data:setbuffersize(bufsize)) end
+    local half = math.floor(len/2)
+    local s1, s2, buf
+    s1 = string.rep("x", half)
+    s2 = string.rep("y", len-half)
+    remote (string.format("str = data:receive(%d)", len))
+    assert(data:sendv{ s1, "", s2 } == len)
+    remote "data:send(str)"
+    assert(data:peek(1) == (s1..s2):sub(1, 1))
+    buf = socket.bytebuffer()
+    assert(data:receive_into(buf, len) == len)
+    assert(buf:tostring() == s1..s2, "blocks don't match")
+end
+
+function t:test_sendv_receive_into()
+    test_sendv_receive_into(1)
+    test_sendv_receive_into(17)
+    test_sendv_receive_into(4091)
+    test_sendv_receive_into(80199)
+    test_sendv_receive_into(80199, 64)
+    test_sendv_receive_into(80199, 65536)
+    test_sendv_receive_into(8000000)
+end
+
+
 local function test_nonblocking(size)
     reconnect()
     remote(string.format([[
@@ -195,6 +195,34 @@ function t :test_conso2()
     test_consolidation_helper("middle", 18)
 end
 
+-- NaN values are skipped by min and max, whatever their position
+function t :test_conso_nan()
+    local nan = 0/0
+    local function test_nan_helper(method, values, expected)
+        local raw = u.assert(stagedb("ram:raw.db", { { name="temp", serialization="fastest"} }))
+        local y = u.assert(raw :newconsolidation("ram:test_conso_nan",
+        { {name="temp", serialization="fastest", consolidation=method} }))
+        for _, v in ipairs(values) do u.assert(raw :row{ temp=v }) end
+        u.assert(raw :consolidate())
+        local r = flush_data(y).temp[1]
+        if expected ~= expected then u.assert(r ~= r, "NaN expected, got "..r)
+        else u.assert_equal(expected, r) end
+    end
+    local function test_min_max(values, min, max)
+        test_nan_helper("min", values, min)
+        test_nan_helper("max", values, max)
+    end
+
+    test_min_max({ nan, 3, 1, nan, 2 }, 1, 3)
+    test_min_max({ nan, nan, nan, nan, 5, nan, 7, 1, nan }, 1, 7)
+    test_min_max({ 4, nan }, 4, 4)
+    test_min_max({ nan, nan, nan }, nan, nan)
+    -- more rows than a batch of the consolidation, the first ones being NaN
+    local values = { }
+    for i = 1, 300 do values[i] = i > 200 and i % 50 or nan end
+    test_min_max(values, 0, 49)
+end
+
 -- test that factor parameter is taken in account for consolidation tables
 function t :test_conso_precision()
     local raw = u.assert(stagedb("ram:raw", { { name="temp", serialization="smallest"} }))
@@ -251,6 +279,26 @@ function t :test_broken()
     u.assert(os.remove(path))
 end
 
+--test the serialization by worker threads, by small chunks, against the
+--serialization by the scheduler thread
+function t :test_worker_serialize()
+    local function serialize(jobsize)
+        u.assert(x :reset())
+        feed_data(x, 10)
+        x.JOBSIZE = jobsize
+        local src, chunks = x :serialize(), { }
+        local chunk = src()
+        while chunk do table.insert(chunks, chunk); chunk = src() end
+        x.JOBSIZE = nil
+        return table.concat(chunks), #chunks
+    end
+    local expected = serialize(false)
+    local data, nchunks = serialize(7)
+    u.assert_equal(expected, data)
+    u.assert_gt(#data / 7 - 1, nchunks)
+    check_data(m3da_deserialize(data), 10)
+end
+
 --******************************************************
 local cont_ts = u.newtestsuite("stagedb containers")
 
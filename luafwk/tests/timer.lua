@@ -184,3 +184,43 @@ function t:test_06_rearm_timer()
 
    timer.cancel(_timer)
 end
+
+function t:test_07_cron_dates()
+   local core = require 'sched.timer.core'
+   local from = os.time{ year=2013, month=1, day=31, hour=23, min=59, sec=30 } -- a Thursday
+
+   local function check(entry, expected)
+      local d = os.date("*t", core.cron(entry):nextdate(from))
+      for k, v in pairs(expected) do u.assert_equal(v, d[k], entry) end
+   end
+   check("* * * * *", { year=2013, month=2, day=1, hour=0, min=0 })
+   check("30 8 * * mon-fri", { month=2, day=1, hour=8, min=30 })
+   check("0 0 * * sun", { month=2, day=3, hour=0, min=0 })
+   check("0 0 * * 7", { month=2, day=3 })
+   check("0 0 13 * 5", { month=2, day=1 }) -- the 13th or a Friday
+   check("0 0 13 * *", { month=2, day=13 })
+   check("5/20 */6 * * *", { day=1, hour=0, min=5 })
+   check("0 0 1 jul *", { year=2013, month=7, day=1 })
+   check("0 12 29 2 *", { year=2016, month=2, day=29, hour=12 })
+   u.assert_nil(core.cron("0 0 30 2 *"):nextdate(from))
+
+   local _, jitter = core.cron("0 0 * * * 120")
+   u.assert_equal(120, jitter)
+   u.assert_error_match("error in pattern 60", function() core.cron "60 * * * *" end)
+   u.assert_error_match("step too big", function() core.cron "*/40 * * * *" end)
+   u.assert_error_match("range", function() core.cron "5-2 * * * *" end)
+   u.assert_error_match("syntax", function() core.cron "* * * *" end)
+   u.assert_error_match("jitter", function() core.cron "* * * * * x" end)
+end
+
+function t:test_08_clock_changed()
+   local cron = timer.new("* * * * *")
+   local periodic = timer.new(-0.5)
+   local nd = periodic.nd
+   sched.timer.clockchanged()
+   u.assert_equal(nd, periodic.nd)
+   u.assert_not_nil(cron.nd)
+   for i = 2, #sched.timer.events do u.assert_lt(sched.timer.events[i], sched.timer.events[i-1]) end
+   u.assert(timer.cancel(cron))
+   u.assert(timer.cancel(periodic))
+end
@@ -19,12 +19,10 @@ local sched = require 'sched'
 local checks = require 'checks'
 local sched_timer = require 'sched.timer'
 local os_time = os.time
-local os_date = os.date
-local monotonic_time = require'sched.timer.core'.time
+local timer_core = require'sched.timer.core'
+local monotonic_time = timer_core.time
 local math = math
 local tonumber = tonumber
-local tostring = tostring
-local error = error
 local unpack = unpack
 local table = table
 local _G=_G
@@ -45,12 +43,8 @@ math.randomseed(os_time())
 
 local TIMER_MT = { __type='timer' }; TIMER_MT.__index=TIMER_MT
 
--- ---------------------------------------------------------------------------
--- CRON name->number conversions
-local conv = {
-        sun = 0, mon = 1, tue = 2, wed = 3, thu = 4, fri = 5, sat = 6,
-        jan = 1, feb = 2, mar = 3, apr = 4,  may = 5,  jun = 6,
-        jul = 7, aug = 8, sep = 9, oct = 10, nov = 11, dec = 12 }
+-- Cron timers follow the wall clock: reschedule them when it is synchronized
+sched.sighook("TIME", "TIME_UPDATED", function() sched_timer.clockchanged() end)
 
 -- ---------------------------------------------------------------------------
 -- CRON alias->config conversions
@@ -63,129 +57,20 @@ local cron_aliases = {
     ["@hourly"]   = "0 * * * *" }
 
 -- ----------------------------------------------------------------------------
--- Converts a CRON element, already extracted from the string, into a number
--- representing the next occurrence. This number's unit is the same as the
--- string's, hence can be in minutes, hours etc.
---
--- @function [parent=#timer] nextval
--- @param p the string extract to convert
--- @param curr value of current time (in the same units as `p`)
--- @param period period of `p`'s units, e.g. 60 for minutes, 24 for hours etc.
--- @param minval minimal acceptable value for the result
--- @return time of next occurrence of the event, in the same units as `p`.
---
-
-local function nextval(p, curr, period, minval)
-
-    local next
-    if p:match(",") then
-        next = math.huge
-        -- we have a list of values, we need to test the list one by one
-        for e in p:gmatch("[^,]+") do
-            local l = nextval(e, curr, period, minval)
-            if l < next then next = l end
-        end
-        return next
-    else
-        local step = tonumber(p:match("/(%d+)")) or 1 -- get the step value (number behind the '/' char)
-        if step>period/2 then error("step too big in "..p) end
-
-        if p:match("%-") then
-            -- we have a range
-            local min, max = p:match("(%d+)%-(%d+)")
-            min = tonumber(min)
-            max = tonumber(max)
-            if not min or not max then error("error in range pattern: "..p) end
-            max = math.min(period, max)
-            min = math.min(math.max(minval, min), max)
-            max = min + math.floor((max-min)/step)*step
-            if curr < min then next = min
-            elseif curr > max then next = period + min
-            else next = min + math.floor((curr-min+step-1)/step)*step end
-        elseif p:match("%*") then
-            if step > 1 then next = math.floor((curr+step-1)/step)*step -- round up the value so it corresponds to the step
-            else next = curr end
-        else
-            local v = tonumber(p) or conv[p:lower()]
-            if not v or v>period or v<minval then error("error in pattern "..p) end
-            next = curr <= v and v or v + period
-        end
-    end
-
-    return next
-end
-
--- ----------------------------------------------------------------------------
--- Retrieves the number of days in the month including a given date.
---
--- @function [parent=#timer] nbofdaysinmonth
--- @param date in `os.time` format included in the considered month
--- @return number of days in the month: 28,29,30,31
---
-
-local function nbofdaysinmonth(now)
-    local cd = os_date("*t", now)
-    cd.day = 0
-    cd.month = cd.month+1
-    return tonumber(os_date("%d", os_time(cd)))
-end
-
--- ----------------------------------------------------------------------------
--- Converts a CRON string into the next date at which the corresponding event
--- shall be triggered. To be stored as a timer object's `nextevent` field.
+-- Computes the next date at which a CRON timer shall be triggered, from its
+-- compiled entry (see `sched.timer.core.cron`). To be stored as a timer
+-- object's `nextevent` field.
 --
 -- @function [parent=#timer] cron_nextevent
--- @param timer the CRON string
--- @return next occurrence's date, as an `os.time()` number.
+-- @param timer the CRON timer
+-- @return next occurrence's date, as a `sched.timer.core.time()` number.
 --
 
 local function cron_nextevent(timer)
-    local entry = timer.cron
     local now = os_time()
-    -- minutes, hours, day of month, month, day of week, random jitter
-    local mm, hh, jj, MMM, JJJ , rnd = entry:match("^(%S+) (%S+) (%S+) (%S+) (%S+) ?(%S*)")
-    local d = os_date("*t", now)
-    if not mm then error("error in entry syntax: "..tostring(entry)) end
-
-    local nmin = nextval(mm, d.min+1, 60, 0)
-
-    if nmin >= 60 then nmin = nmin-60; d.hour = d.hour+1 end
-    d.min = nmin
-
-    local nh = nextval(hh, d.hour, 24, 0)
-    if nh >= 24 then nh = nh-24; d.day = d.day+1; d.wday = d.wday+1 end
-    d.hour = nh
-
-    local nd
-    if JJJ ~= "*" then
-        local wday = d.wday-1 -- 0 is sunday in cron syntax
-        nd = nextval(JJJ, wday, 7, 0) - (wday) + d.day
-    end
-
-    local daysinmonth = nbofdaysinmonth(now)
-    if not nd or jj ~= "*" then
-        local nmd = nextval(jj, d.day, daysinmonth, 1)
-        if nd then nd = math.min(nmd, nd) else nd = nmd end
-    end
-
-    if nd > daysinmonth then nd = nd-daysinmonth; d.month = d.month+1 end
-    d.day = nd
-
-    if #rnd>0 and not timer.jitter then
-        local jitter_boundary = tonumber(rnd) or error "Invalid cron jitter"
-        timer.jitter = math.random(0, jitter_boundary)
-    end
-
-    local nm = nextval(MMM, d.month, 12, 1)
-    d.month = nm -- date sytem will auto increment year if month > 12
-    d.yday = nil
-    d.wday = nil
-    d.sec = 0
-    d = monotonic_time() + (os_time(d) - now)
-
-    if timer.jitter then d=d+timer.jitter end
-
-    return d
+    local d = timer.compiled:nextdate(now)
+    if not d then return nil end
+    return monotonic_time() + (d - now) + (timer.jitter or 0)
 end
 
 -- ----------------------------------------------------------------------------
@@ -270,7 +155,10 @@ function new(expiry, hook, ...)
     local t = tonumber(expiry)
     if not t then
         if type(expiry)=='table' then expiry=table2cron(expiry) end
-        timer = { nextevent=cron_nextevent, cron=cron_aliases[expiry] or expiry }
+        expiry = cron_aliases[expiry] or expiry
+        local compiled, jitter = timer_core.cron(expiry)
+        timer = { nextevent=cron_nextevent, cron=expiry, compiled=compiled, wallclock=true,
+                  jitter=jitter and math.random(0, jitter) }
     elseif t>=0 then
         timer = { nextevent=oneshot_nextevent,  delay=t }
     else
@@ -367,6 +255,14 @@ end
 -- As a consequence, `"*/61"` in the minutes slot will be triggered when the
 -- number of minutes reaches 0, because 0/61==0.
 --
+-- A single value followed by a step denotes every `step` values from it, e.g.
+-- `"5/15"` in the minutes slot is equivalent to `"5,20,35,50"`.
+--
+-- Dates are computed in local time. When daylight saving time starts, a date
+-- in the skipped hour is triggered one hour later; when it ends, a date in
+-- the repeated hour is triggered once. Cron timers are rescheduled when the
+-- wall clock is set, e.g. by NTP synchronization.
+--
 -- Cron also accepts some aliases for common periodicities. `"@hourly"`,
 -- "@daily"`, "@weekly"`, "@monthly"` and "@annually"` represent the
 -- corresponding expected periodic events.
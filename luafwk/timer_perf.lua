@@ -0,0 +1,46 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Benchmark of cron timers: number of next due date computations per second
+-- for a few cron entries, then time taken to reschedule a number of cron
+-- timers after a change of the wall clock.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/timer_perf.lua [computations per entry] [timers]
+
+require 'strict'
+require 'sched'
+local timer = require 'timer'
+local time  = require 'sched.timer.core'.time
+
+local COUNT  = tonumber(arg[1]) or 100000
+local TIMERS = tonumber(arg[2]) or 1000
+local function printf(...) print(string.format(...)) end
+
+local entries = { "* * * * *", "*/5 * * * *", "@daily", "30 8 * * 1-5",
+    "0 0 1,15 * *", "0 12 29 2 *" }
+
+printf("%-20s %12s", "entry", "nextevent/s")
+for _, entry in ipairs(entries) do
+    local t = timer.new(entry)
+    local start = time()
+    for _ = 1, COUNT do t:nextevent() end
+    printf("%-20s %12.0f", entry, COUNT / (time() - start))
+    t:cancel()
+end
+
+local timers = { }
+for i = 1, TIMERS do timers[i] = timer.new(entries[i % #entries + 1]) end
+local start = time()
+sched.timer.clockchanged()
+printf("%d cron timers rescheduled in %.2fms", TIMERS, (time() - start) * 1e3)
+for _, t in ipairs(timers) do t:cancel() end
@@ -32,37 +32,11 @@
 -- @module utils.path
 --
 
-local checks = require"checks"
-
-
+-- The functions are implemented in C by `utils.path.core`.
 
+local core = require 'utils.path.core'
 
 local M = { }
---public API
-local split,clean,segments, get, set, gsplit, concat, find
-
-local function pathconcat(pt, starti, endi)
-    local t = {}
-    local prev
-    local empties = 0
-    starti = starti or 1
-    endi = endi or #pt
-
-    for i = starti, endi do
-        local v = pt[i]
-        if not v then break
-        elseif v == '' then
-            empties = empties+1
-        else
-            table.insert(t, prev)
-            prev = v
-        end
-    end
-    table.insert(t, prev)
-    --log('PATH', 'INFO', "pathconcat(%s, %d, %d) generates table %s, wants indexes %d->%d",
-    --    sprint(pt), starti, endi, sprint(t), 1, endi-starti+1-empties)
-    return table.concat(t, '.', 1, endi-starti+1-empties)
-end
 
 --------------------------------------------------------------------------------
 -- Concatenates a sequence of path strings together.
@@ -71,10 +45,7 @@ end
 -- @param varargs list of strings to concatenate into a valid path
 -- @return resulting path as a string
 --
-
-function concat(...)
-    return pathconcat({...})
-end
+M.concat = core.concat
 
 --------------------------------------------------------------------------------
 -- Cleans a path.
@@ -85,12 +56,7 @@ end
 -- @param path string containing the path to clean.
 -- @return cleaned path as a string.
 --
-
-function clean(path)
-    checks('string')
-    local p = segments(path)
-    return pathconcat(p)
-end
+M.clean = core.clean
 
 --------------------------------------------------------------------------------
 -- Sets a value in a tree-like table structure.
@@ -106,15 +72,7 @@ end
 --  or an array where path[1] is the root and path[n] is the leaf.
 -- @param value the value to set.
 --
-
-function set(t, path, value)
-    checks('table', 'string|table', '?')
-    local p = type(path)=='string' and segments(path) or path
-    local k = table.remove(p)
-    local t = find(t, p, value~=nil) -- only create the table structure if the value to set is non nil!
---    local t = findtable(t, p, true) -- for the creation of the table structure, even if the value to set is non nil!
-    if t then t[k] = value end
-end
+M.set = core.set
 
 --------------------------------------------------------------------------------
 -- Gets the value of a table field. The field can be in a sub table.
@@ -127,15 +85,7 @@ end
 -- @return value if the field is found.
 -- @return nil otherwise.
 --
-function get(t, path)
-    checks('table', 'string|table')
-    local p = type(path)=='string' and segments(path) or path
-    local k = table.remove(p)
-    if not k then return t end
-    local t = find(t, p)
-    return t and t[k]
-end
-
+M.get = core.get
 
 --------------------------------------------------------------------------------
 -- Enumerates path partitions in a for-loop generator, starting from the right.
@@ -147,20 +97,7 @@ end
 -- @param path the path as a string
 -- @return the for-loop iterator function
 --
-
-function gsplit (path)
-    checks ('string')
-    local segs  = segments(path)
-    local nsegs = #segs
-    local limit = nsegs
-    local function f()
-        if limit == -1 then return nil, nil end
-        local a, b = pathconcat(segs, 1, limit), pathconcat(segs, limit+1, nsegs)
-        limit = limit - 1
-        return a, b
-    end
-    return f
-end
+M.gsplit = core.gsplit
 
 --------------------------------------------------------------------------------
 -- Splits a path into two halves, can be used to get path root, tail etc.
@@ -184,17 +121,7 @@ end
 -- @usage local root, tail = split('a.b.c', 1)
 -- ->root contains 'a', tail contains 'b.c'
 --
-
-function split(path, n)
-    checks('string', 'number')
-    local segments = segments(path)
-    if      n>#segments then return path, ''
-    elseif -n>#segments then return '', path
-    else
-        if n<0 then n=#segments+n end
-        return pathconcat(segments, 1, n), pathconcat(segments, n+1, #segments)
-    end
-end
+M.split = core.split
 
 --------------------------------------------------------------------------------
 -- Splits a path into segments.
@@ -205,20 +132,7 @@ end
 -- @param path string containing the path to split.
 -- @return list of split path elements.
 --
-
-function segments(path)
-    checks('string')
-    local t = {}
-    local index, newindex, elt = 1
-    repeat
-        newindex = path:find(".", index, true) or #path+1 --last round
-        elt = path:sub(index, newindex-1)
-        elt = tonumber(elt) or elt
-        if elt and elt ~= "" then table.insert(t, elt) end
-        index = newindex+1
-    until newindex==#path+1
-    return t
-end
+M.segments = core.segments
 
 --------------------------------------------------------------------------------
 -- Retrieves the element in a sub-table corresponding to the path.
@@ -245,22 +159,6 @@ end
 -- @usage config = {toto={titi={tutu = 5}}}
 --     find(config, "toto.titi") -- will return the table titi
 --
-function find(t, path, force)
-    checks('table', 'string|table', '?')
-    path = type(path)=="string" and segments(path) or path
-    for i, n in ipairs(path) do
-        local v  = t[n]
-        if type(v) ~= "table" then
-            if not force or (force=="noowr" and v~=nil) then return nil, pathconcat(path, 1, i)
-            else v = {} t[n] = v end
-        end
-        t = v
-    end
-    return t
-end
-
---public API
-M.split=split; M.clean=clean; M.segments=segments; M.get=get; M.set=set;
-M.gsplit=gsplit; M.concat=concat; M.find=find
+M.find = core.find
 
 return M
@@ -0,0 +1,476 @@
+/*******************************************************************************
+ * Copyright (c) 2012 Sierra Wireless and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *     Sierra Wireless - initial API and implementation
+ *******************************************************************************/
+
+/* Native implementation of utils.path, see path.lua for the documentation.
+ *
+ * A path is parsed once into the list of its segments, and its clean form,
+ * where numeric segments are written back as numbers the way tostring does.
+ * Every half or prefix returned is then a substring of the clean path, and
+ * the tables are walked with the segments as keys, without building any
+ * intermediate string or table. */
+
+#include "lauxlib.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define PATH_SEGS  32
+#define PATH_BUF   256
+#define NUMBER_MAX 32 /* as LUAI_MAXNUMBER2STR */
+
+typedef struct
+{
+    size_t start;   /* in the clean path */
+    size_t len;
+    int isnum;
+    lua_Number num;
+} seg_t;
+
+typedef struct
+{
+    const char *path;   /* path given */
+    size_t pathlen;
+    int n;
+    seg_t *segs;
+    char *clean;
+    size_t len;
+    seg_t segbuf[PATH_SEGS];
+    char buf[PATH_BUF];
+} path_t;
+
+enum { FIND, FORCE, NOOWR };
+
+/* tonumber: same conversion as luaO_str2d */
+static int str2d(const char *s, size_t len, lua_Number *result)
+{
+    char buf[NUMBER_MAX * 2], *end;
+    size_t i;
+
+    /* quick check: numbers start with a sign, a digit, "inf" or "nan" */
+    for (i = 0; i < len && isspace((unsigned char) s[i]); i++);
+    if (i == len || !(isdigit((unsigned char) s[i]) || strchr("+-iInN", s[i])))
+        return 0;
+    if (len >= sizeof(buf) || memchr(s, '\0', len))
+        return 0;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    *result = strtod(buf, &end);
+    if (end == buf)
+        return 0;
+    if (*end == 'x' || *end == 'X')
+        *result = (lua_Number) strtoul(buf, &end, 16);
+    while (isspace((unsigned char) *end))
+        end++;
+    return *end == '\0';
+}
+
+/* Parse the path at stack index `idx`. Memory for long paths is taken from
+ * userdata pushed on the stack. */
+static void parse(lua_State *L, int idx, path_t *p)
+{
+    const char *s = lua_tolstring(L, idx, &p->pathlen);
+    size_t i, start, n = 0;
+    char *c;
+
+    p->path = s;
+    for (i = 0; i < p->pathlen; i++)
+        if (s[i] == '.')
+            n++;
+    n++;
+    p->segs = n <= PATH_SEGS ? p->segbuf : lua_newuserdata(L, n * sizeof(seg_t));
+    p->clean = p->pathlen + n * NUMBER_MAX <= PATH_BUF ? p->buf
+        : lua_newuserdata(L, p->pathlen + n * NUMBER_MAX);
+
+    p->n = 0;
+    c = p->clean;
+    for (start = 0; start <= p->pathlen; start = i + 1)
+    {
+        seg_t *seg = p->segs + p->n;
+        for (i = start; i < p->pathlen && s[i] != '.'; i++);
+        if (i == start)
+            continue;
+        if (p->n)
+            *c++ = '.';
+        seg->start = c - p->clean;
+        seg->isnum = str2d(s + start, i - start, &seg->num);
+        if (seg->isnum)
+            c += sprintf(c, LUA_NUMBER_FMT, seg->num);
+        else
+        {
+            memcpy(c, s + start, i - start);
+            c += i - start;
+        }
+        seg->len = c - p->clean - seg->start;
+        p->n++;
+    }
+    p->len = c - p->clean;
+}
+
+/* segments 1 to i */
+static void pushprefix(lua_State *L, path_t *p, int i)
+{
+    if (i <= 0)
+        lua_pushliteral(L, "");
+    else if (i >= p->n && p->len == p->pathlen && !memcmp(p->clean, p->path, p->len))
+        lua_pushlstring(L, p->path, p->pathlen);
+    else
+        lua_pushlstring(L, p->clean, p->segs[i - 1].start + p->segs[i - 1].len);
+}
+
+/* segments i to n */
+static void pushsuffix(lua_State *L, path_t *p, int i)
+{
+    if (i > p->n)
+        lua_pushliteral(L, "");
+    else
+        lua_pushlstring(L, p->clean + p->segs[i - 1].start, p->len - p->segs[i - 1].start);
+}
+
+static void pushseg(lua_State *L, path_t *p, int i)
+{
+    if (p->segs[i].isnum)
+        lua_pushnumber(L, p->segs[i].num);
+    else
+        lua_pushlstring(L, p->clean + p->segs[i].start, p->segs[i].len);
+}
+
+static void checkpath(lua_State *L, int idx)
+{
+    if (lua_type(L, idx) != LUA_TSTRING)
+        luaL_typerror(L, idx, "string");
+}
+
+/* pathconcat(t, 1, n) */
+static void concattable(lua_State *L, int idx, int n)
+{
+    luaL_Buffer b;
+    int i, first = 1;
+
+    luaL_buffinit(L, &b);
+    for (i = 1; i <= n; i++)
+    {
+        lua_rawgeti(L, idx, i);
+        if (!lua_toboolean(L, -1))
+        {
+            lua_pop(L, 1);
+            break;
+        }
+        if (!lua_isstring(L, -1))
+            luaL_error(L, "invalid value (at index %d) in table for 'concat'", i);
+        if (lua_type(L, -1) == LUA_TSTRING && !lua_objlen(L, -1))
+        {
+            lua_pop(L, 1);
+            continue;
+        }
+        if (!first)
+            luaL_addchar(&b, '.');
+        first = 0;
+        luaL_addvalue(&b);
+    }
+    luaL_pushresult(&b);
+}
+
+/* Walk the tables from the one at index 1, along the `n` first keys of the
+ * path at index 2 (parsed in `p` if it's a string). On success, leaves the
+ * table found on the stack and returns 1; otherwise pushes nil and the path
+ * to the first non table value, and returns 2. */
+static int walk(lua_State *L, path_t *p, int n, int force)
+{
+    int i;
+
+    lua_pushvalue(L, 1);
+    for (i = 0; i < n; i++)
+    {
+        if (p)
+            pushseg(L, p, i);
+        else
+        {
+            lua_rawgeti(L, 2, i + 1);
+            if (lua_isnil(L, -1))
+            {
+                lua_pop(L, 1);
+                break;
+            }
+        }
+        lua_pushvalue(L, -1);
+        lua_gettable(L, -3);                    /* t, k, v */
+        if (!lua_istable(L, -1))
+        {
+            if (force == FIND || (force == NOOWR && !lua_isnil(L, -1)))
+            {
+                lua_pushnil(L);
+                if (p)
+                    pushprefix(L, p, i + 1);
+                else
+                    concattable(L, 2, i + 1);
+                return 2;
+            }
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_insert(L, -3);                  /* t, v, k, v */
+            lua_settable(L, -4);                /* t, v */
+        }
+        else
+            lua_remove(L, -2);                  /* t, v */
+        lua_remove(L, -2);                      /* v */
+    }
+    return 1;
+}
+
+/* Parse the path at index 2 if it's a string, return its number of keys */
+static int keys(lua_State *L, path_t *p, int ipairs)
+{
+    int n = 0;
+    luaL_checktype(L, 1, LUA_TTABLE);
+    if (lua_type(L, 2) == LUA_TSTRING)
+    {
+        parse(L, 2, p);
+        return p->n;
+    }
+    if (lua_type(L, 2) != LUA_TTABLE)
+        luaL_typerror(L, 2, "string|table");
+    if (!ipairs)
+        return lua_objlen(L, 2);
+    while (lua_rawgeti(L, 2, n + 1), !lua_isnil(L, -1))
+    {
+        lua_pop(L, 1);
+        n++;
+    }
+    lua_pop(L, 1);
+    return n;
+}
+
+static void pushlast(lua_State *L, path_t *p, int n)
+{
+    if (lua_type(L, 2) == LUA_TSTRING)
+        pushseg(L, p, n - 1);
+    else
+        lua_rawgeti(L, 2, n);
+}
+
+static int l_find(lua_State *L)
+{
+    path_t p;
+    int n, force = FIND;
+
+    lua_settop(L, 3);
+    n = keys(L, &p, 1);
+    if (lua_type(L, 3) == LUA_TSTRING && !strcmp(lua_tostring(L, 3), "noowr"))
+        force = NOOWR;
+    else if (lua_toboolean(L, 3))
+        force = FORCE;
+    return walk(L, lua_type(L, 2) == LUA_TSTRING ? &p : NULL, n, force);
+}
+
+static int l_get(lua_State *L)
+{
+    path_t p;
+    int n;
+
+    lua_settop(L, 2);
+    n = keys(L, &p, 0);
+    if (!n)
+    {
+        lua_pushvalue(L, 1);
+        return 1;
+    }
+    if (walk(L, lua_type(L, 2) == LUA_TSTRING ? &p : NULL, n - 1, FIND) != 1)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+    pushlast(L, &p, n);
+    lua_gettable(L, -2);
+    return 1;
+}
+
+static int l_set(lua_State *L)
+{
+    path_t p;
+    int n;
+
+    lua_settop(L, 3);
+    n = keys(L, &p, 0);
+    /* only create the table structure if the value to set is non nil */
+    if (walk(L, lua_type(L, 2) == LUA_TSTRING ? &p : NULL, n ? n - 1 : 0, lua_isnil(L, 3) ? FIND : FORCE) != 1)
+        return 0;
+    if (n)
+        pushlast(L, &p, n);
+    else
+        lua_pushnil(L);
+    lua_pushvalue(L, 3);
+    lua_settable(L, -3);
+    return 0;
+}
+
+static int l_segments(lua_State *L)
+{
+    path_t p;
+    int i;
+
+    checkpath(L, 1);
+    parse(L, 1, &p);
+    lua_createtable(L, p.n, 0);
+    for (i = 0; i < p.n; i++)
+    {
+        pushseg(L, &p, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+static int l_clean(lua_State *L)
+{
+    path_t p;
+
+    checkpath(L, 1);
+    parse(L, 1, &p);
+    pushprefix(L, &p, p.n);
+    return 1;
+}
+
+static int l_split(lua_State *L)
+{
+    path_t p;
+    lua_Number n;
+    int i;
+
+    checkpath(L, 1);
+    n = luaL_checknumber(L, 2);
+    parse(L, 1, &p);
+    if (n > p.n)
+    {
+        lua_pushvalue(L, 1);
+        lua_pushliteral(L, "");
+    }
+    else if (-n > p.n)
+    {
+        lua_pushliteral(L, "");
+        lua_pushvalue(L, 1);
+    }
+    else
+    {
+        i = (int) n;
+        if (i < 0)
+            i += p.n;
+        pushprefix(L, &p, i);
+        pushsuffix(L, &p, i + 1);
+    }
+    return 2;
+}
+
+static int l_concat(lua_State *L)
+{
+    luaL_Buffer b;
+    int i, top = lua_gettop(L), first = 1;
+
+    luaL_buffinit(L, &b);
+    for (i = 1; i <= top; i++)
+    {
+        if (!lua_toboolean(L, i))
+        {
+            /* holes are not supported */
+            int hole = i;
+            for (i++; i <= top && lua_isnil(L, i); i++);
+            if (i <= top)
+                luaL_error(L, "invalid value (nil) at index %d in table for 'concat'", hole);
+            break;
+        }
+        if (!lua_isstring(L, i))
+            luaL_error(L, "invalid value (at index %d) in table for 'concat'", i);
+        if (lua_type(L, i) == LUA_TSTRING && !lua_objlen(L, i))
+            continue;
+        if (!first)
+            luaL_addchar(&b, '.');
+        first = 0;
+        lua_pushvalue(L, i);
+        luaL_addvalue(&b);
+    }
+    luaL_pushresult(&b);
+    return 1;
+}
+
+/* gsplit state: the clean path, followed by the start offset of each segment
+ * and the clean path length */
+typedef struct
+{
+    int n;
+    int limit;
+    size_t *bounds;
+    char *clean;
+} gsplit_t;
+
+static int gsplit_next(lua_State *L)
+{
+    gsplit_t *g = lua_touserdata(L, lua_upvalueindex(1));
+    int i = g->limit;
+
+    if (i < 0)
+    {
+        lua_pushnil(L);
+        lua_pushnil(L);
+        return 2;
+    }
+    if (i == g->n)
+        lua_pushvalue(L, lua_upvalueindex(2));
+    else if (i == 0)
+        lua_pushliteral(L, "");
+    else
+        lua_pushlstring(L, g->clean, g->bounds[i] - 1);
+    if (i == 0)
+        lua_pushvalue(L, lua_upvalueindex(2));
+    else
+        lua_pushlstring(L, g->clean + g->bounds[i], g->bounds[g->n] - g->bounds[i]);
+    g->limit--;
+    return 2;
+}
+
+static int l_gsplit(lua_State *L)
+{
+    path_t p;
+    gsplit_t *g;
+    int i;
+
+    checkpath(L, 1);
+    parse(L, 1, &p);
+    g = lua_newuserdata(L, sizeof(gsplit_t) + (p.n + 1) * sizeof(size_t) + p.len);
+    g->n = p.n;
+    g->limit = p.n;
+    g->bounds = (size_t *) (g + 1);
+    g->clean = (char *) (g->bounds + p.n + 1);
+    for (i = 0; i < p.n; i++)
+        g->bounds[i] = p.segs[i].start;
+    g->bounds[p.n] = p.len;
+    memcpy(g->clean, p.clean, p.len);
+    pushprefix(L, &p, p.n);
+    lua_pushcclosure(L, gsplit_next, 2);
+    return 1;
+}
+
+static const luaL_Reg R[] =
+{
+    { "split", l_split },
+    { "clean", l_clean },
+    { "segments", l_segments },
+    { "get", l_get },
+    { "set", l_set },
+    { "gsplit", l_gsplit },
+    { "concat", l_concat },
+    { "find", l_find },
+    { NULL, NULL }
+};
+
+int luaopen_utils_path_core(lua_State* L)
+{
+    luaL_register(L, "utils.path.core", R);
+    return 1;
+}
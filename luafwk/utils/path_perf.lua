@@ -0,0 +1,126 @@
+-------------------------------------------------------------------------------
+-- Copyright (c) 2012 Sierra Wireless and others.
+-- All rights reserved. This program and the accompanying materials
+-- are made available under the terms of the Eclipse Public License v1.0
+-- which accompanies this distribution, and is available at
+-- http://www.eclipse.org/legal/epl-v10.html
+--
+-- Contributors:
+--     Sierra Wireless - initial API and implementation
+-------------------------------------------------------------------------------
+
+-- Microbenchmark of utils.path against its former Lua implementation,
+-- copied below.
+--
+-- From the runtime directory:
+--
+--   bin/lua <this directory>/path_perf.lua [iterations]
+
+local upath = require 'utils.path'
+
+local N = tonumber(arg[1]) or 100000
+
+local lua = { }
+
+local function pathconcat(pt, starti, endi)
+    local t, prev, empties = { }, nil, 0
+    starti = starti or 1
+    endi = endi or #pt
+    for i = starti, endi do
+        local v = pt[i]
+        if not v then break
+        elseif v == '' then empties = empties+1
+        else table.insert(t, prev); prev = v end
+    end
+    table.insert(t, prev)
+    return table.concat(t, '.', 1, endi-starti+1-empties)
+end
+
+function lua.segments(path)
+    local t = {}
+    local index, newindex, elt = 1
+    repeat
+        newindex = path:find(".", index, true) or #path+1
+        elt = path:sub(index, newindex-1)
+        elt = tonumber(elt) or elt
+        if elt and elt ~= "" then table.insert(t, elt) end
+        index = newindex+1
+    until newindex==#path+1
+    return t
+end
+
+function lua.split(path, n)
+    local segments = lua.segments(path)
+    if      n>#segments then return path, ''
+    elseif -n>#segments then return '', path
+    else
+        if n<0 then n=#segments+n end
+        return pathconcat(segments, 1, n), pathconcat(segments, n+1, #segments)
+    end
+end
+
+function lua.gsplit(path)
+    local segs  = lua.segments(path)
+    local nsegs = #segs
+    local limit = nsegs
+    return function()
+        if limit == -1 then return nil, nil end
+        local a, b = pathconcat(segs, 1, limit), pathconcat(segs, limit+1, nsegs)
+        limit = limit - 1
+        return a, b
+    end
+end
+
+function lua.find(t, path, force)
+    path = type(path)=="string" and lua.segments(path) or path
+    for i, n in ipairs(path) do
+        local v  = t[n]
+        if type(v) ~= "table" then
+            if not force or (force=="noowr" and v~=nil) then return nil, pathconcat(path, 1, i)
+            else v = {} t[n] = v end
+        end
+        t = v
+    end
+    return t
+end
+
+function lua.get(t, path)
+    local p = type(path)=='string' and lua.segments(path) or path
+    local k = table.remove(p)
+    if not k then return t end
+    local t = lua.find(t, p)
+    return t and t[k]
+end
+
+function lua.set(t, path, value)
+    local p = type(path)=='string' and lua.segments(path) or path
+    local k = table.remove(p)
+    local t = lua.find(t, p, value~=nil)
+    if t then t[k] = value end
+end
+
+local path = "config.network.bearer.GPRS.retryperiod"
+local tree = { config = { network = { bearer = { GPRS = { retryperiod = 10 } } } } }
+
+local benches = {
+    { "segments", function(m) return m.segments(path) end },
+    { "split 1",  function(m) return m.split(path, 1) end },
+    { "split -1", function(m) return m.split(path, -1) end },
+    { "gsplit",   function(m) for a, b in m.gsplit(path) do end end },
+    { "get",      function(m) return m.get(tree, path) end },
+    { "set",      function(m) return m.set(tree, path, 10) end },
+    { "find",     function(m) return m.find(tree, "config.network.bearer") end },
+}
+
+print(string.format("%-10s %12s %12s %8s", "", "Lua calls/s", "C calls/s", "speedup"))
+for _, b in ipairs(benches) do
+    local name, f = b[1], b[2]
+    local rates = { }
+    for i, m in ipairs{ lua, upath } do
+        collectgarbage()
+        local t = os.clock()
+        for _ = 1, N do f(m) end
+        rates[i] = N / (os.clock() - t)
+    end
+    print(string.format("%-10s %12.0f %12.0f %7.1fx", name, rates[1], rates[2], rates[2] / rates[1]))
+end
@@ -52,6 +52,9 @@
     --Address on which the agent is accepting connection in order to communicate with the assets
     --Pattern is accepted: can be set to "*" to accept connection from any address, by default shell accepts only localhost connection.
     --agent.assetaddress = "*"
+    --UNIX domain socket on which local assets may also connect; those can then ask for the
+    --EMP stream to go through shared memory, unless agent.assetshm is set to false.
+    agent.assetunixpath = "/tmp/mihini_emp"
     agent.deviceId = "012345678901234"
 
     agent.signalport = 18888 -- port used for LUASIGNAL fwk (Linux only)
@@ -125,6 +128,16 @@
     -- timestampformat specifies strftime format to print date/time.
     -- timestampformat is useful only if %t% is in formater string
     log.timestampformat = "%F %T"
+    -- log storage policy, see log/tools.lua; "binary" keeps the logs unformatted
+    -- in a ram ring, written to flash by a background thread, and does not
+    -- display them unless params.display is true
+    --log.policy = { name = "binary", params = { size = 65536, level = "WARNING", flashlogger = { size = 65536, path = "logs" } } }
+
+
+    -- group commit of the persisted tables, see persist.setcommit: writes are buffered
+    -- and committed every commitdelay seconds (0 for each scheduler step), with an
+    -- fdatasync if sync is true; writes still buffered when the agent dies are lost
+    --persist = { commitdelay = 0.1, sync = true }
 
 
     update = {}
@@ -153,6 +166,13 @@
     device = {}
     device.activate = true
     --device.tcprconnect = {addr = '10.41.51.50', port = 2065}
+    -- Coalescing window (in seconds) of devicetree change notifications, disabled when not set
+    --device.notifywindow = 0.1
+    -- Queue of the notifications sent by extvars handlers from other threads: size, and what
+    -- happens when it's full: "block" the thread, "dropoldest" notification, or "coalesce" values
+    --device.extvarsqueue = { size = 256, policy = "block" }
+    -- Send the whole subtree read by a ReadNode command in a single message, rather than a message per node
+    --device.readnodestream = true
 
     -- Monitoring system
     monitoring = {}
@@ -57,149 +57,205 @@ local blocktimeout = base.setmetatable({}, {__mode="kv"})
 local totaltimeout = base.setmetatable({}, {__mode="kv"})
 
 ---------------------------------------------------------------------------
--- TCP blocking methods redifinitions
+-- Stream sockets (TCP, UNIX domain) blocking methods redifinitions
 ---------------------------------------------------------------------------
 
-local tcpmeth = reg["tcp{master}"].__index
-
-local oldtcp = socket.tcp
-local oldtcpsend = tcpmeth.send
-local oldtcpreceive = tcpmeth.receive
-local oldtcpconnect = tcpmeth.connect
-local oldtcpclose = tcpmeth.close
-local oldtcpsettimeout = tcpmeth.settimeout
-local oldtcpaccept = tcpmeth.accept
-local oldtcplisten = tcpmeth.listen
-
-function socket.tcp()
-    local skt = base.assert(oldtcp())
-    oldtcpsettimeout(skt, 0)
-    return skt
-end
-
-local newtcp = {}
-
-function newtcp.settimeout(self, timeout, mode)
-    timeout = tonumber(timeout)
-    timeout = timeout and (timeout>=0 or nil) and timeout -- negative timeout is equivalent to no timeout
-    if not mode or mode:find("b") then blocktimeout[self] = timeout end
-    if mode and mode:find("t") then totaltimeout[self] = timeout end
-    return 1
-end
+-- Build the sched-compatible methods of a family of stream sockets,
+-- from the table of their original methods.
+local function newstream(meth)
+    local oldsend = meth.send
+    local oldreceive = meth.receive
+    local oldsendv = meth.sendv
+    local oldreceive_into = meth.receive_into
+    local oldpeek = meth.peek
+    local oldconnect = meth.connect
+    local oldclose = meth.close
+    local oldsettimeout = meth.settimeout
+    local oldaccept = meth.accept
+    local oldlisten = meth.listen
+
+    local new = {}
+    function new.settimeout(self, timeout, mode)
+        timeout = tonumber(timeout)
+        timeout = timeout and (timeout>=0 or nil) and timeout -- negative timeout is equivalent to no timeout
+        if not mode or mode:find("b") then blocktimeout[self] = timeout end
+        if mode and mode:find("t") then totaltimeout[self] = timeout end
+        return 1
+    end
 
-function newtcp.send(self, data, i, j)
-    local s, err, sent
-    i = i or 1
-    local lastIndex = i - 1
-    --local tmark = os_time() -- time elapsed debug
-    local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
-    local timedelay = blocktimeout[self]
+    function new.send(self, data, i, j)
+        local s, err, sent
+        i = i or 1
+        local lastIndex = i - 1
+        --local tmark = os_time() -- time elapsed debug
+        local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
+        local timedelay = blocktimeout[self]
+
+        repeat
+            s, err, lastIndex = oldsend(self, data, lastIndex + 1, j)
+            if s or err ~= "timeout" then
+                --return s, err, lastIndex, os_time()-tmark -- time elapsed debug
+                return s, err, lastIndex
+            end
+
+            s, err = sched.fd.wait_writable(self, timelimit, timedelay)
+            --if not s then return nil, err, lastIndex, os_time()-tmark end -- time elapsed debug
+            if not s then return nil, err, lastIndex end
+        until false
+    end
 
-    repeat
-        s, err, lastIndex = oldtcpsend(self, data, lastIndex + 1, j)
-        if s or err ~= "timeout" then
-            --return s, err, lastIndex, os_time()-tmark -- time elapsed debug
-            return s, err, lastIndex
+    function new.receive(self, pattern, prefix)
+        local s, err, part
+        local buffer = {prefix}
+        local some_bytes
+        if pattern == "*" then
+            pattern = "*a"
+            some_bytes = true
         end
+        --local tmark = os_time() -- time elapsed debug
+        local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
+        local timedelay = blocktimeout[self]
+
+        repeat
+            s, err, part = oldreceive(self, pattern)
+            local v = s or part
+            if v and #v>0 then table.insert(buffer, v) end
+
+            if s then
+                --return table.concat(buffer), nil, nil, os_time()-tmark -- time elapsed debug
+                return table.concat(buffer)
+            elseif err ~= "timeout" then
+                --return nil, err, table.concat(buffer), os_time()-tmark -- time elapsed debug
+                part = #buffer>0 and table.concat(buffer) or nil -- make sure not to return part if not partial data is available
+                return nil, err, part
+            elseif some_bytes and part and #part > 0 then
+                --return table.concat(buffer), nil, nil, os_time()-tmark -- time elapsed debug
+                return table.concat(buffer)
+            end
+
+            if tonumber(pattern) and part and #part > 0 then
+                pattern = pattern - #part
+            end
+
+            s, err = sched.fd.wait_readable(self, timelimit, timedelay)
+            --if not r then return nil, err, table.concat(buffer), os_time()-tmark  end -- time elapsed debug
+
+            if not s then
+                part = #buffer>0 and table.concat(buffer) or nil -- make sure not to return part if not partial data is available
+                return nil, err, part
+            end
+        until false
+    end
 
-        s, err = sched.fd.wait_writable(self, timelimit, timedelay)
-        --if not s then return nil, err, lastIndex, os_time()-tmark end -- time elapsed debug
-        if not s then return nil, err, lastIndex end
-    until false
-end
+    -- Sends the concatenation of a list of strings and bytebuffers.
+    function new.sendv(self, list, pos)
+        local s, err
+        local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
+        local timedelay = blocktimeout[self]
+
+        repeat
+            s, err, pos = oldsendv(self, list, pos)
+            if s or err ~= "timeout" then return s, err, pos end
+            s, err = sched.fd.wait_writable(self, timelimit, timedelay)
+            if not s then return nil, err, pos end
+        until false
+    end
 
-function newtcp.receive(self, pattern, prefix)
-    local s, err, part
-    local buffer = {prefix}
-    local some_bytes
-    if pattern == "*" then
-        pattern = "*a"
-        some_bytes = true
+    -- Appends `n` bytes, or whatever is available when `n` is nil, to a
+    -- bytebuffer. Partially received data is already in the bytebuffer.
+    function new.receive_into(self, buffer, n)
+        local s, err, got
+        local total = 0
+        local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
+        local timedelay = blocktimeout[self]
+
+        repeat
+            s, err, got = oldreceive_into(self, buffer, n)
+            total = total + (s or got)
+            if s then return total
+            elseif err ~= "timeout" then return nil, err, total
+            elseif not n and got > 0 then return total end
+            if n then n = n - got end
+            s, err = sched.fd.wait_readable(self, timelimit, timedelay)
+            if not s then return nil, err, total end
+        until false
     end
-    --local tmark = os_time() -- time elapsed debug
-    local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
-    local timedelay = blocktimeout[self]
 
-    repeat
-        s, err, part = oldtcpreceive(self, pattern)
-        local v = s or part
-        if v and #v>0 then table.insert(buffer, v) end
-
-        if s then
-            --return table.concat(buffer), nil, nil, os_time()-tmark -- time elapsed debug
-            return table.concat(buffer)
-        elseif err ~= "timeout" then
-            --return nil, err, table.concat(buffer), os_time()-tmark -- time elapsed debug
-            part = #buffer>0 and table.concat(buffer) or nil -- make sure not to return part if not partial data is available
-            return nil, err, part
-        elseif some_bytes and part and #part > 0 then
-            --return table.concat(buffer), nil, nil, os_time()-tmark -- time elapsed debug
-            return table.concat(buffer)
-        end
+    function new.peek(self, n)
+        local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
+        local timedelay = blocktimeout[self]
 
-        if tonumber(pattern) and part and #part > 0 then
-            pattern = pattern - #part
-        end
+        repeat
+            local s, err = oldpeek(self, n)
+            if s or err ~= "timeout" then return s, err end
+            s, err = sched.fd.wait_readable(self, timelimit, timedelay)
+            if not s then return nil, err end
+        until false
+    end
 
-        s, err = sched.fd.wait_readable(self, timelimit, timedelay)
-        --if not r then return nil, err, table.concat(buffer), os_time()-tmark  end -- time elapsed debug
+    function new.connect(self, address, port)
+        local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
+        local timedelay = blocktimeout[self]
+        local r, err = oldconnect(self, address, port)
+        if r or err ~= "timeout" then return r, err end
+        r, err =  sched.fd.wait_writable(self, timelimit, timedelay)
+        if not r then return nil, err end
+        return oldconnect(self, address, port)
+    end
 
-        if not s then
-            part = #buffer>0 and table.concat(buffer) or nil -- make sure not to return part if not partial data is available
-            return nil, err, part
-        end
-    until false
-end
 
-function newtcp.connect(self, address, port)
-    local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
-    local timedelay = blocktimeout[self]
-    local r, err = oldtcpconnect(self, address, port)
-    if r or err ~= "timeout" then return r, err end
-    r, err =  sched.fd.wait_writable(self, timelimit, timedelay)
-    if not r then return nil, err end
-    return oldtcpconnect(self, address, port)
-end
+    local function accept(self)
+        local r, err = oldaccept(self)
+        if r then oldsettimeout(r, 0) end
+        return r, err
+    end
+    function new.accept(self)
+        local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
+        local timedelay = blocktimeout[self]
+        oldsettimeout(self, 0.1)
+        local r, err = accept(self)
+        if r or err ~= "timeout" then return r, err end
+        r, err =  sched.fd.wait_readable(self, timelimit, timedelay)
+        if not r then return nil, err end
+        return accept(self)
+    end
 
+    -- Redefine socket:listen() so to add an additional optional parameter 'hook'
+    -- when defined hook must be a function that will be called when a new client socket
+    -- connects to this server socket.
+    -- backlog parameter is also optional
+    function new.listen(self, backlog, hook)
+        if base.type(backlog)=='function' then hook, backlog = backlog, nil end
+        local r, err = oldlisten(self, backlog)
+        if r and hook then
+            local function spawnclient(server)
+                local client = server:accept()
+                if client then sched.run(hook, client, server) end
+                return "again"
+            end
+            sched.fd.when_readable(self, spawnclient)
+        end
 
-local function accept(self)
-    local r, err = oldtcpaccept(self)
-    if r then oldtcpsettimeout(r, 0) end
-    return r, err
-end
-function newtcp.accept(self)
-    local timelimit = totaltimeout[self] and monotonic_time() + totaltimeout[self]
-    local timedelay = blocktimeout[self]
-    oldtcpsettimeout(self, 0.1)
-    local r, err = accept(self)
-    if r or err ~= "timeout" then return r, err end
-    r, err =  sched.fd.wait_readable(self, timelimit, timedelay)
-    if not r then return nil, err end
-    return accept(self)
-end
+        return r, err
+    end
 
--- Redefine socket:listen() so to add an additional optional parameter 'hook'
--- when defined hook must be a function that will be called when a new client socket
--- connects to this server socket.
--- backlog parameter is also optional
-function newtcp.listen(self, backlog, hook)
-    if base.type(backlog)=='function' then hook, backlog = backlog, nil end
-    local r, err = oldtcplisten(self, backlog)
-    if r and hook then
-        local function spawnclient(server)
-            local client = server:accept()
-            if client then sched.run(hook, client, server) end
-            return "again"
-        end
-        sched.fd.when_readable(self, spawnclient)
+    function new.close(self)
+        sched.fd.close(self)
+        return oldclose(self)
     end
 
-    return r, err
+    return new
 end
 
-function newtcp.close(self)
-    sched.fd.close(self)
-    return oldtcpclose(self)
+local tcpmeth = reg["tcp{master}"].__index
+local oldtcp = socket.tcp
+local oldtcpsettimeout = tcpmeth.settimeout
+local newtcp = newstream(tcpmeth)
+
+function socket.tcp()
+    local skt = base.assert(oldtcp())
+    oldtcpsettimeout(skt, 0)
+    return skt
 end
 
 tableutils.copy(newtcp, reg["tcp{master}"].__index, true)
@@ -209,6 +265,29 @@ reg["tcp{master}"].__gc = newtcp.close
 reg["tcp{client}"].__gc = newtcp.close
 reg["tcp{server}"].__gc = newtcp.close
 
+-- UNIX domain sockets are optional: socket.unix is only defined when the
+-- platform supports them.
+local hasunix = base.pcall(require, "socket.unix")
+if hasunix and reg["unix{master}"] then
+    local unixmeth = reg["unix{master}"].__index
+    local oldunix = socket.unix
+    local oldunixsettimeout = unixmeth.settimeout
+    local newunix = newstream(unixmeth)
+
+    function socket.unix()
+        local skt = base.assert(oldunix())
+        oldunixsettimeout(skt, 0)
+        return skt
+    end
+
+    tableutils.copy(newunix, reg["unix{master}"].__index, true)
+    tableutils.copy(newunix, reg["unix{client}"].__index, true)
+    tableutils.copy(newunix, reg["unix{server}"].__index, true)
+    reg["unix{master}"].__gc = newunix.close
+    reg["unix{client}"].__gc = newunix.close
+    reg["unix{server}"].__gc = newunix.close
+end
+
 
 ---------------------------------------------------------------------------
 -- UDP blocking methods redifinitions
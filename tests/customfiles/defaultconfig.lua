@@ -52,6 +52,9 @@
     --Address on which the agent is accepting connection in order to communicate with the assets
     --Pattern is accepted: can be set to "*" to accept connection from any address, by default shell accepts only localhost connection.
     --agent.assetaddress = "*"
+    --UNIX domain socket on which local assets may also connect; those can then ask for the
+    --EMP stream to go through shared memory, unless agent.assetshm is set to false.
+    agent.assetunixpath = "/tmp/mihini_emp"
     agent.deviceId = "012345678901234"
 
     agent.signalport = 18888 -- port used for LUASIGNAL fwk (Linux only)